@@ -63,6 +63,10 @@ CDC::CDC(struct _stm32l4_usbd_cdc_t *usbd_cdc, bool serialEvent)
     _completionCallback = NULL;
     _receiveCallback = NULL;
 
+    // Callbacks are work items rather than FIFO entries, so they cannot get dropped
+    armv7m_pendsv_work_create(&_receiveWork, CDC::_receive_callback, (void*)this, ARMV7M_PENDSV_PRIORITY_NORMAL);
+    armv7m_pendsv_work_create(&_completionWork, CDC::_completion_callback, (void*)this, ARMV7M_PENDSV_PRIORITY_NORMAL);
+
     stm32l4_usbd_cdc_create(usbd_cdc);
 
     if (serialEvent) {
@@ -279,7 +283,8 @@ bool CDC::write(const uint8_t *buffer, size_t size, void(*callback)(void))
 	return false;
     }
 
-    if (_tx_size2 != 0) {
+    // The previous completion callback has to be called first
+    if ((_tx_size2 != 0) || (_completionCallback != NULL)) {
 	return false;
     }
 
@@ -291,6 +296,8 @@ bool CDC::write(const uint8_t *buffer, size_t size, void(*callback)(void))
 	if (!stm32l4_usbd_cdc_transmit(_usbd_cdc, _tx_data2, _tx_size2)) {
 	    _tx_data2 = NULL;
 	    _tx_size2 = 0;
+
+	    _completionCallback = NULL;
 	}
     }
 
@@ -330,7 +337,7 @@ void CDC::EventCallback(uint32_t events)
 
     if (events & USBD_CDC_EVENT_RECEIVE) {
 	if (_receiveCallback) {
-	    armv7m_pendsv_enqueue((armv7m_pendsv_routine_t)_receiveCallback, NULL, 0);
+	    armv7m_pendsv_work_post(&_receiveWork, 0);
 	}
     }
 
@@ -377,9 +384,7 @@ void CDC::EventCallback(uint32_t events)
 	    _tx_data2 = NULL;
 
 	    if (_completionCallback) {
-		armv7m_pendsv_enqueue((armv7m_pendsv_routine_t)_completionCallback, NULL, 0);
-		
-		_completionCallback = NULL;
+		armv7m_pendsv_work_post(&_completionWork, 0);
 	    }
 	}
     }
@@ -416,6 +421,27 @@ void CDC::_event_callback(void *context, uint32_t events)
     reinterpret_cast<class CDC*>(context)->EventCallback(events);
 }
 
+void CDC::_receive_callback(void *context, uint32_t data)
+{
+    void (*callback)(void) = reinterpret_cast<class CDC*>(context)->_receiveCallback;
+
+    if (callback) {
+	(*callback)();
+    }
+}
+
+void CDC::_completion_callback(void *context, uint32_t data)
+{
+    void (*callback)(void) = reinterpret_cast<class CDC*>(context)->_completionCallback;
+
+    // Clear it first, so that the callback can queue the next write
+    reinterpret_cast<class CDC*>(context)->_completionCallback = NULL;
+
+    if (callback) {
+	(*callback)();
+    }
+}
+
 CDC::operator bool()
 {
     return (_usbd_cdc->state == USBD_CDC_STATE_READY) && (stm32l4_usbd_cdc_info.lineState & 1);
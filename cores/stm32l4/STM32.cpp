@@ -56,6 +56,11 @@ float STM32Class::getVBAT()
 {
     int32_t vbat_data, vref_data, vrefint;
     
+    if (stm32l4_adc.state == ADC_STATE_ACTIVE)
+    {
+	return 0.0;
+    }
+
     if (stm32l4_adc.state == ADC_STATE_NONE)
     {
 	stm32l4_adc_create(&stm32l4_adc, ADC_INSTANCE_ADC1, STM32L4_ADC_IRQ_PRIORITY, 0);
@@ -82,6 +87,11 @@ float STM32Class::getVREF()
 {
     int32_t vref_data, vrefint;
     
+    if (stm32l4_adc.state == ADC_STATE_ACTIVE)
+    {
+	return 0.0;
+    }
+
     if (stm32l4_adc.state == ADC_STATE_NONE)
     {
 	stm32l4_adc_create(&stm32l4_adc, ADC_INSTANCE_ADC1, STM32L4_ADC_IRQ_PRIORITY, 0);
@@ -107,6 +117,11 @@ float STM32Class::getTemperature()
 {
     int32_t ts_data, ts_cal1, ts_cal2, vref_data, vrefint;
 
+    if (stm32l4_adc.state == ADC_STATE_ACTIVE)
+    {
+	return 0.0;
+    }
+
     if (stm32l4_adc.state == ADC_STATE_NONE)
     {
 	stm32l4_adc_create(&stm32l4_adc, ADC_INSTANCE_ADC1, STM32L4_ADC_IRQ_PRIORITY, 0);
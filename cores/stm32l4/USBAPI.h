@@ -125,11 +125,16 @@ private:
 
     volatile uint32_t _tx_timeout;
 
-    void (*_completionCallback)(void);
+    void (*volatile _completionCallback)(void);
     void (*_receiveCallback)(void);
 
+    armv7m_pendsv_work_t _receiveWork;
+    armv7m_pendsv_work_t _completionWork;
+
     static void _event_callback(void *context, uint32_t events);
     void EventCallback(uint32_t events);
+    static void _receive_callback(void *context, uint32_t data);
+    static void _completion_callback(void *context, uint32_t data);
 };
 
 
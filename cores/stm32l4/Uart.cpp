@@ -43,12 +43,18 @@ Uart::Uart(struct _stm32l4_uart_t *uart, unsigned int instance, const struct _st
     _tx_count = 0;
     _tx_size = 0;
 
-    _tx_data2 = NULL;
-    _tx_size2 = 0;
+    _tx_queue_write = 0;
+    _tx_queue_read = 0;
+    _tx_queue_done = 0;
+    _tx_queue_count = 0;
+    _tx_queue_complete = 0;
   
-    _completionCallback = NULL;
     _receiveCallback = NULL;
 
+    // Callbacks are work items rather than FIFO entries, so they cannot get dropped
+    armv7m_pendsv_work_create(&_receiveWork, Uart::_receive_callback, (void*)this, ARMV7M_PENDSV_PRIORITY_NORMAL);
+    armv7m_pendsv_work_create(&_completionWork, Uart::_completion_callback, (void*)this, ARMV7M_PENDSV_PRIORITY_NORMAL);
+
     stm32l4_uart_create(uart, instance, pins, priority, mode);
 
     if (serialEvent) {
@@ -99,7 +105,7 @@ int Uart::availableForWrite()
 	return 0;
     }
 
-    if (_tx_size2 != 0) {
+    if (_tx_queue_count != 0) {
 	return 0;
     }
 
@@ -132,11 +138,11 @@ size_t Uart::read(uint8_t *buffer, size_t size)
 void Uart::flush()
 {
     if (armv7m_core_priority() <= STM32L4_UART_IRQ_PRIORITY) {
-	while ((_tx_count != 0) || (_tx_size2 != 0) || !stm32l4_uart_done(_uart)) {
+	while ((_tx_count != 0) || (_tx_queue_count != 0) || !stm32l4_uart_done(_uart)) {
 	    stm32l4_uart_poll(_uart);
 	}
     } else {
-	while ((_tx_count != 0) || (_tx_size2 != 0) || !stm32l4_uart_done(_uart)) {
+	while ((_tx_count != 0) || (_tx_queue_count != 0) || !stm32l4_uart_done(_uart)) {
 	    armv7m_core_yield();
 	}
     }
@@ -160,12 +166,12 @@ size_t Uart::write(const uint8_t *buffer, size_t size)
 	return 0;
     }
 
-    if (_tx_size2 != 0) {
+    if (_tx_queue_count != 0) {
 	if (!_blocking || (__get_IPSR() != 0)) {
 	    return 0;
 	}
 	
-	while (_tx_size2 != 0) {
+	while (_tx_queue_count != 0) {
 	    armv7m_core_yield();
 	}
     }
@@ -248,6 +254,8 @@ size_t Uart::write(const uint8_t *buffer, size_t size)
 
 bool Uart::write(const uint8_t *buffer, size_t size, void(*callback)(void))
 {
+    unsigned int tx_read, tx_write;
+
     if (_uart->state < UART_STATE_READY) {
 	return false;
     }
@@ -256,16 +264,25 @@ bool Uart::write(const uint8_t *buffer, size_t size, void(*callback)(void))
 	return false;
     }
 
-    if (_tx_size2 != 0) {
+    // A slot is busy until its callback got called
+    if ((_tx_queue_count + _tx_queue_complete) >= UART_TX_QUEUE_SIZE) {
 	return false;
     }
 
-    _completionCallback = callback;
-    _tx_data2 = buffer;
-    _tx_size2 = size;
+    tx_write = _tx_queue_write;
+
+    _tx_queue[tx_write].data = buffer;
+    _tx_queue[tx_write].size = size;
+    _tx_queue[tx_write].callback = callback;
+
+    _tx_queue_write = (tx_write + 1) & (UART_TX_QUEUE_SIZE -1);
+
+    armv7m_atomic_add(&_tx_queue_count, 1);
 
     if (stm32l4_uart_done(_uart)) {
-	stm32l4_uart_transmit(_uart, _tx_data2, _tx_size2);
+	tx_read = _tx_queue_read;
+
+	stm32l4_uart_transmit(_uart, _tx_queue[tx_read].data, _tx_queue[tx_read].size);
     }
 
     return true;
@@ -277,7 +294,7 @@ bool Uart::done()
 	return false;
     }
 
-    if (_tx_size2) {
+    if (_tx_queue_count) {
 	return false;
     }
 
@@ -304,7 +321,7 @@ void Uart::EventCallback(uint32_t events)
 
     if (events & UART_EVENT_RECEIVE) {
 	if (_receiveCallback) {
-	    armv7m_pendsv_enqueue((armv7m_pendsv_routine_t)_receiveCallback, NULL, 0);
+	    armv7m_pendsv_work_post(&_receiveWork, 0);
 	}
     }
 
@@ -335,19 +352,49 @@ void Uart::EventCallback(uint32_t events)
 	  
 		stm32l4_uart_transmit(_uart, &_tx_data[tx_read], tx_size);
 	    } else {
-		if (_tx_size2 != 0) {
-		    stm32l4_uart_transmit(_uart, _tx_data2, _tx_size2);
+		if (_tx_queue_count != 0) {
+		    tx_read = _tx_queue_read;
+
+		    stm32l4_uart_transmit(_uart, _tx_queue[tx_read].data, _tx_queue[tx_read].size);
 		}
 	    }
 	} else {
-	    _tx_size2 = 0;
-	    _tx_data2 = NULL;
+	    tx_read = _tx_queue_read;
 
-	    if (_completionCallback) {
-		armv7m_pendsv_enqueue((armv7m_pendsv_routine_t)_completionCallback, NULL, 0);
+	    _tx_queue_read = (tx_read + 1) & (UART_TX_QUEUE_SIZE -1);
 
-		_completionCallback = NULL;
+	    armv7m_atomic_add(&_tx_queue_complete, 1);
+	    armv7m_atomic_sub(&_tx_queue_count, 1);
+
+	    // Chain the next queued buffer back-to-back, no copy into _tx_data[]
+	    if (_tx_queue_count != 0) {
+		tx_read = _tx_queue_read;
+
+		stm32l4_uart_transmit(_uart, _tx_queue[tx_read].data, _tx_queue[tx_read].size);
 	    }
+
+	    armv7m_pendsv_work_post(&_completionWork, 0);
+	}
+    }
+}
+
+void Uart::CompletionCallback()
+{
+    unsigned int tx_done;
+    void (*callback)(void);
+
+    // Completions coalesce, so call back for every buffer finished since the last run
+    while (_tx_queue_complete != 0) {
+	tx_done = _tx_queue_done;
+
+	callback = _tx_queue[tx_done].callback;
+
+	_tx_queue_done = (tx_done + 1) & (UART_TX_QUEUE_SIZE -1);
+
+	armv7m_atomic_sub(&_tx_queue_complete, 1);
+
+	if (callback) {
+	    (*callback)();
 	}
     }
 }
@@ -357,6 +404,20 @@ void Uart::_event_callback(void *context, uint32_t events)
   reinterpret_cast<class Uart*>(context)->EventCallback(events);
 }
 
+void Uart::_receive_callback(void *context, uint32_t data)
+{
+    void (*callback)(void) = reinterpret_cast<class Uart*>(context)->_receiveCallback;
+
+    if (callback) {
+	(*callback)();
+    }
+}
+
+void Uart::_completion_callback(void *context, uint32_t data)
+{
+  reinterpret_cast<class Uart*>(context)->CompletionCallback();
+}
+
 #if !defined(USBCON)
 
 bool Serial_empty() { return !Serial.available(); }
@@ -32,6 +32,7 @@
 
 #define UART_RX_BUFFER_SIZE 64
 #define UART_TX_BUFFER_SIZE 64
+#define UART_TX_QUEUE_SIZE  8
 
 class Uart : public HardwareSerial
 {
@@ -56,7 +57,7 @@ public:
     // STM32L4 EXTENSTION: non-blocking multi-byte read
     size_t read(uint8_t *buffer, size_t size);
 
-    // STM32L4 EXTENSTION: asynchronous write with callback
+    // STM32L4 EXTENSTION: asynchronous write with callback, up to UART_TX_QUEUE_SIZE buffers can be queued
     bool write(const uint8_t *buffer, size_t size, void(*callback)(void));
     bool done(void);
 
@@ -76,12 +77,25 @@ private:
     volatile uint32_t _tx_count;
     volatile uint32_t _tx_size;
 
-    const uint8_t *_tx_data2;
-    volatile uint32_t _tx_size2;
+    struct {
+	const uint8_t *data;
+	uint32_t size;
+	void (*callback)(void);
+    } _tx_queue[UART_TX_QUEUE_SIZE];
+    volatile uint16_t _tx_queue_write;
+    volatile uint16_t _tx_queue_read;
+    volatile uint16_t _tx_queue_done;
+    volatile uint32_t _tx_queue_count;
+    volatile uint32_t _tx_queue_complete;
 
-    void (*_completionCallback)(void);
     void (*_receiveCallback)(void);
 
+    armv7m_pendsv_work_t _receiveWork;
+    armv7m_pendsv_work_t _completionWork;
+
     static void _event_callback(void *context, uint32_t events);
     void EventCallback(uint32_t events);
+    static void _receive_callback(void *context, uint32_t data);
+    static void _completion_callback(void *context, uint32_t data);
+    void CompletionCallback();
 };
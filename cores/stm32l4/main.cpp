@@ -132,6 +132,7 @@ extern "C" int main( void )
     {
 	loop();
 	if (serialEventCallback) (*serialEventCallback)();
+	yield();
     }
 
     return 0;
@@ -110,11 +110,11 @@ void init( void )
     stm32l4_exti_enable(&stm32l4_exti);
 
 #if (DOSFS_SDCARD == 1)
-    stm32l4_sdspi_initialize();
+    stm32l4_sdspi_initialize(STM32L4_SDCARD_IRQ_PRIORITY);
 #elif (DOSFS_SDCARD == 2)
-    stm32l4_sdmmc_initialize(0);
+    stm32l4_sdmmc_initialize(STM32L4_SDCARD_IRQ_PRIORITY, 0);
 #elif (DOSFS_SDCARD == 3)
-    stm32l4_sdmmc_initialize(STM32L4_SDMMC_OPTION_HIGH_SPEED);
+    stm32l4_sdmmc_initialize(STM32L4_SDCARD_IRQ_PRIORITY, STM32L4_SDMMC_OPTION_HIGH_SPEED);
 #endif
 #if (DOSFS_SFLASH >= 1)
     dosfs_sflash_init();
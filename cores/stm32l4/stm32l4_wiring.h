@@ -59,13 +59,7 @@ static inline uint32_t micros(void)
     return armv7m_systick_micros();
 }
 
-static inline void delay(uint32_t msec) 
-{
-    if (msec == 0)
-	return;
-
-    armv7m_systick_delay(msec);
-}
+extern void delay(uint32_t msec);
 
 static inline void delayMicroseconds(uint32_t usec) 
 {
@@ -77,6 +71,28 @@ static inline void delayMicroseconds(uint32_t usec)
 
 extern void init(void);
 
+#define LOOP_PRIORITY_HIGH     0
+#define LOOP_PRIORITY_NORMAL   1
+#define LOOP_PRIORITY_LOW      2
+
+typedef struct _semaphore_t {
+    volatile uint32_t count;
+} semaphore_t;
+
+#define SEMAPHORE_INIT(_count) { (_count) }
+#define SEMAPHORE_FOREVER      0xffffffff
+
+extern bool startLoop(void (*routine)(void), uint32_t stackSize, uint32_t priority);
+#ifdef __cplusplus
+extern bool startLoop(void (*routine)(void), uint32_t stackSize = 1024, uint32_t priority = LOOP_PRIORITY_NORMAL);
+#endif
+extern void schedulerIdle(uint32_t timeout);
+extern void schedulerIdleStop(bool enable);
+
+extern void semaphoreInit(semaphore_t *semaphore, uint32_t count);
+extern void semaphoreGive(semaphore_t *semaphore);
+extern bool semaphoreTake(semaphore_t *semaphore, uint32_t timeout);
+
 
 typedef enum _eAnalogReference {
   AR_DEFAULT,
@@ -90,6 +106,8 @@ extern void analogWriteResolution(int resolution);
 extern void analogWriteFrequency(uint32_t pin, uint32_t frequency);
 extern void analogWriteRange(uint32_t pin, uint32_t range);
 extern void analogWrite(uint32_t pin, uint32_t value);
+extern bool analogWriteStream(uint32_t pin, uint16_t *data, uint32_t count, uint32_t frequency, void(*callback)(uint16_t *data, uint32_t count));
+extern void analogWriteStreamStop(uint32_t pin);
 
 extern void pinMode(uint32_t pin, uint32_t mode);
 extern void digitalWrite(uint32_t pin, uint32_t value);
@@ -104,6 +122,16 @@ extern uint32_t pulseIn(uint32_t pin, uint32_t state, uint32_t timeout);
 extern uint32_t pulseIn(uint32_t pin, uint32_t state, uint32_t timeout = 1000000L);
 #endif
 
+extern uint32_t pulseInLong(uint32_t pin, uint32_t state, uint32_t timeout);
+#ifdef __cplusplus
+extern uint32_t pulseInLong(uint32_t pin, uint32_t state, uint32_t timeout = 1000000L);
+#endif
+
+extern bool attachPulseCapture(uint32_t pin, uint32_t state, void(*callback)(uint32_t width, uint32_t period));
+extern void detachPulseCapture(uint32_t pin);
+extern int pulseCaptureAvailable(uint32_t pin);
+extern bool pulseCaptureRead(uint32_t pin, uint32_t *width, uint32_t *period);
+
 extern uint32_t shiftIn( uint32_t ulDataPin, uint32_t ulClockPin, uint32_t ulBitOrder);
 extern void shiftOut( uint32_t ulDataPin, uint32_t ulClockPin, uint32_t ulBitOrder, uint32_t ulVal);
 
@@ -35,8 +35,9 @@ extern "C" {
 
 #if defined(PIN_DAC0) || defined(PIN_DAC1)
 static stm32l4_dac_t stm32l4_dac;
+static stm32l4_timer_t stm32l4_dac_timer[2];
 #endif /* defined(PIN_DAC0) || defined(PIN_DAC1) */
-static stm32l4_timer_t stm32l4_pwm[PWM_INSTANCE_COUNT];
+stm32l4_timer_t stm32l4_pwm[PWM_INSTANCE_COUNT];
 
 static uint8_t _channels[PWM_INSTANCE_COUNT];
 
@@ -49,6 +50,12 @@ static uint32_t _writeRange[PWM_INSTANCE_COUNT];
 
 static uint8_t _writeCalibrate = 3;
 
+#if defined(PIN_DAC0) || defined(PIN_DAC1)
+static uint16_t *_writeStreamData[2];
+static uint32_t _writeStreamCount[2];
+static void (*_writeStreamCallback[2])(uint16_t *data, uint32_t count);
+#endif /* defined(PIN_DAC0) || defined(PIN_DAC1) */
+
 bool _analogReadFast = false;
 
 void analogReference(eAnalogReference reference)
@@ -111,6 +118,13 @@ uint32_t analogRead(uint32_t pin)
     }
 #endif /* defined(PIN_DAC0) || defined(PIN_DAC1) */
 
+    /* A timer triggered stream owns the ADC till stm32l4_adc_stop().
+     */
+    if (stm32l4_adc.state == ADC_STATE_ACTIVE)
+    {
+	return 0;
+    }
+
     if (stm32l4_adc.state == ADC_STATE_NONE)
     {
 	stm32l4_adc_create(&stm32l4_adc, ADC_INSTANCE_ADC1, STM32L4_ADC_IRQ_PRIORITY, 0);
@@ -156,7 +170,7 @@ void analogWriteFrequency(uint32_t pin, uint32_t frequency)
 	{
 	    _writeFrequency[instance] = frequency;
 	    
-	    if (stm32l4_pwm[instance].state == TIMER_STATE_ACTIVE)
+	    if ((stm32l4_pwm[instance].state == TIMER_STATE_ACTIVE) && _channels[instance])
 	    {
 		if (_writeFrequency[instance] && _writeRange[instance])
 		{
@@ -201,7 +215,7 @@ void analogWriteRange(uint32_t pin, uint32_t range)
 	{
 	    _writeRange[instance] = range;
 	    
-	    if (stm32l4_pwm[instance].state == TIMER_STATE_ACTIVE)
+	    if ((stm32l4_pwm[instance].state == TIMER_STATE_ACTIVE) && _channels[instance])
 	    {
 		if (_writeFrequency[instance] && _writeRange[instance])
 		{
@@ -259,6 +273,11 @@ void analogWrite(uint32_t pin, uint32_t value)
 
 	channel = ((pin == PIN_DAC0) ? DAC_CHANNEL_1 : DAC_CHANNEL_2);
 
+	if (stm32l4_dac.channels & (1ul << channel))
+	{
+	    analogWriteStreamStop(pin);
+	}
+
 	if (_writeCalibrate & (1ul << channel))
 	{
 	    _writeCalibrate &= ~(1ul << channel);
@@ -278,6 +297,12 @@ void analogWrite(uint32_t pin, uint32_t value)
     {
 	instance = g_APinDescription[pin].pwm_instance;
 
+	// The timer is in use by attachPulseCapture() or tone()
+	if ((stm32l4_pwm[instance].state != TIMER_STATE_NONE) && !_channels[instance])
+	{
+	    return;
+	}
+
 	if (_writeFrequency[instance] && _writeRange[instance])
 	{
 	    if (value > _writeRange[instance])
@@ -296,11 +321,13 @@ void analogWrite(uint32_t pin, uint32_t value)
 	}
 	else
 	{
-	    _channels[instance] |= (1u << g_APinDescription[pin].pwm_channel);
-
 	    if (stm32l4_pwm[instance].state == TIMER_STATE_NONE)
 	    {
-		stm32l4_timer_create(&stm32l4_pwm[instance], g_PWMInstances[instance], STM32L4_PWM_IRQ_PRIORITY, 0);
+		// The timer may be owned outside of the PWM code, like TIM2 by stm32l4_hrtimer
+		if (!stm32l4_timer_create(&stm32l4_pwm[instance], g_PWMInstances[instance], STM32L4_PWM_IRQ_PRIORITY, 0))
+		{
+		    return;
+		}
 		
 		if (_writeFrequency[instance] && _writeRange[instance])
 		{
@@ -324,6 +351,8 @@ void analogWrite(uint32_t pin, uint32_t value)
 		stm32l4_timer_start(&stm32l4_pwm[instance], false);
 	    }
 	    
+	    _channels[instance] |= (1u << g_APinDescription[pin].pwm_channel);
+
 	    stm32l4_gpio_pin_configure(g_APinDescription[pin].pin, (GPIO_PUPD_NONE | GPIO_OSPEED_HIGH | GPIO_OTYPE_PUSHPULL | GPIO_MODE_ALTERNATE));
 	    
 	    stm32l4_timer_channel(&stm32l4_pwm[instance], g_APinDescription[pin].pwm_channel, value, TIMER_CONTROL_PWM);
@@ -345,6 +374,172 @@ void analogWrite(uint32_t pin, uint32_t value)
     }
 }
 
+#if defined(PIN_DAC0) || defined(PIN_DAC1)
+
+static void analogWriteStreamCallback(void *context, uint32_t events)
+{
+    if (events & DAC_EVENT_CHANNEL_1_HALF)
+    {
+	(*_writeStreamCallback[DAC_CHANNEL_1])(&_writeStreamData[DAC_CHANNEL_1][0], (_writeStreamCount[DAC_CHANNEL_1] / 2));
+    }
+
+    if (events & DAC_EVENT_CHANNEL_1_DONE)
+    {
+	(*_writeStreamCallback[DAC_CHANNEL_1])(&_writeStreamData[DAC_CHANNEL_1][_writeStreamCount[DAC_CHANNEL_1] / 2], (_writeStreamCount[DAC_CHANNEL_1] - (_writeStreamCount[DAC_CHANNEL_1] / 2)));
+    }
+
+    if (events & DAC_EVENT_CHANNEL_2_HALF)
+    {
+	(*_writeStreamCallback[DAC_CHANNEL_2])(&_writeStreamData[DAC_CHANNEL_2][0], (_writeStreamCount[DAC_CHANNEL_2] / 2));
+    }
+
+    if (events & DAC_EVENT_CHANNEL_2_DONE)
+    {
+	(*_writeStreamCallback[DAC_CHANNEL_2])(&_writeStreamData[DAC_CHANNEL_2][_writeStreamCount[DAC_CHANNEL_2] / 2], (_writeStreamCount[DAC_CHANNEL_2] - (_writeStreamCount[DAC_CHANNEL_2] / 2)));
+    }
+}
+
+static void analogWriteStreamNotify(void)
+{
+    uint32_t events;
+
+    events = 0;
+
+    if (_writeStreamCallback[DAC_CHANNEL_1])
+    {
+	events |= (DAC_EVENT_CHANNEL_1_HALF | DAC_EVENT_CHANNEL_1_DONE);
+    }
+
+    if (_writeStreamCallback[DAC_CHANNEL_2])
+    {
+	events |= (DAC_EVENT_CHANNEL_2_HALF | DAC_EVENT_CHANNEL_2_DONE);
+    }
+
+    stm32l4_dac_notify(&stm32l4_dac, analogWriteStreamCallback, NULL, events);
+}
+
+#endif /* defined(PIN_DAC0) || defined(PIN_DAC1) */
+
+// Plays the 12 bit samples in data[count] circular on PIN_DAC0 (TIM6) or
+// PIN_DAC1 (TIM7) at "frequency" samples per second. If a callback is given
+// it gets called with the half of data[] that has just been played, so that
+// it can be refilled while the other half is playing. Fails if the timer or
+// the DMA channel is in use already (Servo, tone()).
+bool analogWriteStream(uint32_t pin, uint16_t *data, uint32_t count, uint32_t frequency, void(*callback)(uint16_t *data, uint32_t count))
+{
+#if defined(PIN_DAC0) || defined(PIN_DAC1)
+    uint32_t channel, clock, modulus, divider;
+
+    if (g_APinDescription[pin].GPIO == NULL)
+    {
+	return false;
+    }
+
+    if (!(g_APinDescription[pin].attr & PIN_ATTR_DAC) || (count < 2) || (frequency == 0))
+    {
+	return false;
+    }
+
+    channel = ((pin == PIN_DAC0) ? DAC_CHANNEL_1 : DAC_CHANNEL_2);
+
+    if (stm32l4_dac.state == DAC_STATE_NONE)
+    {
+	stm32l4_dac_create(&stm32l4_dac, DAC_INSTANCE_DAC, STM32L4_DAC_IRQ_PRIORITY, 0);
+	stm32l4_dac_enable(&stm32l4_dac, 0, NULL, NULL, 0);
+    }
+
+    if (stm32l4_dac.channels & (1ul << channel))
+    {
+	analogWriteStreamStop(pin);
+    }
+
+    /* TIM6 might be owned by Servo, TIM7 by tone().
+     */
+    if (!stm32l4_timer_create(&stm32l4_dac_timer[channel], ((channel == DAC_CHANNEL_1) ? TIMER_INSTANCE_TIM6 : TIMER_INSTANCE_TIM7), STM32L4_DAC_IRQ_PRIORITY, 0))
+    {
+	return false;
+    }
+
+    clock = stm32l4_timer_clock(&stm32l4_dac_timer[channel]);
+
+    modulus = clock / frequency;
+
+    if (modulus == 0)
+    {
+	stm32l4_timer_destroy(&stm32l4_dac_timer[channel]);
+
+	return false;
+    }
+
+    divider = (modulus + 65535) / 65536;
+    modulus = clock / (divider * frequency);
+
+    stm32l4_timer_enable(&stm32l4_dac_timer[channel], divider -1, modulus -1, TIMER_OPTION_TRGO_UPDATE, NULL, NULL, 0);
+
+    stm32l4_gpio_pin_configure(g_APinDescription[pin].pin, (GPIO_PUPD_NONE | GPIO_MODE_ANALOG));
+
+    if (_writeCalibrate & (1ul << channel))
+    {
+	_writeCalibrate &= ~(1ul << channel);
+
+	stm32l4_dac_channel(&stm32l4_dac, channel, data[0], DAC_CONTROL_EXTERNAL | DAC_CONTROL_CALIBRATE);
+    }
+
+    _writeStreamData[channel] = data;
+    _writeStreamCount[channel] = count;
+    _writeStreamCallback[channel] = callback;
+
+    analogWriteStreamNotify();
+
+    if (!stm32l4_dac_start(&stm32l4_dac, channel, &stm32l4_dac_timer[channel], data, count))
+    {
+	_writeStreamCallback[channel] = NULL;
+
+	analogWriteStreamNotify();
+
+	stm32l4_timer_disable(&stm32l4_dac_timer[channel]);
+	stm32l4_timer_destroy(&stm32l4_dac_timer[channel]);
+
+	return false;
+    }
+
+    stm32l4_timer_start(&stm32l4_dac_timer[channel], false);
+
+    return true;
+#else /* defined(PIN_DAC0) || defined(PIN_DAC1) */
+    return false;
+#endif /* defined(PIN_DAC0) || defined(PIN_DAC1) */
+}
+
+void analogWriteStreamStop(uint32_t pin)
+{
+#if defined(PIN_DAC0) || defined(PIN_DAC1)
+    uint32_t channel;
+
+    if (!(g_APinDescription[pin].attr & PIN_ATTR_DAC))
+    {
+	return;
+    }
+
+    channel = ((pin == PIN_DAC0) ? DAC_CHANNEL_1 : DAC_CHANNEL_2);
+
+    if (!(stm32l4_dac.channels & (1ul << channel)))
+    {
+	return;
+    }
+
+    stm32l4_timer_stop(&stm32l4_dac_timer[channel]);
+    stm32l4_timer_disable(&stm32l4_dac_timer[channel]);
+    stm32l4_timer_destroy(&stm32l4_dac_timer[channel]);
+
+    stm32l4_dac_stop(&stm32l4_dac, channel);
+
+    _writeStreamCallback[channel] = NULL;
+
+    analogWriteStreamNotify();
+#endif /* defined(PIN_DAC0) || defined(PIN_DAC1) */
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -60,6 +60,7 @@ extern "C" {
 #define STM32L4_ADC_IRQ_PRIORITY     15
 #define STM32L4_DAC_IRQ_PRIORITY     15
 #define STM32L4_PWM_IRQ_PRIORITY     15
+#define STM32L4_SDCARD_IRQ_PRIORITY  15
 
 #define STM32L4_USB_IRQ_PRIORITY     14
 #define STM32L4_RTC_IRQ_PRIORITY     13
@@ -156,6 +157,7 @@ extern void stm32l4_usbd_dap_initialize(uint16_t pin_swclk, uint16_t pin_swdio);
  ************************************************************************/
 
 extern stm32l4_adc_t stm32l4_adc;
+extern stm32l4_timer_t stm32l4_pwm[PWM_INSTANCE_COUNT];
 extern stm32l4_exti_t stm32l4_exti;
 
 #ifdef __cplusplus
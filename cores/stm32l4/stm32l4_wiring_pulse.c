@@ -20,6 +20,441 @@
 #include "stm32l4_wiring_private.h"
 #include <stdio.h>
 
+/* Input capture on the PWM timer of a pin, in PWM input mode: the pin's
+ * own channel latches the leading edge, and its partner channel (1/2, 3/4)
+ * latches the trailing edge of the same input. So both edges are
+ * timestamped by the hardware, and the interrupt never has to guess the
+ * polarity. Timers with a single channel (TIM16/TIM17) cannot do that.
+ * 16 bit timers are extended to 32 bits by counting overflows, so that
+ * pulses/periods up to 2^32 ticks (536s at 8MHz) can be measured.
+ */
+
+#define PULSE_CAPTURE_CLOCK   8000000
+#define PULSE_CAPTURE_COUNT   4
+#define PULSE_CAPTURE_ENTRIES 4
+
+typedef struct _stm32l4_pulse_capture_t {
+    uint8_t                 pin;
+    uint8_t                 state;
+    uint8_t                 instance;
+    uint8_t                 channel;
+    uint8_t                 pair;
+    uint8_t                 valid;
+    uint32_t                leading;
+    uint32_t                period;
+    void                    (*callback)(uint32_t width, uint32_t period);
+    volatile uint8_t        read;
+    volatile uint8_t        write;
+    volatile uint32_t       count;
+    struct {
+	uint32_t            width;
+	uint32_t            period;
+    }                       data[PULSE_CAPTURE_ENTRIES];
+} stm32l4_pulse_capture_t;
+
+static stm32l4_pulse_capture_t *_captureSlots[PULSE_CAPTURE_COUNT];
+static stm32l4_pulse_capture_t _captureData[PULSE_CAPTURE_COUNT];
+static uint32_t _captureOverflow[PWM_INSTANCE_COUNT];
+static uint32_t _captureClock[PWM_INSTANCE_COUNT];
+static uint8_t _captureChannels[PWM_INSTANCE_COUNT];
+
+static inline uint32_t pulseCaptureScale(uint32_t instance, uint32_t ticks, uint32_t scale)
+{
+    return (uint32_t)(((uint64_t)ticks * scale) / _captureClock[instance]);
+}
+
+static inline uint32_t pulseCaptureTimestamp(uint32_t instance, uint32_t channel, uint32_t events, uint32_t overflow)
+{
+    uint32_t timestamp;
+
+    timestamp = stm32l4_timer_capture(&stm32l4_pwm[instance], channel);
+
+    if (stm32l4_pwm[instance].events & TIMER_EVENT_PERIOD)
+    {
+	/* A small capture value next to a pending overflow was taken after the wrap.
+	 */
+	timestamp = ((events & TIMER_EVENT_PERIOD) && (timestamp < 0x8000)) ? ((overflow + 0x00010000) | timestamp) : (overflow | timestamp);
+    }
+
+    return timestamp;
+}
+
+static void pulseCaptureLeading(stm32l4_pulse_capture_t *capture, uint32_t timestamp)
+{
+    if (capture->valid)
+    {
+	capture->period = timestamp - capture->leading;
+    }
+
+    capture->leading = timestamp;
+    capture->valid = true;
+}
+
+static void pulseCaptureTrailing(stm32l4_pulse_capture_t *capture, uint32_t timestamp)
+{
+    uint32_t width, write;
+
+    if (capture->valid)
+    {
+	width = timestamp - capture->leading;
+
+	if (capture->count != PULSE_CAPTURE_ENTRIES)
+	{
+	    write = capture->write;
+
+	    capture->data[write].width = width;
+	    capture->data[write].period = capture->period;
+
+	    capture->write = (write + 1) & (PULSE_CAPTURE_ENTRIES -1);
+
+	    armv7m_atomic_add(&capture->count, 1);
+	}
+
+	if (capture->callback)
+	{
+	    (*capture->callback)(pulseCaptureScale(capture->instance, width, 1000000000), pulseCaptureScale(capture->instance, capture->period, 1000000000));
+	}
+    }
+}
+
+static void pulseCaptureCallback(void *context, uint32_t events)
+{
+    stm32l4_pulse_capture_t *capture;
+    uint32_t instance, index, overflow, leading, trailing;
+
+    instance = (uint32_t)context;
+
+    overflow = _captureOverflow[instance];
+
+    for (index = 0; index < PULSE_CAPTURE_COUNT; index++)
+    {
+	capture = _captureSlots[index];
+
+	if (!capture || (capture->instance != instance))
+	{
+	    continue;
+	}
+
+	leading = 0;
+	trailing = 0;
+
+	if (events & (TIMER_EVENT_CHANNEL_1 << capture->channel))
+	{
+	    leading = pulseCaptureTimestamp(instance, capture->channel, events, overflow);
+	}
+
+	if (events & (TIMER_EVENT_CHANNEL_1 << capture->pair))
+	{
+	    trailing = pulseCaptureTimestamp(instance, capture->pair, events, overflow);
+	}
+
+	/* With both edges pending the older one has to go first. That is the
+	 * trailing edge, if it ends the pulse that started before "leading".
+	 */
+	if (events & (TIMER_EVENT_CHANNEL_1 << capture->channel))
+	{
+	    if ((events & (TIMER_EVENT_CHANNEL_1 << capture->pair)) && ((trailing - capture->leading) < (leading - capture->leading)))
+	    {
+		pulseCaptureTrailing(capture, trailing);
+
+		events &= ~(TIMER_EVENT_CHANNEL_1 << capture->pair);
+	    }
+
+	    pulseCaptureLeading(capture, leading);
+	}
+
+	if (events & (TIMER_EVENT_CHANNEL_1 << capture->pair))
+	{
+	    pulseCaptureTrailing(capture, trailing);
+	}
+    }
+
+    if (events & TIMER_EVENT_PERIOD)
+    {
+	_captureOverflow[instance] = overflow + 0x00010000;
+    }
+}
+
+// Starts continuous capture of pulses of level "state" on a PWM capable pin.
+// Width and period (leading edge to leading edge, 0 for the first pulse) of
+// each complete pulse are queued for pulseCaptureRead(), and passed in
+// nanoseconds to "callback" (if not NULL) from the timer interrupt.
+bool attachPulseCapture(uint32_t pin, uint32_t state, void(*callback)(uint32_t width, uint32_t period))
+{
+    stm32l4_pulse_capture_t *capture;
+    GPIO_TypeDef *GPIO;
+    uint32_t instance, channel, pair, index, slot, divider, pupd;
+
+    if (g_APinDescription[pin].GPIO == NULL)
+    {
+	return false;
+    }
+
+    if (!(g_APinDescription[pin].attr & PIN_ATTR_PWM))
+    {
+	return false;
+    }
+
+    instance = g_APinDescription[pin].pwm_instance;
+    channel = g_APinDescription[pin].pwm_channel;
+
+    if (channel > TIMER_CHANNEL_4)
+    {
+	return false;
+    }
+
+    /* The trailing edge is latched by the partner channel, which only
+     * timers with at least 2 channels have.
+     */
+    if ((g_PWMInstances[instance] == TIMER_INSTANCE_TIM16)
+#if defined(STM32L476xx) || defined(STM32L496xx)
+	|| (g_PWMInstances[instance] == TIMER_INSTANCE_TIM17)
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+	)
+    {
+	return false;
+    }
+
+    pair = channel ^ 1;
+
+    /* The timer is either owned by analogWrite(), or by the capture code.
+     */
+    if ((stm32l4_pwm[instance].state != TIMER_STATE_NONE) && !_captureChannels[instance])
+    {
+	return false;
+    }
+
+    if (_captureChannels[instance] & ((1u << channel) | (1u << pair)))
+    {
+	return false;
+    }
+
+    for (slot = PULSE_CAPTURE_COUNT, index = 0; index < PULSE_CAPTURE_COUNT; index++)
+    {
+	if (!_captureSlots[index])
+	{
+	    slot = index;
+
+	    break;
+	}
+    }
+
+    if (slot == PULSE_CAPTURE_COUNT)
+    {
+	return false;
+    }
+
+    capture = &_captureData[slot];
+
+    capture->pin = pin;
+    capture->state = state ? 1 : 0;
+    capture->instance = instance;
+    capture->channel = channel;
+    capture->pair = pair;
+    capture->valid = false;
+    capture->leading = 0;
+    capture->period = 0;
+    capture->callback = callback;
+    capture->read = 0;
+    capture->write = 0;
+    capture->count = 0;
+
+    if (!_captureChannels[instance])
+    {
+	if (!stm32l4_timer_create(&stm32l4_pwm[instance], g_PWMInstances[instance], STM32L4_PWM_IRQ_PRIORITY, 0))
+	{
+	    return false;
+	}
+
+	divider = stm32l4_timer_clock(&stm32l4_pwm[instance]) / PULSE_CAPTURE_CLOCK;
+
+	if (divider == 0)
+	{
+	    divider = 1;
+	}
+
+	_captureClock[instance] = stm32l4_timer_clock(&stm32l4_pwm[instance]) / divider;
+	_captureOverflow[instance] = 0;
+
+	if ((g_PWMInstances[instance] == TIMER_INSTANCE_TIM2)
+#if defined(STM32L476xx) || defined(STM32L496xx)
+	    || (g_PWMInstances[instance] == TIMER_INSTANCE_TIM5)
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+	    )
+	{
+	    stm32l4_timer_enable(&stm32l4_pwm[instance], divider -1, 0xffffffff, 0, pulseCaptureCallback, (void*)instance,
+				 (TIMER_EVENT_CHANNEL_1 | TIMER_EVENT_CHANNEL_2 | TIMER_EVENT_CHANNEL_3 | TIMER_EVENT_CHANNEL_4));
+	}
+	else
+	{
+	    stm32l4_timer_enable(&stm32l4_pwm[instance], divider -1, 0xffff, 0, pulseCaptureCallback, (void*)instance,
+				 (TIMER_EVENT_PERIOD | TIMER_EVENT_CHANNEL_1 | TIMER_EVENT_CHANNEL_2 | TIMER_EVENT_CHANNEL_3 | TIMER_EVENT_CHANNEL_4));
+	}
+
+	stm32l4_timer_start(&stm32l4_pwm[instance], false);
+    }
+
+    _captureChannels[instance] |= ((1u << channel) | (1u << pair));
+
+    _captureSlots[slot] = capture;
+
+    /* Keep the pull-up/pull-down set up by pinMode().
+     */
+    GPIO = (GPIO_TypeDef*)g_APinDescription[pin].GPIO;
+
+    pupd = ((GPIO->PUPDR >> ((31 - __CLZ(g_APinDescription[pin].bit)) * 2)) & 3) << GPIO_PUPD_SHIFT;
+
+    stm32l4_gpio_pin_configure(g_APinDescription[pin].pin, (pupd | GPIO_OSPEED_HIGH | GPIO_OTYPE_PUSHPULL | GPIO_MODE_ALTERNATE));
+
+    /* "channel" sees the pin directly and latches the leading edge, "pair"
+     * sees the same pin through the alternate input and latches the
+     * trailing edge.
+     */
+    stm32l4_timer_channel(&stm32l4_pwm[instance], channel, 0, (state ? TIMER_CONTROL_CAPTURE_RISING_EDGE : TIMER_CONTROL_CAPTURE_FALLING_EDGE));
+    stm32l4_timer_channel(&stm32l4_pwm[instance], pair, 0, ((state ? TIMER_CONTROL_CAPTURE_FALLING_EDGE : TIMER_CONTROL_CAPTURE_RISING_EDGE) | TIMER_CONTROL_CAPTURE_ALTERNATE));
+
+    return true;
+}
+
+void detachPulseCapture(uint32_t pin)
+{
+    stm32l4_pulse_capture_t *capture;
+    GPIO_TypeDef *GPIO;
+    uint32_t instance, channel, index, pupd;
+
+    for (capture = NULL, index = 0; index < PULSE_CAPTURE_COUNT; index++)
+    {
+	if (_captureSlots[index] && (_captureSlots[index]->pin == pin))
+	{
+	    capture = _captureSlots[index];
+
+	    break;
+	}
+    }
+
+    if (!capture)
+    {
+	return;
+    }
+
+    instance = capture->instance;
+    channel = capture->channel;
+
+    stm32l4_timer_channel(&stm32l4_pwm[instance], channel, 0, TIMER_CONTROL_DISABLE);
+    stm32l4_timer_channel(&stm32l4_pwm[instance], capture->pair, 0, TIMER_CONTROL_DISABLE);
+
+    _captureSlots[index] = NULL;
+
+    _captureChannels[instance] &= ~((1u << channel) | (1u << capture->pair));
+
+    if (!_captureChannels[instance])
+    {
+	stm32l4_timer_stop(&stm32l4_pwm[instance]);
+	stm32l4_timer_disable(&stm32l4_pwm[instance]);
+	stm32l4_timer_destroy(&stm32l4_pwm[instance]);
+    }
+
+    GPIO = (GPIO_TypeDef*)g_APinDescription[pin].GPIO;
+
+    pupd = ((GPIO->PUPDR >> ((31 - __CLZ(g_APinDescription[pin].bit)) * 2)) & 3) << GPIO_PUPD_SHIFT;
+
+    stm32l4_gpio_pin_configure(g_APinDescription[pin].pin, (pupd | GPIO_OSPEED_MEDIUM | GPIO_OTYPE_PUSHPULL | GPIO_MODE_INPUT));
+}
+
+int pulseCaptureAvailable(uint32_t pin)
+{
+    uint32_t index;
+
+    for (index = 0; index < PULSE_CAPTURE_COUNT; index++)
+    {
+	if (_captureSlots[index] && (_captureSlots[index]->pin == pin))
+	{
+	    return _captureSlots[index]->count;
+	}
+    }
+
+    return 0;
+}
+
+// Returns the oldest queued pulse with width and period in nanoseconds.
+bool pulseCaptureRead(uint32_t pin, uint32_t *width, uint32_t *period)
+{
+    stm32l4_pulse_capture_t *capture;
+    uint32_t index, read;
+
+    for (capture = NULL, index = 0; index < PULSE_CAPTURE_COUNT; index++)
+    {
+	if (_captureSlots[index] && (_captureSlots[index]->pin == pin))
+	{
+	    capture = _captureSlots[index];
+
+	    break;
+	}
+    }
+
+    if (!capture || !capture->count)
+    {
+	return false;
+    }
+
+    read = capture->read;
+
+    if (width)
+    {
+	*width = pulseCaptureScale(capture->instance, capture->data[read].width, 1000000000);
+    }
+
+    if (period)
+    {
+	*period = pulseCaptureScale(capture->instance, capture->data[read].period, 1000000000);
+    }
+
+    capture->read = (read + 1) & (PULSE_CAPTURE_ENTRIES -1);
+
+    armv7m_atomic_sub(&capture->count, 1);
+
+    return true;
+}
+
+static uint32_t pulseCaptureInline(uint32_t pin, uint32_t state, uint32_t timeout)
+{
+    stm32l4_pulse_capture_t *capture;
+    uint32_t index, micros, width;
+
+    if (!attachPulseCapture(pin, state, NULL))
+    {
+	return 0xffffffff;
+    }
+
+    for (capture = NULL, index = 0; index < PULSE_CAPTURE_COUNT; index++)
+    {
+	if (_captureSlots[index] && (_captureSlots[index]->pin == pin))
+	{
+	    capture = _captureSlots[index];
+
+	    break;
+	}
+    }
+
+    micros = armv7m_systick_micros();
+
+    while (!capture->count)
+    {
+	if (((uint32_t)armv7m_systick_micros() - micros) >= timeout)
+	{
+	    break;
+	}
+
+	armv7m_core_yield();
+    }
+
+    width = capture->count ? pulseCaptureScale(capture->instance, capture->data[capture->read].width, 1000000) : 0;
+
+    detachPulseCapture(pin);
+
+    return width;
+}
+
 static inline __attribute__((optimize("O3"),always_inline)) uint32_t countPulseInline(const volatile uint32_t *port, uint32_t bit, uint32_t stateMask, unsigned long maxloops)
 {
     uint32_t micros;
@@ -78,6 +513,23 @@ uint32_t pulseIn(uint32_t pin, uint32_t state, uint32_t timeout)
   // the initial loop; it takes (roughly) 8 clock cycles per iteration.
   uint32_t maxloops = microsecondsToClockCycles(timeout) / 8;
 
+  // use the input capture of the pin's PWM timer if it is free, unless
+  // called from an interrupt that would block the timer interrupt
+  if ((g_APinDescription[pin].attr & PIN_ATTR_PWM) && (armv7m_core_priority() > STM32L4_PWM_IRQ_PRIORITY))
+  {
+      uint32_t width = pulseCaptureInline(pin, state, timeout);
+
+      if (width != 0xffffffff)
+      {
+	  return width;
+      }
+  }
+
   return countPulseInline(&GPIO->IDR, bit, stateMask, maxloops);
 }
 
+uint32_t pulseInLong(uint32_t pin, uint32_t state, uint32_t timeout)
+{
+    return pulseIn(pin, state, timeout);
+}
+
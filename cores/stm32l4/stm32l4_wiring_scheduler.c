@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2016 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "Arduino.h"
+#include "stm32l4_wiring_private.h"
+
+/* Cooperative scheduler for additional loop() style tasks. Each task
+ * gets its own stack, and control only changes hands in yield(),
+ * delay() or semaphoreTake().
+ *
+ * The main loop stays on the main stack, while the tasks started by
+ * startLoop() run on the process stack (CONTROL.SPSEL = 1). Interrupt
+ * handlers always run on the main stack, so a task's stack only needs
+ * room for its own frames plus one exception frame (up to 26 words with
+ * FPU state). The lowest 32 bytes of the current task's stack are an MPU
+ * no-access region, so an overflow faults right where it happens.
+ *
+ * A switch only needs to preserve what the AAPCS declares callee saved,
+ * i.e. r4-r11 and s16-s31, plus the return address. r3 is pushed along
+ * to keep the stack 8 byte aligned.
+ */
+
+#define LOOP_STACK_GUARD     32
+#define LOOP_STACK_MINIMUM   256
+#define LOOP_MPU_REGION      7
+
+#define LOOP_TIMEOUT_NONE    0
+#define LOOP_TIMEOUT_FOREVER 0xffffffff
+
+typedef struct _stm32l4_loop_t {
+    struct _stm32l4_loop_t  *next;
+    uint32_t                *stack;
+    uint32_t                *limit;
+    void                    (*routine)(void);
+    uint32_t                priority;
+    semaphore_t             *semaphore;
+    uint32_t                start;
+    uint32_t                timeout;
+} stm32l4_loop_t;
+
+typedef struct _stm32l4_loop_control_t {
+    stm32l4_loop_t          *self;
+    stm32l4_loop_t          main;
+    volatile bool           stop;
+} stm32l4_loop_control_t;
+
+static stm32l4_loop_control_t stm32l4_loop_control = {
+    &stm32l4_loop_control.main,
+    {
+	&stm32l4_loop_control.main,
+	NULL,
+	NULL,
+	NULL,
+	LOOP_PRIORITY_NORMAL,
+	NULL,
+	0,
+	LOOP_TIMEOUT_NONE,
+    },
+    false,
+};
+
+/* "control" selects the stack pointer to continue on, 0 for MSP and
+ * CONTROL_SPSEL_Msk for PSP. The other CONTROL bits (FPCA) are kept.
+ */
+static __attribute__((naked, noinline)) void stm32l4_loop_switch(uint32_t **p_stack, uint32_t *stack, uint32_t control)
+{
+    __asm__(
+	"push     { r3-r11, lr }                   \n"
+#if defined (__VFP_FP__) && !defined(__SOFTFP__)
+	"vpush    { s16-s31 }                      \n"
+#endif /* __VFP_FP__ && !__SOFTFP__ */
+	"mov      r3, sp                           \n"
+	"str      r3, [r0]                         \n"
+	"mrs      r3, CONTROL                      \n"
+	"bic      r3, r3, #2                       \n"
+	"orr      r3, r3, r2                       \n"
+	"msr      CONTROL, r3                      \n"
+	"isb                                       \n"
+	"mov      sp, r1                           \n"
+#if defined (__VFP_FP__) && !defined(__SOFTFP__)
+	"vpop     { s16-s31 }                      \n"
+#endif /* __VFP_FP__ && !__SOFTFP__ */
+	"pop      { r3-r11, pc }                   \n"
+	);
+}
+
+/* Move the MPU guard region to the bottom of the stack of "loop", or
+ * disable it for the main loop.
+ */
+static void stm32l4_loop_guard(stm32l4_loop_t *loop)
+{
+    MPU->RNR = LOOP_MPU_REGION;
+
+    if (loop->limit)
+    {
+	MPU->RBAR = (uint32_t)loop->limit;
+	MPU->RASR = (((__builtin_ctz(LOOP_STACK_GUARD) -1) << MPU_RASR_SIZE_Pos) | MPU_RASR_XN_Msk | MPU_RASR_ENABLE_Msk);
+    }
+    else
+    {
+	MPU->RASR = 0;
+    }
+
+    __DSB();
+    __ISB();
+}
+
+void schedulerIdleStop(bool enable)
+{
+    stm32l4_loop_control.stop = enable;
+}
+
+/* Called with PRIMASK set, right after the last check for a runnable
+ * loop. An interrupt that becomes pending still ends WFE (SCR.SEVONPEND
+ * is set), and gets serviced once this returns. So a semaphoreGive() or
+ * an expiring deadline cannot slip in between the check and the sleep.
+ *
+ * STOP mode is only used after schedulerIdleStop(true), because it stops
+ * the clocks of peripherals that may still be busy.
+ */
+void __attribute__((weak)) schedulerIdle(uint32_t timeout)
+{
+    if (stm32l4_loop_control.stop)
+    {
+	/* USB needs its clocks to stay up while a host is attached, so only
+	 * go into STOP mode with USB disconnected. stm32l4_system_stop()
+	 * itself backs out if anybody holds SYSTEM_LOCK_SLEEP.
+	 */
+#if defined(USBCON)
+	if (!USBD_Connected())
+#endif
+	{
+	    if (stm32l4_system_stop(timeout))
+	    {
+		return;
+	    }
+	}
+    }
+
+    __WFE();
+}
+
+static void stm32l4_loop_schedule(void)
+{
+    stm32l4_loop_t *self, *loop, *next;
+    uint32_t primask, elapsed, timeout;
+
+    self = stm32l4_loop_control.self;
+
+    primask = __get_PRIMASK();
+
+    while (1)
+    {
+	next = NULL;
+	timeout = LOOP_TIMEOUT_FOREVER;
+
+	/* The scan runs with PRIMASK set, so that if nothing is ready the
+	 * decision to sleep is based on up to date semaphore counts.
+	 */
+	__disable_irq();
+
+	/* Walk the ring starting after "self", so that among ready tasks of
+	 * equal priority the one that just ran is picked last.
+	 */
+	loop = self;
+
+	do
+	{
+	    loop = loop->next;
+
+	    if (!loop->semaphore || !loop->semaphore->count)
+	    {
+		elapsed = millis() - loop->start;
+
+		if (elapsed < loop->timeout)
+		{
+		    if ((loop->timeout != LOOP_TIMEOUT_FOREVER) && ((loop->timeout - elapsed) < timeout))
+		    {
+			timeout = loop->timeout - elapsed;
+		    }
+
+		    continue;
+		}
+	    }
+
+	    if (!next || (loop->priority < next->priority))
+	    {
+		next = loop;
+	    }
+	}
+	while (loop != self);
+
+	if (next)
+	{
+	    break;
+	}
+
+	SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+
+	schedulerIdle((timeout == LOOP_TIMEOUT_FOREVER) ? 0 : timeout);
+
+	__set_PRIMASK(primask);
+    }
+
+    __set_PRIMASK(primask);
+
+    if (next != self)
+    {
+	stm32l4_loop_guard(next);
+
+	stm32l4_loop_control.self = next;
+
+	stm32l4_loop_switch(&self->stack, next->stack, (next->limit ? CONTROL_SPSEL_Msk : 0));
+    }
+}
+
+static void stm32l4_loop_wait(semaphore_t *semaphore, uint32_t timeout)
+{
+    stm32l4_loop_t *self;
+
+    self = stm32l4_loop_control.self;
+
+    self->semaphore = semaphore;
+    self->start = millis();
+    self->timeout = timeout;
+
+    stm32l4_loop_schedule();
+
+    self->semaphore = NULL;
+    self->timeout = LOOP_TIMEOUT_NONE;
+}
+
+static void stm32l4_loop_entry(void)
+{
+    stm32l4_loop_t *self;
+
+    self = stm32l4_loop_control.self;
+
+    while (1)
+    {
+	(*self->routine)();
+
+	stm32l4_loop_wait(NULL, LOOP_TIMEOUT_NONE);
+    }
+}
+
+bool startLoop(void (*routine)(void), uint32_t stackSize, uint32_t priority)
+{
+    stm32l4_loop_t *self, *loop;
+    uint32_t *stack, offset;
+    void *memory;
+
+    if (__get_IPSR() != 0)
+    {
+	return false;
+    }
+
+    if (stackSize < LOOP_STACK_MINIMUM)
+    {
+	stackSize = LOOP_STACK_MINIMUM;
+    }
+
+    stackSize = (stackSize + 7) & ~7;
+
+    /* The guard region needs to be aligned to its size, so allocate
+     * enough to align the stack bottom.
+     */
+    memory = malloc(sizeof(stm32l4_loop_t) + (LOOP_STACK_GUARD -1) + LOOP_STACK_GUARD + stackSize);
+
+    if (!memory)
+    {
+	return false;
+    }
+
+    loop = (stm32l4_loop_t*)memory;
+
+    offset = (((uint32_t)memory + sizeof(stm32l4_loop_t) + (LOOP_STACK_GUARD -1)) & ~(LOOP_STACK_GUARD -1)) - (uint32_t)memory;
+
+    loop->limit = (uint32_t*)((uint8_t*)memory + offset);
+
+    /* Initial frame as stm32l4_loop_switch() would have left it, with
+     * the return address pointing to stm32l4_loop_entry().
+     */
+    stack = (uint32_t*)((uint8_t*)memory + offset + LOOP_STACK_GUARD + stackSize);
+
+    stack -= 10;
+    memset(stack, 0, 9 * sizeof(uint32_t));
+    stack[9] = (uint32_t)&stm32l4_loop_entry;
+
+#if defined (__VFP_FP__) && !defined(__SOFTFP__)
+    stack -= 16;
+    memset(stack, 0, 16 * sizeof(uint32_t));
+#endif /* __VFP_FP__ && !__SOFTFP__ */
+
+    loop->stack = stack;
+    loop->routine = routine;
+    loop->priority = priority;
+    loop->semaphore = NULL;
+    loop->start = 0;
+    loop->timeout = LOOP_TIMEOUT_NONE;
+
+    /* The background map stays in place for privileged code, only the
+     * guard region is carved out of it.
+     */
+    if (!(MPU->CTRL & MPU_CTRL_ENABLE_Msk))
+    {
+	MPU->RNR = LOOP_MPU_REGION;
+	MPU->RASR = 0;
+	MPU->CTRL = (MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_ENABLE_Msk);
+
+	__DSB();
+	__ISB();
+    }
+
+    /* Interrupts never touch the ring, so there is no need for a critical
+     * section here.
+     */
+    self = stm32l4_loop_control.self;
+
+    loop->next = self->next;
+    self->next = loop;
+
+    return true;
+}
+
+/* yield() stays weak, so that a sketch or library can still supply its
+ * own cooperative scheduler.
+ */
+void __attribute__((weak)) yield(void)
+{
+    if (__get_IPSR() != 0)
+    {
+	return;
+    }
+
+    if (stm32l4_loop_control.self->next != stm32l4_loop_control.self)
+    {
+	stm32l4_loop_wait(NULL, LOOP_TIMEOUT_NONE);
+    }
+}
+
+void delay(uint32_t msec)
+{
+    if (msec == 0)
+    {
+	return;
+    }
+
+    if (__get_IPSR() != 0)
+    {
+	armv7m_systick_delay(msec);
+    }
+    else
+    {
+	stm32l4_loop_wait(NULL, msec);
+    }
+}
+
+void semaphoreInit(semaphore_t *semaphore, uint32_t count)
+{
+    semaphore->count = count;
+}
+
+void semaphoreGive(semaphore_t *semaphore)
+{
+    armv7m_atomic_add(&semaphore->count, 1);
+}
+
+bool semaphoreTake(semaphore_t *semaphore, uint32_t timeout)
+{
+    uint32_t count, start, elapsed;
+
+    start = millis();
+
+    while (1)
+    {
+	count = semaphore->count;
+
+	while (count)
+	{
+	    if (armv7m_atomic_compare_exchange(&semaphore->count, &count, count - 1))
+	    {
+		return true;
+	    }
+	}
+
+	elapsed = millis() - start;
+
+	if ((elapsed >= timeout) || (__get_IPSR() != 0))
+	{
+	    return false;
+	}
+
+	stm32l4_loop_wait(semaphore, ((timeout == LOOP_TIMEOUT_FOREVER) ? LOOP_TIMEOUT_FOREVER : (timeout - elapsed)));
+    }
+}
@@ -29,64 +29,241 @@
 #include "Arduino.h"
 #include "stm32l4_wiring_private.h"
 
+/* A tone on a PWM capable pin is generated by the pin's timer in output
+ * compare toggle mode, so no CPU cycles are spent per edge. All tones on
+ * one timer share its frequency. Any other pin uses TIM7, whose update
+ * event triggers a circular DMA that alternately writes the set and reset
+ * words to GPIO->BSRR. Only if no DMA channel is available the update
+ * interrupt toggles the pin.
+ *
+ * The duration is tracked by a software timer, not by counting edges.
+ */
+
+#define TONE_SLOT_COUNT    4
+
+#define TONE_MODE_NONE     0
+#define TONE_MODE_COMPARE  1
+#define TONE_MODE_DMA      2
+#define TONE_MODE_TOGGLE   3
+
+typedef struct _stm32l4_tone_slot_t {
+    armv7m_timer_t     timer;
+    uint16_t           pin;
+    uint8_t            mode;
+    uint8_t            instance;
+    uint8_t            channel;
+} stm32l4_tone_slot_t;
+
+static stm32l4_tone_slot_t _toneSlots[TONE_SLOT_COUNT];
+
+static uint8_t  _toneChannels[PWM_INSTANCE_COUNT];
+static uint32_t _toneModulus[PWM_INSTANCE_COUNT];
+
 static GPIO_TypeDef *toneGPIO = NULL;
 static uint32_t     toneBit = 0x00000000;
-static uint32_t     toneCount = 0;
+static uint32_t     toneBSRR[2];
 
 static stm32l4_timer_t stm32l4_tone;
+static stm32l4_dma_t   stm32l4_tone_dma;
 
 static void tone_event_callback(void *context, uint32_t events)
 {
-    if (toneCount) {
-      if (toneGPIO->ODR & toneBit) {
+    if (toneGPIO) {
+	if (toneGPIO->ODR & toneBit) {
 	    toneGPIO->BRR = toneBit;
 	} else {
 	    toneGPIO->BSRR = toneBit;
 	}
+    }
+}
+
+static void toneRelease(stm32l4_tone_slot_t *slot)
+{
+    uint32_t instance;
+
+    if (slot->mode == TONE_MODE_COMPARE) {
+	instance = slot->instance;
+
+	stm32l4_timer_channel(&stm32l4_pwm[instance], slot->channel, 0, TIMER_CONTROL_DISABLE);
 
-	if (toneCount <= 0xfffffffe) {
-	    toneCount--;
+	_toneChannels[instance] &= ~(1u << slot->channel);
+
+	if (!_toneChannels[instance]) {
+	    stm32l4_timer_stop(&stm32l4_pwm[instance]);
+	    stm32l4_timer_disable(&stm32l4_pwm[instance]);
+	    stm32l4_timer_destroy(&stm32l4_pwm[instance]);
 	}
+
+	digitalWrite(slot->pin, LOW);
+	pinMode(slot->pin, OUTPUT);
     } else {
 	stm32l4_timer_stop(&stm32l4_tone);
 	stm32l4_timer_disable(&stm32l4_tone);
+	stm32l4_timer_destroy(&stm32l4_tone);
+
+	if (slot->mode == TONE_MODE_DMA) {
+	    stm32l4_dma_stop(&stm32l4_tone_dma);
+	    stm32l4_dma_disable(&stm32l4_tone_dma);
+	    stm32l4_dma_destroy(&stm32l4_tone_dma);
+	}
 
 	toneGPIO->BRR = toneBit;
 	toneGPIO = NULL;
     }
+
+    slot->mode = TONE_MODE_NONE;
 }
 
-void tone(uint32_t pin, uint32_t frequency, uint32_t duration)
+static void toneTimeout(armv7m_timer_t *timer)
+{
+    toneRelease((stm32l4_tone_slot_t*)timer);
+}
+
+static stm32l4_tone_slot_t *toneSlot(uint32_t pin)
 {
-    uint32_t modulus;
+    uint32_t index;
 
-    if (frequency == 0) {
-	return;
+    for (index = 0; index < TONE_SLOT_COUNT; index++) {
+	if ((_toneSlots[index].mode != TONE_MODE_NONE) && (_toneSlots[index].pin == pin)) {
+	    return &_toneSlots[index];
+	}
     }
 
-    if ( g_APinDescription[pin].GPIO == NULL ) {
-	return ;
+    return NULL;
+}
+
+static bool toneCompare(stm32l4_tone_slot_t *slot, uint32_t pin, uint32_t modulus)
+{
+    uint32_t instance, channel, divider;
+
+    if (!(g_APinDescription[pin].attr & PIN_ATTR_PWM)) {
+	return false;
     }
 
-    if (stm32l4_tone.state == TIMER_STATE_NONE) {
-	stm32l4_timer_create(&stm32l4_tone, TIMER_INSTANCE_TIM7, STM32L4_TONE_IRQ_PRIORITY, 0);
+    instance = g_APinDescription[pin].pwm_instance;
+    channel = g_APinDescription[pin].pwm_channel;
+
+    if (channel > TIMER_CHANNEL_4) {
+	return false;
     }
 
+    /* The timer is either free, or already owned by tone() at the same frequency.
+     */
+    if (_toneChannels[instance]) {
+	if (_toneModulus[instance] != modulus) {
+	    return false;
+	}
+    } else {
+	if (stm32l4_pwm[instance].state != TIMER_STATE_NONE) {
+	    return false;
+	}
+
+	if (!stm32l4_timer_create(&stm32l4_pwm[instance], g_PWMInstances[instance], STM32L4_PWM_IRQ_PRIORITY, 0)) {
+	    return false;
+	}
+
+	divider = stm32l4_timer_clock(&stm32l4_pwm[instance]) / 4000000;
+
+	if (divider == 0) {
+	    divider = 1;
+	}
+
+	stm32l4_timer_enable(&stm32l4_pwm[instance], divider -1, modulus -1, TIMER_OPTION_COUNT_PRELOAD, NULL, NULL, 0);
+	stm32l4_timer_start(&stm32l4_pwm[instance], false);
+
+	_toneModulus[instance] = modulus;
+    }
+
+    _toneChannels[instance] |= (1u << channel);
+
+    slot->pin = pin;
+    slot->mode = TONE_MODE_COMPARE;
+    slot->instance = instance;
+    slot->channel = channel;
+
+    digitalWrite(pin, LOW);
+
+    stm32l4_gpio_pin_configure(g_APinDescription[pin].pin, (GPIO_PUPD_NONE | GPIO_OSPEED_HIGH | GPIO_OTYPE_PUSHPULL | GPIO_MODE_ALTERNATE));
+
+    stm32l4_timer_channel(&stm32l4_pwm[instance], channel, 0, TIMER_CONTROL_COMPARE_TOGGLE);
+
+    return true;
+}
+
+static bool toneUpdate(stm32l4_tone_slot_t *slot, uint32_t pin, uint32_t modulus)
+{
     GPIO_TypeDef *GPIO = (GPIO_TypeDef *)g_APinDescription[pin].GPIO;
     uint32_t bit = g_APinDescription[pin].bit;
+    uint32_t index;
 
-    if ((toneGPIO != GPIO) || (toneBit != bit)) {
-	if (toneGPIO) {
-	    noTone(pin);
+    /* TIM7 drives only one pin at a time.
+     */
+    if (toneGPIO) {
+	for (index = 0; index < TONE_SLOT_COUNT; index++) {
+	    if ((_toneSlots[index].mode == TONE_MODE_DMA) || (_toneSlots[index].mode == TONE_MODE_TOGGLE)) {
+		armv7m_timer_stop(&_toneSlots[index].timer);
+
+		toneRelease(&_toneSlots[index]);
+	    }
 	}
+    }
 
-	digitalWrite(pin, LOW);
-	pinMode(pin, OUTPUT);
+    /* TIM7 is only held while a tone is playing, as analogWriteStream() uses
+     * it for PIN_DAC1.
+     */
+    if (!stm32l4_timer_create(&stm32l4_tone, TIMER_INSTANCE_TIM7, STM32L4_TONE_IRQ_PRIORITY, 0)) {
+	return false;
     }
 
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+
     toneGPIO = GPIO;
     toneBit  = bit;
 
+    slot->pin = pin;
+
+    if (stm32l4_dma_create(&stm32l4_tone_dma, DMA_CHANNEL_DMA1_CH4_TIM7_UP, STM32L4_TONE_IRQ_PRIORITY) ||
+	stm32l4_dma_create(&stm32l4_tone_dma, DMA_CHANNEL_DMA2_CH5_TIM7_UP, STM32L4_TONE_IRQ_PRIORITY)) {
+	slot->mode = TONE_MODE_DMA;
+
+	toneBSRR[0] = bit;
+	toneBSRR[1] = bit << 16;
+
+	stm32l4_dma_enable(&stm32l4_tone_dma, NULL, NULL);
+	stm32l4_dma_start(&stm32l4_tone_dma, (uint32_t)&GPIO->BSRR, (uint32_t)&toneBSRR[0], 2,
+			  (DMA_OPTION_MEMORY_TO_PERIPHERAL |
+			   DMA_OPTION_CIRCULAR |
+			   DMA_OPTION_MEMORY_DATA_INCREMENT |
+			   DMA_OPTION_PERIPHERAL_DATA_SIZE_32 |
+			   DMA_OPTION_MEMORY_DATA_SIZE_32 |
+			   DMA_OPTION_PRIORITY_HIGH));
+
+	stm32l4_timer_enable(&stm32l4_tone, (stm32l4_timer_clock(&stm32l4_tone) / 4000000) -1, modulus -1, (TIMER_OPTION_COUNT_PRELOAD | TIMER_OPTION_DMA_UPDATE), NULL, NULL, 0);
+    } else {
+	slot->mode = TONE_MODE_TOGGLE;
+
+	stm32l4_timer_enable(&stm32l4_tone, (stm32l4_timer_clock(&stm32l4_tone) / 4000000) -1, modulus -1, TIMER_OPTION_COUNT_PRELOAD, tone_event_callback, NULL, TIMER_EVENT_PERIOD);
+    }
+
+    stm32l4_timer_start(&stm32l4_tone, false);
+
+    return true;
+}
+
+void tone(uint32_t pin, uint32_t frequency, uint32_t duration)
+{
+    stm32l4_tone_slot_t *slot;
+    uint32_t modulus, index;
+
+    if (frequency == 0) {
+	return;
+    }
+
+    if ( g_APinDescription[pin].GPIO == NULL ) {
+	return ;
+    }
+
     /* Use 4MHz as a carrier frequency. The Arduino UNO spec says we need to be able
      * to hit 31.5Hz at the bottom, which means a 63Hz period to toggle the GPIO.
      * Hence 4MHz is upper boundary if the timer counter should still fit into 16 bits.
@@ -98,31 +275,69 @@ void tone(uint32_t pin, uint32_t frequency, uint32_t duration)
     }
 
     if (modulus > 65536) {
-	modulus = 63356;
+	modulus = 65536;
     }
 
-    frequency = 4000000 / (modulus * 2);
+    slot = toneSlot(pin);
 
-    if (duration) {
-	toneCount = (frequency * duration * 2) / 1000;
-    } else {
-	toneCount = 0xffffffff;
+    if (slot) {
+	armv7m_timer_stop(&slot->timer);
+
+	if (slot->mode == TONE_MODE_COMPARE) {
+	    if (_toneModulus[slot->instance] != modulus) {
+		if (_toneChannels[slot->instance] == (1u << slot->channel)) {
+		    stm32l4_timer_period(&stm32l4_pwm[slot->instance], modulus -1, false);
+
+		    _toneModulus[slot->instance] = modulus;
+		} else {
+		    toneRelease(slot);
+
+		    slot = NULL;
+		}
+	    }
+	} else {
+	    stm32l4_timer_period(&stm32l4_tone, modulus -1, false);
+	}
     }
 
-    if (stm32l4_tone.state == TIMER_STATE_INIT) {
-	stm32l4_timer_enable(&stm32l4_tone, (stm32l4_timer_clock(&stm32l4_tone) / 4000000) -1, modulus -1, TIMER_OPTION_COUNT_PRELOAD, tone_event_callback, NULL, TIMER_EVENT_PERIOD);
-	stm32l4_timer_start(&stm32l4_tone, false);
-    } else {
-	stm32l4_timer_period(&stm32l4_tone, modulus -1, false);
+    if (!slot) {
+	for (index = 0; index < TONE_SLOT_COUNT; index++) {
+	    if (_toneSlots[index].mode == TONE_MODE_NONE) {
+		slot = &_toneSlots[index];
+
+		break;
+	    }
+	}
+
+	if (!slot) {
+	    return;
+	}
+
+	armv7m_timer_create(&slot->timer, toneTimeout);
+
+	if (!toneCompare(slot, pin, modulus)) {
+	    if (!toneUpdate(slot, pin, modulus)) {
+		return;
+	    }
+	}
+    }
+
+    if (duration) {
+	armv7m_timer_start(&slot->timer, duration);
     }
 }
 
 void noTone(uint32_t pin)
 {
-    stm32l4_timer_stop(&stm32l4_tone);
-    stm32l4_timer_disable(&stm32l4_tone);
+    stm32l4_tone_slot_t *slot;
 
-    digitalWrite(pin, LOW);
+    slot = toneSlot(pin);
+
+    if (slot) {
+	armv7m_timer_stop(&slot->timer);
 
-    toneGPIO = NULL;
+	toneRelease(slot);
+    } else {
+	digitalWrite(pin, LOW);
+    }
 }
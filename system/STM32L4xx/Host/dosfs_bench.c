@@ -0,0 +1,286 @@
+/*
+ * dosfs workload benchmark against the simulated SDCARD.
+ *
+ * Each phase resets the device and volume statistics and reports the
+ * commands, blocks and modeled device time (see dosfs_sdcard_timing_t)
+ * it took. Numbers are deterministic for a given configuration, so
+ * comparing two builds (CONFIG+=... in the Makefile) compares the
+ * configurations rather than the host.
+ *
+ *   dosfs_bench <image> [sdsc|sdhc|sflash]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dosfs_api.h"
+#include "dosfs_core.h"
+#include "dosfs_sdcard.h"
+
+#define BENCH_LOG_CHUNK   32768
+#define BENCH_LOG_CHUNKS  256
+#define BENCH_RECORDS     3000
+#define BENCH_SMALL_FILES 200
+
+static unsigned char bench_data[BENCH_LOG_CHUNK];
+static unsigned bench_errors;
+
+static void bench_reset(void)
+{
+    memset(&dosfs_sdcard.statistics, 0, sizeof(dosfs_sdcard.statistics));
+    memset(&dosfs_volume.statistics, 0, sizeof(dosfs_volume.statistics));
+}
+
+static void bench_report(const char *phase)
+{
+    printf("%-16s cmd r/w %6u/%-6u blk r/w %8llu/%-8llu stop %6u time %9.3f ms  fat hit/miss/write %u/%u/%u  extent hit/miss %u/%u\n",
+	   phase,
+	   dosfs_sdcard.statistics.sdcard_command_read,
+	   dosfs_sdcard.statistics.sdcard_command_write,
+	   (unsigned long long)(dosfs_sdcard.statistics.sdcard_data_read / DOSFS_BLK_SIZE),
+	   (unsigned long long)(dosfs_sdcard.statistics.sdcard_data_write / DOSFS_BLK_SIZE),
+	   dosfs_sdcard.statistics.sdcard_command_stop,
+	   (double)dosfs_sdcard.statistics.sdcard_time / 1000.0,
+	   dosfs_volume.statistics.fat_cache_hit,
+	   dosfs_volume.statistics.fat_cache_miss,
+	   dosfs_volume.statistics.fat_cache_write,
+	   dosfs_volume.statistics.extent_cache_hit,
+	   dosfs_volume.statistics.extent_cache_miss);
+}
+
+static void bench_check(int condition)
+{
+    if (!condition)
+    {
+	bench_errors++;
+    }
+}
+
+static void bench_sequential(void)
+{
+    F_FILE *file;
+    long count;
+    int i;
+
+    for (i = 0; i < BENCH_LOG_CHUNK; i++)
+    {
+	bench_data[i] = i * 7;
+    }
+
+    bench_reset();
+
+    file = f_open("log.bin", "w");
+
+    for (i = 0; i < BENCH_LOG_CHUNKS; i++)
+    {
+	bench_check(f_write(bench_data, 1, BENCH_LOG_CHUNK, file) == BENCH_LOG_CHUNK);
+    }
+
+    bench_check(f_close(file) == F_NO_ERROR);
+
+    bench_report("sequential write");
+
+    bench_reset();
+
+    file = f_open("log.bin", "r");
+
+    while ((count = f_read(bench_data, 1, BENCH_LOG_CHUNK, file)) > 0)
+    {
+	for (i = 0; i < count; i++)
+	{
+	    bench_check(bench_data[i] == (unsigned char)(i * 7));
+	}
+    }
+
+    bench_check(f_close(file) == F_NO_ERROR);
+
+    bench_report("sequential read");
+}
+
+static void bench_random(void)
+{
+    F_FILE *file;
+    long offset;
+    int i;
+
+    bench_reset();
+
+    file = f_open("log.bin", "r");
+
+    srand(1);
+
+    for (i = 0; i < 2000; i++)
+    {
+	offset = (rand() % (BENCH_LOG_CHUNKS * (BENCH_LOG_CHUNK / 512))) * 512L;
+
+	bench_check(f_seek(file, offset, F_SEEK_SET) == F_NO_ERROR);
+	bench_check(f_read(bench_data, 1, 512, file) == 512);
+	bench_check(bench_data[0] == (unsigned char)((offset % BENCH_LOG_CHUNK) * 7));
+    }
+
+    bench_check(f_close(file) == F_NO_ERROR);
+
+    bench_report("random read");
+}
+
+static void bench_interleave(void)
+{
+    F_FILE *file_a, *file_b;
+    int i;
+
+    bench_reset();
+
+    file_a = f_open("a.bin", "w");
+    file_b = f_open("b.bin", "w");
+
+    for (i = 0; i < BENCH_RECORDS; i++)
+    {
+	memset(bench_data, i, 512);
+	bench_check(f_write(bench_data, 1, 512, file_a) == 512);
+
+	memset(bench_data, ~i, 512);
+	bench_check(f_write(bench_data, 1, 512, file_b) == 512);
+    }
+
+    bench_check(f_close(file_a) == F_NO_ERROR);
+    bench_check(f_close(file_b) == F_NO_ERROR);
+
+    bench_report("interleave write");
+
+    f_delvolume();
+    f_initvolume();
+
+    bench_reset();
+
+    file_a = f_open("a.bin", "r");
+
+    srand(2);
+
+    for (i = 0; i < BENCH_RECORDS; i++)
+    {
+	int record = rand() % BENCH_RECORDS;
+
+	bench_check(f_seek(file_a, (long)record * 512, F_SEEK_SET) == F_NO_ERROR);
+	bench_check(f_read(bench_data, 1, 512, file_a) == 512);
+	bench_check(bench_data[0] == (unsigned char)record);
+    }
+
+    bench_check(f_close(file_a) == F_NO_ERROR);
+
+    bench_report("fragmented seek");
+}
+
+/* A sequential ("S") file gets its clusters from the end of the volume, a
+ * normal one from the start. Appending to both in turn modifies two FAT
+ * blocks far apart, which is where a single entry FAT cache thrashes.
+ */
+static void bench_pingpong(void)
+{
+    F_FILE *file_n, *file_s;
+    uint32_t size;
+    int i;
+
+    size = dosfs_volume.cls_blk_size * DOSFS_BLK_SIZE;
+
+    if (size > BENCH_LOG_CHUNK)
+    {
+	size = BENCH_LOG_CHUNK;
+    }
+
+    bench_reset();
+
+    file_n = f_open("normal.bin", "w");
+    file_s = f_open("sequential.bin", "wS");
+
+    for (i = 0; i < 256; i++)
+    {
+	memset(bench_data, i, size);
+
+	bench_check(f_write(bench_data, 1, size, file_n) == size);
+	bench_check(f_write(bench_data, 1, size, file_s) == size);
+    }
+
+    bench_check(f_close(file_n) == F_NO_ERROR);
+    bench_check(f_close(file_s) == F_NO_ERROR);
+
+    bench_report("ping-pong write");
+}
+
+static void bench_small(void)
+{
+    F_FILE *file;
+    char name[32];
+    int i;
+
+    bench_reset();
+
+    for (i = 0; i < BENCH_SMALL_FILES; i++)
+    {
+	snprintf(name, sizeof(name), "file%04d.txt", i);
+
+	file = f_open(name, "w");
+	bench_check(f_write("hello", 1, 5, file) == 5);
+	bench_check(f_close(file) == F_NO_ERROR);
+    }
+
+    for (i = 0; i < BENCH_SMALL_FILES; i += 2)
+    {
+	snprintf(name, sizeof(name), "file%04d.txt", i);
+
+	bench_check(f_delete(name) == F_NO_ERROR);
+    }
+
+    bench_report("small files");
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t media;
+
+    if (argc < 2)
+    {
+	printf("usage: %s <image> [sdsc|sdhc|sflash]\n", argv[0]);
+
+	return 1;
+    }
+
+    media = DOSFS_MEDIA_SDHC;
+
+    if ((argc > 2) && !strcmp(argv[2], "sdsc"))
+    {
+	media = DOSFS_MEDIA_SDSC;
+    }
+
+    if ((argc > 2) && !strcmp(argv[2], "sflash"))
+    {
+	media = DOSFS_MEDIA_SFLASH;
+    }
+
+    unlink(argv[1]);
+
+    if (dosfs_sdcard_init(argv[1], media, NULL) || f_initvolume())
+    {
+	printf("FAIL: cannot create volume on \"%s\"\n", argv[1]);
+
+	return 1;
+    }
+
+    bench_sequential();
+    bench_random();
+    bench_interleave();
+    bench_pingpong();
+    bench_small();
+
+    f_delvolume();
+
+    if (bench_errors)
+    {
+	printf("FAIL: %u errors\n", bench_errors);
+
+	return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,508 @@
+/*
+ * Randomized dosfs correctness test against the simulated SDCARD.
+ *
+ * A set of files is written, appended, truncated, renamed, deleted and read
+ * back at random, while a shadow copy in RAM keeps the expected contents.
+ * Every so often the volume is unmounted and mounted again, and at the end
+ * the free space reported before and after a remount has to agree.
+ *
+ * Without transaction safety every write to FAT1 is checked to leave a crash
+ * consistent FAT behind, i.e. no allocated cluster links to a free one.
+ *
+ *   dosfs_stress <image> [iterations] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dosfs_api.h"
+#include "dosfs_core.h"
+#include "dosfs_sdcard.h"
+
+#define STRESS_FILES     6
+#define STRESS_SIZE_MAX  (600 * 1024)
+
+static unsigned char *stress_shadow[STRESS_FILES];
+static long stress_size[STRESS_FILES];
+static int stress_exists[STRESS_FILES];
+static char stress_name[STRESS_FILES][64];
+static unsigned stress_seed;
+
+static unsigned char stress_wdata[STRESS_SIZE_MAX];
+static unsigned char stress_rdata[STRESS_SIZE_MAX];
+
+#if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0)
+
+static dosfs_device_interface_t stress_interface;
+static const dosfs_device_interface_t *stress_interface_o;
+static unsigned char *stress_fat;
+static unsigned stress_fat_checks;
+
+static uint32_t stress_fat_entry(uint32_t clsno)
+{
+    uint32_t offset;
+
+    if (dosfs_volume.type == DOSFS_VOLUME_TYPE_FAT12)
+    {
+	offset = clsno + (clsno >> 1);
+
+	return ((stress_fat[offset] | (stress_fat[offset +1] << 8)) >> ((clsno & 1) ? 4 : 0)) & 0x0fff;
+    }
+    else if (dosfs_volume.type == DOSFS_VOLUME_TYPE_FAT16)
+    {
+	offset = clsno << 1;
+
+	return stress_fat[offset] | (stress_fat[offset +1] << 8);
+    }
+    else
+    {
+	offset = clsno << 2;
+
+	return (stress_fat[offset] | (stress_fat[offset +1] << 8) | (stress_fat[offset +2] << 16) | ((uint32_t)stress_fat[offset +3] << 24)) & 0x0fffffff;
+    }
+}
+
+static void stress_fat_check(uint32_t address, uint32_t length)
+{
+    uint32_t clsno, clsdata;
+
+    if ((dosfs_volume.state != DOSFS_VOLUME_STATE_MOUNTED) ||
+	((address + length) <= dosfs_volume.fat1_blkno) ||
+	(address >= (dosfs_volume.fat1_blkno + dosfs_volume.fat_blkcnt)))
+    {
+	return;
+    }
+
+    stress_fat = realloc(stress_fat, dosfs_volume.fat_blkcnt * DOSFS_BLK_SIZE);
+
+    fflush(dosfs_sdcard.image);
+
+    if (pread(fileno(dosfs_sdcard.image), stress_fat, dosfs_volume.fat_blkcnt * DOSFS_BLK_SIZE, (off_t)dosfs_volume.fat1_blkno * DOSFS_BLK_SIZE) != (ssize_t)(dosfs_volume.fat_blkcnt * DOSFS_BLK_SIZE))
+    {
+	printf("FAIL: cannot read back FAT\n");
+
+	exit(1);
+    }
+
+    for (clsno = 2; clsno <= dosfs_volume.last_clsno; clsno++)
+    {
+	clsdata = stress_fat_entry(clsno);
+
+	if ((clsdata >= 2) && (clsdata <= dosfs_volume.last_clsno) && (stress_fat_entry(clsdata) == 0))
+	{
+	    printf("FAIL: cluster %u links to free cluster %u on the media\n", clsno, clsdata);
+
+	    exit(1);
+	}
+    }
+
+    stress_fat_checks++;
+}
+
+static int stress_write_single(void *context, uint32_t address, const uint8_t *data, uint32_t length, volatile uint8_t *p_status)
+{
+    int status;
+
+    status = (*stress_interface_o->write)(context, address, data, length, p_status);
+
+    stress_fat_check(address, length);
+
+    return status;
+}
+
+static int stress_write_vector(void *context, const dosfs_device_segment_t *segments, uint32_t count, volatile uint8_t *p_status)
+{
+    int status;
+    uint32_t index;
+
+    status = (*stress_interface_o->write_vector)(context, segments, count, p_status);
+
+    for (index = 0; index < count; index++)
+    {
+	stress_fat_check(segments[index].address, segments[index].length);
+    }
+
+    return status;
+}
+
+static void stress_intercept(void)
+{
+    stress_interface_o = dosfs_device.interface;
+    stress_interface = *stress_interface_o;
+    stress_interface.write = stress_write_single;
+    stress_interface.write_vector = stress_write_vector;
+
+    dosfs_device.interface = &stress_interface;
+}
+
+#endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0) */
+
+static unsigned stress_random(void)
+{
+    stress_seed = stress_seed * 1103515245u + 12345u;
+
+    return (stress_seed >> 8);
+}
+
+static void stress_fail(const char *what, int index)
+{
+    printf("FAIL: %s, file %d (%s)\n", what, index, stress_name[index]);
+
+    exit(1);
+}
+
+static void stress_verify(int index)
+{
+    F_FILE *file;
+    long size, offset, count, i;
+    int n;
+
+    file = f_open(stress_name[index], "r");
+
+    if (!stress_exists[index])
+    {
+	if (file)
+	{
+	    stress_fail("file exists after delete", index);
+	}
+
+	return;
+    }
+
+    if (!file)
+    {
+	stress_fail("open for read", index);
+    }
+
+    size = stress_size[index];
+
+    if (f_length(file) != size)
+    {
+	stress_fail("length", index);
+    }
+
+    if (f_read(stress_rdata, 1, size, file) != size)
+    {
+	stress_fail("short read", index);
+    }
+
+    if (memcmp(stress_rdata, stress_shadow[index], size))
+    {
+	for (i = 0; i < size; i++)
+	{
+	    if (stress_rdata[i] != stress_shadow[index][i])
+	    {
+		break;
+	    }
+	}
+
+	printf("mismatch at %ld of %ld\n", i, size);
+
+	stress_fail("content", index);
+    }
+
+    for (n = 0; (n < 20) && (size != 0); n++)
+    {
+	offset = stress_random() % size;
+	count = stress_random() % (size - offset + 1);
+
+	if (f_seek(file, offset, F_SEEK_SET))
+	{
+	    stress_fail("seek", index);
+	}
+
+	if (f_read(stress_rdata, 1, count, file) != count)
+	{
+	    stress_fail("random read", index);
+	}
+
+	if (memcmp(stress_rdata, stress_shadow[index] + offset, count))
+	{
+	    stress_fail("random read content", index);
+	}
+    }
+
+    if (f_close(file))
+    {
+	stress_fail("close after read", index);
+    }
+}
+
+static void stress_write(int index)
+{
+    F_FILE *file;
+    long offset, count, split, i;
+
+    file = f_open(stress_name[index], (stress_exists[index] ? "r+" : ((stress_random() & 1) ? "w+S" : "w+")));
+
+    if (!file)
+    {
+	stress_fail("open for write", index);
+    }
+
+    if (!stress_exists[index])
+    {
+	stress_exists[index] = 1;
+	stress_size[index] = 0;
+    }
+
+    offset = stress_size[index] ? (stress_random() % (stress_size[index] + 1)) : 0;
+    count = ((stress_random() & 3) == 0) ? (stress_random() % 70000) : (stress_random() % 3000);
+
+    if ((offset + count) > STRESS_SIZE_MAX)
+    {
+	count = STRESS_SIZE_MAX - offset;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+	stress_wdata[i] = stress_random();
+    }
+
+    if (f_seek(file, offset, F_SEEK_SET))
+    {
+	stress_fail("seek for write", index);
+    }
+
+    split = count ? (stress_random() % (count + 1)) : 0;
+
+    if ((f_write(stress_wdata, 1, split, file) != split) ||
+	(f_write(stress_wdata + split, 1, count - split, file) != (count - split)))
+    {
+	stress_fail("write", index);
+    }
+
+    memcpy(stress_shadow[index] + offset, stress_wdata, count);
+
+    if (stress_size[index] < (offset + count))
+    {
+	stress_size[index] = offset + count;
+    }
+
+    if ((stress_random() % 3) == 0)
+    {
+	if (f_flush(file))
+	{
+	    stress_fail("flush", index);
+	}
+    }
+
+    if (f_close(file))
+    {
+	stress_fail("close after write", index);
+    }
+}
+
+static void stress_append(int index)
+{
+    F_FILE *file;
+    long count, i;
+
+    file = f_open(stress_name[index], "a");
+
+    if (!file)
+    {
+	stress_fail("open for append", index);
+    }
+
+    count = stress_random() % 5000;
+
+    if ((stress_size[index] + count) > STRESS_SIZE_MAX)
+    {
+	count = STRESS_SIZE_MAX - stress_size[index];
+    }
+
+    for (i = 0; i < count; i++)
+    {
+	stress_wdata[i] = stress_random();
+    }
+
+    if (f_write(stress_wdata, 1, count, file) != count)
+    {
+	stress_fail("append", index);
+    }
+
+    memcpy(stress_shadow[index] + stress_size[index], stress_wdata, count);
+
+    stress_size[index] += count;
+
+    if (f_close(file))
+    {
+	stress_fail("close after append", index);
+    }
+}
+
+static void stress_truncate(int index)
+{
+    F_FILE *file;
+    long offset;
+
+    file = f_open(stress_name[index], "r+");
+
+    if (!file)
+    {
+	stress_fail("open for truncate", index);
+    }
+
+    offset = stress_size[index] ? (stress_random() % (stress_size[index] + 1)) : 0;
+
+    if (f_seek(file, offset, F_SEEK_SET) || f_seteof(file))
+    {
+	stress_fail("truncate", index);
+    }
+
+    stress_size[index] = offset;
+
+    if (f_close(file))
+    {
+	stress_fail("close after truncate", index);
+    }
+}
+
+static void stress_rename(int index)
+{
+    char temp[80];
+    const char *name, *base;
+
+    name = stress_name[index];
+    base = strrchr(name, '/') ? (strrchr(name, '/') + 1) : name;
+
+    snprintf(temp, sizeof(temp), "%s.tmp", name);
+
+    if (f_rename(name, (strrchr(temp, '/') ? (strrchr(temp, '/') + 1) : temp)))
+    {
+	stress_fail("rename", index);
+    }
+
+    if (f_rename(temp, base))
+    {
+	stress_fail("rename back", index);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    F_SPACE space_0, space_1;
+    int iterations, iteration, index, op;
+
+    if (argc < 2)
+    {
+	printf("usage: %s <image> [iterations] [seed]\n", argv[0]);
+
+	return 1;
+    }
+
+    iterations = (argc > 2) ? atoi(argv[2]) : 2000;
+    stress_seed = (argc > 3) ? atoi(argv[3]) : 1;
+
+    unlink(argv[1]);
+
+    if (dosfs_sdcard_init(argv[1], DOSFS_MEDIA_SDHC, NULL) || f_initvolume())
+    {
+	printf("FAIL: cannot create volume on \"%s\"\n", argv[1]);
+
+	return 1;
+    }
+
+#if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0)
+    stress_intercept();
+#endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0) */
+
+    f_mkdir("dir");
+
+    for (index = 0; index < STRESS_FILES; index++)
+    {
+	stress_shadow[index] = malloc(STRESS_SIZE_MAX);
+
+	snprintf(stress_name[index], sizeof(stress_name[index]), "%sfile_long_name_%d.dat", ((index & 1) ? "dir/" : ""), index);
+    }
+
+    for (iteration = 0; iteration < iterations; iteration++)
+    {
+	index = stress_random() % STRESS_FILES;
+	op = stress_random() % 10;
+
+	if (op < 4)
+	{
+	    stress_write(index);
+	}
+	else if (!stress_exists[index])
+	{
+	    continue;
+	}
+	else if (op == 4)
+	{
+	    stress_append(index);
+	}
+	else if (op == 5)
+	{
+	    if (f_delete(stress_name[index]))
+	    {
+		stress_fail("delete", index);
+	    }
+
+	    stress_exists[index] = 0;
+	}
+	else if (op == 6)
+	{
+	    stress_truncate(index);
+	}
+	else if (op == 7)
+	{
+	    stress_rename(index);
+	}
+	else if (op == 8)
+	{
+	    stress_verify(index);
+	}
+	else
+	{
+	    if ((stress_random() & 3) == 0)
+	    {
+		f_delvolume();
+
+		if (f_initvolume())
+		{
+		    stress_fail("remount", index);
+		}
+	    }
+
+	    if (f_getfreespace(&space_0))
+	    {
+		stress_fail("free space", index);
+	    }
+	}
+    }
+
+    for (index = 0; index < STRESS_FILES; index++)
+    {
+	stress_verify(index);
+    }
+
+    f_getfreespace(&space_0);
+    f_delvolume();
+    f_initvolume();
+    f_getfreespace(&space_1);
+
+    for (index = 0; index < STRESS_FILES; index++)
+    {
+	stress_verify(index);
+    }
+
+    if (space_0.free != space_1.free)
+    {
+	printf("FAIL: free space %lu before and %lu after remount\n", (unsigned long)space_0.free, (unsigned long)space_1.free);
+
+	return 1;
+    }
+
+    printf("OK: %d iterations, seed %d\n", iterations, ((argc > 3) ? atoi(argv[3]) : 1));
+
+#if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0)
+    printf("FAT ordering checked after %u writes\n", stress_fat_checks);
+#endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0) */
+
+    return 0;
+}
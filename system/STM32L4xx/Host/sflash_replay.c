@@ -0,0 +1,290 @@
+/*
+ * dosfs workload replay against the simulated SFLASH FTL.
+ *
+ * Most of the volume is filled with static ("cold") files first. Then each
+ * round a logger appends records to one of 8 log files, with a f_flush()
+ * every 50 records (hot FAT/directory sectors), while a small "database"
+ * file gets random in place record updates. At the end the FTL statistics
+ * are reported: write amplification, garbage collection, the erase count
+ * spread over the physical sectors, and the xlate cache hit rates.
+ *
+ * Building with DOSFS_CONFIG_SFLASH_SIMULATE_TRACE=1 in CONFIG logs every
+ * victim decision of the garbage collection as well.
+ *
+ *   sflash_replay [rounds] [cold files] [database interval]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dosfs_api.h"
+#include "dosfs_core.h"
+#include "dosfs_sflash.h"
+
+#define REPLAY_COLD_CHUNK      65536
+#define REPLAY_COLD_CHUNKS     16
+#define REPLAY_LOG_FILES       8
+#define REPLAY_LOG_RECORDS     2000
+#define REPLAY_LOG_FLUSH       50
+#define REPLAY_RECORD_SIZE     100
+#define REPLAY_DB_SIZE         (4 * 65536)
+#define REPLAY_HISTOGRAM       8
+
+static unsigned char replay_data[REPLAY_COLD_CHUNK];
+static unsigned char replay_record[REPLAY_RECORD_SIZE];
+static unsigned replay_errors;
+
+static void replay_check(int condition)
+{
+    if (!condition)
+    {
+	replay_errors++;
+    }
+}
+
+static void replay_cold(int count)
+{
+    F_FILE *file;
+    char name[32];
+    int i, n;
+
+    for (i = 0; i < count; i++)
+    {
+	snprintf(name, sizeof(name), "cold%03d.bin", i);
+
+	file = f_open(name, "w");
+
+	replay_check(file != NULL);
+
+	memset(replay_data, i, REPLAY_COLD_CHUNK);
+
+	for (n = 0; n < REPLAY_COLD_CHUNKS; n++)
+	{
+	    replay_check(f_write(replay_data, 1, REPLAY_COLD_CHUNK, file) == REPLAY_COLD_CHUNK);
+	}
+
+	replay_check(f_close(file) == F_NO_ERROR);
+    }
+
+    file = f_open("db.bin", "w");
+
+    memset(replay_data, 0, REPLAY_COLD_CHUNK);
+
+    for (n = 0; n < (REPLAY_DB_SIZE / REPLAY_COLD_CHUNK); n++)
+    {
+	replay_check(f_write(replay_data, 1, REPLAY_COLD_CHUNK, file) == REPLAY_COLD_CHUNK);
+    }
+
+    replay_check(f_close(file) == F_NO_ERROR);
+}
+
+static void replay_round(int round, int interval)
+{
+    F_FILE *file, *db;
+    char name[32];
+    long offset, size, count, i;
+    int n;
+
+    snprintf(name, sizeof(name), "log%03d.txt", (round % REPLAY_LOG_FILES));
+
+    file = f_open(name, "w");
+    db = f_open("db.bin", "r+");
+
+    replay_check((file != NULL) && (db != NULL));
+
+    for (n = 0; n < REPLAY_LOG_RECORDS; n++)
+    {
+	memset(replay_record, ('a' + (n % 26)), REPLAY_RECORD_SIZE);
+
+	replay_check(f_write(replay_record, 1, REPLAY_RECORD_SIZE, file) == REPLAY_RECORD_SIZE);
+
+	if ((n % REPLAY_LOG_FLUSH) == (REPLAY_LOG_FLUSH -1))
+	{
+	    replay_check(f_flush(file) == F_NO_ERROR);
+	}
+
+	if ((n % interval) == 0)
+	{
+	    offset = (rand() % (REPLAY_DB_SIZE / 512)) * 512;
+
+	    memset(replay_data, round, 512);
+
+	    replay_check(f_seek(db, offset, F_SEEK_SET) == F_NO_ERROR);
+	    replay_check(f_write(replay_data, 1, 512, db) == 512);
+	}
+    }
+
+    replay_check(f_close(file) == F_NO_ERROR);
+    replay_check(f_close(db) == F_NO_ERROR);
+
+    file = f_open(name, "r");
+
+    replay_check(file != NULL);
+
+    size = 0;
+
+    while ((count = f_read(replay_data, 1, 512, file)) > 0)
+    {
+	for (i = 0; i < count; i++)
+	{
+	    replay_check(replay_data[i] == ('a' + (((size + i) / REPLAY_RECORD_SIZE) % 26)));
+	}
+
+	size += count;
+    }
+
+    replay_check(size == (REPLAY_LOG_RECORDS * REPLAY_RECORD_SIZE));
+    replay_check(f_close(file) == F_NO_ERROR);
+}
+
+static void replay_verify(int count)
+{
+    F_FILE *file;
+    char name[32];
+    int i, n, k;
+
+    for (i = 0; i < count; i++)
+    {
+	snprintf(name, sizeof(name), "cold%03d.bin", i);
+
+	file = f_open(name, "r");
+
+	replay_check(file != NULL);
+
+	for (n = 0; n < REPLAY_COLD_CHUNKS; n++)
+	{
+	    replay_check(f_read(replay_data, 1, REPLAY_COLD_CHUNK, file) == REPLAY_COLD_CHUNK);
+
+	    for (k = 0; k < REPLAY_COLD_CHUNK; k += 512)
+	    {
+		replay_check(replay_data[k] == (unsigned char)i);
+	    }
+	}
+
+	replay_check(f_close(file) == F_NO_ERROR);
+    }
+}
+
+static void replay_report(void)
+{
+    uint32_t erase, erase_min, erase_max, histogram[REPLAY_HISTOGRAM], step;
+    uint64_t erase_sum;
+    unsigned int index, count;
+
+    printf("ftl write %u, nor write %u, write amplification %.3f\n",
+	   dosfs_sflash.statistics.sflash_ftl_write,
+	   dosfs_sflash.statistics.sflash_nor_write,
+	   (double)dosfs_sflash.statistics.sflash_nor_write / (double)dosfs_sflash.statistics.sflash_ftl_write);
+
+    printf("reclaim %u, copy %u, free %u, static %u\n",
+	   dosfs_sflash.statistics.sflash_ftl_reclaim,
+	   dosfs_sflash.statistics.sflash_ftl_reclaim_copy,
+	   dosfs_sflash.statistics.sflash_ftl_reclaim_free,
+	   dosfs_sflash.statistics.sflash_ftl_reclaim_static);
+
+    printf("xlate hit/miss %u/%u, xlate2 hit/miss %u/%u, nor read %u\n",
+	   dosfs_sflash.statistics.sflash_ftl_xlate_hit,
+	   dosfs_sflash.statistics.sflash_ftl_xlate_miss,
+	   dosfs_sflash.statistics.sflash_ftl_xlate2_hit,
+	   dosfs_sflash.statistics.sflash_ftl_xlate2_miss,
+	   dosfs_sflash.statistics.sflash_nor_read);
+
+    count = dosfs_sflash.data_size / DOSFS_SFLASH_ERASE_SIZE;
+
+    erase_min = 0xffffffff;
+    erase_max = 0;
+    erase_sum = 0;
+
+    for (index = 0; index < count; index++)
+    {
+	erase = dosfs_sflash.statistics.sflash_nor_erase_sector[index];
+
+	if (erase_min > erase)
+	{
+	    erase_min = erase;
+	}
+
+	if (erase_max < erase)
+	{
+	    erase_max = erase;
+	}
+
+	erase_sum += erase;
+    }
+
+    printf("erase count min %u, max %u, average %.2f over %u sectors\n", erase_min, erase_max, (double)erase_sum / (double)count, count);
+
+    step = ((erase_max - erase_min) / REPLAY_HISTOGRAM) +1;
+
+    memset(histogram, 0, sizeof(histogram));
+
+    for (index = 0; index < count; index++)
+    {
+	histogram[(dosfs_sflash.statistics.sflash_nor_erase_sector[index] - erase_min) / step]++;
+    }
+
+    for (index = 0; index < REPLAY_HISTOGRAM; index++)
+    {
+	if (histogram[index])
+	{
+	    printf("  erase %6u..%-6u %5u sectors\n", (erase_min + index * step), (erase_min + (index +1) * step -1), histogram[index]);
+	}
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int rounds, cold, interval, round;
+
+    rounds = (argc > 1) ? atoi(argv[1]) : 40;
+    cold = (argc > 2) ? atoi(argv[2]) : 20;
+    interval = (argc > 3) ? atoi(argv[3]) : 10;
+
+    if ((rounds <= 0) || (cold < 0) || (interval <= 0))
+    {
+	printf("usage: %s [rounds] [cold files] [database interval]\n", argv[0]);
+
+	return 1;
+    }
+
+    if (dosfs_sflash_init() || f_initvolume())
+    {
+	printf("FAIL: cannot create SFLASH volume\n");
+
+	return 1;
+    }
+
+    replay_cold(cold);
+
+    memset(&dosfs_sflash.statistics, 0, sizeof(dosfs_sflash.statistics));
+
+    srand(1);
+
+    for (round = 0; round < rounds; round++)
+    {
+	replay_round(round, interval);
+    }
+
+    replay_verify(cold);
+
+    replay_report();
+
+    f_delvolume();
+
+    if (f_initvolume() || (f_checkvolume() != F_NO_ERROR))
+    {
+	replay_errors++;
+    }
+
+    f_delvolume();
+
+    if (replay_errors)
+    {
+	printf("FAIL: %u errors\n", replay_errors);
+
+	return 1;
+    }
+
+    return 0;
+}
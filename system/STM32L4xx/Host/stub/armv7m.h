@@ -0,0 +1,38 @@
+/*
+ * Host stand-in for armv7m.h, so that the armv7m_* sources that do not
+ * touch the hardware directly can be built and tested on the host.
+ *
+ * Everything runs in one thread, which by default acts like the PendSV
+ * handler (see stub_IPSR in stm32l476xx.h). The harness provides the
+ * armv7m_atomic_* and armv7m_pendsv_* routines the code under test needs,
+ * and decides when posted work runs.
+ */
+
+#if !defined(_ARMV7M_H)
+#define _ARMV7M_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "armv7m_atomic.h"
+#include "armv7m_pendsv.h"
+#include "armv7m_systick.h"
+#include "armv7m_timer.h"
+
+static inline uint32_t armv7m_svcall_2(uint32_t routine, uint32_t a0, uint32_t a1)
+{
+    /* Thread mode is never emulated.
+     */
+    abort();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ARMV7M_H */
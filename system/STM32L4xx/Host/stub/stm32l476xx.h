@@ -0,0 +1,40 @@
+/*
+ * Host stand-in for the CMSIS device header. Only the bits the armv7m_*
+ * sources use outside of inline assembly are provided.
+ */
+
+#if !defined(__STM32L476xx_H)
+#define __STM32L476xx_H
+
+#include <stdint.h>
+
+typedef enum {
+    SVCall_IRQn    = -5,
+    PendSV_IRQn    = -2,
+    SysTick_IRQn   = -1,
+} IRQn_Type;
+
+/* The exception number the code under test believes it runs at. The
+ * harness sets it, and restores it to 16 + PendSV_IRQn when done.
+ */
+extern uint32_t stub_IPSR;
+
+static inline uint32_t __get_IPSR(void)
+{
+    return stub_IPSR;
+}
+
+static inline uint32_t __get_PRIMASK(void)
+{
+    return 0;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+}
+
+static inline void __disable_irq(void)
+{
+}
+
+#endif /* __STM32L476xx_H */
@@ -0,0 +1,380 @@
+/*
+ * armv7m_timer timing wheel test and benchmark.
+ *
+ * The real armv7m_timer.c is driven by a simulated SYSTICK heartbeat. A set
+ * of timers gets started, restarted and stopped at random, while the clock
+ * advances by single ticks or by long jumps (as after a long ISR, or after
+ * STOP mode). Timeouts beyond the range of the wheel are mixed in. Every
+ * expiry has to happen in the heartbeat that crosses its deadline, and no
+ * armed timer may be left behind with its deadline passed. Some callbacks
+ * restart their own timer. A quarter of the starts and stops are issued as
+ * if from an interrupt handler, in bursts that are only processed when the
+ * PendSV work item runs, so that the request list and its coalescing get
+ * exercised as well.
+ *
+ * Then the cost of a restart with all timers armed, of catching up 1000
+ * ticks in one heartbeat, and of an idle single tick are measured.
+ *
+ *   timer_wheel [timers] [max timeout] [operations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "armv7m.h"
+
+#include "stm32l476xx.h"
+
+#define WHEEL_TIMERS_MAX    4096
+#define WHEEL_LONG_TIMEOUT  3000000
+#define WHEEL_BENCH_STARTS  2000000
+#define WHEEL_BENCH_TICKS   100000
+
+static armv7m_timer_t wheel_timer[WHEEL_TIMERS_MAX];
+static uint32_t wheel_due[WHEEL_TIMERS_MAX];
+static uint8_t wheel_armed[WHEEL_TIMERS_MAX];
+static uint64_t wheel_millis, wheel_previous;
+static armv7m_systick_callback_t wheel_notify;
+static unsigned wheel_checking, wheel_errors, wheel_fired;
+static armv7m_pendsv_work_t *wheel_work;
+static uint32_t wheel_work_pending;
+
+uint32_t stub_IPSR = (16 + PendSV_IRQn);
+
+uint64_t armv7m_systick_millis(void)
+{
+    return wheel_millis;
+}
+
+void armv7m_systick_notify(armv7m_systick_callback_t callback, void *context)
+{
+    wheel_notify = callback;
+}
+
+uint32_t armv7m_atomic_and(volatile uint32_t *p_data, uint32_t data)
+{
+    uint32_t data_return;
+
+    data_return = *p_data;
+
+    *p_data = data_return & data;
+
+    return data_return;
+}
+
+uint32_t armv7m_atomic_or(volatile uint32_t *p_data, uint32_t data)
+{
+    uint32_t data_return;
+
+    data_return = *p_data;
+
+    *p_data = data_return | data;
+
+    return data_return;
+}
+
+bool armv7m_pendsv_work_create(armv7m_pendsv_work_t *work, armv7m_pendsv_routine_t routine, void *context, unsigned int priority)
+{
+    work->routine = routine;
+    work->context = context;
+    work->data = 0;
+    work->priority = priority;
+    work->index = 0;
+
+    wheel_work = work;
+
+    return true;
+}
+
+bool armv7m_pendsv_work_post(armv7m_pendsv_work_t *work, uint32_t data)
+{
+    work->data = data;
+
+    if (wheel_work_pending)
+    {
+	return false;
+    }
+
+    wheel_work_pending = 1;
+
+    return true;
+}
+
+/* What PendSV would do once the interrupt handlers are done.
+ */
+static void wheel_pendsv(void)
+{
+    if (wheel_work_pending)
+    {
+	wheel_work_pending = 0;
+
+	(*wheel_work->routine)(wheel_work->context, wheel_work->data);
+    }
+}
+
+static void wheel_callback(armv7m_timer_t *timer);
+
+/* armv7m_timer.c relies on bit 0 being set in a Thumb function pointer.
+ * On the host that is emulated by an entry point at an odd address.
+ */
+__asm__(
+    ".text                                         \n"
+    ".p2align 4                                    \n"
+    "wheel_thumb:                                  \n"
+    "    nop                                       \n"
+    "    jmp      wheel_callback                   \n"
+    );
+
+extern const char wheel_thumb[];
+
+#define WHEEL_CALLBACK ((armv7m_timer_callback_t)((uintptr_t)wheel_thumb | 1))
+
+static void wheel_start(unsigned int index, uint32_t timeout, bool interrupt)
+{
+    wheel_due[index] = (uint32_t)wheel_millis + (timeout ? timeout : 1);
+    wheel_armed[index] = 1;
+
+    stub_IPSR = interrupt ? (16 + 30) : (16 + PendSV_IRQn);
+
+    armv7m_timer_start(&wheel_timer[index], timeout);
+
+    stub_IPSR = (16 + PendSV_IRQn);
+}
+
+static void wheel_stop(unsigned int index, bool interrupt)
+{
+    wheel_armed[index] = 0;
+
+    stub_IPSR = interrupt ? (16 + 30) : (16 + PendSV_IRQn);
+
+    armv7m_timer_stop(&wheel_timer[index]);
+
+    stub_IPSR = (16 + PendSV_IRQn);
+}
+
+static __attribute__((used)) void wheel_callback(armv7m_timer_t *timer)
+{
+    unsigned int index;
+    uint32_t timeout;
+
+    index = timer - &wheel_timer[0];
+
+    wheel_fired++;
+
+    if (wheel_checking)
+    {
+	/* The deadline has to lie within the heartbeat that just happened.
+	 */
+	if (!wheel_armed[index] ||
+	    ((int32_t)(wheel_due[index] - (uint32_t)wheel_millis) > 0) ||
+	    ((int32_t)(wheel_due[index] - (uint32_t)wheel_previous) <= 0))
+	{
+	    wheel_errors++;
+	}
+
+	wheel_armed[index] = 0;
+
+	/* The wheel is at the deadline here, not at the end of the heartbeat.
+	 */
+	if ((index % 7) == 0)
+	{
+	    timeout = 1 + rand() % 3000;
+
+	    wheel_due[index] += timeout;
+	    wheel_armed[index] = 1;
+
+	    armv7m_timer_start(timer, timeout);
+	}
+    }
+}
+
+static void wheel_advance(uint32_t elapsed)
+{
+    wheel_pendsv();
+
+    wheel_previous = wheel_millis;
+    wheel_millis += elapsed;
+
+    (*wheel_notify)(NULL, (uint32_t)wheel_millis);
+}
+
+static void wheel_verify(unsigned int count)
+{
+    unsigned int index;
+
+    for (index = 0; index < count; index++)
+    {
+	if (wheel_armed[index] && ((int32_t)(wheel_due[index] - (uint32_t)wheel_millis) <= 0))
+	{
+	    wheel_errors++;
+
+	    wheel_armed[index] = 0;
+	}
+    }
+}
+
+static double wheel_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void wheel_check(unsigned int count, uint32_t timeout, long operations)
+{
+    unsigned int index;
+    bool interrupt;
+    long n;
+
+    wheel_checking = 1;
+
+    for (n = 0; n < operations; n++)
+    {
+	index = rand() % count;
+
+	interrupt = ((rand() % 4) == 0);
+
+	switch (rand() % 4) {
+	case 0:
+	case 1:
+	    wheel_start(index, ((rand() % 8) == 0) ? (uint32_t)(1 + rand() % WHEEL_LONG_TIMEOUT) : (1 + rand() % timeout), interrupt);
+	    break;
+
+	case 2:
+	    wheel_stop(index, interrupt);
+	    break;
+
+	case 3:
+	    wheel_advance(((rand() % 16) == 0) ? (1 + rand() % 5000) : 1);
+
+	    wheel_verify(count);
+	    break;
+	}
+    }
+
+    for (index = 0; index < count; index++)
+    {
+	wheel_stop(index, false);
+    }
+
+    wheel_checking = 0;
+}
+
+static void wheel_bench(unsigned int count, uint32_t timeout)
+{
+    unsigned int index, fired;
+    double start, restart, catchup, tick;
+    long n;
+
+    for (index = 0; index < count; index++)
+    {
+	wheel_start(index, (1 + rand() % timeout), false);
+    }
+
+    start = wheel_seconds();
+
+    for (n = 0; n < WHEEL_BENCH_STARTS; n++)
+    {
+	armv7m_timer_start(&wheel_timer[n % count], (1 + (n * 7919) % timeout));
+    }
+
+    restart = (wheel_seconds() - start) / WHEEL_BENCH_STARTS;
+
+    for (index = 0; index < count; index++)
+    {
+	wheel_stop(index, false);
+    }
+
+    for (index = 0; index < count; index++)
+    {
+	wheel_start(index, (1 + index * (timeout / count)), false);
+    }
+
+    fired = wheel_fired;
+
+    start = wheel_seconds();
+
+    for (n = 0; n < 100; n++)
+    {
+	wheel_advance(1000);
+    }
+
+    catchup = (wheel_seconds() - start) / 100;
+
+    fired = wheel_fired - fired;
+
+    for (index = 0; index < count; index++)
+    {
+	wheel_stop(index, false);
+    }
+
+    for (index = 0; index < count; index++)
+    {
+	wheel_start(index, timeout, false);
+    }
+
+    start = wheel_seconds();
+
+    for (n = 0; n < WHEEL_BENCH_TICKS; n++)
+    {
+	wheel_advance(1);
+    }
+
+    tick = (wheel_seconds() - start) / WHEEL_BENCH_TICKS;
+
+    for (index = 0; index < count; index++)
+    {
+	wheel_stop(index, false);
+    }
+
+    printf("timers %u, max timeout %u: restart %.0f ns, catch up 1000 ticks %.0f ns (%u expired), tick %.0f ns\n",
+	   count, timeout, restart * 1e9, catchup * 1e9, fired, tick * 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int count, index;
+    uint32_t timeout;
+    long operations;
+
+    count = (argc > 1) ? atoi(argv[1]) : 1000;
+    timeout = (argc > 2) ? atoi(argv[2]) : 10000;
+    operations = (argc > 3) ? atol(argv[3]) : 200000;
+
+    if ((count == 0) || (count > WHEEL_TIMERS_MAX) || (timeout < count) || (operations < 0))
+    {
+	printf("usage: %s [timers] [max timeout] [operations]\n", argv[0]);
+
+	return 1;
+    }
+
+    srand(1);
+
+    /* Start close to the 32 bit wrap of the heartbeat.
+     */
+    wheel_millis = 0xfffff000;
+
+    armv7m_timer_initialize();
+
+    for (index = 0; index < count; index++)
+    {
+	armv7m_timer_create(&wheel_timer[index], WHEEL_CALLBACK);
+    }
+
+    wheel_check(count, timeout, operations);
+
+    if (wheel_errors)
+    {
+	printf("FAIL: %u errors\n", wheel_errors);
+
+	return 1;
+    }
+
+    wheel_bench(count, timeout);
+
+    return 0;
+}
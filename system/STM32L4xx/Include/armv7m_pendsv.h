@@ -30,6 +30,7 @@
 #define _ARMV7M_PENDSV_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
  extern "C" {
@@ -37,10 +38,41 @@
 
 #define ARMV7M_PENDSV_ENTRY_COUNT 32
 
+#define ARMV7M_PENDSV_PRIORITY_HIGH   0
+#define ARMV7M_PENDSV_PRIORITY_NORMAL 1  /* same class as armv7m_pendsv_enqueue() */
+#define ARMV7M_PENDSV_PRIORITY_LOW    2
+#define ARMV7M_PENDSV_PRIORITY_COUNT  3
+
+#define ARMV7M_PENDSV_WORK_COUNT      32 /* per priority class */
+
 typedef void (*armv7m_pendsv_routine_t)(void *context, uint32_t data);
 
+/* A statically registered deferred work item. Posting it only sets a
+ * pending bit, so it cannot fail for lack of queue space. Posting an
+ * already pending item coalesces with the earlier post, and the routine
+ * sees the most recent "data".
+ */
+typedef struct _armv7m_pendsv_work_t {
+    armv7m_pendsv_routine_t          routine;
+    void                             *context;
+    volatile uint32_t                data;
+    uint8_t                          priority;
+    uint8_t                          index;
+} armv7m_pendsv_work_t;
+
+typedef struct _armv7m_pendsv_statistics_t {
+    uint32_t                         queue_high_water;
+    uint32_t                         queue_drops;
+    uint32_t                         work_posts;
+    uint32_t                         work_coalesced;
+} armv7m_pendsv_statistics_t;
+
 extern volatile armv7m_pendsv_routine_t * armv7m_pendsv_enqueue(armv7m_pendsv_routine_t routine, void *context, uint32_t data);
 
+extern bool armv7m_pendsv_work_create(armv7m_pendsv_work_t *work, armv7m_pendsv_routine_t routine, void *context, unsigned int priority);
+extern bool armv7m_pendsv_work_post(armv7m_pendsv_work_t *work, uint32_t data);
+extern void armv7m_pendsv_statistics(armv7m_pendsv_statistics_t *p_statistics_return);
+
 extern void armv7m_pendsv_initialize(void);
 
 extern void PendSV_Handler(void);
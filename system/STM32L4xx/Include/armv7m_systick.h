@@ -41,6 +41,7 @@ extern uint64_t armv7m_systick_millis(void);
 extern uint64_t armv7m_systick_micros(void);
 extern void armv7m_systick_delay(uint32_t delay);
 extern void armv7m_systick_notify(armv7m_systick_callback_t callback, void *context);
+extern void armv7m_systick_advance(uint64_t micros);
 extern void armv7m_systick_initialize(unsigned int priority);
 extern void armv7m_systick_enable(void);
 extern void armv7m_systick_disable(void);
@@ -44,14 +44,18 @@ struct _armv7m_timer_t {
     armv7m_timer_t                   *next;
     armv7m_timer_t                   *previous;
     volatile armv7m_timer_callback_t callback;
-    uint32_t                         remaining;
+    uint32_t                         timeout;
+    armv7m_timer_t                   *request_next;
+    volatile uint32_t                request;
+    volatile uint32_t                request_timeout;
 };
 
-#define ARMV7M_TIMER_INIT(_callback,_timeout) { NULL, NULL, (_callback), (_timeout) }
+#define ARMV7M_TIMER_INIT(_callback,_timeout) { NULL, NULL, (_callback), (_timeout), NULL, 0, 0 }
 
 extern void armv7m_timer_create(armv7m_timer_t *timer, armv7m_timer_callback_t callback);
 extern bool armv7m_timer_start(armv7m_timer_t *timer, uint32_t timeout);
 extern bool armv7m_timer_stop(armv7m_timer_t *timer);
+extern uint32_t armv7m_timer_next(void);
 
 extern void armv7m_timer_initialize(void);
 
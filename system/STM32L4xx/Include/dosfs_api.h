@@ -172,6 +172,7 @@ extern int     f_format(int fattype);
 extern int     f_hardformat(int fattype);
 extern int     f_getfreespace(F_SPACE *pspace);
 extern int     f_getserial(unsigned long *p_serial);
+extern int     f_getqueue(unsigned long *p_count);
 extern int     f_setlabel(const char *volname);
 extern int     f_getlabel(char *volname, int length);
 
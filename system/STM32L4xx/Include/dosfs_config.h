@@ -48,7 +48,11 @@
 #define DOSFS_CONFIG_FAT_CACHE_ENTRIES          1
 #define DOSFS_CONFIG_DATA_CACHE_ENTRIES         0
 #define DOSFS_CONFIG_FILE_DATA_CACHE            0
-#define DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES      0
+#define DOSFS_CONFIG_EXTENT_CACHE_ENTRIES       4
+#define DOSFS_CONFIG_DEVICE_SEGMENTS            4
+#define DOSFS_CONFIG_FREE_MAP_ENTRIES           0
+#define DOSFS_CONFIG_NAME_CACHE_ENTRIES         8
+#define DOSFS_CONFIG_WRITE_QUEUE_ENTRIES        0
 #define DOSFS_CONFIG_META_DATA_RETRIES          3
 #define DOSFS_CONFIG_STATISTICS                 0
 
@@ -56,6 +60,8 @@
 #define DOSFS_CONFIG_SDCARD_CRC                 1
 #define DOSFS_CONFIG_SDCARD_COMMAND_RETRIES     4
 #define DOSFS_CONFIG_SDCARD_DATA_RETRIES        4
+#define DOSFS_CONFIG_SDCARD_DMA                 1
+#define DOSFS_CONFIG_SDCARD_READ_AHEAD_ENTRIES  4
 #define DOSFS_CONFIG_SDCARD_SIMULATE            0
 #define DOSFS_CONFIG_SDCARD_SIMULATE_BLKCNT     (unsigned long)(65536 * 64)
 #define DOSFS_CONFIG_SDCARD_SIMULATE_TRACE      0
@@ -63,6 +69,8 @@
 #define DOSFS_CONFIG_SFLASH_SIMULATE            0
 #define DOSFS_CONFIG_SFLASH_SIMULATE_DATA_SIZE  0x02000000
 #define DOSFS_CONFIG_SFLASH_SIMULATE_TRACE      0
+#define DOSFS_CONFIG_SFLASH_VICTIM_POLICY       0
+#define DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES 0
 #define DOSFS_CONFIG_SFLASH_DEBUG               0
 
 #ifdef __cplusplus
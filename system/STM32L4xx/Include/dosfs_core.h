@@ -42,7 +42,8 @@ typedef struct _dosfs_dir_t           dosfs_dir_t;
 typedef struct _dosfs_ldir_t          dosfs_ldir_t;
 typedef struct _dosfs_file_t          dosfs_file_t;
 typedef struct _dosfs_cache_entry_t   dosfs_cache_entry_t;
-typedef struct _dosfs_cluster_entry_t dosfs_cluster_entry_t;
+typedef struct _dosfs_extent_t        dosfs_extent_t;
+typedef struct _dosfs_name_entry_t    dosfs_name_entry_t;
 typedef struct _dosfs_volume_t        dosfs_volume_t;
 
 #if (DOSFS_CONFIG_VFAT_SUPPORTED == 0)
@@ -94,6 +95,8 @@ typedef uint16_t dosfs_unicode_t;
 #define DOSFS_BLKNO_RESERVED                 0xfffffffe /* internal only, will fail to read/write */
 #define DOSFS_BLKNO_INVALID                  0xffffffff /* internal only, will fail to read/write */
 
+#define DOSFS_FREE_MAP_UNKNOWN               0xffffffff /* free map unit not scanned yet */
+
 #define DOSFS_HTOFS(_data)                   (_data)
 #define DOSFS_HTOFL(_data)                   (_data)
 #define DOSFS_FTOHS(_data)                   (_data)
@@ -340,6 +343,35 @@ struct _dosfs_cache_entry_t {
 #endif /* (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1) */
 #define DOSFS_FILE_FLAG_END_OF_CHAIN         0x80   /* END_OF_CHAIN seen */
 
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0)
+
+/* A run of consecutive clusters within a cluster chain. "clsofs" is the index of
+ * "clsno" within the chain, i.e. the file offset divided by the cluster size.
+ */
+struct _dosfs_extent_t {
+    uint32_t                clsofs;
+    uint32_t                clsno;
+    uint32_t                clscnt;
+};
+
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
+
+#if (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0)
+
+/* A directory lookup result. "clsno_d" is the directory that was searched
+ * (DOSFS_CLSNO_NONE for the root directory, DOSFS_CLSNO_END_OF_CHAIN for an
+ * unused entry), "clsno/index" the location of the first directory entry of
+ * the match (LDIR or DIR).
+ */
+struct _dosfs_name_entry_t {
+    uint32_t                clsno_d;
+    uint32_t                hash;
+    uint32_t                clsno;
+    uint32_t                index;
+};
+
+#endif /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
+
 struct _dosfs_file_t {
     uint8_t                 mode;
     uint8_t                 flags;
@@ -357,6 +389,10 @@ struct _dosfs_file_t {
     uint32_t                clsno;
     uint32_t                blkno;
     uint32_t                blkno_e;        /* exclusive */
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0)
+    uint32_t                extent_count;
+    dosfs_extent_t          extent_table[DOSFS_CONFIG_EXTENT_CACHE_ENTRIES]; /* sorted by clsofs */
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
 #if (DOSFS_CONFIG_FILE_DATA_CACHE == 1)
 #if (DOSFS_CONFIG_DATA_CACHE_ENTRIES != 0)
     dosfs_cache_entry_t      data_cache;
@@ -364,15 +400,6 @@ struct _dosfs_file_t {
 #endif /* (DOSFS_CONFIG_FILE_DATA_CACHE == 1) */
 };
 
-#if (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0)
-
-struct _dosfs_cluster_entry_t {
-    uint32_t                clsno;
-    uint32_t                clsdata;
-};
-
-#endif /* (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0) */
-
 #define DOSFS_VOLUME_STATE_NONE              0
 #define DOSFS_VOLUME_STATE_INITIALIZED       1
 #define DOSFS_VOLUME_STATE_CARDREMOVED       2
@@ -383,15 +410,7 @@ struct _dosfs_cluster_entry_t {
 #define DOSFS_VOLUME_TYPE_FAT16              1
 #define DOSFS_VOLUME_TYPE_FAT32              2
 
-#if (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1)
-#define DOSFS_VOLUME_FLAG_FAT_INDEX_CURRENT  0x0001
-#define DOSFS_VOLUME_FLAG_FAT_0_CURRENT      0x0000
-#define DOSFS_VOLUME_FLAG_FAT_1_CURRENT      0x0001
-#define DOSFS_VOLUME_FLAG_FAT_0_DIRTY        0x0002
-#define DOSFS_VOLUME_FLAG_FAT_1_DIRTY        0x0004
-#else /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1) */
 #define DOSFS_VOLUME_FLAG_FAT_DIRTY          0x0002
-#endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1) */
 #if (DOSFS_CONFIG_FSINFO_SUPPORTED == 1)
 #define DOSFS_VOLUME_FLAG_FSINFO_DIRTY       0x0008
 #define DOSFS_VOLUME_FLAG_FSINFO_VALID       0x0010
@@ -435,6 +454,9 @@ struct _dosfs_volume_t {
     dosfs_cache_entry_t     fat_cache;
 #else /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
     dosfs_cache_entry_t     fat_cache[DOSFS_CONFIG_FAT_CACHE_ENTRIES];
+    uint8_t                 fat_cache_lru[DOSFS_CONFIG_FAT_CACHE_ENTRIES];    /* fat_cache[] indices, most recently used first */
+    uint8_t                 fat_cache_dirty[DOSFS_CONFIG_FAT_CACHE_ENTRIES];
+    uint32_t                fat_cache_last;               /* blkno of the most recently modified entry */
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES != 0) */
 #if (DOSFS_CONFIG_FILE_DATA_CACHE == 0)
@@ -443,9 +465,20 @@ struct _dosfs_volume_t {
     dosfs_cache_entry_t     data_cache;
 #endif /* (DOSFS_CONFIG_DATA_CACHE_ENTRIES != 0) */
 #endif /* (DOSFS_CONFIG_FILE_DATA_CACHE == 0) */
-#if (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0)
-    dosfs_cluster_entry_t   cluster_cache[DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES];
-#endif /* (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0) */
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+    uint8_t                 free_map_shift;               /* shift to get the free_map[] index for a clsno */
+    uint32_t                free_map[DOSFS_CONFIG_FREE_MAP_ENTRIES];    /* free clusters per unit, or DOSFS_FREE_MAP_UNKNOWN */
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+#if (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0)
+    dosfs_name_entry_t      name_cache[DOSFS_CONFIG_NAME_CACHE_ENTRIES];
+#endif /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+    uint16_t                write_head;                   /* index of the oldest queued block */
+    uint16_t                write_count;                  /* number of queued blocks */
+    uint8_t                 *write_data;                  /* DOSFS_CONFIG_WRITE_QUEUE_ENTRIES blocks */
+    uint32_t                write_blkno[DOSFS_CONFIG_WRITE_QUEUE_ENTRIES];
+    dosfs_file_t            *write_file[DOSFS_CONFIG_WRITE_QUEUE_ENTRIES];
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
 
     /* WORK AREA BELOW */
 
@@ -530,6 +563,7 @@ struct _dosfs_volume_t {
 	uint32_t                fat_cache_read;
 	uint32_t                fat_cache_write;
 	uint32_t                fat_cache_flush;
+	uint32_t                fat_cache_evict;
 	uint32_t                dir_cache_hit;
 	uint32_t                dir_cache_miss;
 	uint32_t                dir_cache_zero;
@@ -542,8 +576,17 @@ struct _dosfs_volume_t {
 	uint32_t                data_cache_write;
 	uint32_t                data_cache_flush;
 	uint32_t                data_cache_invalidate;
-	uint32_t                cluster_cache_hit;
-	uint32_t                cluster_cache_miss;
+	uint32_t                data_vector_read;
+	uint32_t                data_vector_write;
+	uint32_t                extent_cache_hit;
+	uint32_t                extent_cache_miss;
+	uint32_t                free_map_scan;
+	uint32_t                free_map_skip;
+	uint32_t                name_cache_hit;
+	uint32_t                name_cache_miss;
+	uint32_t                write_queue_enqueue;
+	uint32_t                write_queue_write;
+	uint32_t                write_queue_stall;
     }                       statistics;
 #endif /* (DOSFS_CONFIG_STATISTICS == 1) */
 };
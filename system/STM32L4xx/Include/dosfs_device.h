@@ -50,6 +50,20 @@ typedef struct _dosfs_device_t dosfs_device_t;
 #define DOSFS_MEDIA_SDSC     2
 #define DOSFS_MEDIA_SDHC     3
 
+/* A segment of a vectored "read_vector" / "write_vector" request. "address" and 
+ * "length" are in units of DOSFS_BLK_SIZE. Segments whose addresses are contiguous
+ * on the device are transferred with one multi block command.
+ */
+typedef struct _dosfs_device_segment_t {
+    uint32_t                address;
+    uint8_t                 *data;
+    uint32_t                length;
+} dosfs_device_segment_t;
+
+/* "busy" reports whether the device is still busy with a previous write, i.e.
+ * whether a new request would have to wait for the device. It does not wait
+ * itself, nor does it terminate an open multi block write.
+ */
 typedef struct _dosfs_device_interface_t {
     int                     (*release)(void *context);
     int                     (*info)(void *context, uint8_t *p_type, uint8_t *p_write_protected, uint32_t *p_block_count, uint32_t *p_au_size, uint32_t *p_serial);
@@ -59,6 +73,9 @@ typedef struct _dosfs_device_interface_t {
     int                     (*read)(void *context, uint32_t address, uint8_t *data, uint32_t length, bool prefetch);
     int                     (*write)(void *context, uint32_t address, const uint8_t *data, uint32_t length, volatile uint8_t *p_status);
     int                     (*sync)(void *context, bool wait);
+    int                     (*read_vector)(void *context, const dosfs_device_segment_t *segments, uint32_t count, bool prefetch);
+    int                     (*write_vector)(void *context, const dosfs_device_segment_t *segments, uint32_t count, volatile uint8_t *p_status);
+    int                     (*busy)(void *context, bool *p_busy);
 } dosfs_device_interface_t;
 
 #define DOSFS_DEVICE_LOCK_INIT               0x00000001 /* device lock during init */
@@ -80,6 +97,12 @@ extern dosfs_device_t dosfs_device;
 
 extern int dosfs_device_format(dosfs_device_t *device, uint8_t *data);
 
+/* Generic "read_vector" / "write_vector" for devices with multi block commands,
+ * built on top of "interface"'s "read", "write" and "sync".
+ */
+extern int dosfs_device_read_vector(const dosfs_device_interface_t *interface, void *context, const dosfs_device_segment_t *segments, uint32_t count, bool prefetch);
+extern int dosfs_device_write_vector(const dosfs_device_interface_t *interface, void *context, const dosfs_device_segment_t *segments, uint32_t count, volatile uint8_t *p_status);
+
 #ifdef __cplusplus
 }
 #endif
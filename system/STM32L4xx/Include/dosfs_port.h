@@ -29,12 +29,19 @@
 #if !defined(_DOSFS_PORT_h)
 #define _DOSFS_PORT_h
 
+#include "dosfs_config.h"
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE == 0) && (DOSFS_CONFIG_SFLASH_SIMULATE == 0)
+#include "armv7m.h"
 #include "stm32l4_rtc.h"
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE == 0) && (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
 
 #ifdef __cplusplus
  extern "C" {
 #endif
 
+#if (DOSFS_CONFIG_SDCARD_SIMULATE == 0) && (DOSFS_CONFIG_SFLASH_SIMULATE == 0)
+
 static inline void stm32l4_system_timedate(uint16_t *p_time, uint16_t *p_date)
 {
     stm32l4_rtc_time_t rtc_time;
@@ -47,6 +54,21 @@ static inline void stm32l4_system_timedate(uint16_t *p_time, uint16_t *p_date)
 
 #define DOSFS_PORT_CORE_TIMEDATE(_ctime, _cdate) stm32l4_system_timedate((_ctime),(_cdate))
 
+#define DOSFS_PORT_CORE_YIELD()                               armv7m_core_yield()
+#define DOSFS_PORT_ATOMIC_COMPARE_EXCHANGE(_p, _p_expected, _d) armv7m_atomic_compare_exchange((_p), (_p_expected), (_d))
+#define DOSFS_PORT_ATOMIC_AND(_p, _d)                         armv7m_atomic_and((_p), (_d))
+
+#else /* (DOSFS_CONFIG_SDCARD_SIMULATE == 0) && (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
+
+/* Hosted build against a simulated device, there is no RTC and a single thread.
+ */
+
+#define DOSFS_PORT_CORE_YIELD()                               /**/
+#define DOSFS_PORT_ATOMIC_COMPARE_EXCHANGE(_p, _p_expected, _d) __atomic_compare_exchange_n((_p), (_p_expected), (_d), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define DOSFS_PORT_ATOMIC_AND(_p, _d)                         __atomic_and_fetch((_p), (_d), __ATOMIC_SEQ_CST)
+
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE == 0) && (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
+
 #ifdef __cplusplus
 }
 #endif
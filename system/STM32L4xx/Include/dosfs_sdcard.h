@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2017 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#if !defined(_DOSFS_SDCARD_H)
+#define _DOSFS_SDCARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dosfs_device.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE == 1)
+
+#include <stdio.h>
+
+/* Timing model for the simulated media. All values are in microseconds.
+ * "command" is charged for each READ/WRITE command issued (a sequential
+ * CMD18/CMD25 stream pays it only once), "stop" when such a stream gets
+ * terminated, "read"/"write" per transferred block, "program" for the
+ * busy period at the end of a write command, and "erase" per erase or
+ * discard request.
+ */
+typedef struct _dosfs_sdcard_timing_t {
+    uint32_t                command;
+    uint32_t                stop;
+    uint32_t                read;
+    uint32_t                write;
+    uint32_t                program;
+    uint32_t                erase;
+} dosfs_sdcard_timing_t;
+
+typedef struct _dosfs_sdcard_t dosfs_sdcard_t;
+
+#define DOSFS_SDCARD_STATE_NONE                  0
+#define DOSFS_SDCARD_STATE_READY                 1
+#define DOSFS_SDCARD_STATE_READ_MULTIPLE         2
+#define DOSFS_SDCARD_STATE_WRITE_MULTIPLE        3
+
+struct _dosfs_sdcard_t {
+    uint8_t                 state;
+    uint8_t                 media;
+    uint32_t                au_size;
+    uint32_t                block_count;
+    uint32_t                address;
+    FILE                    *image;
+    dosfs_sdcard_timing_t   timing;
+
+#if (DOSFS_CONFIG_STATISTICS == 1)
+    struct {
+        uint32_t                sdcard_command_read;
+        uint32_t                sdcard_command_write;
+        uint32_t                sdcard_command_erase;
+        uint32_t                sdcard_command_discard;
+        uint32_t                sdcard_command_sync;
+        uint32_t                sdcard_command_stop;
+        uint32_t                sdcard_read_single;
+        uint32_t                sdcard_read_multiple;
+        uint32_t                sdcard_write_single;
+        uint32_t                sdcard_write_multiple;
+        uint32_t                sdcard_erase;
+        uint32_t                sdcard_discard;
+        uint64_t                sdcard_data_read;
+        uint64_t                sdcard_data_write;
+        uint64_t                sdcard_time;
+    }                       statistics;
+#endif /* (DOSFS_CONFIG_STATISTICS == 1) */
+};
+
+extern dosfs_sdcard_t dosfs_sdcard;
+
+extern const dosfs_sdcard_timing_t dosfs_sdcard_timing_sdsc;
+extern const dosfs_sdcard_timing_t dosfs_sdcard_timing_sdhc;
+extern const dosfs_sdcard_timing_t dosfs_sdcard_timing_sflash;
+
+/* Attach a file backed image as "dosfs_device". If "filename" does not exist
+ * it gets created with DOSFS_CONFIG_SDCARD_SIMULATE_BLKCNT blocks and formatted.
+ * "media" is reported back via info(), "timing" may be NULL to pick the default
+ * model for "media".
+ */
+extern int dosfs_sdcard_init(const char *filename, uint8_t media, const dosfs_sdcard_timing_t *timing);
+
+#if (DOSFS_CONFIG_STATISTICS == 1)
+
+#define DOSFS_SDCARD_STATISTICS_COUNT(_name)         { sdcard->statistics._name += 1; }
+#define DOSFS_SDCARD_STATISTICS_COUNT_N(_name,_n)    { sdcard->statistics._name += (_n); }
+
+#else /* (DOSFS_CONFIG_STATISTICS == 1) */
+
+#define DOSFS_SDCARD_STATISTICS_COUNT(_name)         /**/
+#define DOSFS_SDCARD_STATISTICS_COUNT_N(_name,_n)    /**/
+
+#endif /* (DOSFS_CONFIG_STATISTICS == 1) */
+
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE == 1) */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DOSFS_SDCARD_H */
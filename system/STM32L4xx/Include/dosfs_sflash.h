@@ -35,7 +35,9 @@
 
 #include "dosfs_device.h"
 
+#if (DOSFS_CONFIG_SFLASH_SIMULATE == 0)
 #include "stm32l4_qspi.h"
+#endif /* (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
 
 #ifdef __cplusplus
  extern "C" {
@@ -63,6 +65,21 @@
 
 #define DOSFS_SFLASH_XLATE_ENTRY_NOT_ALLOCATED   0xffff
 
+/* XLATE/XLATE_SECONDARY blocks are cached in DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES
+ * block sized entries, which are replaced in LRU order. Updating a mapping needs
+ * the XLATE and the XLATE_SECONDARY block of a segment at the same time, hence
+ * there need to be at least 2 entries.
+ *
+ * With DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES set to 0 no extra RAM is used. The
+ * 2 entries then share the scratch buffers cache[0]/cache[1], and get dropped
+ * whenever those are needed for something else.
+ */
+#if (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0)
+#define DOSFS_SFLASH_XLATE_CACHE_ENTRIES         DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES
+#else /* (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0) */
+#define DOSFS_SFLASH_XLATE_CACHE_ENTRIES         2
+#endif /* (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0) */
+
 #define DOSFS_SFLASH_BLOCK_INFO_ENTRIES          128
 
 #define DOSFS_SFLASH_LOGICAL_BLOCK_MASK          0x0000007f
@@ -78,6 +95,27 @@
 #define DOSFS_SFLASH_VICTIM_DELETED_INCREMENT    0x02
 #define DOSFS_SFLASH_VICTIM_ALLOCATED_MASK       0x01
 
+/* Garbage collection victim selection (DOSFS_CONFIG_SFLASH_VICTIM_POLICY):
+ *
+ * WEAR          deleted blocks plus the erase count delta (default)
+ * GREEDY        most deleted blocks
+ * COST_BENEFIT  age * deleted / valid
+ * HOT_COLD      COST_BENEFIT, with rewritten blocks and first time writes
+ *               being allocated from separate write frontiers
+ *
+ * Except for WEAR, a sector whose erase count lags by DOSFS_SFLASH_VICTIM_WEAR_THRESHOLD
+ * or more is picked first, so that static data gets moved eventually.
+ */
+#define DOSFS_SFLASH_VICTIM_POLICY_WEAR          0
+#define DOSFS_SFLASH_VICTIM_POLICY_GREEDY        1
+#define DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT  2
+#define DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD      3
+
+#define DOSFS_SFLASH_VICTIM_WEAR_THRESHOLD       128
+
+#define DOSFS_SFLASH_FRONTIER_COLD               0
+#define DOSFS_SFLASH_FRONTIER_HOT                1
+
 #define DOSFS_SFLASH_STATE_NONE                  0
 #define DOSFS_SFLASH_STATE_READY                 1
 #define DOSFS_SFLASH_STATE_NOT_FORMATTED         2
@@ -121,10 +159,10 @@ struct _dosfs_sflash_t {
     uint32_t                sector_mask[(DOSFS_SFLASH_DATA_SIZE / DOSFS_SFLASH_ERASE_SIZE) / 32];
 #endif /* DOSFS_SFLASH_DATA_SIZE */
     uint16_t                block_table[DOSFS_SFLASH_XLATE_OFFSET];
-    uint16_t                xlate_logical; 
     uint16_t                xlate_table[DOSFS_SFLASH_XLATE_COUNT];
-    uint16_t                xlate2_logical; 
     uint16_t                xlate2_table[DOSFS_SFLASH_XLATE_COUNT];
+    uint16_t                xlate_logical[DOSFS_SFLASH_XLATE_CACHE_ENTRIES];
+    uint8_t                 xlate_order[DOSFS_SFLASH_XLATE_CACHE_ENTRIES];
 
     uint16_t                alloc_sector;
     uint8_t                 alloc_index;
@@ -132,9 +170,21 @@ struct _dosfs_sflash_t {
     uint32_t                alloc_free;
     uint32_t                alloc_mask[DOSFS_SFLASH_BLOCK_INFO_ENTRIES / 32];
 
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD)
+    uint8_t                 alloc_frontier;
+    uint8_t                 frontier_index;
+    uint8_t                 frontier_count;
+    uint16_t                frontier_sector;
+    uint32_t                frontier_mask[DOSFS_SFLASH_BLOCK_INFO_ENTRIES / 32];
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
+
     uint16_t                victim_sector;
     uint8_t                 victim_delta[DOSFS_SFLASH_DATA_SIZE / DOSFS_SFLASH_ERASE_SIZE];
     uint8_t                 victim_score[DOSFS_SFLASH_DATA_SIZE / DOSFS_SFLASH_ERASE_SIZE];
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT)
+    uint16_t                victim_clock;
+    uint16_t                victim_stamp[DOSFS_SFLASH_DATA_SIZE / DOSFS_SFLASH_ERASE_SIZE];
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT) */
 
     uint32_t                reclaim_offset;
     uint32_t                reclaim_erase_count;
@@ -142,6 +192,7 @@ struct _dosfs_sflash_t {
     uint32_t                erase_count_max;
 
     uint32_t                *cache[2];
+    uint16_t                *xlate_cache[DOSFS_SFLASH_XLATE_CACHE_ENTRIES];
 
 #if (DOSFS_CONFIG_SFLASH_SIMULATE == 1)
     uint8_t                 *image;
@@ -165,6 +216,16 @@ struct _dosfs_sflash_t {
 	uint32_t                sflash_ftl_xlate_hit;
 	uint32_t                sflash_ftl_xlate2_miss;
 	uint32_t                sflash_ftl_xlate2_hit;
+	uint32_t                sflash_ftl_xlate_segment_miss[DOSFS_SFLASH_XLATE_COUNT];
+	uint32_t                sflash_ftl_xlate_segment_hit[DOSFS_SFLASH_XLATE_COUNT];
+	uint32_t                sflash_ftl_reclaim;
+	uint32_t                sflash_ftl_reclaim_copy;
+	uint32_t                sflash_ftl_reclaim_free;
+	uint32_t                sflash_ftl_reclaim_static;
+	uint32_t                sflash_ftl_write_hot;
+#if (DOSFS_CONFIG_SFLASH_SIMULATE == 1)
+	uint32_t                sflash_nor_erase_sector[DOSFS_SFLASH_DATA_SIZE / DOSFS_SFLASH_ERASE_SIZE];
+#endif /* (DOSFS_CONFIG_SFLASH_SIMULATE == 1) */
     }                       statistics;
 #endif /* (DOSFS_CONFIG_STATISTICS == 1) */
 
@@ -174,7 +235,9 @@ struct _dosfs_sflash_t {
     uint32_t                command_erase;
     uint32_t                command_program;
     uint32_t                command_read;
+#if (DOSFS_CONFIG_SFLASH_SIMULATE == 0)
     stm32l4_qspi_t          qspi;
+#endif /* (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
 };
 
 /* RESERVED -> XLATE_SECONDARY -> XLATE -> DELETED
@@ -219,6 +282,10 @@ struct _dosfs_sflash_t {
 
 #endif /* (DOSFS_CONFIG_STATISTICS == 1) */
 
+extern dosfs_sflash_t dosfs_sflash;
+
+extern int dosfs_sflash_init(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,9 @@
 
 #include "stm32l4xx.h"
 
+#include "stm32l4_dma.h"
+#include "stm32l4_timer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -69,6 +72,25 @@ enum {
 #define ADC_CHANNEL_ADC2_DAC1                    17
 #define ADC_CHANNEL_ADC2_DAC2                    18
 
+#define ADC_OPTION_OVERSAMPLE_RATIO_MASK         0x0000000f
+#define ADC_OPTION_OVERSAMPLE_RATIO_SHIFT        0
+#define ADC_OPTION_OVERSAMPLE_RATIO_1            0x00000000
+#define ADC_OPTION_OVERSAMPLE_RATIO_2            0x00000001
+#define ADC_OPTION_OVERSAMPLE_RATIO_4            0x00000002
+#define ADC_OPTION_OVERSAMPLE_RATIO_8            0x00000003
+#define ADC_OPTION_OVERSAMPLE_RATIO_16           0x00000004
+#define ADC_OPTION_OVERSAMPLE_RATIO_32           0x00000005
+#define ADC_OPTION_OVERSAMPLE_RATIO_64           0x00000006
+#define ADC_OPTION_OVERSAMPLE_RATIO_128          0x00000007
+#define ADC_OPTION_OVERSAMPLE_RATIO_256          0x00000008
+#define ADC_OPTION_OVERSAMPLE_SHIFT_MASK         0x000000f0
+#define ADC_OPTION_OVERSAMPLE_SHIFT_SHIFT        4
+#define ADC_OPTION_OVERSAMPLE_SHIFT(_n)          (((_n) << ADC_OPTION_OVERSAMPLE_SHIFT_SHIFT) & ADC_OPTION_OVERSAMPLE_SHIFT_MASK)
+
+#define ADC_EVENT_TRANSFER_DONE                  0x00000001
+#define ADC_EVENT_TRANSFER_HALF                  0x00000002
+#define ADC_EVENT_TRANSFER_ERROR                 0x00000004
+
 typedef void (*stm32l4_adc_callback_t)(void *context, uint32_t events);
 
 #define ADC_VREFINT_PERIOD                       4
@@ -79,6 +101,7 @@ typedef void (*stm32l4_adc_callback_t)(void *context, uint32_t events);
 #define ADC_STATE_INIT                         1
 #define ADC_STATE_BUSY                         2
 #define ADC_STATE_READY                        3
+#define ADC_STATE_ACTIVE                       4
 
 typedef struct _stm32l4_adc_t {
     ADC_TypeDef                 *ADCx;
@@ -88,6 +111,8 @@ typedef struct _stm32l4_adc_t {
     stm32l4_adc_callback_t      callback;
     void                        *context;
     uint32_t                    events;
+    uint32_t                    channels;
+    stm32l4_dma_t               dma;
 } stm32l4_adc_t;
 
 extern bool     stm32l4_adc_create(stm32l4_adc_t *adc, unsigned int instance, unsigned int priority, unsigned int mode);
@@ -98,6 +123,8 @@ extern bool     stm32l4_adc_configure(stm32l4_adc_t *adc, uint32_t option);
 extern bool     stm32l4_adc_calibrate(stm32l4_adc_t *adc);
 extern bool     stm32l4_adc_notify(stm32l4_adc_t *adc, stm32l4_adc_callback_t callback, void *context, uint32_t events);
 extern uint32_t stm32l4_adc_convert(stm32l4_adc_t *adc, unsigned int channel, unsigned int period);
+extern bool     stm32l4_adc_start(stm32l4_adc_t *adc, const uint8_t *channels, unsigned int count, unsigned int period, stm32l4_timer_t *timer, uint16_t *data, uint32_t size, uint32_t option);
+extern bool     stm32l4_adc_stop(stm32l4_adc_t *adc);
 
 #ifdef __cplusplus
 }
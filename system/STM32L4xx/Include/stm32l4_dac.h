@@ -34,6 +34,9 @@
 
 #include "stm32l4xx.h"
 
+#include "stm32l4_dma.h"
+#include "stm32l4_timer.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -51,6 +54,11 @@ enum {
 #define DAC_CONTROL_EXTERNAL                     0x00000002
 #define DAC_CONTROL_CALIBRATE                    0x00000004
 
+#define DAC_EVENT_CHANNEL_1_DONE                 0x00000001
+#define DAC_EVENT_CHANNEL_1_HALF                 0x00000002
+#define DAC_EVENT_CHANNEL_2_DONE                 0x00000004
+#define DAC_EVENT_CHANNEL_2_HALF                 0x00000008
+
 typedef void (*stm32l4_dac_callback_t)(void *context, uint32_t events);
 
 #define DAC_STATE_NONE                         0
@@ -66,6 +74,8 @@ typedef struct _stm32l4_dac_t {
     stm32l4_dac_callback_t      callback;
     void                        *context;
     uint32_t                    events;
+    volatile uint32_t           channels;
+    stm32l4_dma_t               dma[2];
 } stm32l4_dac_t;
 
 extern bool     stm32l4_dac_create(stm32l4_dac_t *dac, unsigned int instance, unsigned int priority, unsigned int mode);
@@ -77,6 +87,8 @@ extern bool     stm32l4_dac_configure(stm32l4_dac_t *dac, uint32_t option);
 extern bool     stm32l4_dac_notify(stm32l4_dac_t *dac, stm32l4_dac_callback_t callback, void *context, uint32_t events);
 extern bool     stm32l4_dac_channel(stm32l4_dac_t *dac, unsigned int channel, uint32_t output, uint32_t control);
 extern bool     stm32l4_dac_convert(stm32l4_dac_t *dac, unsigned int channel, uint32_t output);
+extern bool     stm32l4_dac_start(stm32l4_dac_t *dac, unsigned int channel, stm32l4_timer_t *timer, const uint16_t *data, uint32_t count);
+extern bool     stm32l4_dac_stop(stm32l4_dac_t *dac, unsigned int channel);
 
 #ifdef __cplusplus
 }
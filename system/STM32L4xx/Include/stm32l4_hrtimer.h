@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2016-2017 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#if !defined(_STM32L4_HRTIMER_H)
+#define _STM32L4_HRTIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "stm32l4xx.h"
+
+#include "stm32l4_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* High resolution software timers, multiplexed over the compare channels of
+ * a free running 32 bit timer (TIM2 or TIM5) counting in microseconds.
+ *
+ * stm32l4_hrtimer_start() and stm32l4_hrtimer_stop() can be called from any
+ * interrupt level. The callback is called from the timer's interrupt.
+ * A timeout is limited to 0x7fffffff microseconds.
+ *
+ * stm32l4_hrtimer_initialize() fails if the timer instance is already in
+ * use, e.g. TIM2 by analogWrite() on a variant that routes PWM pins to it.
+ */
+
+#define HRTIMER_CLOCK                            1000000
+
+typedef struct _stm32l4_hrtimer_t stm32l4_hrtimer_t;
+
+typedef void (*stm32l4_hrtimer_callback_t)(stm32l4_hrtimer_t *hrtimer);
+
+struct _stm32l4_hrtimer_t {
+    stm32l4_hrtimer_t                 *next;
+    stm32l4_hrtimer_t                 *previous;
+    stm32l4_hrtimer_callback_t        callback;
+    uint32_t                          deadline;
+    uint8_t                           channel;
+};
+
+#define STM32L4_HRTIMER_INIT(_callback) { NULL, NULL, (_callback), 0, 0xff }
+
+extern bool     stm32l4_hrtimer_initialize(unsigned int instance, unsigned int priority);
+extern uint32_t stm32l4_hrtimer_count(void);
+extern void     stm32l4_hrtimer_create(stm32l4_hrtimer_t *hrtimer, stm32l4_hrtimer_callback_t callback);
+extern bool     stm32l4_hrtimer_start(stm32l4_hrtimer_t *hrtimer, uint32_t timeout, bool offset);
+extern bool     stm32l4_hrtimer_stop(stm32l4_hrtimer_t *hrtimer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STM32L4_HRTIMER_H */
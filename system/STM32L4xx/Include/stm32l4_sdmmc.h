@@ -36,6 +36,7 @@
 #include "dosfs_device.h"
 
 #include "stm32l4_gpio.h"
+#include "stm32l4_dma.h"
 
 #ifdef __cplusplus
  extern "C" {
@@ -59,11 +60,38 @@ typedef struct _stm32l4_sdmmc_t stm32l4_sdmmc_t;
 #define STM32L4_SDMMC_MODE_DATA_TRANSFER_WIDE      3
 #define STM32L4_SDMMC_MODE_DATA_TRANSFER_WIDE_HS   4
 
+#define STM32L4_SDMMC_DMA_RECEIVE                  0x01
+#define STM32L4_SDMMC_DMA_TRANSMIT                 0x02
+#define STM32L4_SDMMC_DMA_AHEAD                    0x40
+#define STM32L4_SDMMC_DMA_BUSY                     0x80
+
+/* Read-ahead into a ring of 512 byte buffers needs the RX DMA to run in the background.
+ * The ring is filled one half at a time, so the number of entries is rounded down to
+ * an even number.
+ */
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+#define STM32L4_SDMMC_READ_AHEAD_ENTRIES           (DOSFS_CONFIG_SDCARD_READ_AHEAD_ENTRIES & ~1)
+#else /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+#define STM32L4_SDMMC_READ_AHEAD_ENTRIES           0
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+
+#define STM32L4_SDMMC_READ_AHEAD_HALF              (STM32L4_SDMMC_READ_AHEAD_ENTRIES / 2)
+
 struct _stm32l4_sdmmc_t {
     uint8_t                 state;
     uint8_t                 media;
     uint8_t                 option;
     uint8_t                 shift;
+    uint8_t                 priority;
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+    volatile uint8_t        dma;
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+    uint8_t                 ahead_index;
+    uint8_t                 ahead_fill;
+    volatile uint8_t        ahead_head;
+    volatile uint8_t        ahead_tail;
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
     uint32_t                speed;
     uint32_t                au_size;
     uint32_t                erase_size;
@@ -80,6 +108,10 @@ struct _stm32l4_sdmmc_t {
     uint8_t                 CSD[16];
     uint8_t                 SCR[8];
     uint8_t                 SSR[64];
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+    stm32l4_dma_t           rx_dma;
+    stm32l4_dma_t           tx_dma;
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
 
 #if (DOSFS_CONFIG_STATISTICS == 1)
     struct {
@@ -110,13 +142,23 @@ struct _stm32l4_sdmmc_t {
         uint32_t                sdcard_read_stop;
         uint32_t                sdcard_write_stop;
         uint32_t                sdcard_write_sync;
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+        uint32_t                sdcard_dma_receive;
+        uint32_t                sdcard_dma_transmit;
+        uint32_t                sdcard_dma_fallback;
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+        uint32_t                sdcard_read_ahead;
+        uint32_t                sdcard_read_ahead_hit;
+        uint32_t                sdcard_read_ahead_discard;
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
         uint32_t                sdcard_command_crcfail_2[64];
         uint32_t                sdcard_command_timeout_2[64];
     }                       statistics;
 #endif /* (DOSFS_CONFIG_STATISTICS == 1) */
 };
 
-extern int stm32l4_sdmmc_initialize(uint32_t option);
+extern int stm32l4_sdmmc_initialize(unsigned int priority, uint32_t option);
 
 #if (DOSFS_CONFIG_STATISTICS == 1)
 
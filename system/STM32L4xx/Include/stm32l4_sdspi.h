@@ -63,6 +63,11 @@ typedef struct _stm32l4_sdspi_pins_t {
 #define STM32L4_SDSPI_MODE_IDENTIFY                1
 #define STM32L4_SDSPI_MODE_DATA_TRANSFER           2
 
+#define STM32L4_SDSPI_DMA_NONE                     0
+#define STM32L4_SDSPI_DMA_READY                    1
+#define STM32L4_SDSPI_DMA_BUSY                     2
+#define STM32L4_SDSPI_DMA_ERROR                    3
+
 struct _stm32l4_sdspi_t {
     uint8_t                 state;
     uint8_t                 media;
@@ -83,10 +88,18 @@ struct _stm32l4_sdspi_t {
     uint8_t                 SSR[64];
     uint8_t                 response[5]; 
     uint8_t                 instance;
+    uint8_t                 priority;
     stm32l4_sdspi_pins_t    pins;
     SPI_TypeDef             *SPI;
     uint32_t                cr1;
     uint32_t                cr2;
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+    volatile uint8_t        dma;
+    uint16_t                tx_default;
+    uint16_t                rx_null;
+    stm32l4_dma_t           rx_dma;
+    stm32l4_dma_t           tx_dma;
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
 
 #if (DOSFS_CONFIG_STATISTICS == 1)
     struct {
@@ -120,6 +133,12 @@ struct _stm32l4_sdspi_t {
         uint32_t                sdcard_write_sync_fail;
         uint32_t                sdcard_select;
         uint32_t                sdcard_deselect;
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+        uint32_t                sdcard_dma_receive;
+        uint32_t                sdcard_dma_transmit;
+        uint32_t                sdcard_dma_fallback;
+        uint32_t                sdcard_dma_error;
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
         uint32_t                sdcard_command_crcfail_2[64];
         uint32_t                sdcard_command_timeout_2[64];
         uint32_t                sdcard_command_fail_2[64];
@@ -127,7 +146,7 @@ struct _stm32l4_sdspi_t {
 #endif /* (DOSFS_CONFIG_STATISTICS == 1) */
 };
 
-extern int stm32l4_sdspi_initialize(void);
+extern int stm32l4_sdspi_initialize(unsigned int priority);
 
 #if (DOSFS_CONFIG_STATISTICS == 1)
 
@@ -58,6 +58,7 @@ enum {
 #define UART_MODE_RX_DMA             0x00000002
 #define UART_MODE_TX_DMA_SECONDARY   0x00000004
 #define UART_MODE_RX_DMA_SECONDARY   0x00000008
+#define UART_MODE_RX_DMA_DIRECT      0x00000010
 
 #define UART_OPTION_STOP_MASK        0x0000000f
 #define UART_OPTION_STOP_SHIFT       0
@@ -134,6 +135,7 @@ typedef struct _stm32l4_uart_t {
     uint16_t                   rx_write;
     uint16_t                   rx_index;
     uint16_t                   rx_event;
+    volatile uint16_t          rx_sync;
     volatile uint32_t          rx_count;
     stm32l4_dma_t              tx_dma;
     stm32l4_dma_t              rx_dma;
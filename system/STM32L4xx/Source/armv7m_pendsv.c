@@ -42,6 +42,13 @@ typedef struct _armv7m_pendsv_control_t {
     volatile armv7m_pendsv_entry_t   *pendsv_read;
     volatile armv7m_pendsv_entry_t   *pendsv_write;
     armv7m_pendsv_entry_t            pendsv_data[ARMV7M_PENDSV_ENTRY_COUNT];
+    volatile uint32_t                work_allocated[ARMV7M_PENDSV_PRIORITY_COUNT];
+    volatile uint32_t                work_pending[ARMV7M_PENDSV_PRIORITY_COUNT];
+    armv7m_pendsv_work_t             *work_data[ARMV7M_PENDSV_PRIORITY_COUNT][ARMV7M_PENDSV_WORK_COUNT];
+    volatile uint32_t                queue_high_water;
+    volatile uint32_t                queue_drops;
+    volatile uint32_t                work_posts;
+    volatile uint32_t                work_coalesced;
 } armv7m_pendsv_control_t;
 
 static armv7m_pendsv_control_t armv7m_pendsv_control;
@@ -49,6 +56,7 @@ static armv7m_pendsv_control_t armv7m_pendsv_control;
 volatile armv7m_pendsv_routine_t * armv7m_pendsv_enqueue(armv7m_pendsv_routine_t routine, void *context, uint32_t data)
 {
     volatile armv7m_pendsv_entry_t *pendsv_write, *pendsv_write_next;
+    uint32_t count;
 
     do
     {
@@ -62,11 +70,22 @@ volatile armv7m_pendsv_routine_t * armv7m_pendsv_enqueue(armv7m_pendsv_routine_t
 
 	if (pendsv_write_next == armv7m_pendsv_control.pendsv_read)
 	{
+	    armv7m_atomic_add(&armv7m_pendsv_control.queue_drops, 1);
+
 	    return NULL;
 	}
     }
     while (!armv7m_atomic_compare_exchange((volatile uint32_t*)&armv7m_pendsv_control.pendsv_write, (uint32_t*)&pendsv_write, (uint32_t)pendsv_write_next));
 
+    /* The high water mark is only a statistic, so a lost update due to a race is harmless.
+     */
+    count = (pendsv_write_next - armv7m_pendsv_control.pendsv_read) & (ARMV7M_PENDSV_ENTRY_COUNT -1);
+
+    if (armv7m_pendsv_control.queue_high_water < count)
+    {
+	armv7m_pendsv_control.queue_high_water = count;
+    }
+
     pendsv_write->routine = routine;
     pendsv_write->context = context;
     pendsv_write->data = data;
@@ -76,6 +95,100 @@ volatile armv7m_pendsv_routine_t * armv7m_pendsv_enqueue(armv7m_pendsv_routine_t
     return &pendsv_write->routine;
 }
 
+bool armv7m_pendsv_work_create(armv7m_pendsv_work_t *work, armv7m_pendsv_routine_t routine, void *context, unsigned int priority)
+{
+    uint32_t allocated;
+    unsigned int index;
+
+    if (priority >= ARMV7M_PENDSV_PRIORITY_COUNT)
+    {
+	return false;
+    }
+
+    allocated = armv7m_pendsv_control.work_allocated[priority];
+
+    do
+    {
+	if (allocated == 0xffffffff)
+	{
+	    return false;
+	}
+
+	index = __builtin_ctz(~allocated);
+    }
+    while (!armv7m_atomic_compare_exchange(&armv7m_pendsv_control.work_allocated[priority], &allocated, (allocated | (1ul << index))));
+
+    work->routine = routine;
+    work->context = context;
+    work->data = 0;
+    work->priority = priority;
+    work->index = index;
+
+    armv7m_pendsv_control.work_data[priority][index] = work;
+
+    return true;
+}
+
+/* Returns false if the post was coalesced with a still pending one.
+ */
+bool armv7m_pendsv_work_post(armv7m_pendsv_work_t *work, uint32_t data)
+{
+    uint32_t mask;
+
+    mask = (1ul << work->index);
+
+    work->data = data;
+
+    if (armv7m_atomic_or(&armv7m_pendsv_control.work_pending[work->priority], mask) & mask)
+    {
+	armv7m_atomic_add(&armv7m_pendsv_control.work_coalesced, 1);
+
+	return false;
+    }
+
+    armv7m_atomic_add(&armv7m_pendsv_control.work_posts, 1);
+
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+
+    return true;
+}
+
+void armv7m_pendsv_statistics(armv7m_pendsv_statistics_t *p_statistics_return)
+{
+    p_statistics_return->queue_high_water = armv7m_pendsv_control.queue_high_water;
+    p_statistics_return->queue_drops = armv7m_pendsv_control.queue_drops;
+    p_statistics_return->work_posts = armv7m_pendsv_control.work_posts;
+    p_statistics_return->work_coalesced = armv7m_pendsv_control.work_coalesced;
+}
+
+static bool armv7m_pendsv_work(unsigned int priority)
+{
+    armv7m_pendsv_work_t *work;
+    uint32_t pending;
+    unsigned int index;
+
+    pending = armv7m_pendsv_control.work_pending[priority];
+
+    if (!pending)
+    {
+	return false;
+    }
+
+    index = __builtin_ctz(pending);
+
+    armv7m_atomic_and(&armv7m_pendsv_control.work_pending[priority], ~(1ul << index));
+
+    work = armv7m_pendsv_control.work_data[priority][index];
+
+    (*work->routine)(work->context, work->data);
+
+    return true;
+}
+
+/* Run one routine at a time, always picking the highest priority class
+ * that has something pending. The armv7m_pendsv_enqueue() FIFO sits in
+ * between the NORMAL and LOW work items.
+ */
 static __attribute__((used)) void armv7m_pendsv_dequeue(void)
 {
     volatile armv7m_pendsv_entry_t *pendsv_read;
@@ -83,25 +196,39 @@ static __attribute__((used)) void armv7m_pendsv_dequeue(void)
     void *context;
     uint32_t data;
 
-    pendsv_read = armv7m_pendsv_control.pendsv_read;
-
-    while (pendsv_read != armv7m_pendsv_control.pendsv_write)
+    while (1)
     {
+	if (armv7m_pendsv_work(ARMV7M_PENDSV_PRIORITY_HIGH) || armv7m_pendsv_work(ARMV7M_PENDSV_PRIORITY_NORMAL))
+	{
+	    continue;
+	}
 
-	routine = pendsv_read->routine;
-	context = pendsv_read->context;
-	data = pendsv_read->data;
-
-	pendsv_read = pendsv_read + 1;
+	pendsv_read = armv7m_pendsv_control.pendsv_read;
 
-	if (pendsv_read == &armv7m_pendsv_control.pendsv_data[ARMV7M_PENDSV_ENTRY_COUNT])
+	if (pendsv_read != armv7m_pendsv_control.pendsv_write)
 	{
-	    pendsv_read = &armv7m_pendsv_control.pendsv_data[0];
-	}
+	    routine = pendsv_read->routine;
+	    context = pendsv_read->context;
+	    data = pendsv_read->data;
+
+	    pendsv_read = pendsv_read + 1;
+
+	    if (pendsv_read == &armv7m_pendsv_control.pendsv_data[ARMV7M_PENDSV_ENTRY_COUNT])
+	    {
+		pendsv_read = &armv7m_pendsv_control.pendsv_data[0];
+	    }
+
+	    armv7m_pendsv_control.pendsv_read = pendsv_read;
 
-	armv7m_pendsv_control.pendsv_read = pendsv_read;
+	    (*routine)(context, data);
 
-	(*routine)(context, data);
+	    continue;
+	}
+
+	if (!armv7m_pendsv_work(ARMV7M_PENDSV_PRIORITY_LOW))
+	{
+	    break;
+	}
     }
 }
 
@@ -63,10 +63,16 @@ void __attribute__((naked)) SVC_Handler(void)
 
 #else /* __ORCHID__ */
 
+/* The caller's exception frame is on the PSP if it was a startLoop() task,
+ * and on the MSP otherwise (EXC_RETURN bit 2).
+ */
 void __attribute__((naked)) SVC_Handler(void)
 {
     __asm__(
-        "mov     r2, sp                              \n"
+        "tst     lr, #4                              \n"
+        "ite     eq                                  \n"
+        "moveq   r2, sp                              \n"
+        "mrsne   r2, PSP                             \n"
         "push    { r2, lr }                          \n"
         "ldmia   r2, { r0, r1, r2, r3, r12 }         \n"
         "blx     r12                                 \n"
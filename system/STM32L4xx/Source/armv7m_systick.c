@@ -41,8 +41,10 @@ typedef struct _armv7m_systick_control_t {
     uint32_t                  frac;
     uint32_t                  accum;
     uint32_t                  scale;
+    uint32_t                  residual;
     armv7m_systick_callback_t callback;
     void                      *context;
+    armv7m_pendsv_work_t      work;
 } armv7m_systick_control_t;
 
 static armv7m_systick_control_t armv7m_systick_control;
@@ -82,6 +84,18 @@ void armv7m_systick_delay(uint32_t delay)
     while ((armv7m_systick_control.millis - millis) < delay);
 }
 
+static void armv7m_systick_heartbeat(void *context, uint32_t data)
+{
+    armv7m_systick_callback_t callback;
+
+    callback = armv7m_systick_control.callback;
+
+    if (callback)
+    {
+	(*callback)(armv7m_systick_control.context, data);
+    }
+}
+
 void armv7m_systick_notify(armv7m_systick_callback_t callback, void *context)
 {
     armv7m_systick_control.callback = NULL;
@@ -89,10 +103,40 @@ void armv7m_systick_notify(armv7m_systick_callback_t callback, void *context)
     armv7m_systick_control.callback = callback;
 }
 
+/* Account for time spent with SYSTICK disabled (i.e. in STOP mode), as
+ * measured by a low power timebase. Sub-millisecond portions are carried
+ * over so that millis() does not drift against micros(). The time is 64 bit,
+ * as a STOP without timeout can last for hours.
+ */
+void armv7m_systick_advance(uint64_t micros)
+{
+    uint64_t millis;
+
+    armv7m_systick_control.micros += micros;
+
+    micros += armv7m_systick_control.residual;
+
+    millis = micros / 1000;
+
+    armv7m_systick_control.residual = (uint32_t)(micros - (millis * 1000));
+
+    if (millis)
+    {
+	armv7m_systick_control.millis += millis;
+
+	if (armv7m_systick_control.callback) 
+	{
+	    armv7m_pendsv_work_post(&armv7m_systick_control.work, (uint32_t)armv7m_systick_control.millis);
+	}
+    }
+}
+
 void armv7m_systick_initialize(unsigned int priority)
 {
     NVIC_SetPriority(SysTick_IRQn, priority);
 
+    armv7m_pendsv_work_create(&armv7m_systick_control.work, armv7m_systick_heartbeat, NULL, ARMV7M_PENDSV_PRIORITY_HIGH);
+
     SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk;
 }
 
@@ -157,8 +201,11 @@ void SysTick_Handler(void)
 	}
     }
 
+    /* The heartbeat is a coalescing work item, so it cannot be dropped
+     * when the PendSV queue is full; the callback catches up from "millis".
+     */
     if (armv7m_systick_control.callback) 
     {
-	armv7m_pendsv_enqueue((armv7m_pendsv_routine_t)armv7m_systick_control.callback, armv7m_systick_control.context, (uint32_t)armv7m_systick_control.millis);
+	armv7m_pendsv_work_post(&armv7m_systick_control.work, (uint32_t)armv7m_systick_control.millis);
     }
 }
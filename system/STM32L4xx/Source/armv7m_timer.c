@@ -32,52 +32,148 @@
 
 #include "stm32l476xx.h"
 
-typedef struct _armv7m_timer_control_t {
+/* Timers are kept in a hierarchical timing wheel. Each level has 32 slots,
+ * where a slot on level N covers 32^N milliseconds. A timer is filed by its
+ * absolute expiry time into the lowest level that can hold it, and moved
+ * down a level ("cascaded") when the wheel below wraps around. Start and
+ * stop are O(1). A per level bitmap of non-empty slots allows skipping
+ * ticks where nothing happens, so catching up after a long ISR costs time
+ * proportional to the number of timers rather than the elapsed ticks.
+ *
+ * Timeouts beyond the range of the wheel are parked in the top level and
+ * refiled each time they get cascaded.
+ *
+ * The wheel belongs to the PendSV/SVCall level. A start or stop from an
+ * interrupt handler gets recorded in the timer itself, and the timer is
+ * put on a request list that a PendSV work item drains. A timer is on
+ * that list at most once, and a later request overrides an earlier one,
+ * so a request can never be lost for lack of queue space.
+ */
+
+#define ARMV7M_TIMER_WHEEL_LEVELS 4
+#define ARMV7M_TIMER_WHEEL_SHIFT  5
+#define ARMV7M_TIMER_WHEEL_SIZE   (1ul << ARMV7M_TIMER_WHEEL_SHIFT)
+#define ARMV7M_TIMER_WHEEL_MASK   (ARMV7M_TIMER_WHEEL_SIZE -1)
+#define ARMV7M_TIMER_WHEEL_RANGE  (1ul << (ARMV7M_TIMER_WHEEL_LEVELS * ARMV7M_TIMER_WHEEL_SHIFT))
+
+#define ARMV7M_TIMER_REQUEST_START  0x00000001
+#define ARMV7M_TIMER_REQUEST_STOP   0x00000002
+#define ARMV7M_TIMER_REQUEST_QUEUED 0x00000004
+
+typedef struct _armv7m_timer_slot_t {
     struct _armv7m_timer_t *next;
     struct _armv7m_timer_t *previous;
+} armv7m_timer_slot_t;
+
+typedef struct _armv7m_timer_control_t {
     uint32_t               millis;
+    uint32_t               pending[ARMV7M_TIMER_WHEEL_LEVELS];
+    armv7m_timer_slot_t    slot[ARMV7M_TIMER_WHEEL_LEVELS][ARMV7M_TIMER_WHEEL_SIZE];
+    armv7m_timer_t         *request;
+    armv7m_pendsv_work_t   work;
 } armv7m_timer_control_t;
 
 static armv7m_timer_control_t armv7m_timer_control;
 
-static void armv7m_timer_insert(void *context, uint32_t data)
+static void armv7m_timer_link(armv7m_timer_t *timer)
 {
-    armv7m_timer_t *timer, *element;
-    uint32_t remaining;
+    armv7m_timer_slot_t *slot;
+    uint32_t timeout, delta, level, index;
 
-    timer = (armv7m_timer_t*)context;
+    timeout = timer->timeout;
+    delta = timeout - armv7m_timer_control.millis;
 
-    if (timer->next)
+    if (delta >= ARMV7M_TIMER_WHEEL_RANGE)
     {
-	timer->next->previous = timer->previous;
-	timer->previous->next = timer->next;
-    
-	timer->next = NULL;
-	timer->previous = NULL;
+	timeout = armv7m_timer_control.millis + (ARMV7M_TIMER_WHEEL_RANGE -1);
+	delta = ARMV7M_TIMER_WHEEL_RANGE -1;
     }
 
-    remaining = data;
-    element = armv7m_timer_control.next;
-
-    while (element != (armv7m_timer_t*)&armv7m_timer_control)
+    for (level = 0; level < (ARMV7M_TIMER_WHEEL_LEVELS -1); level++)
     {
-	if (remaining < element->remaining)
+	if (delta < (ARMV7M_TIMER_WHEEL_SIZE << (level * ARMV7M_TIMER_WHEEL_SHIFT)))
 	{
-	    element->remaining -= remaining;
 	    break;
 	}
-	
-	remaining -= element->remaining;
-	element = element->next;
     }
 
-    timer->previous = element->previous;
-    timer->next = element;
+    index = (timeout >> (level * ARMV7M_TIMER_WHEEL_SHIFT)) & ARMV7M_TIMER_WHEEL_MASK;
+
+    slot = &armv7m_timer_control.slot[level][index];
+
+    timer->previous = slot->previous;
+    timer->next = (armv7m_timer_t*)slot;
 
     timer->previous->next = timer;
     timer->next->previous = timer;
+
+    armv7m_timer_control.pending[level] |= (1ul << index);
+}
+
+static void armv7m_timer_unlink(armv7m_timer_t *timer)
+{
+    armv7m_timer_t *next, *previous;
+    uint32_t index;
+
+    next = timer->next;
+    previous = timer->previous;
+
+    next->previous = previous;
+    previous->next = next;
     
-    timer->remaining = remaining;
+    timer->next = NULL;
+    timer->previous = NULL;
+
+    /* If only the list head is left, and it's a wheel slot, mark the slot as empty.
+     */
+    if ((next == previous) &&
+	((armv7m_timer_slot_t*)next >= &armv7m_timer_control.slot[0][0]) &&
+	((armv7m_timer_slot_t*)next < (&armv7m_timer_control.slot[0][0] + (ARMV7M_TIMER_WHEEL_LEVELS * ARMV7M_TIMER_WHEEL_SIZE))))
+    {
+	index = (armv7m_timer_slot_t*)next - &armv7m_timer_control.slot[0][0];
+
+	armv7m_timer_control.pending[index >> ARMV7M_TIMER_WHEEL_SHIFT] &= ~(1ul << (index & ARMV7M_TIMER_WHEEL_MASK));
+    }
+}
+
+/* Move all timers of a slot onto a separate list headed by "list".
+ */
+static void armv7m_timer_detach(unsigned int level, unsigned int index, armv7m_timer_slot_t *list)
+{
+    armv7m_timer_slot_t *slot;
+
+    slot = &armv7m_timer_control.slot[level][index];
+
+    list->next = slot->next;
+    list->previous = slot->previous;
+
+    list->next->previous = (armv7m_timer_t*)list;
+    list->previous->next = (armv7m_timer_t*)list;
+
+    slot->next = (armv7m_timer_t*)slot;
+    slot->previous = (armv7m_timer_t*)slot;
+
+    armv7m_timer_control.pending[level] &= ~(1ul << index);
+}
+
+static void armv7m_timer_insert(void *context, uint32_t data)
+{
+    armv7m_timer_t *timer;
+
+    timer = (armv7m_timer_t*)context;
+
+    if (timer->next)
+    {
+	armv7m_timer_unlink(timer);
+    }
+
+    timer->timeout = armv7m_timer_control.millis + (data ? data : 1);
+
+    armv7m_timer_link(timer);
+
+    /* A stop from an interrupt handler may have cleared bit 0 in the meantime.
+     */
+    armv7m_atomic_or((volatile uint32_t *)&timer->callback, 1);
 }
 
 static void armv7m_timer_remove(void *context, uint32_t data)
@@ -88,120 +184,321 @@ static void armv7m_timer_remove(void *context, uint32_t data)
 
     if (timer->next)
     {
-	timer->next->previous = timer->previous;
-	timer->previous->next = timer->next;
-    
-	timer->next = NULL;
-	timer->previous = NULL;
+	armv7m_timer_unlink(timer);
     }
 
     armv7m_atomic_or((volatile uint32_t *)&timer->callback, 1);
 }
 
+/* Record a start/stop request from an interrupt handler. The last
+ * request before the work item runs is the one that counts.
+ */
+static void armv7m_timer_request(armv7m_timer_t *timer, uint32_t request, uint32_t timeout)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    timer->request_timeout = timeout;
+
+    if (!(timer->request & ARMV7M_TIMER_REQUEST_QUEUED))
+    {
+	timer->request_next = armv7m_timer_control.request;
+
+	armv7m_timer_control.request = timer;
+    }
+
+    timer->request = (request | ARMV7M_TIMER_REQUEST_QUEUED);
+
+    __set_PRIMASK(primask);
+
+    armv7m_pendsv_work_post(&armv7m_timer_control.work, 0);
+}
+
+/* A direct start/stop supersedes a queued request. The timer stays on the
+ * request list, but gets skipped there.
+ */
+static void armv7m_timer_direct_start(void *context, uint32_t data)
+{
+    armv7m_timer_t *timer;
+
+    timer = (armv7m_timer_t*)context;
+
+    if (timer->request)
+    {
+	armv7m_atomic_and(&timer->request, ARMV7M_TIMER_REQUEST_QUEUED);
+    }
+
+    armv7m_timer_insert(context, data);
+}
+
+static void armv7m_timer_direct_stop(void *context, uint32_t data)
+{
+    armv7m_timer_t *timer;
+
+    timer = (armv7m_timer_t*)context;
+
+    if (timer->request)
+    {
+	armv7m_atomic_and(&timer->request, ARMV7M_TIMER_REQUEST_QUEUED);
+    }
+
+    armv7m_timer_remove(context, 0);
+}
+
+static void armv7m_timer_process(void *context, uint32_t data)
+{
+    armv7m_timer_t *timer, *timer_next;
+    uint32_t primask, request, timeout;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    timer_next = armv7m_timer_control.request;
+
+    armv7m_timer_control.request = NULL;
+
+    __set_PRIMASK(primask);
+
+    while (timer_next)
+    {
+	timer = timer_next;
+
+	__disable_irq();
+
+	timer_next = timer->request_next;
+
+	request = timer->request;
+	timeout = timer->request_timeout;
+
+	timer->request_next = NULL;
+	timer->request = 0;
+
+	__set_PRIMASK(primask);
+
+	if (request & ARMV7M_TIMER_REQUEST_START)
+	{
+	    armv7m_timer_insert((void*)timer, timeout);
+	}
+
+	if (request & ARMV7M_TIMER_REQUEST_STOP)
+	{
+	    armv7m_timer_remove((void*)timer, 0);
+	}
+    }
+}
+
 void armv7m_timer_create(armv7m_timer_t *timer, armv7m_timer_callback_t callback)
 {
     timer->next = NULL;
     timer->previous = NULL;
     timer->callback = callback;
-    timer->remaining = 0;
+    timer->timeout = 0;
+    timer->request_next = NULL;
+    timer->request = 0;
+    timer->request_timeout = 0;
 }
 
 bool armv7m_timer_start(armv7m_timer_t *timer, uint32_t timeout)
 {
     IRQn_Type irq;
-    bool success = true;
 
     irq = ((__get_IPSR() & 0x1ff) - 16);
 
     if (irq >= SysTick_IRQn)
     {
-	success = (armv7m_pendsv_enqueue((armv7m_pendsv_routine_t)armv7m_timer_insert, (void*)timer, timeout) != NULL);
+	armv7m_timer_request(timer, ARMV7M_TIMER_REQUEST_START, timeout);
     }
     else if (irq >= SVCall_IRQn)
     {
-	armv7m_timer_insert((void*)timer, timeout);
+	armv7m_timer_direct_start((void*)timer, timeout);
     }
     else
     {
-	armv7m_svcall_2((uint32_t)&armv7m_timer_insert, (uint32_t)timer, timeout);
+	armv7m_svcall_2((uint32_t)&armv7m_timer_direct_start, (uint32_t)timer, timeout);
     }
 
-    return success;
+    return true;
 }
 
 bool armv7m_timer_stop(armv7m_timer_t *timer)
 {
     IRQn_Type irq;
-    bool success = true;
 
     irq = ((__get_IPSR() & 0x1ff) - 16);
 
     if (irq >= SysTick_IRQn)
     {
-	success = (armv7m_pendsv_enqueue((armv7m_pendsv_routine_t)armv7m_timer_remove, (void*)timer, 0) != NULL);
+	/* Clearing bit 0 keeps an expiry that is already in progress from
+	 * calling back before the request gets processed.
+	 */
+	armv7m_atomic_and((volatile uint32_t *)&timer->callback, ~1);
 
-	if (success)
-	{
-	    armv7m_atomic_and((volatile uint32_t *)&timer->callback, ~1);
-	}
+	armv7m_timer_request(timer, ARMV7M_TIMER_REQUEST_STOP, 0);
     }
     else if (irq >= SVCall_IRQn)
     {
-	armv7m_timer_remove((void*)timer, 0);
+	armv7m_timer_direct_stop((void*)timer, 0);
     }
     else
     {
-	armv7m_svcall_2((uint32_t)&armv7m_timer_remove, (uint32_t)timer, 0);
+	armv7m_svcall_2((uint32_t)&armv7m_timer_direct_stop, (uint32_t)timer, 0);
     }
 
-    return success;
+    return true;
 }
 
-static void armv7m_timer_callback(void *context, uint32_t data)
+/* Return the number of ticks from "millis" to the next tick where
+ * a slot needs to be expired or cascaded, or 0xffffffff if the wheel is empty.
+ */
+static uint32_t armv7m_timer_lookahead(void)
+{
+    uint32_t millis, level, shift, base, index, pending, delta, lookahead;
+
+    millis = armv7m_timer_control.millis;
+    lookahead = 0xffffffff;
+
+    for (level = 0; level < ARMV7M_TIMER_WHEEL_LEVELS; level++)
+    {
+	pending = armv7m_timer_control.pending[level];
+
+	if (pending)
+	{
+	    shift = level * ARMV7M_TIMER_WHEEL_SHIFT;
+	    base = ((millis >> shift) + 1) << shift;
+	    index = (base >> shift) & ARMV7M_TIMER_WHEEL_MASK;
+
+	    if (index)
+	    {
+		pending = (pending >> index) | (pending << (ARMV7M_TIMER_WHEEL_SIZE - index));
+	    }
+
+	    delta = (base - millis) + (__builtin_ctz(pending) << shift);
+
+	    if (lookahead > delta)
+	    {
+		lookahead = delta;
+	    }
+	}
+    }
+
+    return lookahead;
+}
+
+static void armv7m_timer_tick(void)
 {
     armv7m_timer_t *timer;
     armv7m_timer_callback_t callback;
-    uint32_t millis;
+    armv7m_timer_slot_t list;
+    uint32_t millis, level, shift;
 
-    millis = data;
+    millis = armv7m_timer_control.millis;
 
-    while (armv7m_timer_control.millis != millis)
+    for (level = (ARMV7M_TIMER_WHEEL_LEVELS -1); level != 0; level--)
+    {
+	shift = level * ARMV7M_TIMER_WHEEL_SHIFT;
+
+	if (!(millis & ((1ul << shift) -1)) && (armv7m_timer_control.pending[level] & (1ul << ((millis >> shift) & ARMV7M_TIMER_WHEEL_MASK))))
+	{
+	    armv7m_timer_detach(level, ((millis >> shift) & ARMV7M_TIMER_WHEEL_MASK), &list);
+
+	    while (list.next != (armv7m_timer_t*)&list)
+	    {
+		timer = list.next;
+
+		armv7m_timer_unlink(timer);
+		armv7m_timer_link(timer);
+	    }
+	}
+    }
+
+    if (armv7m_timer_control.pending[0] & (1ul << (millis & ARMV7M_TIMER_WHEEL_MASK)))
     {
-	timer = armv7m_timer_control.next;
+	/* All timers in the level 0 slot expire now. They are processed as
+	 * a batch off a private list, so that a callback can restart its own,
+	 * or stop any other timer.
+	 */
+	armv7m_timer_detach(0, (millis & ARMV7M_TIMER_WHEEL_MASK), &list);
 
-	if (timer != (armv7m_timer_t*)&armv7m_timer_control)
+	while (list.next != (armv7m_timer_t*)&list)
 	{
-	    timer->remaining--;
+	    timer = list.next;
 
-	    while (timer != (armv7m_timer_t*)&armv7m_timer_control)
+	    callback = timer->callback;
+	    
+	    armv7m_timer_remove(timer, 0);
+	    
+	    if ((uint32_t)callback & 1)
 	    {
-		if (timer->remaining)
-		{
-		    break;
-		}
-		
-		callback = timer->callback;
-		
-		armv7m_timer_remove(timer, 0);
-		
-		if ((uint32_t)callback & 1)
-		{
-		    (*callback)(timer);
-		}
-		
-		timer = armv7m_timer_control.next;
+		(*callback)(timer);
 	    }
 	}
+    }
+}
+
+uint32_t armv7m_timer_next(void)
+{
+    uint32_t lookahead, elapsed;
+
+    lookahead = armv7m_timer_lookahead();
+
+    if (lookahead == 0xffffffff)
+    {
+	return 0xffffffff;
+    }
+
+    /* SYSTICK may have advanced past the last processed heartbeat.
+     */
+    elapsed = (uint32_t)armv7m_systick_millis() - armv7m_timer_control.millis;
+
+    return ((lookahead > elapsed) ? (lookahead - elapsed) : 0);
+}
+
+static void armv7m_timer_callback(void *context, uint32_t data)
+{
+    uint32_t millis, lookahead;
+
+    millis = data;
+
+    while (armv7m_timer_control.millis != millis)
+    {
+	lookahead = armv7m_timer_lookahead();
+
+	if (lookahead > (millis - armv7m_timer_control.millis))
+	{
+	    armv7m_timer_control.millis = millis;
+	}
+	else
+	{
+	    armv7m_timer_control.millis += lookahead;
 
-	armv7m_timer_control.millis++;
+	    armv7m_timer_tick();
+	}
     }
 }
 
 void armv7m_timer_initialize(void)
 {
-    armv7m_timer_control.next = (armv7m_timer_t*)&armv7m_timer_control;
-    armv7m_timer_control.previous = (armv7m_timer_t*)&armv7m_timer_control;
+    uint32_t level, index;
+
+    for (level = 0; level < ARMV7M_TIMER_WHEEL_LEVELS; level++)
+    {
+	for (index = 0; index < ARMV7M_TIMER_WHEEL_SIZE; index++)
+	{
+	    armv7m_timer_control.slot[level][index].next = (armv7m_timer_t*)&armv7m_timer_control.slot[level][index];
+	    armv7m_timer_control.slot[level][index].previous = (armv7m_timer_t*)&armv7m_timer_control.slot[level][index];
+	}
+
+	armv7m_timer_control.pending[level] = 0;
+    }
+
     armv7m_timer_control.millis = armv7m_systick_millis();
+    armv7m_timer_control.request = NULL;
+
+    armv7m_pendsv_work_create(&armv7m_timer_control.work, armv7m_timer_process, NULL, ARMV7M_PENDSV_PRIORITY_HIGH);
 
     armv7m_systick_notify(armv7m_timer_callback, NULL);
 }
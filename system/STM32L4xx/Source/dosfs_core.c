@@ -27,14 +27,13 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 
 #include "dosfs_core.h"
 
-#include "armv7m.h"
-
 
 static int dosfs_volume_init(dosfs_volume_t *volume, dosfs_device_t *device);
 static int dosfs_volume_mount(dosfs_volume_t *volume);
@@ -75,7 +74,7 @@ static int dosfs_map_cache_resolve(dosfs_volume_t *volume);
 static int dosfs_fat_cache_write(dosfs_volume_t *volume, dosfs_cache_entry_t *entry);
 static int dosfs_fat_cache_fill(dosfs_volume_t *volume, uint32_t blkno, dosfs_cache_entry_t **p_entry);
 static int dosfs_fat_cache_read(dosfs_volume_t *volume, uint32_t blkno, dosfs_cache_entry_t **p_entry);
-static void dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry);
+static int dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry, uint32_t blkno_d);
 static int dosfs_fat_cache_flush(dosfs_volume_t *volume);
 
 static int dosfs_data_cache_write(dosfs_volume_t *volume, dosfs_file_t *file);
@@ -85,10 +84,21 @@ static int dosfs_data_cache_zero(dosfs_volume_t *volume, dosfs_file_t *file, uin
 static void dosfs_data_cache_modify(dosfs_volume_t *volume, dosfs_file_t *file);
 static int dosfs_data_cache_flush(dosfs_volume_t *volume, dosfs_file_t *file);
 
-static int dosfs_cluster_read_uncached(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clsdata);
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+static int dosfs_write_queue_drain(dosfs_volume_t *volume, dosfs_file_t *owner, uint32_t blkcnt);
+static int dosfs_write_queue_check(dosfs_volume_t *volume, uint32_t blkno, uint32_t blkcnt);
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+static int dosfs_write_queue_write(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t blkno, const uint8_t *data);
+
 static int dosfs_cluster_read(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clsdata);
-static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t clsdata, int allocate);
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+static void dosfs_free_map_init(dosfs_volume_t *volume);
+static int dosfs_free_map_count(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clscnt);
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t clsdata);
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES == 0)
 static int dosfs_cluster_chain_seek(dosfs_volume_t *volume, uint32_t clsno, uint32_t clscnt, uint32_t *p_clsno);
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES == 0) */
 static int dosfs_cluster_chain_create(dosfs_volume_t *volume, uint32_t clsno, uint32_t clscnt, uint32_t *p_clsno_a, uint32_t *p_clsno_l);
 #if (DOSFS_CONFIG_SEQUENTIAL_SUPPORTED == 1)
 static int dosfs_cluster_chain_create_sequential(dosfs_volume_t *volume, uint32_t clsno, uint32_t clscnt, uint32_t *p_clsno_a, uint32_t *p_clsno_l);
@@ -120,6 +130,11 @@ static uint16_t dosfs_name_checksum_uniname(const dosfs_unicode_t *uniname, unsi
 #endif /* (DOSFS_CONFIG_VFAT_SUPPORTED == 1) */
 
 static int dosfs_path_convert_filename(dosfs_volume_t *volume, const char *filename, const char **p_filename);
+#if (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0)
+static void dosfs_name_cache_init(dosfs_volume_t *volume);
+static void dosfs_name_cache_invalidate(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t first_clsno);
+#endif /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
+static int dosfs_path_scan_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t count, dosfs_find_callback_t callback, void *private, uint32_t *p_clsno, uint32_t *p_index, dosfs_dir_t **p_dir);
 static int dosfs_path_find_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t count, dosfs_find_callback_t callback, void *private, uint32_t *p_clsno, uint32_t *p_index, dosfs_dir_t **p_dir);
 static int dosfs_path_find_directory(dosfs_volume_t *volume, const char *filename, const char **p_filename, uint32_t *p_clsno);
 static int dosfs_path_find_file(dosfs_volume_t *volume, const char *filename, uint32_t *p_clsno, uint32_t *p_index, dosfs_dir_t **p_dir);
@@ -136,6 +151,13 @@ static int dosfs_path_destroy_entry(dosfs_volume_t *volume, uint32_t clsno, uint
 static dosfs_file_t *dosfs_file_enumerate(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t clsno, uint32_t index);
 static int dosfs_file_sync(dosfs_volume_t *volume, dosfs_file_t *file, int access, int modify, uint32_t first_clsno, uint32_t length);
 static int dosfs_file_flush(dosfs_volume_t *volume, dosfs_file_t *file, int close);
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0)
+static dosfs_extent_t *dosfs_file_extent_search(dosfs_file_t *file, uint32_t clsofs);
+static void dosfs_file_extent_evict(dosfs_file_t *file, uint32_t index, uint32_t clsofs, uint32_t clsno);
+static void dosfs_file_extent_insert(dosfs_file_t *file, uint32_t clsofs, uint32_t clsno);
+static void dosfs_file_extent_truncate(dosfs_file_t *file, uint32_t clscnt);
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
+static int dosfs_file_chain_seek(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t clsno, uint32_t clsofs, uint32_t clscnt, uint32_t *p_clsno);
 static int dosfs_file_seek(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t position);
 static int dosfs_file_shrink(dosfs_volume_t *volume, dosfs_file_t *file);
 static int dosfs_file_extend(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t length);
@@ -144,6 +166,8 @@ static int dosfs_file_reserve(dosfs_volume_t *volume, dosfs_file_t *file, uint32
 #endif /* (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1) */
 static int dosfs_file_open(dosfs_volume_t *volume, const char *filename, uint32_t mode, uint32_t size, dosfs_file_t **p_file);
 static int dosfs_file_close(dosfs_volume_t *volume, dosfs_file_t *file);
+static int dosfs_file_read_vector(dosfs_volume_t *volume, dosfs_file_t *file, const dosfs_device_segment_t *segments, uint32_t count);
+static int dosfs_file_write_vector(dosfs_volume_t *volume, dosfs_file_t *file, const dosfs_device_segment_t *segments, uint32_t count);
 static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *data, uint32_t count, uint32_t *p_count);
 static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const uint8_t *data, uint32_t count, uint32_t *p_count);
 
@@ -153,7 +177,8 @@ dosfs_volume_t dosfs_volume;
 static uint32_t dosfs_cache[(1 +
 			    DOSFS_CONFIG_FAT_CACHE_ENTRIES +
 			    ((DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) ? 1 : 0) +
-			    (((DOSFS_CONFIG_FILE_DATA_CACHE == 0) ? 1 : DOSFS_CONFIG_MAX_FILES) * DOSFS_CONFIG_DATA_CACHE_ENTRIES))
+			    (((DOSFS_CONFIG_FILE_DATA_CACHE == 0) ? 1 : DOSFS_CONFIG_MAX_FILES) * DOSFS_CONFIG_DATA_CACHE_ENTRIES) +
+			    DOSFS_CONFIG_WRITE_QUEUE_ENTRIES)
 			   * (DOSFS_BLK_SIZE / sizeof(uint32_t))];
 
 static const char dosfs_dirname_dot[11]    = ".          ";
@@ -189,6 +214,9 @@ static int dosfs_volume_init(dosfs_volume_t *volume, dosfs_device_t *device)
     dosfs_file_t *file_s, *file_e;
 #endif /* (DOSFS_CONFIG_MAX_FILES != 1) */
 #endif /* (DOSFS_CONFIG_FILE_DATA_CACHE == 1) */
+#if (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1)
+    unsigned int index;
+#endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1) */
 
 #if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1)
     /* In order not to mess up dosfs_volume_t too much, the dosfs_boot_t.bpblog struct is aliased to
@@ -244,10 +272,11 @@ static int dosfs_volume_init(dosfs_volume_t *volume, dosfs_device_t *device)
     volume->fat_cache.data = cache;
     cache += DOSFS_BLK_SIZE;
 #else /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
-    volume->fat_cache[0].data = cache;
-    cache += DOSFS_BLK_SIZE;
-    volume->fat_cache[1].data = cache;
-    cache += DOSFS_BLK_SIZE;
+    for (index = 0; index < DOSFS_CONFIG_FAT_CACHE_ENTRIES; index++)
+    {
+	volume->fat_cache[index].data = cache;
+	cache += DOSFS_BLK_SIZE;
+    }
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES != 0) */
 
@@ -274,6 +303,11 @@ static int dosfs_volume_init(dosfs_volume_t *volume, dosfs_device_t *device)
 #endif /* (DOSFS_CONFIG_FILE_DATA_CACHE == 0) */
 #endif /* (DOSFS_CONFIG_DATA_CACHE_ENTRIES != 0) */
 
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+    volume->write_data = cache;
+    cache += (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES * DOSFS_BLK_SIZE);
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
     if (device->interface)
     {
         volume->state = DOSFS_VOLUME_STATE_INITIALIZED;
@@ -304,9 +338,9 @@ static int dosfs_volume_mount(dosfs_volume_t * volume)
 #if (DOSFS_CONFIG_MAX_FILES != 1)
     dosfs_file_t *file_s, *file_e;
 #endif /* (DOSFS_CONFIG_MAX_FILES != 1) */
-#if (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0)
+#if (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1)
     unsigned int index;
-#endif /* (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0) */
+#endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1) */
 
     device = DOSFS_VOLUME_DEVICE(volume);
 
@@ -585,6 +619,10 @@ static int dosfs_volume_mount(dosfs_volume_t * volume)
 			{
 			    volume->last_clsno = (((boot_blkno + tot_sec) - volume->cls_blk_offset) >> volume->cls_blk_shift) -1;
 
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+			    dosfs_free_map_init(volume);
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+
 #if (DOSFS_CONFIG_SEQUENTIAL_SUPPORTED == 1) || (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1)
 			    if (au_size == 0)
 			    {
@@ -664,6 +702,15 @@ static int dosfs_volume_mount(dosfs_volume_t * volume)
 				     */
 				    volume->dir_cache.blkno = DOSFS_BLKNO_INVALID;
 
+#if (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0)
+				    dosfs_name_cache_init(volume);
+#endif /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
+
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+				    volume->write_head = 0;
+				    volume->write_count = 0;
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
 #if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1)
 				    volume->map_cache.blkno = DOSFS_BLKNO_INVALID;
 #endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) */
@@ -672,8 +719,14 @@ static int dosfs_volume_mount(dosfs_volume_t * volume)
 #if (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1)
 				    volume->fat_cache.blkno = DOSFS_BLKNO_INVALID;
 #else /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
-				    volume->fat_cache[0].blkno = DOSFS_BLKNO_INVALID;
-				    volume->fat_cache[1].blkno = DOSFS_BLKNO_INVALID;
+				    for (index = 0; index < DOSFS_CONFIG_FAT_CACHE_ENTRIES; index++)
+				    {
+					volume->fat_cache[index].blkno = DOSFS_BLKNO_INVALID;
+					volume->fat_cache_lru[index] = index;
+					volume->fat_cache_dirty[index] = 0;
+				    }
+
+				    volume->fat_cache_last = DOSFS_BLKNO_INVALID;
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES != 0) */
 			    
@@ -684,14 +737,6 @@ static int dosfs_volume_mount(dosfs_volume_t * volume)
 #endif /* (DOSFS_CONFIG_DATA_CACHE_ENTRIES != 0) */
 #endif /* (DOSFS_CONFIG_FILE_DATA_CACHE == 0) */
 			    
-#if (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0)
-				    for (index = 0; index < DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES; index++)
-				    {
-					volume->cluster_cache[index].clsno   = DOSFS_CLSNO_NONE;
-					volume->cluster_cache[index].clsdata = DOSFS_CLSNO_NONE;
-				    }
-#endif /* (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0) */
-			    
 				    volume->cwd_clsno = DOSFS_CLSNO_NONE;
 			    
 #if (DOSFS_CONFIG_MAX_FILES == 1)
@@ -1580,6 +1625,10 @@ static int dosfs_volume_commit(dosfs_volume_t *volume)
 	    clsno = volume->del_clsno;
 	    index = volume->del_index;
 
+#if (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0)
+	    dosfs_name_cache_invalidate(volume, clsno, index, DOSFS_CLSNO_NONE);
+#endif /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
+
 	    if (clsno == DOSFS_CLSNO_NONE)
 	    {
 		clsno = volume->root_clsno;
@@ -2035,7 +2084,7 @@ static int dosfs_dir_cache_write(dosfs_volume_t *volume)
     {
 	dosfs_file_t *file = volume->data_file;
 
-	status = (*device->interface->write)(device->context, volume->dir_cache.blkno, volume->dir_cache.data, 1, &file->status);
+	status = dosfs_write_queue_write(volume, file, volume->dir_cache.blkno, volume->dir_cache.data);
 
 #if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
 	if (status == F_ERR_INVALIDSECTOR)
@@ -2393,6 +2442,9 @@ static int dosfs_map_cache_resolve(dosfs_volume_t *volume)
     uint32_t *map, *map_e;
     uint8_t *data;
     dosfs_cache_entry_t *entry;
+#if (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1)
+    unsigned int index;
+#endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1) */
 
     status = dosfs_dir_cache_flush(volume);
 
@@ -2419,13 +2471,17 @@ static int dosfs_map_cache_resolve(dosfs_volume_t *volume)
 		    data = volume->fat_cache.data;
 		}
 #else /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
-		if (blkno == volume->fat_cache[0].blkno)
+		for (index = 0; index < DOSFS_CONFIG_FAT_CACHE_ENTRIES; index++)
 		{
-		    data = volume->fat_cache[0].data;
+		    if (blkno == volume->fat_cache[index].blkno)
+		    {
+			break;
+		    }
 		}
-		else if (blkno == volume->fat_cache[1].blkno)
+
+		if (index != DOSFS_CONFIG_FAT_CACHE_ENTRIES)
 		{
-		    data = volume->fat_cache[1].data;
+		    data = volume->fat_cache[index].data;
 		}
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 0) */
@@ -2519,13 +2575,17 @@ static int dosfs_map_cache_resolve(dosfs_volume_t *volume)
 				data = volume->fat_cache.data;
 			    }
 #else /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
-			    if (blkno == volume->fat_cache[0].blkno)
+			    for (index = 0; index < DOSFS_CONFIG_FAT_CACHE_ENTRIES; index++)
 			    {
-				data = volume->fat_cache[0].data;
+				if (blkno == volume->fat_cache[index].blkno)
+				{
+				    break;
+				}
 			    }
-			    else if (blkno == volume->fat_cache[1].blkno)
+
+			    if (index != DOSFS_CONFIG_FAT_CACHE_ENTRIES)
 			    {
-				data = volume->fat_cache[1].data;
+				data = volume->fat_cache[index].data;
 			    }
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
 #endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 0) */
@@ -2678,9 +2738,11 @@ static int dosfs_fat_cache_read(dosfs_volume_t *volume, uint32_t blkno, dosfs_ca
     return status;
 }
 
-static inline void dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry)
+static inline int dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry, uint32_t blkno_d)
 {
     volume->flags |= DOSFS_VOLUME_FLAG_FAT_DIRTY;
+
+    return F_NO_ERROR;
 }
 
 static int dosfs_fat_cache_flush(dosfs_volume_t *volume)
@@ -2699,30 +2761,99 @@ static int dosfs_fat_cache_flush(dosfs_volume_t *volume)
 
 #else /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 1) */
 
+/* The FAT cache is a DOSFS_CONFIG_FAT_CACHE_ENTRIES way LRU cache. volume->fat_cache_lru[] holds
+ * the cache indices ordered from most recently used to least recently used. Each entry has its own
+ * dirty bit in volume->fat_cache_dirty[], while DOSFS_VOLUME_FLAG_FAT_DIRTY is set if any entry
+ * is dirty.
+ *
+ * For a non-TRANSACTION_SAFE setup some FAT updates have to reach the media before others: a link
+ * must not be written before the FAT entry of the cluster it points to got allocated, and a cluster
+ * must not be written as free before the entry that referenced it got updated. dosfs_cluster_write()
+ * passes such a dependency as "blkno_d" to dosfs_fat_cache_modify(), which writes back just that
+ * entry if it is dirty and a different block. With the dependencies on the media, the remaining
+ * dirty entries can be written back in any order, hence an eviction only writes back the victim,
+ * and dosfs_fat_cache_flush() writes back all dirty entries in ascending block order, first to the
+ * 1st FAT and then in one batch to the 2nd FAT.
+ */
+
+static void dosfs_fat_cache_touch(dosfs_volume_t *volume, unsigned int slot)
+{
+    unsigned int index;
+
+    index = volume->fat_cache_lru[slot];
+
+    while (slot != 0)
+    {
+	volume->fat_cache_lru[slot] = volume->fat_cache_lru[slot -1];
+
+	slot--;
+    }
+
+    volume->fat_cache_lru[0] = index;
+}
+
+/* Write back the dirty "entry", or all dirty entries if "entry" is NULL.
+ */
+
 static int dosfs_fat_cache_write(dosfs_volume_t *volume, dosfs_cache_entry_t *entry)
 {
     int status = F_NO_ERROR;
+    unsigned int index, count, n;
+    dosfs_cache_entry_t *entry_table[DOSFS_CONFIG_FAT_CACHE_ENTRIES];
+
+    for (index = 0, count = 0; index < DOSFS_CONFIG_FAT_CACHE_ENTRIES; index++)
+    {
+	if (volume->fat_cache_dirty[index] && (!entry || (entry == &volume->fat_cache[index])))
+	{
+	    for (n = count; (n != 0) && (entry_table[n -1]->blkno > volume->fat_cache[index].blkno); n--)
+	    {
+		entry_table[n] = entry_table[n -1];
+	    }
 
-    DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_write);
+	    entry_table[n] = &volume->fat_cache[index];
+
+	    count++;
+	}
+    }
+
+    for (n = 0; (status == F_NO_ERROR) && (n < count); n++)
+    {
+	DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_write);
 
 #if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1)
-    status = dosfs_map_cache_write(volume, entry->blkno, entry->data);
+	status = dosfs_map_cache_write(volume, entry_table[n]->blkno, entry_table[n]->data);
 #else /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) */
-    status = dosfs_volume_write(volume, entry->blkno, entry->data);
+	status = dosfs_volume_write(volume, entry_table[n]->blkno, entry_table[n]->data);
 #endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) */
+    }
 
-    if (status == F_NO_ERROR)
-    {
 #if (DOSFS_CONFIG_2NDFAT_SUPPORTED == 1) && (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0)
-	if (volume->fat2_blkno)
+    if (volume->fat2_blkno)
+    {
+	for (n = 0; (status == F_NO_ERROR) && (n < count); n++)
 	{
-	    status = dosfs_volume_write(volume, entry->blkno + volume->fat_blkcnt, entry->data);
+	    status = dosfs_volume_write(volume, entry_table[n]->blkno + volume->fat_blkcnt, entry_table[n]->data);
 	}
-
-	if (status == F_NO_ERROR)
+    }
 #endif /* (DOSFS_CONFIG_2NDFAT_SUPPORTED == 1) && (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0) */
+
+    if (status == F_NO_ERROR)
+    {
+	volume->flags &= ~DOSFS_VOLUME_FLAG_FAT_DIRTY;
+
+	for (index = 0; index < DOSFS_CONFIG_FAT_CACHE_ENTRIES; index++)
 	{
-	    volume->flags &= ((entry == &volume->fat_cache[0]) ? ~DOSFS_VOLUME_FLAG_FAT_0_DIRTY : ~DOSFS_VOLUME_FLAG_FAT_1_DIRTY);
+	    if (volume->fat_cache_dirty[index])
+	    {
+		if (!entry || (entry == &volume->fat_cache[index]))
+		{
+		    volume->fat_cache_dirty[index] = 0;
+		}
+		else
+		{
+		    volume->flags |= DOSFS_VOLUME_FLAG_FAT_DIRTY;
+		}
+	    }
 	}
     }
 
@@ -2734,55 +2865,34 @@ static int dosfs_fat_cache_fill(dosfs_volume_t *volume, uint32_t blkno, dosfs_ca
     int status = F_NO_ERROR;
     unsigned int index;
 
-    index = (volume->flags & DOSFS_VOLUME_FLAG_FAT_INDEX_CURRENT) ^ DOSFS_VOLUME_FLAG_FAT_INDEX_CURRENT;
+    DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_miss);
 
-#if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0)
-    /* For a non-TRANSACTION_SAFE setup, the write backs from the cache
-     * have to be in sequence. That means, if there is any cache entry
-     * dirty it have to be written back, before either a new one gets 
-     * read or the non least recently used one is used.
-     */
-    if (volume->flags & (DOSFS_VOLUME_FLAG_FAT_0_DIRTY | DOSFS_VOLUME_FLAG_FAT_1_DIRTY))
+    index = volume->fat_cache_lru[DOSFS_CONFIG_FAT_CACHE_ENTRIES -1];
+
+    if (volume->fat_cache_dirty[index])
     {
-	status = dosfs_fat_cache_write(volume, &volume->fat_cache[index ^ DOSFS_VOLUME_FLAG_FAT_INDEX_CURRENT]);
+	DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_evict);
+
+	status = dosfs_fat_cache_write(volume, &volume->fat_cache[index]);
     }
 
     if (status == F_NO_ERROR)
-#endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0) */
     {
-	if (volume->fat_cache[index].blkno != blkno)
-	{
-	    DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_miss);
-	    DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_read);
-	    
-#if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1)
-	    if (volume->flags & (DOSFS_VOLUME_FLAG_FAT_0_DIRTY << index))
-	    {
-		status = dosfs_fat_cache_write(volume, &volume->fat_cache[index]);
-	    }
-#endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) */
+	DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_read);
+
+	volume->fat_cache[index].blkno = DOSFS_BLKNO_INVALID;
 
-	    if (status == F_NO_ERROR)
-	    {
 #if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1)
-		status = dosfs_map_cache_read(volume, blkno, volume->fat_cache[index].data);
+	status = dosfs_map_cache_read(volume, blkno, volume->fat_cache[index].data);
 #else /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) */
-		status = dosfs_volume_read(volume, blkno, volume->fat_cache[index].data);
+	status = dosfs_volume_read(volume, blkno, volume->fat_cache[index].data);
 #endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) */
-	    
-		if (status == F_NO_ERROR)
-		{
-		    volume->flags ^= DOSFS_VOLUME_FLAG_FAT_INDEX_CURRENT;
-		
-		    volume->fat_cache[index].blkno = blkno;
-		}
-	    }
-	}
-	else
+
+	if (status == F_NO_ERROR)
 	{
-	    DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_hit);
+	    volume->fat_cache[index].blkno = blkno;
 
-	    volume->flags ^= DOSFS_VOLUME_FLAG_FAT_INDEX_CURRENT;
+	    dosfs_fat_cache_touch(volume, (DOSFS_CONFIG_FAT_CACHE_ENTRIES -1));
 	}
     }
 
@@ -2794,11 +2904,19 @@ static int dosfs_fat_cache_fill(dosfs_volume_t *volume, uint32_t blkno, dosfs_ca
 static int dosfs_fat_cache_read(dosfs_volume_t *volume, uint32_t blkno, dosfs_cache_entry_t **p_entry)
 {
     int status = F_NO_ERROR;
-    unsigned int index;
+    unsigned int slot, index;
 
-    index = volume->flags & DOSFS_VOLUME_FLAG_FAT_INDEX_CURRENT;
+    for (slot = 0; slot < DOSFS_CONFIG_FAT_CACHE_ENTRIES; slot++)
+    {
+	index = volume->fat_cache_lru[slot];
+
+	if (volume->fat_cache[index].blkno == blkno)
+	{
+	    break;
+	}
+    }
 
-    if (volume->fat_cache[index].blkno != blkno)
+    if (slot == DOSFS_CONFIG_FAT_CACHE_ENTRIES)
     {
 	status = dosfs_fat_cache_fill(volume, blkno, p_entry);
     }
@@ -2806,33 +2924,54 @@ static int dosfs_fat_cache_read(dosfs_volume_t *volume, uint32_t blkno, dosfs_ca
     {
 	DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_hit);
 
+	dosfs_fat_cache_touch(volume, slot);
+
 	*p_entry = &volume->fat_cache[index];
     }
 
     return status;
 }
 
-static inline void dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry)
-{
-    volume->flags |= ((entry == &volume->fat_cache[0]) ? DOSFS_VOLUME_FLAG_FAT_0_DIRTY : DOSFS_VOLUME_FLAG_FAT_1_DIRTY);
-}
-
-static int dosfs_fat_cache_flush(dosfs_volume_t *volume)
+static int dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry, uint32_t blkno_d)
 {
     int status = F_NO_ERROR;
+#if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0)
+    unsigned int index;
 
-    if (volume->flags & DOSFS_VOLUME_FLAG_FAT_0_DIRTY)
+    if ((volume->flags & DOSFS_VOLUME_FLAG_FAT_DIRTY) && (blkno_d != DOSFS_BLKNO_INVALID) && (blkno_d != entry->blkno))
     {
-	DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_flush);
+	for (index = 0; index < DOSFS_CONFIG_FAT_CACHE_ENTRIES; index++)
+	{
+	    if (volume->fat_cache_dirty[index] && (volume->fat_cache[index].blkno == blkno_d))
+	    {
+		status = dosfs_fat_cache_write(volume, &volume->fat_cache[index]);
+
+		break;
+	    }
+	}
+    }
+
+    if (status == F_NO_ERROR)
+#endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0) */
+    {
+	volume->fat_cache_dirty[entry - &volume->fat_cache[0]] = 1;
+	volume->fat_cache_last = entry->blkno;
 
-	status = dosfs_fat_cache_write(volume, &volume->fat_cache[0]);
+	volume->flags |= DOSFS_VOLUME_FLAG_FAT_DIRTY;
     }
 
-    if ((status == F_NO_ERROR) && (volume->flags & DOSFS_VOLUME_FLAG_FAT_1_DIRTY))
+    return status;
+}
+
+static int dosfs_fat_cache_flush(dosfs_volume_t *volume)
+{
+    int status = F_NO_ERROR;
+
+    if (volume->flags & DOSFS_VOLUME_FLAG_FAT_DIRTY)
     {
 	DOSFS_VOLUME_STATISTICS_COUNT(fat_cache_flush);
 
-	status = dosfs_fat_cache_write(volume, &volume->fat_cache[1]);
+	status = dosfs_fat_cache_write(volume, NULL);
     }
 
     return status;
@@ -2949,9 +3088,11 @@ static inline int dosfs_fat_cache_read(dosfs_volume_t *volume, uint32_t blkno, d
 
 #endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 1) */
 
-static inline void dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry)
+static inline int dosfs_fat_cache_modify(dosfs_volume_t *volume, dosfs_cache_entry_t *entry, uint32_t blkno_d)
 {
     volume->flags |= DOSFS_VOLUME_FLAG_FAT_DIRTY;
+
+    return F_NO_ERROR;
 }
 
 static int dosfs_fat_cache_flush(dosfs_volume_t *volume)
@@ -2982,7 +3123,7 @@ static int dosfs_data_cache_write(dosfs_volume_t *volume, dosfs_file_t *file)
 
     device = DOSFS_VOLUME_DEVICE(volume);
 
-    status = (*device->interface->write)(device->context, file->data_cache.blkno, file->data_cache.data, 1, &file->status);
+    status = dosfs_write_queue_write(volume, file, file->data_cache.blkno, file->data_cache.data);
 
 #if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
     if (status == F_ERR_INVALIDSECTOR)
@@ -3041,7 +3182,14 @@ static int dosfs_data_cache_fill(dosfs_volume_t *volume, dosfs_file_t *file, uin
 	}
 	else
 	{
-	  status = (*device->interface->read)(device->context, blkno, file->data_cache.data, 1, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+	    status = dosfs_write_queue_check(volume, blkno, 1);
+
+	    if (status == F_NO_ERROR)
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+	    {
+		status = (*device->interface->read)(device->context, blkno, file->data_cache.data, 1, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+	    }
 
 #if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
 	    if (status == F_ERR_INVALIDSECTOR)
@@ -3106,6 +3254,37 @@ static int dosfs_data_cache_zero(dosfs_volume_t *volume, dosfs_file_t *file, uin
     return status;
 }
 
+/* Claim the data cache for "blkno", so that it can be filled as part of a vectored
+ * device read. The entry stays invalid till the caller stores "blkno" after the read
+ * completed. If "blkno" is already cached, *p_entry is set to NULL.
+ */
+static int dosfs_data_cache_claim(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t blkno, dosfs_cache_entry_t ** p_entry)
+{
+    int status = F_NO_ERROR;
+
+    *p_entry = NULL;
+
+    if (file->data_cache.blkno != blkno)
+    {
+	if (file->flags & DOSFS_FILE_FLAG_DATA_DIRTY)
+	{
+	    status = dosfs_data_cache_write(volume, file);
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    DOSFS_VOLUME_STATISTICS_COUNT(data_cache_miss);
+	    DOSFS_VOLUME_STATISTICS_COUNT(data_cache_read);
+
+	    file->data_cache.blkno = DOSFS_BLKNO_INVALID;
+
+	    *p_entry = &file->data_cache;
+	}
+    }
+
+    return status;
+}
+
 static inline void dosfs_data_cache_modify(dosfs_volume_t *volume, dosfs_file_t *file)
 {
     file->flags |= DOSFS_FILE_FLAG_DATA_DIRTY;
@@ -3150,7 +3329,7 @@ static int dosfs_data_cache_write(dosfs_volume_t *volume, dosfs_file_t *file)
 
     device = DOSFS_VOLUME_DEVICE(volume);
 
-    status = (*device->interface->write)(device->context, volume->data_cache.blkno, volume->data_cache.data, 1, &file->status);
+    status = dosfs_write_queue_write(volume, file, volume->data_cache.blkno, volume->data_cache.data);
 
 #if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
     if (status == F_ERR_INVALIDSECTOR)
@@ -3208,7 +3387,14 @@ static int dosfs_data_cache_fill(dosfs_volume_t *volume, dosfs_file_t *file, uin
 	}
 	else
 	{
-            status = (*device->interface->read)(device->context, blkno, volume->data_cache.data, 1, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+	    status = dosfs_write_queue_check(volume, blkno, 1);
+
+	    if (status == F_NO_ERROR)
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+	    {
+		status = (*device->interface->read)(device->context, blkno, volume->data_cache.data, 1, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+	    }
 
 #if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
 	    if (status == F_ERR_INVALIDSECTOR)
@@ -3273,6 +3459,33 @@ static int dosfs_data_cache_zero(dosfs_volume_t *volume, dosfs_file_t *file, uin
     return status;
 }
 
+static int dosfs_data_cache_claim(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t blkno, dosfs_cache_entry_t ** p_entry)
+{
+    int status = F_NO_ERROR;
+
+    *p_entry = NULL;
+
+    if (volume->data_cache.blkno != blkno)
+    {
+	if (volume->data_file)
+	{
+	    status = dosfs_data_cache_write(volume, file);
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    DOSFS_VOLUME_STATISTICS_COUNT(data_cache_miss);
+	    DOSFS_VOLUME_STATISTICS_COUNT(data_cache_read);
+
+	    volume->data_cache.blkno = DOSFS_BLKNO_INVALID;
+
+	    *p_entry = &volume->data_cache;
+	}
+    }
+
+    return status;
+}
+
 static inline void dosfs_data_cache_modify(dosfs_volume_t *volume, dosfs_file_t *file)
 {
     volume->data_file = file;
@@ -3355,7 +3568,14 @@ static int dosfs_data_cache_fill(dosfs_volume_t *volume, dosfs_file_t *file, uin
 	}
 	else
 	{
-            status = (*device->interface->read)(device->context, blkno, volume->dir_cache.data, 1, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+	    status = dosfs_write_queue_check(volume, blkno, 1);
+
+	    if (status == F_NO_ERROR)
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+	    {
+		status = (*device->interface->read)(device->context, blkno, volume->dir_cache.data, 1, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+	    }
 
 #if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
 	    if (status == F_ERR_INVALIDSECTOR)
@@ -3420,6 +3640,45 @@ static int dosfs_data_cache_zero(dosfs_volume_t *volume, dosfs_file_t *file, uin
     return status;
 }
 
+static int dosfs_data_cache_claim(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t blkno, dosfs_cache_entry_t ** p_entry)
+{
+    int status = F_NO_ERROR;
+
+    *p_entry = NULL;
+
+    if (volume->dir_cache.blkno != blkno)
+    {
+	DOSFS_VOLUME_STATISTICS_COUNT(data_cache_miss);
+	DOSFS_VOLUME_STATISTICS_COUNT(data_cache_read);
+
+	if (volume->data_file
+#if (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 0)
+	    || (volume->flags & DOSFS_VOLUME_FLAG_FAT_DIRTY)
+#endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES == 0) */
+	    )
+	{
+	    status = dosfs_dir_cache_write(volume);
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    volume->dir_cache.blkno = DOSFS_BLKNO_INVALID;
+
+	    *p_entry = &volume->dir_cache;
+	}
+
+	/* After any data related disk operation, "file->status" needs
+	 * to be checked asynchronously for a previous error.
+	 */
+	if (file->status != F_NO_ERROR)
+	{
+	    status = file->status;
+	}
+    }
+
+    return status;
+}
+
 static inline void dosfs_data_cache_modify(dosfs_volume_t *volume, dosfs_file_t *file)
 {
     volume->data_file = file;
@@ -3460,41 +3719,212 @@ static int dosfs_data_cache_invalidate(dosfs_volume_t *volume, dosfs_file_t *fil
 
 /***********************************************************************************************************************/
 
-static int dosfs_cluster_read_uncached(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clsdata)
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+
+/* The write queue holds copies of file data blocks written through a file opened
+ * with DOSFS_FILE_MODE_SEQUENTIAL. Queued blocks are handed to the device only
+ * while it is not busy with a previous write (at the end of each f_write()), so
+ * that the caller does not wait for the device to finish programming. Only
+ * if the queue is full, the oldest block is written unconditionally. Nothing
+ * runs in the background: the queue is drained synchronously from within dosfs
+ * calls, so device programming only overlaps with the caller's own work between
+ * two f_write() calls.
+ *
+ * A write error is recorded in the status of the file that queued the block.
+ * dosfs_write_queue_drain() returns it only if that file is "owner", so that
+ * the error surfaces from the owning file's f_write()/f_flush()/f_close(), and
+ * not from an unrelated call that happened to drain the queue.
+ *
+ * Any device read of a queued block, or any direct write to it, first writes
+ * out the whole queue. So does freeing a cluster chain, as the clusters could
+ * be reused otherwise before their queued blocks got written. dosfs_file_flush()
+ * writes out the queue as well, which makes f_flush()/f_close() a barrier.
+ */
+
+static int dosfs_write_queue_drain(dosfs_volume_t *volume, dosfs_file_t *owner, uint32_t blkcnt)
 {
     int status = F_NO_ERROR;
-    uint32_t offset, blkno, clsdata;
-    dosfs_cache_entry_t *entry;
-
-#if (DOSFS_CONFIG_FAT12_SUPPORTED == 1)
-    if (volume->type == DOSFS_VOLUME_TYPE_FAT12)
-    {
-	uint8_t *fat_data;
+    int result;
+    unsigned int index;
+    bool busy;
+    dosfs_file_t *file;
+    dosfs_device_t *device;
 
-	offset = clsno + (clsno >> 1);
-	blkno = volume->fat1_blkno + (offset >> DOSFS_BLK_SHIFT);
+    device = DOSFS_VOLUME_DEVICE(volume);
 
-	status = dosfs_fat_cache_read(volume, blkno, &entry);
-	
-	if (status == F_NO_ERROR)
+    while (volume->write_count)
+    {
+	if (blkcnt == 0)
 	{
-	    fat_data = (uint8_t*)(entry->data + (offset & DOSFS_BLK_MASK));
-	    
-	    if (clsno & 1)
-	    {
-		clsdata = ((uint32_t)(*fat_data) >> 4);
-	    }
-	    else
+	    if (((*device->interface->busy)(device->context, &busy) != F_NO_ERROR) || busy)
 	    {
-		clsdata = ((uint32_t)(*fat_data));
+		break;
 	    }
-	    
-	    if ((offset & DOSFS_BLK_MASK) == DOSFS_BLK_MASK)
-	    {
-		status = dosfs_fat_cache_read(volume, (blkno+1), &entry);
-		
-		if (status == F_NO_ERROR)
-		{
+	}
+	else
+	{
+	    blkcnt--;
+	}
+
+	index = volume->write_head;
+	file = volume->write_file[index];
+
+	result = (*device->interface->write)(device->context, volume->write_blkno[index], volume->write_data + (index * DOSFS_BLK_SIZE), 1, &file->status);
+
+#if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
+	if (result == F_ERR_INVALIDSECTOR)
+	{
+	    volume->flags |= DOSFS_VOLUME_FLAG_MEDIA_FAILURE;
+	}
+#endif /* (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1) */
+
+	if (result == F_NO_ERROR)
+	{
+	    DOSFS_VOLUME_STATISTICS_COUNT(write_queue_write);
+	}
+	else
+	{
+	    /* The error belongs to the file that queued the block.
+	     */
+	    if (file->status == F_NO_ERROR)
+	    {
+		file->status = result;
+	    }
+
+	    if ((file == owner) && (status == F_NO_ERROR))
+	    {
+		status = result;
+	    }
+	}
+
+	/* A failed block is dropped as well. Otherwise the queue would
+	 * get stuck, and still refer to the file after it got closed.
+	 */
+	volume->write_head = (index == (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES -1)) ? 0 : (index +1);
+	volume->write_count--;
+    }
+
+    return status;
+}
+
+static int dosfs_write_queue_check(dosfs_volume_t *volume, uint32_t blkno, uint32_t blkcnt)
+{
+    int status = F_NO_ERROR;
+    unsigned int index, n;
+
+    for (index = volume->write_head, n = 0; n < volume->write_count; n++)
+    {
+	if ((blkno <= volume->write_blkno[index]) && (volume->write_blkno[index] < (blkno + blkcnt)))
+	{
+	    status = dosfs_write_queue_drain(volume, NULL, volume->write_count);
+
+	    break;
+	}
+
+	index = (index == (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES -1)) ? 0 : (index +1);
+    }
+
+    return status;
+}
+
+static int dosfs_write_queue_write(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t blkno, const uint8_t *data)
+{
+    int status = F_NO_ERROR;
+    unsigned int index;
+    dosfs_device_t *device;
+
+    if (file->mode & DOSFS_FILE_MODE_SEQUENTIAL)
+    {
+	if (volume->write_count == DOSFS_CONFIG_WRITE_QUEUE_ENTRIES)
+	{
+	    DOSFS_VOLUME_STATISTICS_COUNT(write_queue_stall);
+
+	    status = dosfs_write_queue_drain(volume, file, 1);
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    DOSFS_VOLUME_STATISTICS_COUNT(write_queue_enqueue);
+
+	    index = volume->write_head + volume->write_count;
+
+	    if (index >= DOSFS_CONFIG_WRITE_QUEUE_ENTRIES)
+	    {
+		index -= DOSFS_CONFIG_WRITE_QUEUE_ENTRIES;
+	    }
+
+	    memcpy(volume->write_data + (index * DOSFS_BLK_SIZE), data, DOSFS_BLK_SIZE);
+
+	    volume->write_blkno[index] = blkno;
+	    volume->write_file[index] = file;
+	    volume->write_count++;
+	}
+    }
+    else
+    {
+	status = dosfs_write_queue_check(volume, blkno, 1);
+
+	if (status == F_NO_ERROR)
+	{
+	    device = DOSFS_VOLUME_DEVICE(volume);
+
+	    status = (*device->interface->write)(device->context, blkno, data, 1, &file->status);
+	}
+    }
+
+    return status;
+}
+
+#else /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
+static inline int dosfs_write_queue_write(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t blkno, const uint8_t *data)
+{
+    dosfs_device_t *device;
+
+    device = DOSFS_VOLUME_DEVICE(volume);
+
+    return (*device->interface->write)(device->context, blkno, data, 1, &file->status);
+}
+
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
+/***********************************************************************************************************************/
+
+static int dosfs_cluster_read(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clsdata)
+{
+    int status = F_NO_ERROR;
+    uint32_t offset, blkno, clsdata;
+    dosfs_cache_entry_t *entry;
+
+#if (DOSFS_CONFIG_FAT12_SUPPORTED == 1)
+    if (volume->type == DOSFS_VOLUME_TYPE_FAT12)
+    {
+	uint8_t *fat_data;
+
+	offset = clsno + (clsno >> 1);
+	blkno = volume->fat1_blkno + (offset >> DOSFS_BLK_SHIFT);
+
+	status = dosfs_fat_cache_read(volume, blkno, &entry);
+	
+	if (status == F_NO_ERROR)
+	{
+	    fat_data = (uint8_t*)(entry->data + (offset & DOSFS_BLK_MASK));
+	    
+	    if (clsno & 1)
+	    {
+		clsdata = ((uint32_t)(*fat_data) >> 4);
+	    }
+	    else
+	    {
+		clsdata = ((uint32_t)(*fat_data));
+	    }
+	    
+	    if ((offset & DOSFS_BLK_MASK) == DOSFS_BLK_MASK)
+	    {
+		status = dosfs_fat_cache_read(volume, (blkno+1), &entry);
+		
+		if (status == F_NO_ERROR)
+		{
 		    fat_data = (uint8_t*)(entry->data + 0);
 		}
 	    }
@@ -3562,49 +3992,127 @@ static int dosfs_cluster_read_uncached(dosfs_volume_t *volume, uint32_t clsno, u
     return status;
 }
 
-#if (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0)
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
 
-static int dosfs_cluster_read(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clsdata)
+/* The free map splits the cluster range into DOSFS_CONFIG_FREE_MAP_ENTRIES units
+ * and keeps the number of free clusters per unit. A unit is scanned the first time
+ * the allocator (or f_getfreespace()) looks at it, and is then kept up to date by
+ * dosfs_cluster_write(). Units without free clusters can be skipped without reading
+ * their FAT blocks.
+ */
+
+static void dosfs_free_map_init(dosfs_volume_t *volume)
 {
-    int status = F_NO_ERROR;
-    uint32_t clsdata;
     unsigned int index;
 
-    index = clsno % DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES;
+    volume->free_map_shift = 0;
 
-    if (volume->cluster_cache[index].clsno != clsno)
+    while ((volume->last_clsno >> volume->free_map_shift) >= DOSFS_CONFIG_FREE_MAP_ENTRIES)
     {
-	DOSFS_VOLUME_STATISTICS_COUNT(cluster_cache_miss);
-
-	status = dosfs_cluster_read_uncached(volume, clsno, &clsdata);
-
-	volume->cluster_cache[index].clsno = clsno;
-	volume->cluster_cache[index].clsdata = clsdata;
+	volume->free_map_shift++;
     }
-    else
+
+    for (index = 0; index < DOSFS_CONFIG_FREE_MAP_ENTRIES; index++)
     {
-	DOSFS_VOLUME_STATISTICS_COUNT(cluster_cache_hit);
+	volume->free_map[index] = DOSFS_FREE_MAP_UNKNOWN;
     }
+}
 
-    *p_clsdata = volume->cluster_cache[index].clsdata;
+static int dosfs_free_map_count(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clscnt)
+{
+    int status = F_NO_ERROR;
+    uint32_t index, clsno_s, clsno_e, clscnt, clsdata;
 
-    return status;
-}
+    index = clsno >> volume->free_map_shift;
+
+    if (volume->free_map[index] == DOSFS_FREE_MAP_UNKNOWN)
+    {
+	DOSFS_VOLUME_STATISTICS_COUNT(free_map_scan);
 
-#else /* (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0) */
+	clsno_s = index << volume->free_map_shift;
+	clsno_e = clsno_s + (1 << volume->free_map_shift) -1;
 
-static inline int dosfs_cluster_read(dosfs_volume_t *volume, uint32_t clsno, uint32_t *p_clsdata)
-{
-    return dosfs_cluster_read_uncached(volume, clsno, p_clsdata);
+	if (clsno_s < 2)
+	{
+	    clsno_s = 2;
+	}
+
+	if (clsno_e > volume->last_clsno)
+	{
+	    clsno_e = volume->last_clsno;
+	}
+
+	for (clscnt = 0; ((status == F_NO_ERROR) && (clsno_s <= clsno_e)); clsno_s++)
+	{
+	    status = dosfs_cluster_read(volume, clsno_s, &clsdata);
+		
+	    if (status == F_NO_ERROR)
+	    {
+		if (clsdata == DOSFS_CLSNO_FREE)
+		{
+		    clscnt++;
+		}
+	    }
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    volume->free_map[index] = clscnt;
+	}
+    }
+
+    if (status == F_NO_ERROR)
+    {
+	*p_clscnt = volume->free_map[index];
+    }
+
+    return status;
 }
 
-#endif /* (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0) */
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
 
-static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t clsdata, int allocate)
+static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t clsdata)
 {
     int status = F_NO_ERROR;
-    uint32_t offset, blkno;
+    uint32_t offset, blkno, blkno_d;
     dosfs_cache_entry_t *entry;
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+    uint32_t index, clsdata_o;
+
+    /* The previous FAT entry is picked up from the FAT cache entry before
+     * it gets overwritten, to track free/used transitions of the free map.
+     */
+    index = clsno >> volume->free_map_shift;
+    clsdata_o = DOSFS_CLSNO_FREE;
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+
+    /* dosfs_fat_cache_modify() needs to be called before the cache entry
+     * is modified, so that it can preserve the order of FAT write backs.
+     * A link depends on the FAT entry of the cluster it points to, a free
+     * entry on the previous update, which removed the reference to it.
+     */
+    blkno_d = DOSFS_BLKNO_INVALID;
+
+#if (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1)
+    if ((clsdata >= 2) && (clsdata <= volume->last_clsno))
+    {
+#if (DOSFS_CONFIG_FAT12_SUPPORTED == 1)
+	if (volume->type == DOSFS_VOLUME_TYPE_FAT12)
+	{
+	    blkno_d = volume->fat1_blkno + ((clsdata + (clsdata >> 1)) >> DOSFS_BLK_SHIFT);
+	}
+	else
+#endif /* (DOSFS_CONFIG_FAT12_SUPPORTED == 1) */
+	{
+	    blkno_d = volume->fat1_blkno + ((clsdata << volume->type) >> DOSFS_BLK_SHIFT);
+	}
+    }
+
+    if (clsdata == DOSFS_CLSNO_FREE)
+    {
+	blkno_d = volume->fat_cache_last;
+    }
+#endif /* (DOSFS_CONFIG_FAT_CACHE_ENTRIES > 1) */
 
 #if (DOSFS_CONFIG_FAT12_SUPPORTED == 1)
     if (volume->type == DOSFS_VOLUME_TYPE_FAT12)
@@ -3616,9 +4124,18 @@ static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t
 	
 	status = dosfs_fat_cache_read(volume, blkno, &entry);
 
+	if (status == F_NO_ERROR)
+	{
+	    status = dosfs_fat_cache_modify(volume, entry, blkno_d);
+	}
+
 	if (status == F_NO_ERROR)
 	{
 	    fat_data = (uint8_t*)(entry->data + (offset & DOSFS_BLK_MASK));
+
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+	    clsdata_o = (clsno & 1) ? (*fat_data >> 4) : *fat_data;
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
 	    
 	    if (clsno & 1)
 	    {
@@ -3631,12 +4148,12 @@ static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t
 	    
 	    if ((offset & DOSFS_BLK_MASK) == DOSFS_BLK_MASK)
 	    {
-		dosfs_fat_cache_modify(volume, entry);
-		
 		status = dosfs_fat_cache_read(volume, (blkno+1), &entry);
 		
 		if (status == F_NO_ERROR)
 		{
+		    status = dosfs_fat_cache_modify(volume, entry, blkno_d);
+
 		    fat_data = (uint8_t*)(entry->data + 0);
 		}
 	    }
@@ -3647,6 +4164,10 @@ static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t
 	    
 	    if (status == F_NO_ERROR)
 	    {
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+		clsdata_o |= (clsno & 1) ? (*fat_data << 4) : ((*fat_data & 0x0f) << 8);
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+
 		if (clsno & 1)
 		{
 		    *fat_data = clsdata >> 4;
@@ -3655,8 +4176,6 @@ static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t
 		{
 		    *fat_data = (*fat_data & 0xf0) | ((clsdata >> 8) & 0x0f);
 		}
-		
-		dosfs_fat_cache_modify(volume, entry);
 	    }
 	}
     }
@@ -3668,6 +4187,11 @@ static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t
 
 	status = dosfs_fat_cache_read(volume, blkno, &entry);
 	    
+	if (status == F_NO_ERROR)
+	{
+	    status = dosfs_fat_cache_modify(volume, entry, blkno_d);
+	}
+
 	if (status == F_NO_ERROR)
 	{
 	    if (volume->type == DOSFS_VOLUME_TYPE_FAT16)
@@ -3676,6 +4200,10 @@ static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t
 
 		fat_data = (uint16_t*)((void*)(entry->data + (offset & DOSFS_BLK_MASK)));
 
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+		clsdata_o = DOSFS_FTOHS(*fat_data);
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+
 		*fat_data = DOSFS_HTOFS(clsdata);
 	    }
 	    else
@@ -3684,33 +4212,38 @@ static int dosfs_cluster_write(dosfs_volume_t *volume, uint32_t clsno, uint32_t
 
 		fat_data = (uint32_t*)((void*)(entry->data + (offset & DOSFS_BLK_MASK)));
 
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+		clsdata_o = DOSFS_FTOHL(*fat_data) & 0x0fffffff;
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+
 		*fat_data = (*fat_data & 0xf0000000) | (DOSFS_HTOFL(clsdata) & 0x0fffffff);
 	    }
-
-	    dosfs_fat_cache_modify(volume, entry);
 	}
     }
 
-#if (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0)
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
     if (status == F_NO_ERROR)
     {
-	unsigned int index;
-
-	index = clsno % DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES;
-	
-	if (allocate || (volume->cluster_cache[index].clsno == clsno))
+	if (volume->free_map[index] != DOSFS_FREE_MAP_UNKNOWN)
 	{
-	    volume->cluster_cache[index].clsno = clsno;
-	    volume->cluster_cache[index].clsdata = clsdata;
+	    if ((clsdata_o == DOSFS_CLSNO_FREE) && (clsdata != DOSFS_CLSNO_FREE))
+	    {
+		volume->free_map[index]--;
+	    }
+
+	    if ((clsdata_o != DOSFS_CLSNO_FREE) && (clsdata == DOSFS_CLSNO_FREE))
+	    {
+		volume->free_map[index]++;
+	    }
 	}
     }
-
-#endif /* (DOSFS_CONFIG_CLUSTER_CACHE_ENTRIES != 0) */
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
 
     return status;
 }
 
 
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES == 0)
 static int dosfs_cluster_chain_seek(dosfs_volume_t *volume, uint32_t clsno, uint32_t clscnt, uint32_t *p_clsno)
 {
     int status = F_NO_ERROR;
@@ -3743,6 +4276,8 @@ static int dosfs_cluster_chain_seek(dosfs_volume_t *volume, uint32_t clsno, uint
     return status;
 }
 
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES == 0) */
+
 
 /* In order to guarantee file system fault tolerance the chain allocation is done iteratively.
  * free entry is found, it's marked as END_OF_CHAIN, and then the previous entry in the chain
@@ -3758,6 +4293,9 @@ static int dosfs_cluster_chain_create(dosfs_volume_t *volume, uint32_t clsno, ui
 {
     int status = F_NO_ERROR;
     uint32_t clsno_a, clsno_f, clsno_n, clsno_l, clscnt_a, clsdata;
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+    uint32_t clsno_s, clscnt_f;
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
 
     clsno_f = volume->next_clsno;
     clsno_a = DOSFS_CLSNO_NONE;
@@ -3768,15 +4306,51 @@ static int dosfs_cluster_chain_create(dosfs_volume_t *volume, uint32_t clsno, ui
 
     do
     {
-	/* Bypass cluster cache on read while searching.
-	 */
-	status = dosfs_cluster_read_uncached(volume, clsno_n, &clsdata);
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+	status = dosfs_free_map_count(volume, clsno_n, &clscnt_f);
+
+	if ((status == F_NO_ERROR) && (clscnt_f == 0))
+	{
+	    /* No free cluster left in this unit, so skip to the start of the next one,
+	     * but stop if that would step over the start of the search.
+	     */
+	    DOSFS_VOLUME_STATISTICS_COUNT(free_map_skip);
+
+	    clsno_s = ((clsno_n >> volume->free_map_shift) +1) << volume->free_map_shift;
+
+	    if ((clsno_n < clsno_f) && (clsno_f < clsno_s))
+	    {
+		clsno_n = clsno_f;
+	    }
+	    else
+	    {
+		clsno_n = clsno_s;
+
+		if (clsno_n > volume->last_clsno)
+		{
+		    clsno_n = 2; 
+		}
+	    }
+
+	    if (clsno_n == clsno_f)
+	    {
+		status = F_ERR_NOMOREENTRY;
+	    }
+
+	    continue;
+	}
+
+	if (status == F_NO_ERROR)
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+	{
+	    status = dosfs_cluster_read(volume, clsno_n, &clsdata);
+	}
 	
 	if (status == F_NO_ERROR)
 	{
 	    if (clsdata == DOSFS_CLSNO_FREE)
 	    {
-		status = dosfs_cluster_write(volume, clsno_n, DOSFS_CLSNO_END_OF_CHAIN, TRUE);
+		status = dosfs_cluster_write(volume, clsno_n, DOSFS_CLSNO_END_OF_CHAIN);
 		
 		if (status == F_NO_ERROR)
 		{
@@ -3787,7 +4361,7 @@ static int dosfs_cluster_chain_create(dosfs_volume_t *volume, uint32_t clsno, ui
 		    
 		    if (clsno_l != DOSFS_CLSNO_NONE)
 		    {
-			status = dosfs_cluster_write(volume, clsno_l, clsno_n, TRUE);
+			status = dosfs_cluster_write(volume, clsno_l, clsno_n);
 		    }
 		    
 		    clsno_l = clsno_n;
@@ -3814,7 +4388,7 @@ static int dosfs_cluster_chain_create(dosfs_volume_t *volume, uint32_t clsno, ui
     {
 	if (clsno != DOSFS_CLSNO_NONE)
 	{
-	    status = dosfs_cluster_write(volume, clsno, clsno_a, TRUE);
+	    status = dosfs_cluster_write(volume, clsno, clsno_a);
 	}
 	
 	if (status == F_NO_ERROR)
@@ -3905,7 +4479,18 @@ static int dosfs_cluster_chain_create_sequential(dosfs_volume_t *volume, uint32_
 		    {
 			clsno_s = clsno_n -1;
 
-			status = dosfs_cluster_read_uncached(volume, clsno_s, &clsdata);
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+			if (volume->free_map[clsno_s >> volume->free_map_shift] == 0)
+			{
+			    DOSFS_VOLUME_STATISTICS_COUNT(free_map_skip);
+
+			    clsdata = DOSFS_CLSNO_END_OF_CHAIN;
+			}
+			else
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+			{
+			    status = dosfs_cluster_read(volume, clsno_s, &clsdata);
+			}
 
 			if (status == F_NO_ERROR)
 			{
@@ -3923,7 +4508,7 @@ static int dosfs_cluster_chain_create_sequential(dosfs_volume_t *volume, uint32_
 
 	if (status == F_NO_ERROR)
 	{
-	    status = dosfs_cluster_write(volume, clsno_n, DOSFS_CLSNO_END_OF_CHAIN, TRUE);
+	    status = dosfs_cluster_write(volume, clsno_n, DOSFS_CLSNO_END_OF_CHAIN);
 		
 	    if (status == F_NO_ERROR)
 	    {
@@ -3934,7 +4519,7 @@ static int dosfs_cluster_chain_create_sequential(dosfs_volume_t *volume, uint32_
 		    
 		if (clsno_l != DOSFS_CLSNO_NONE)
 		{
-		    status = dosfs_cluster_write(volume, clsno_l, clsno_n, TRUE);
+		    status = dosfs_cluster_write(volume, clsno_l, clsno_n);
 		}
 		
 		clsno_l = clsno_n;
@@ -3950,7 +4535,7 @@ static int dosfs_cluster_chain_create_sequential(dosfs_volume_t *volume, uint32_
     {
 	if (clsno != DOSFS_CLSNO_NONE)
 	{
-	    status = dosfs_cluster_write(volume, clsno, clsno_a, TRUE);
+	    status = dosfs_cluster_write(volume, clsno, clsno_a);
 	}
 	
 	if (status == F_NO_ERROR)
@@ -4019,9 +4604,18 @@ static int dosfs_cluster_chain_create_contiguous(dosfs_volume_t *volume, uint32_
     {
 	clsno_a--;
 
-	/* Bypass cluster cache on read while searching.
-	 */
-	status = dosfs_cluster_read_uncached(volume, clsno_a, &clsdata);
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+	if (volume->free_map[clsno_a >> volume->free_map_shift] == 0)
+	{
+	    DOSFS_VOLUME_STATISTICS_COUNT(free_map_skip);
+
+	    clsdata = DOSFS_CLSNO_END_OF_CHAIN;
+	}
+	else
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+	{
+	    status = dosfs_cluster_read(volume, clsno_a, &clsdata);
+	}
 	
 	if (status == F_NO_ERROR)
 	{
@@ -4048,7 +4642,7 @@ static int dosfs_cluster_chain_create_contiguous(dosfs_volume_t *volume, uint32_
 	    {
 		clsno_n--;
 
-		status = dosfs_cluster_write(volume, clsno_n, clsdata, FALSE);
+		status = dosfs_cluster_write(volume, clsno_n, clsdata);
 
 		clsdata = clsno_n;
 	    }
@@ -4094,18 +4688,27 @@ static int dosfs_cluster_chain_destroy(dosfs_volume_t *volume, uint32_t clsno, u
 
     device = DOSFS_VOLUME_DEVICE(volume);
 
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+    /* Queued blocks need to be written before their clusters
+     * can be reused. A failed block is dropped from the queue,
+     * and its error is left with the file that queued it.
+     */
+    if (volume->write_count)
+    {
+	dosfs_write_queue_drain(volume, NULL, volume->write_count);
+    }
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
     clsno_s = DOSFS_CLSNO_NONE;
     clsno_e = DOSFS_CLSNO_NONE;
 
     do
     {
-	/* Bypass cluster cache on read while destroying.
-	 */
-	status = dosfs_cluster_read_uncached(volume, clsno, &clsno_n);
+	status = dosfs_cluster_read(volume, clsno, &clsno_n);
 
 	if (status == F_NO_ERROR)
 	{
-	    status = dosfs_cluster_write(volume, clsno, clsdata, FALSE);
+	    status = dosfs_cluster_write(volume, clsno, clsdata);
 
 	    if (status == F_NO_ERROR)
 	    {
@@ -5955,7 +6558,7 @@ static int dosfs_path_find_callback_pattern(dosfs_volume_t *volume, void *privat
  * The number of secondary entries is contained within name->lfn_entries. 
  */
 
-static int dosfs_path_find_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t count, dosfs_find_callback_t callback, void *private, uint32_t *p_clsno, uint32_t *p_index, dosfs_dir_t **p_dir)
+static int dosfs_path_scan_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t count, dosfs_find_callback_t callback, void *private, uint32_t *p_clsno, uint32_t *p_index, dosfs_dir_t **p_dir)
 {
     int status = F_NO_ERROR;
     int done;
@@ -5977,7 +6580,7 @@ static int dosfs_path_find_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_
     }
     else
     {
-	/* dosfs_path_find_entry reports back clsno/index for the current set of
+	/* dosfs_path_scan_entry reports back clsno/index for the current set of
 	 * directory entries. Hence dosfs_path_find_next has to set to the next
 	 * entry by adding the composite size to "index", which of course
 	 * can cross then a cluster boundary.
@@ -6276,10 +6879,226 @@ static int dosfs_path_find_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_
     return status;
 }
 
-/*
- * filename   incoming full path
- * p_filename last path element 
- * p_clsno    clsno of parent directory of last path element
+#if (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0)
+
+/* The name cache remembers where a name was found within a directory, so that
+ * a repeated lookup can start scanning at the matching entry rather than at the
+ * start of the directory. A cache entry is only a hint. The scan started at the
+ * cached location has to report back that very location, otherwise the whole
+ * directory is scanned. Entries are dropped when their directory entries are
+ * destroyed, so that a reused location cannot alias a different set of entries.
+ *
+ * The entries are kept in most recently used order, so a lookup is a linear
+ * search over the hash values, and a new entry replaces the least recently
+ * used one. A slot is only claimed or moved to the front once a name was
+ * actually found, so that probing for names that do not exist leaves the
+ * cache alone.
+ */
+
+static void dosfs_name_cache_init(dosfs_volume_t *volume)
+{
+    unsigned int index;
+
+    for (index = 0; index < DOSFS_CONFIG_NAME_CACHE_ENTRIES; index++)
+    {
+	volume->name_cache[index].clsno_d = DOSFS_CLSNO_END_OF_CHAIN;
+    }
+}
+
+static void dosfs_name_cache_invalidate(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t first_clsno)
+{
+    unsigned int n;
+    dosfs_name_entry_t *name_entry;
+
+    for (n = 0; n < DOSFS_CONFIG_NAME_CACHE_ENTRIES; n++)
+    {
+	name_entry = &volume->name_cache[n];
+
+	if (((name_entry->clsno == clsno) && (name_entry->index == index)) ||
+	    ((first_clsno != DOSFS_CLSNO_NONE) && (name_entry->clsno_d == first_clsno)))
+	{
+	    name_entry->clsno_d = DOSFS_CLSNO_END_OF_CHAIN;
+	}
+    }
+}
+
+/* Move name_cache[index] to the front and return it.
+ */
+static dosfs_name_entry_t *dosfs_name_cache_touch(dosfs_volume_t *volume, unsigned int index)
+{
+    dosfs_name_entry_t name_entry;
+
+    if (index != 0)
+    {
+	name_entry = volume->name_cache[index];
+
+	memmove(&volume->name_cache[1], &volume->name_cache[0], (index * sizeof(dosfs_name_entry_t)));
+
+	volume->name_cache[0] = name_entry;
+    }
+
+    return &volume->name_cache[0];
+}
+
+/* FNV-1a over the directory clsno and the name being looked up (the 8.3 name,
+ * and for VFAT the upcased long name).
+ */
+static uint32_t dosfs_name_cache_hash(dosfs_volume_t *volume, uint32_t clsno)
+{
+    unsigned int n;
+    uint32_t hash;
+
+    hash = 0x811c9dc5;
+
+    hash = (hash ^ clsno) * 0x01000193;
+
+    for (n = 0; n < sizeof(volume->dir.dir_name); n++)
+    {
+	hash = (hash ^ volume->dir.dir_name[n]) * 0x01000193;
+    }
+
+#if (DOSFS_CONFIG_VFAT_SUPPORTED == 1)
+    for (n = 0; n < volume->lfn_count; n++)
+    {
+#if (DOSFS_CONFIG_UTF8_SUPPORTED == 1)
+	hash = (hash ^ dosfs_name_unicode_upcase(volume->lfn_name[n])) * 0x01000193;
+#else /* (DOSFS_CONFIG_UTF8_SUPPORTED == 1) */
+	hash = (hash ^ dosfs_name_ascii_upcase(volume->lfn_name[n])) * 0x01000193;
+#endif /* (DOSFS_CONFIG_UTF8_SUPPORTED == 1) */
+    }
+#endif /* (DOSFS_CONFIG_VFAT_SUPPORTED == 1) */
+
+    return hash;
+}
+
+static int dosfs_path_find_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t count, dosfs_find_callback_t callback, void *private, uint32_t *p_clsno, uint32_t *p_index, dosfs_dir_t **p_dir)
+{
+    int status = F_NO_ERROR;
+#if (DOSFS_CONFIG_VFAT_SUPPORTED == 1)
+    uint8_t dir_entries;
+#endif /* (DOSFS_CONFIG_VFAT_SUPPORTED == 1) */
+    unsigned int n;
+    uint32_t hash, clsno_m, index_m;
+    dosfs_name_entry_t *name_entry;
+    dosfs_dir_t *dir;
+
+    if ((callback == dosfs_path_find_callback_name) && (index == 0) && (count == 0))
+    {
+	hash = dosfs_name_cache_hash(volume, clsno);
+
+	for (n = 0; n < DOSFS_CONFIG_NAME_CACHE_ENTRIES; n++)
+	{
+	    if ((volume->name_cache[n].clsno_d == clsno) && (volume->name_cache[n].hash == hash))
+	    {
+		break;
+	    }
+	}
+
+	dir = NULL;
+
+	if (n != DOSFS_CONFIG_NAME_CACHE_ENTRIES)
+	{
+	    name_entry = &volume->name_cache[n];
+
+#if (DOSFS_CONFIG_VFAT_SUPPORTED == 1)
+	    /* A SFN match updates volume->dir_entries, which needs to be undone
+	     * if the scan has to be redone from the start of the directory.
+	     */
+	    dir_entries = volume->dir_entries;
+#endif /* (DOSFS_CONFIG_VFAT_SUPPORTED == 1) */
+
+	    status = dosfs_path_scan_entry(volume, name_entry->clsno, name_entry->index, 0, callback, private, &clsno_m, &index_m, &dir);
+
+	    if (status == F_NO_ERROR)
+	    {
+		if ((dir != NULL) && (clsno_m == name_entry->clsno) && (index_m == name_entry->index))
+		{
+		    DOSFS_VOLUME_STATISTICS_COUNT(name_cache_hit);
+
+		    dosfs_name_cache_touch(volume, n);
+		}
+		else
+		{
+#if (DOSFS_CONFIG_VFAT_SUPPORTED == 1)
+		    volume->dir_entries = dir_entries;
+#endif /* (DOSFS_CONFIG_VFAT_SUPPORTED == 1) */
+
+		    /* A stale hint is dropped, and its slot reused below.
+		     */
+		    name_entry->clsno_d = DOSFS_CLSNO_END_OF_CHAIN;
+
+		    dir = NULL;
+		}
+	    }
+	}
+
+	if ((status == F_NO_ERROR) && (dir == NULL))
+	{
+	    DOSFS_VOLUME_STATISTICS_COUNT(name_cache_miss);
+
+	    status = dosfs_path_scan_entry(volume, clsno, 0, 0, callback, private, &clsno_m, &index_m, &dir);
+
+	    if (status == F_NO_ERROR)
+	    {
+		/* A non-zero index at the start of a cluster would be taken by
+		 * dosfs_path_scan_entry() as a request to continue with the next
+		 * cluster, so such a location cannot be cached.
+		 */
+		if ((dir != NULL) && ((clsno_m == DOSFS_CLSNO_NONE) || !index_m || ((index_m << DOSFS_DIR_SHIFT) & volume->cls_mask)))
+		{
+		    if (n == DOSFS_CONFIG_NAME_CACHE_ENTRIES)
+		    {
+			n = DOSFS_CONFIG_NAME_CACHE_ENTRIES -1;
+		    }
+
+		    name_entry = dosfs_name_cache_touch(volume, n);
+
+		    name_entry->clsno_d = clsno;
+		    name_entry->hash = hash;
+		    name_entry->clsno = clsno_m;
+		    name_entry->index = index_m;
+		}
+	    }
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    if (p_clsno)
+	    {
+		if (dir != NULL)
+		{
+		    *p_clsno = clsno_m;
+		    *p_index = index_m;
+		}
+	    }
+
+	    if (p_dir)
+	    {
+		*p_dir = dir;
+	    }
+	}
+    }
+    else
+    {
+	status = dosfs_path_scan_entry(volume, clsno, index, count, callback, private, p_clsno, p_index, p_dir);
+    }
+
+    return status;
+}
+
+#else /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
+
+static inline int dosfs_path_find_entry(dosfs_volume_t *volume, uint32_t clsno, uint32_t index, uint32_t count, dosfs_find_callback_t callback, void *private, uint32_t *p_clsno, uint32_t *p_index, dosfs_dir_t **p_dir)
+{
+    return dosfs_path_scan_entry(volume, clsno, index, count, callback, private, p_clsno, p_index, p_dir);
+}
+
+#endif /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
+
+/*
+ * filename   incoming full path
+ * p_filename last path element 
+ * p_clsno    clsno of parent directory of last path element
  */
 
 static int dosfs_path_find_directory(dosfs_volume_t *volume, const char *filename, const char **p_filename, uint32_t *p_clsno)
@@ -6655,7 +7474,7 @@ static int dosfs_path_create_entry(dosfs_volume_t *volume, uint32_t clsno_d, uin
 
 		    if (status == F_NO_ERROR)
 		    {
-			status = dosfs_cluster_write(volume, clsno, clsno_s, TRUE);
+			status = dosfs_cluster_write(volume, clsno, clsno_s);
 
 			if (status == F_NO_ERROR)
 			{
@@ -6870,7 +7689,13 @@ static int dosfs_path_destroy_entry(dosfs_volume_t *volume, uint32_t clsno, uint
     dosfs_dir_t *dir;
 #endif /* (DOSFS_CONFIG_VFAT_SUPPORTED == 1) */
     dosfs_cache_entry_t *entry;
+#endif /* (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0) */
+
+#if (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0)
+    dosfs_name_cache_invalidate(volume, clsno, index, first_clsno);
+#endif /* (DOSFS_CONFIG_NAME_CACHE_ENTRIES != 0) */
 
+#if (DOSFS_CONFIG_TRANSACTION_SAFE_SUPPORTED == 0)
     if (clsno == DOSFS_CLSNO_NONE)
     {
 	clsno = volume->root_clsno;
@@ -7181,6 +8006,22 @@ static int dosfs_file_flush(dosfs_volume_t *volume, dosfs_file_t *file, int clos
 
 	status = dosfs_data_cache_flush(volume, file);
 
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+	/* The write queue is always emptied, so that a f_flush() or f_close()
+	 * acts as a barrier for all queued writes. Only a failed block of
+	 * this file is reported here; other files keep theirs in their own
+	 * status.
+	 */
+	if (status == F_NO_ERROR)
+	{
+	    status = dosfs_write_queue_drain(volume, file, volume->write_count);
+	}
+	else
+	{
+	    dosfs_write_queue_drain(volume, file, volume->write_count);
+	}
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
 	if (status == F_NO_ERROR)
 	{
 	    status = (*device->interface->sync)(device->context, true);
@@ -7190,30 +8031,268 @@ static int dosfs_file_flush(dosfs_volume_t *volume, dosfs_file_t *file, int clos
 	{
 	    file->status = status;
 	}
-
-	if (close || (file->flags & (DOSFS_FILE_FLAG_DIR_MODIFIED | DOSFS_FILE_FLAG_DATA_MODIFIED)))
+
+	if (close || (file->flags & (DOSFS_FILE_FLAG_DIR_MODIFIED | DOSFS_FILE_FLAG_DATA_MODIFIED)))
+	{
+	    status = dosfs_file_sync(volume, file, close, (file->flags & (DOSFS_FILE_FLAG_DIR_MODIFIED | DOSFS_FILE_FLAG_DATA_MODIFIED)), file->first_clsno, file->length);
+	}
+    }
+
+    if (status == F_NO_ERROR)
+    {
+	file->flags &= ~(DOSFS_FILE_FLAG_DATA_MODIFIED | DOSFS_FILE_FLAG_DIR_MODIFIED);
+    }
+
+    if (file->status != F_NO_ERROR)
+    {
+	status = file->status;
+    }
+
+    return status;
+}
+
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0)
+
+/* The extent cache of a file maps the index of a cluster within the cluster
+ * chain (clsofs) to its clsno. It is built lazily by dosfs_file_chain_seek(),
+ * which records every link it follows, merging consecutive clusters into one
+ * extent. Hence a seek only needs a binary search over the extents discovered
+ * so far, and FAT reads only for parts of the chain not yet visited.
+ *
+ * If the extent table is full, the extent whose removal leaves the shortest
+ * uncached span of the chain is dropped (which may be the new one). The last
+ * extent is never dropped, so that sequential reads/writes at the end of a
+ * file stay cached. This keeps the cached extents spread evenly over the
+ * chain: a seek into a part that is not cached follows no more links than
+ * the longest uncached span, which is bounded by about
+ * 2 * clscnt / DOSFS_CONFIG_EXTENT_CACHE_ENTRIES for a chain of "clscnt"
+ * clusters, rather than growing with the distance from the last extent.
+ *
+ * The table is a fixed part of dosfs_file_t (12 bytes per entry), as there is
+ * no allocator to grow it with the file. A chain with no more runs than
+ * entries is mapped completely and a seek costs O(log runs). A chain with
+ * more runs (worst case one cluster per run) is only covered partially, so
+ * a seek still walks O(clscnt / DOSFS_CONFIG_EXTENT_CACHE_ENTRIES) links.
+ */
+
+static dosfs_extent_t *dosfs_file_extent_search(dosfs_file_t *file, uint32_t clsofs)
+{
+    dosfs_extent_t *extent;
+    uint32_t index_l, index_h, index_m;
+
+    /* Find the extent with the largest extent->clsofs less than or equal to "clsofs".
+     */
+    extent = NULL;
+
+    index_l = 0;
+    index_h = file->extent_count;
+
+    while (index_l < index_h)
+    {
+	index_m = (index_l + index_h) >> 1;
+
+	if (file->extent_table[index_m].clsofs <= clsofs)
+	{
+	    extent = &file->extent_table[index_m];
+
+	    index_l = index_m +1;
+	}
+	else
+	{
+	    index_h = index_m;
+	}
+    }
+
+    return extent;
+}
+
+/* Insert a new extent at "index" into a full extent table, dropping the
+ * extent whose removal leaves the shortest uncached span. The span of an
+ * extent reaches from the end of its predecessor (or the start of the chain)
+ * to the start of its successor.
+ */
+static void dosfs_file_extent_evict(dosfs_file_t *file, uint32_t index, uint32_t clsofs, uint32_t clsno)
+{
+    dosfs_extent_t extent_table[DOSFS_CONFIG_EXTENT_CACHE_ENTRIES +1];
+    uint32_t index_v, span, span_v, clsofs_p;
+
+    memcpy(&extent_table[0], &file->extent_table[0], index * sizeof(dosfs_extent_t));
+    memcpy(&extent_table[index +1], &file->extent_table[index], (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES - index) * sizeof(dosfs_extent_t));
+
+    extent_table[index].clsofs = clsofs;
+    extent_table[index].clsno = clsno;
+    extent_table[index].clscnt = 1;
+
+    index_v = DOSFS_CONFIG_EXTENT_CACHE_ENTRIES;
+    span_v = 0xffffffff;
+    clsofs_p = 0;
+
+    for (index = 0; index < DOSFS_CONFIG_EXTENT_CACHE_ENTRIES; index++)
+    {
+	span = extent_table[index +1].clsofs - clsofs_p;
+
+	if (span < span_v)
+	{
+	    index_v = index;
+	    span_v = span;
+	}
+
+	clsofs_p = extent_table[index].clsofs + extent_table[index].clscnt;
+    }
+
+    memcpy(&file->extent_table[0], &extent_table[0], index_v * sizeof(dosfs_extent_t));
+    memcpy(&file->extent_table[index_v], &extent_table[index_v +1], (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES - index_v) * sizeof(dosfs_extent_t));
+}
+
+static void dosfs_file_extent_insert(dosfs_file_t *file, uint32_t clsofs, uint32_t clsno)
+{
+    dosfs_extent_t *extent, *extent_n, *extent_e;
+
+    extent = dosfs_file_extent_search(file, clsofs);
+    extent_e = &file->extent_table[file->extent_count];
+
+    if (extent && (clsofs < (extent->clsofs + extent->clscnt)))
+    {
+	/* Already known.
+	 */
+    }
+    else if (extent && (clsofs == (extent->clsofs + extent->clscnt)) && (clsno == (extent->clsno + extent->clscnt)))
+    {
+	extent->clscnt++;
+
+	extent_n = extent +1;
+
+	if ((extent_n != extent_e) && (extent_n->clsofs == (clsofs +1)) && (extent_n->clsno == (clsno +1)))
+	{
+	    extent->clscnt += extent_n->clscnt;
+
+	    memmove(extent_n, extent_n +1, (extent_e - (extent_n +1)) * sizeof(dosfs_extent_t));
+
+	    file->extent_count--;
+	}
+    }
+    else
+    {
+	extent_n = extent ? (extent +1) : &file->extent_table[0];
+
+	if (file->extent_count == DOSFS_CONFIG_EXTENT_CACHE_ENTRIES)
+	{
+	    dosfs_file_extent_evict(file, (extent_n - &file->extent_table[0]), clsofs, clsno);
+	}
+	else
+	{
+	    memmove(extent_n +1, extent_n, (extent_e - extent_n) * sizeof(dosfs_extent_t));
+
+	    file->extent_count++;
+
+	    extent_n->clsofs = clsofs;
+	    extent_n->clsno = clsno;
+	    extent_n->clscnt = 1;
+	}
+    }
+}
+
+/* Drop all extents beyond the first "clscnt" clusters of the chain.
+ */
+static void dosfs_file_extent_truncate(dosfs_file_t *file, uint32_t clscnt)
+{
+    dosfs_extent_t *extent;
+
+    while ((file->extent_count != 0) && (file->extent_table[file->extent_count -1].clsofs >= clscnt))
+    {
+	file->extent_count--;
+    }
+
+    if (file->extent_count != 0)
+    {
+	extent = &file->extent_table[file->extent_count -1];
+
+	if ((extent->clsofs + extent->clscnt) > clscnt)
+	{
+	    extent->clscnt = clscnt - extent->clsofs;
+	}
+    }
+}
+
+/* Starting at "clsno", which is the cluster with index "clsofs" within the file's
+ * cluster chain, follow "clscnt" links.
+ */
+static int dosfs_file_chain_seek(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t clsno, uint32_t clsofs, uint32_t clscnt, uint32_t *p_clsno)
+{
+    int status = F_NO_ERROR;
+    uint32_t clsofs_e, clsdata;
+    dosfs_extent_t *extent;
+
+    clsofs_e = clsofs + clscnt;
+
+    extent = dosfs_file_extent_search(file, clsofs_e);
+
+    if (extent && (clsofs_e < (extent->clsofs + extent->clscnt)))
+    {
+	DOSFS_VOLUME_STATISTICS_COUNT(extent_cache_hit);
+
+	*p_clsno = extent->clsno + (clsofs_e - extent->clsofs);
+    }
+    else
+    {
+	DOSFS_VOLUME_STATISTICS_COUNT(extent_cache_miss);
+
+	/* Start at the end of the closest extent, if that is closer than
+	 * the cluster passed in.
+	 */
+	if (extent && (clsofs < (extent->clsofs + extent->clscnt -1)))
+	{
+	    clsofs = extent->clsofs + extent->clscnt -1;
+	    clsno = extent->clsno + extent->clscnt -1;
+	}
+	else
+	{
+	    dosfs_file_extent_insert(file, clsofs, clsno);
+	}
+
+	do
+	{
+	    status = dosfs_cluster_read(volume, clsno, &clsdata);
+	
+	    if (status == F_NO_ERROR)
+	    {
+		if ((clsdata >= 2) && (clsdata <= volume->last_clsno))
+		{
+		    clsno = clsdata;
+		    clsofs++;
+
+		    dosfs_file_extent_insert(file, clsofs, clsno);
+		}
+		else
+		{
+		    status = F_ERR_EOF;
+		}
+	    }
+	}
+	while ((status == F_NO_ERROR) && (clsofs != clsofs_e));
+    
+	if (status == F_NO_ERROR)
 	{
-	    status = dosfs_file_sync(volume, file, close, (file->flags & (DOSFS_FILE_FLAG_DIR_MODIFIED | DOSFS_FILE_FLAG_DATA_MODIFIED)), file->first_clsno, file->length);
+	    *p_clsno = clsno;
 	}
     }
 
-    if (status == F_NO_ERROR)
-    {
-	file->flags &= ~(DOSFS_FILE_FLAG_DATA_MODIFIED | DOSFS_FILE_FLAG_DIR_MODIFIED);
-    }
+    return status;
+}
 
-    if (file->status != F_NO_ERROR)
-    {
-	status = file->status;
-    }
+#else /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
 
-    return status;
+static inline int dosfs_file_chain_seek(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t clsno, uint32_t clsofs, uint32_t clscnt, uint32_t *p_clsno)
+{
+    return dosfs_cluster_chain_seek(volume, clsno, clscnt, p_clsno);
 }
 
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
+
 static int dosfs_file_seek(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t position)
 {
     int status = F_NO_ERROR;
-    uint32_t clsno, clscnt, offset;
+    uint32_t clsno, clsofs, clscnt, offset;
 
     if ((file->mode & DOSFS_FILE_MODE_WRITE) && ((file->position & ~DOSFS_BLK_MASK) != (position & ~DOSFS_BLK_MASK)))
     {
@@ -7284,17 +8363,19 @@ static int dosfs_file_seek(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t
 				    if ((file->position == 0) || (file->position > offset))
 				    {
 					clsno = file->first_clsno;
-					clscnt = DOSFS_OFFSET_TO_CLSCNT(offset -1);
+					clsofs = 0;
 				    }
 				    else
 				    {
 					clsno = file->clsno;
-					clscnt = DOSFS_OFFSET_TO_CLSCNT(offset -1) - DOSFS_OFFSET_TO_CLSCNT(file->position -1);
+					clsofs = DOSFS_OFFSET_TO_CLSCNT(file->position -1);
 				    }
 
+				    clscnt = DOSFS_OFFSET_TO_CLSCNT(offset -1) - clsofs;
+
 				    if (clscnt != 0)
 				    {
-					status = dosfs_cluster_chain_seek(volume, clsno, clscnt, &clsno);
+					status = dosfs_file_chain_seek(volume, file, clsno, clsofs, clscnt, &clsno);
 				    }
 				}
 			    }
@@ -7377,6 +8458,10 @@ static int dosfs_file_shrink(dosfs_volume_t *volume, dosfs_file_t *file)
 	{
 	    file->first_clsno = DOSFS_CLSNO_NONE;
 	    file->last_clsno = DOSFS_CLSNO_NONE;
+
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0)
+	    file->extent_count = 0;
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
 		
 	    /* file->position is 0 here, but clsno/blkno/blkno_e
 	     * point to the first cluster, which just got deleted.
@@ -7401,6 +8486,10 @@ static int dosfs_file_shrink(dosfs_volume_t *volume, dosfs_file_t *file)
 		if (status == F_NO_ERROR)
 		{
 		    file->last_clsno = file->clsno;
+
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0)
+		    dosfs_file_extent_truncate(file, DOSFS_OFFSET_TO_CLSCNT(file->position -1) +1);
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
 		}
 	    }
 	}
@@ -7446,7 +8535,7 @@ static int dosfs_file_shrink(dosfs_volume_t *volume, dosfs_file_t *file)
 static int dosfs_file_extend(dosfs_volume_t *volume, dosfs_file_t *file, uint32_t length)
 {
     int status = F_NO_ERROR;
-    uint32_t clsno, clscnt, clsno_a, clsno_l, clsno_n, clsdata, blkno, blkno_e, blkcnt, count, size, position, offset, length_o;
+    uint32_t clsno, clsofs, clscnt, clsno_a, clsno_l, clsno_n, clsdata, blkno, blkno_e, blkcnt, count, size, position, offset, length_o;
     dosfs_cache_entry_t *entry;
 
     /* Compute below:
@@ -7499,17 +8588,19 @@ static int dosfs_file_extend(dosfs_volume_t *volume, dosfs_file_t *file, uint32_
 		    if (!file->position || (file->position > length_o))
 		    {
 			clsno = file->first_clsno;
-			clscnt = DOSFS_OFFSET_TO_CLSCNT(length_o -1);
+			clsofs = 0;
 		    }
 		    else
 		    {
 			clsno = file->clsno;
-			clscnt = DOSFS_OFFSET_TO_CLSCNT(length_o -1) - DOSFS_OFFSET_TO_CLSCNT(file->position -1);
+			clsofs = DOSFS_OFFSET_TO_CLSCNT(file->position -1);
 		    }
+
+		    clscnt = DOSFS_OFFSET_TO_CLSCNT(length_o -1) - clsofs;
 		    
 		    if (clscnt != 0)
 		    {
-			status = dosfs_cluster_chain_seek(volume, clsno, clscnt, &clsno);
+			status = dosfs_file_chain_seek(volume, file, clsno, clsofs, clscnt, &clsno);
 		    }
 		}
 
@@ -7748,7 +8839,7 @@ static int dosfs_file_extend(dosfs_volume_t *volume, dosfs_file_t *file, uint32_
 				else
 #endif /* (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1) */
 				{
-				    status = dosfs_cluster_chain_seek(volume, clsno, 1, &clsno);
+				    status = dosfs_file_chain_seek(volume, file, clsno, (DOSFS_OFFSET_TO_CLSCNT(position) -1), 1, &clsno);
 					
 				    if (status == F_NO_ERROR)
 				    {
@@ -8061,6 +9152,10 @@ static int dosfs_file_open(dosfs_volume_t *volume, const char *filename, uint32_
 				file->position = 0;
 				file->last_clsno = DOSFS_CLSNO_NONE;
 
+#if (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0)
+				file->extent_count = 0;
+#endif /* (DOSFS_CONFIG_EXTENT_CACHE_ENTRIES != 0) */
+
 				if (file->first_clsno == DOSFS_CLSNO_NONE)
 				{
 				    file->flags |= DOSFS_FILE_FLAG_END_OF_CHAIN;
@@ -8198,15 +9293,124 @@ static int dosfs_file_close(dosfs_volume_t *volume, dosfs_file_t *file)
     return status;
 }
 
-static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *data, uint32_t count, uint32_t *p_count)
+/* The aligned parts of a f_read()/f_write() are collected into a vector of up to
+ * DOSFS_CONFIG_DEVICE_SEGMENTS segments (merging runs that are contiguous across
+ * cluster boundaries) and handed to the device with one call, so that a run is
+ * transferred with a single multi block command.
+ */
+static int dosfs_file_read_vector(dosfs_volume_t *volume, dosfs_file_t *file, const dosfs_device_segment_t *segments, uint32_t count)
 {
     int status = F_NO_ERROR;
     dosfs_device_t *device;
-    uint32_t blkno, blkno_e, blkcnt, clsno, position, total, size;
-    dosfs_cache_entry_t *entry;
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+    uint32_t index;
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
+    device = DOSFS_VOLUME_DEVICE(volume);
+
+    DOSFS_VOLUME_STATISTICS_COUNT(data_vector_read);
+
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+    for (index = 0; (status == F_NO_ERROR) && (index < count); index++)
+    {
+	status = dosfs_write_queue_check(volume, segments[index].address, segments[index].length);
+    }
+
+    if (status == F_NO_ERROR)
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+    {
+	status = (*device->interface->read_vector)(device->context, segments, count, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+    }
+
+#if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
+    if (status == F_ERR_INVALIDSECTOR)
+    {
+	volume->flags |= DOSFS_VOLUME_FLAG_MEDIA_FAILURE;
+    }
+#endif /* (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1) */
+
+    /* After any data related disk operation, "file->status" needs
+     * to be checked asynchronously for a previous error.
+     */
+    if (file->status != F_NO_ERROR)
+    {
+	status = file->status;
+    }
+
+    return status;
+}
+
+static int dosfs_file_write_vector(dosfs_volume_t *volume, dosfs_file_t *file, const dosfs_device_segment_t *segments, uint32_t count)
+{
+    int status = F_NO_ERROR;
+    dosfs_device_t *device;
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+    uint32_t index, offset, blkcnt;
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
 
     device = DOSFS_VOLUME_DEVICE(volume);
 
+    DOSFS_VOLUME_STATISTICS_COUNT(data_vector_write);
+
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+    for (index = 0, blkcnt = 0; index < count; index++)
+    {
+	blkcnt += segments[index].length;
+    }
+
+    if ((file->mode & DOSFS_FILE_MODE_SEQUENTIAL) && ((volume->write_count + blkcnt) <= DOSFS_CONFIG_WRITE_QUEUE_ENTRIES))
+    {
+	/* Short runs of a sequential file are queued block by block.
+	 */
+	for (index = 0; (status == F_NO_ERROR) && (index < count); index++)
+	{
+	    for (offset = 0; (status == F_NO_ERROR) && (offset < segments[index].length); offset++)
+	    {
+		status = dosfs_write_queue_write(volume, file, segments[index].address + offset, segments[index].data + (offset * DOSFS_BLK_SIZE));
+	    }
+	}
+    }
+    else
+    {
+	for (index = 0; (status == F_NO_ERROR) && (index < count); index++)
+	{
+	    status = dosfs_write_queue_check(volume, segments[index].address, segments[index].length);
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    status = (*device->interface->write_vector)(device->context, segments, count, &file->status);
+	}
+    }
+#else /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+    status = (*device->interface->write_vector)(device->context, segments, count, &file->status);
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
+#if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
+    if (status == F_ERR_INVALIDSECTOR)
+    {
+	volume->flags |= DOSFS_VOLUME_FLAG_MEDIA_FAILURE;
+    }
+#endif /* (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1) */
+
+    /* After any data related disk operation, "file->status" needs
+     * to be checked asynchronously for a previous error.
+     */
+    if (file->status != F_NO_ERROR)
+    {
+	status = file->status;
+    }
+
+    return status;
+}
+
+static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *data, uint32_t count, uint32_t *p_count)
+{
+    int status = F_NO_ERROR;
+    uint32_t blkno, blkno_e, blkcnt, clsno, position, total, size, index, pending;
+    dosfs_cache_entry_t *entry;
+    dosfs_device_segment_t segments[DOSFS_CONFIG_DEVICE_SEGMENTS];
+
     *p_count = 0;
 
     if (file->position >= file->length)
@@ -8229,6 +9433,8 @@ static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *
         clsno = file->clsno;
         blkno = file->blkno;
         blkno_e = file->blkno_e;
+        index = 0;
+        pending = 0;
 
 	/* Take care of the case where there is an empty cluster chain,
 	 * but file->length is not 0.
@@ -8250,7 +9456,7 @@ static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *
 		else
 #endif /* (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1) */
 		{
-		    status = dosfs_cluster_chain_seek(volume, clsno, 1, &clsno);
+		    status = dosfs_file_chain_seek(volume, file, clsno, (DOSFS_OFFSET_TO_CLSCNT(position) -1), 1, &clsno);
 
 		    if (status == F_NO_ERROR)
 		    {
@@ -8313,7 +9519,7 @@ static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *
 			else
 #endif /* (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1) */
 			{
-			    status = dosfs_cluster_chain_seek(volume, clsno, 1, &clsno);
+			    status = dosfs_file_chain_seek(volume, file, clsno, (DOSFS_OFFSET_TO_CLSCNT(position) -1), 1, &clsno);
 			    
 			    if (status == F_NO_ERROR)
 			    {
@@ -8327,7 +9533,51 @@ static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *
                     {
                         if (count < DOSFS_BLK_SIZE)
                         {
-                            status = dosfs_data_cache_read(volume, file, blkno, &entry);
+			    entry = NULL;
+
+			    if (index != 0)
+			    {
+				/* If the tail block continues the pending run, it is read into the
+				 * data cache as part of the same vectored request.
+				 */
+				if ((index < DOSFS_CONFIG_DEVICE_SEGMENTS) && ((segments[index -1].address + segments[index -1].length) == blkno))
+				{
+				    status = dosfs_data_cache_claim(volume, file, blkno, &entry);
+
+				    if (entry != NULL)
+				    {
+					segments[index].address = blkno;
+					segments[index].data = entry->data;
+					segments[index].length = 1;
+
+					index++;
+				    }
+				}
+
+				if (status == F_NO_ERROR)
+				{
+				    status = dosfs_file_read_vector(volume, file, segments, index);
+
+				    if (status == F_NO_ERROR)
+				    {
+					pending = 0;
+				    }
+				}
+
+				index = 0;
+			    }
+
+			    if (status == F_NO_ERROR)
+			    {
+				if (entry != NULL)
+				{
+				    entry->blkno = blkno;
+				}
+				else
+				{
+				    status = dosfs_data_cache_read(volume, file, blkno, &entry);
+				}
+			    }
                     
                             if (status == F_NO_ERROR)
                             {
@@ -8349,39 +9599,69 @@ static int dosfs_file_read(dosfs_volume_t *volume, dosfs_file_t *file, uint8_t *
 
                             blkcnt = size >> DOSFS_BLK_SHIFT;
 
-                            status = dosfs_data_cache_flush(volume, file);
-
-                            if (status == F_NO_ERROR)
-                            {
-                                status = (*device->interface->read)(device->context, blkno, data, blkcnt, !!(file->mode & DOSFS_FILE_MODE_SEQUENTIAL));
+			    if (index == 0)
+			    {
+				status = dosfs_data_cache_flush(volume, file);
+			    }
 
-#if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
-				if (status == F_ERR_INVALIDSECTOR)
+			    if (status == F_NO_ERROR)
+			    {
+				if ((index != 0) && ((segments[index -1].address + segments[index -1].length) == blkno))
 				{
-				    volume->flags |= DOSFS_VOLUME_FLAG_MEDIA_FAILURE;
+				    segments[index -1].length += blkcnt;
 				}
-#endif /* (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1) */
+				else
+				{
+				    if (index == DOSFS_CONFIG_DEVICE_SEGMENTS)
+				    {
+					status = dosfs_file_read_vector(volume, file, segments, index);
 
-                                if (status == F_NO_ERROR)
-                                {
-                                    position += size;
-                                    data += size;
-                                    count -= size;
+					if (status == F_NO_ERROR)
+					{
+					    pending = 0;
+					}
 
-                                    blkno += blkcnt;
-                                }
+					index = 0;
+				    }
 
-				/* After any data related disk operation, "file->status" needs
-				 * to be checked asynchronously for a previous error.
-				 */
-				if (file->status != F_NO_ERROR)
-				{
-				    status = file->status;
+				    if (status == F_NO_ERROR)
+				    {
+					segments[index].address = blkno;
+					segments[index].data = data;
+					segments[index].length = blkcnt;
+
+					index++;
+				    }
 				}
-                            }
+			    }
+
+			    if (status == F_NO_ERROR)
+			    {
+				position += size;
+				data += size;
+				count -= size;
+				pending += size;
+
+				blkno += blkcnt;
+			    }
                         }
                     }
                 }
+
+		if ((status == F_NO_ERROR) && (index != 0))
+		{
+		    status = dosfs_file_read_vector(volume, file, segments, index);
+
+		    if (status == F_NO_ERROR)
+		    {
+			pending = 0;
+		    }
+		}
+
+		/* Data that was collected into a failed vectored request
+		 * was not transferred.
+		 */
+		count += pending;
             }
         
             if (status == F_NO_ERROR)
@@ -8408,8 +9688,9 @@ static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const ui
 {
     int status = F_NO_ERROR;
     dosfs_device_t *device;
-    uint32_t blkno, blkno_e, blkcnt, clsno, offset, position, length, total, size;
+    uint32_t blkno, blkno_e, blkcnt, clsno, offset, position, length, total, size, index, pending;
     dosfs_cache_entry_t *entry;
+    dosfs_device_segment_t segments[DOSFS_CONFIG_DEVICE_SEGMENTS];
 
     device = DOSFS_VOLUME_DEVICE(volume);
 
@@ -8475,6 +9756,8 @@ static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const ui
 		    clsno = file->clsno;
 		    blkno = file->blkno;
 		    blkno_e = file->blkno_e;
+		    index = 0;
+		    pending = 0;
 
 		    /* Take care of the case where the cluster chain of a file was truncted,
 		     * but the length was not adjusted on disk.
@@ -8500,7 +9783,7 @@ static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const ui
 				else
 #endif /* (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1) */
 				{
-				    status = dosfs_cluster_chain_seek(volume, clsno, 1, &clsno);
+				    status = dosfs_file_chain_seek(volume, file, clsno, (DOSFS_OFFSET_TO_CLSCNT(position) -1), 1, &clsno);
 			
 				    if (status == F_NO_ERROR)
 				    {
@@ -8599,7 +9882,7 @@ static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const ui
 					else
 #endif /* (DOSFS_CONFIG_CONTIGUOUS_SUPPORTED == 1) */
 					{
-					    status = dosfs_cluster_chain_seek(volume, clsno, 1, &clsno);
+					    status = dosfs_file_chain_seek(volume, file, clsno, (DOSFS_OFFSET_TO_CLSCNT(position) -1), 1, &clsno);
 					
 					    if (status == F_NO_ERROR)
 					    {
@@ -8614,13 +9897,28 @@ static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const ui
 				{
 				    if (count < DOSFS_BLK_SIZE)
 				    {
-					if (position >= offset)
+					if (index != 0)
 					{
-					    status = dosfs_data_cache_zero(volume, file, blkno, &entry);
+					    status = dosfs_file_write_vector(volume, file, segments, index);
+
+					    if (status == F_NO_ERROR)
+					    {
+						pending = 0;
+					    }
+
+					    index = 0;
 					}
-					else
+
+					if (status == F_NO_ERROR)
 					{
-					    status = dosfs_data_cache_read(volume, file, blkno, &entry);
+					    if (position >= offset)
+					    {
+						status = dosfs_data_cache_zero(volume, file, blkno, &entry);
+					    }
+					    else
+					    {
+						status = dosfs_data_cache_read(volume, file, blkno, &entry);
+					    }
 					}
 
 					if (status == F_NO_ERROR)
@@ -8652,35 +9950,62 @@ static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const ui
 
 					if (status == F_NO_ERROR)
 					{
-					    status = (*device->interface->write)(device->context, blkno, data, blkcnt, &file->status);
-
-#if (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1)
-					    if (status == F_ERR_INVALIDSECTOR)
+					    if ((index != 0) && ((segments[index -1].address + segments[index -1].length) == blkno))
 					    {
-						volume->flags |= DOSFS_VOLUME_FLAG_MEDIA_FAILURE;
+						segments[index -1].length += blkcnt;
 					    }
-#endif /* (DOSFS_CONFIG_MEDIA_FAILURE_SUPPORTED == 1) */
-
-					    if (status == F_NO_ERROR)
+					    else
 					    {
-						position += size;
-						data += size;
-						count -= size;
-                                            
-						blkno += blkcnt;
-					    }
+						if (index == DOSFS_CONFIG_DEVICE_SEGMENTS)
+						{
+						    status = dosfs_file_write_vector(volume, file, segments, index);
 
-					    /* After any data related disk operation, "file->status" needs
-					     * to be checked asynchronously for a previous error.
-					     */
-					    if (file->status != F_NO_ERROR)
-					    {
-						status = file->status;
+						    if (status == F_NO_ERROR)
+						    {
+							pending = 0;
+						    }
+
+						    index = 0;
+						}
+
+						if (status == F_NO_ERROR)
+						{
+						    segments[index].address = blkno;
+						    segments[index].data = (uint8_t*)data;
+						    segments[index].length = blkcnt;
+
+						    index++;
+						}
 					    }
 					}
+
+					if (status == F_NO_ERROR)
+					{
+					    position += size;
+					    data += size;
+					    count -= size;
+					    pending += size;
+                                            
+					    blkno += blkcnt;
+					}
 				    }
 				}
 			    }
+
+			    if ((status == F_NO_ERROR) && (index != 0))
+			    {
+				status = dosfs_file_write_vector(volume, file, segments, index);
+
+				if (status == F_NO_ERROR)
+				{
+				    pending = 0;
+				}
+			    }
+
+			    /* Data that was collected into a failed vectored request
+			     * was not transferred.
+			     */
+			    count += pending;
 			}
 		    }
 
@@ -8690,6 +10015,14 @@ static int dosfs_file_write(dosfs_volume_t *volume, dosfs_file_t *file, const ui
 			{
 			    status = (*device->interface->sync)(device->context, !!(file->mode & DOSFS_FILE_MODE_RANDOM));
 			}
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+			else
+			{
+			    /* Hand queued blocks to the device while it is idle.
+			     */
+			    status = dosfs_write_queue_drain(volume, file, 0);
+			}
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
 
 			if (file->status != F_NO_ERROR)
 			{
@@ -8744,13 +10077,13 @@ int f_initvolume(void)
 	{
 	    n_lock = o_lock | DOSFS_DEVICE_LOCK_VOLUME;
 	    
-	    if (armv7m_atomic_compare_exchange(&device->lock, &o_lock, n_lock))
+	    if (DOSFS_PORT_ATOMIC_COMPARE_EXCHANGE(&device->lock, &o_lock, n_lock))
 	    {
 		break;
 	    }
 	}
 	
-	armv7m_core_yield();
+	DOSFS_PORT_CORE_YIELD();
     }
 
     status = dosfs_volume_lock_noinit(volume);
@@ -8764,7 +10097,7 @@ int f_initvolume(void)
 
     if (status != F_NO_ERROR)
     {
-	armv7m_atomic_and(&device->lock, ~DOSFS_DEVICE_LOCK_VOLUME);
+	DOSFS_PORT_ATOMIC_AND(&device->lock, ~DOSFS_DEVICE_LOCK_VOLUME);
     }
 
     return status;
@@ -8800,7 +10133,7 @@ int f_delvolume(void)
 
     if (status == F_NO_ERROR)
     {
-	armv7m_atomic_and(&device->lock, ~DOSFS_DEVICE_LOCK_VOLUME);
+	DOSFS_PORT_ATOMIC_AND(&device->lock, ~DOSFS_DEVICE_LOCK_VOLUME);
     }
 
     return status;
@@ -8891,7 +10224,12 @@ int f_hardformat(int fattype)
 int f_getfreespace(F_SPACE *pspace)
 {
     int status = F_NO_ERROR;
-    uint32_t clsno, clsno_e, clscnt_total, clscnt_free, clsdata;
+    uint32_t clsno, clsno_e, clscnt_total, clscnt_free;
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+    uint32_t clscnt;
+#else /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
+    uint32_t clsdata;
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
     dosfs_volume_t *volume;
 
     volume = DOSFS_DEFAULT_VOLUME();
@@ -8912,11 +10250,20 @@ int f_getfreespace(F_SPACE *pspace)
 	    clscnt_total = volume->last_clsno - 1;
 	    clscnt_free = 0;
 
+#if (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0)
+	    for (clsno = 2, clsno_e = volume->last_clsno; ((status == F_NO_ERROR) && (clsno <= clsno_e)); clsno = (((clsno >> volume->free_map_shift) +1) << volume->free_map_shift))
+	    {
+		status = dosfs_free_map_count(volume, clsno, &clscnt);
+
+		if (status == F_NO_ERROR)
+		{
+		    clscnt_free += clscnt;
+		}
+	    }
+#else /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
 	    for (clsno = 2, clsno_e = volume->last_clsno; ((status == F_NO_ERROR) && (clsno <= clsno_e)); clsno++)
 	    {
-		/* Bypass cluster cache on read while scanning.
-		 */
-		status = dosfs_cluster_read_uncached(volume, clsno, &clsdata);
+		status = dosfs_cluster_read(volume, clsno, &clsdata);
 		
 		if (status == F_NO_ERROR)
 		{
@@ -8926,6 +10273,7 @@ int f_getfreespace(F_SPACE *pspace)
 		    }
 		}
 	    }
+#endif /* (DOSFS_CONFIG_FREE_MAP_ENTRIES != 0) */
 
 #if (DOSFS_CONFIG_FSINFO_SUPPORTED == 1)
 	    if (status == F_NO_ERROR)
@@ -9009,6 +10357,29 @@ int f_getserial(unsigned long *p_serial)
     return status;
 }
 
+int f_getqueue(unsigned long *p_count)
+{
+    int status = F_NO_ERROR;
+    dosfs_volume_t *volume;
+
+    volume = DOSFS_DEFAULT_VOLUME();
+    
+    status = dosfs_volume_lock(volume);
+    
+    if (status == F_NO_ERROR)
+    {
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+	*p_count = volume->write_count;
+#else /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+	*p_count = 0;
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
+	status = dosfs_volume_unlock(volume, status);
+    }
+
+    return status;
+}
+
 
 int f_setlabel(const char *volname)
 {
@@ -10864,6 +12235,13 @@ int f_rewind(F_FILE *file)
 
 	    status = dosfs_data_cache_flush(volume, file);
 
+#if (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0)
+	    if (status == F_NO_ERROR)
+	    {
+		status = dosfs_write_queue_drain(volume, file, volume->write_count);
+	    }
+#endif /* (DOSFS_CONFIG_WRITE_QUEUE_ENTRIES != 0) */
+
 	    if (status == F_NO_ERROR)
 	    {
 		status = (*device->interface->sync)(device->context, true);
@@ -720,3 +720,92 @@ int dosfs_device_format(dosfs_device_t *device, uint8_t *data)
 
     return status;
 }
+
+int dosfs_device_read_vector(const dosfs_device_interface_t *interface, void *context, const dosfs_device_segment_t *segments, uint32_t count, bool prefetch)
+{
+    int status = F_NO_ERROR;
+    const dosfs_device_segment_t *segment, *segment_e;
+    bool stream, next;
+
+    /* Segments of a contiguous run are issued with "prefetch", so that the CMD18
+     * stays open and the whole run is transferred with one command. If the caller
+     * did not ask for "prefetch", the stream is closed again after the last segment.
+     */
+    stream = false;
+
+    for (segment = segments, segment_e = segments + count; (status == F_NO_ERROR) && (segment != segment_e); segment++)
+    {
+	next = (((segment +1) != segment_e) && ((segment->address + segment->length) == (segment +1)->address));
+
+	status = (*interface->read)(context, segment->address, segment->data, segment->length, (prefetch || stream || next));
+
+	stream = (stream || next);
+    }
+
+    if (!prefetch && stream)
+    {
+	if (status == F_NO_ERROR)
+	{
+	    status = (*interface->sync)(context, true);
+	}
+	else
+	{
+	    (*interface->sync)(context, true);
+	}
+    }
+
+    return status;
+}
+
+int dosfs_device_write_vector(const dosfs_device_interface_t *interface, void *context, const dosfs_device_segment_t *segments, uint32_t count, volatile uint8_t *p_status)
+{
+    int status = F_NO_ERROR;
+    const dosfs_device_segment_t *segment, *segment_e;
+    volatile uint8_t status_vector;
+    bool stream, next, deferred;
+
+    /* Segments of a contiguous run are issued with a non-NULL "p_status", so that the
+     * CMD25 stays open between segments. If the caller asked for a synchronous write,
+     * the stream is closed at the end and its deferred status is folded in.
+     */
+    status_vector = F_NO_ERROR;
+    stream = false;
+    deferred = false;
+
+    for (segment = segments, segment_e = segments + count; (status == F_NO_ERROR) && (segment != segment_e); segment++)
+    {
+	next = (((segment +1) != segment_e) && ((segment->address + segment->length) == (segment +1)->address));
+
+	if ((p_status == NULL) && (stream || next))
+	{
+	    status = (*interface->write)(context, segment->address, segment->data, segment->length, &status_vector);
+
+	    deferred = true;
+	}
+	else
+	{
+	    status = (*interface->write)(context, segment->address, segment->data, segment->length, p_status);
+	}
+
+	stream = next;
+    }
+
+    if (deferred)
+    {
+	if (status == F_NO_ERROR)
+	{
+	    status = (*interface->sync)(context, true);
+	}
+	else
+	{
+	    (*interface->sync)(context, true);
+	}
+
+	if (status == F_NO_ERROR)
+	{
+	    status = status_vector;
+	}
+    }
+
+    return status;
+}
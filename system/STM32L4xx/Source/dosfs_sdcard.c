@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2017 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "dosfs_core.h"
+#include "dosfs_sdcard.h"
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE == 1)
+
+#include <stdio.h>
+#include <sys/types.h>
+
+dosfs_sdcard_t dosfs_sdcard;
+
+/* SDSC over SPI at 24MHz.
+ */
+const dosfs_sdcard_timing_t dosfs_sdcard_timing_sdsc = {
+    40,     /* command */
+    20,     /* stop    */
+    200,    /* read    */
+    200,    /* write   */
+    750,    /* program */
+    2000,   /* erase   */
+};
+
+/* SDHC over a 4 bit SDMMC at 24MHz.
+ */
+const dosfs_sdcard_timing_t dosfs_sdcard_timing_sdhc = {
+    20,     /* command */
+    10,     /* stop    */
+    45,     /* read    */
+    45,     /* write   */
+    500,    /* program */
+    2000,   /* erase   */
+};
+
+/* SFLASH over QSPI, including the FTL overhead of 2 page programs per block.
+ */
+const dosfs_sdcard_timing_t dosfs_sdcard_timing_sflash = {
+    5,      /* command */
+    0,      /* stop    */
+    60,     /* read    */
+    20,     /* write   */
+    1200,   /* program */
+    0,      /* erase   */
+};
+
+static void dosfs_sdcard_time(dosfs_sdcard_t *sdcard, uint32_t time)
+{
+    DOSFS_SDCARD_STATISTICS_COUNT_N(sdcard_time, time);
+}
+
+static void dosfs_sdcard_stop(dosfs_sdcard_t *sdcard)
+{
+    if (sdcard->state == DOSFS_SDCARD_STATE_READ_MULTIPLE)
+    {
+	DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_stop);
+
+	dosfs_sdcard_time(sdcard, sdcard->timing.stop);
+    }
+
+    if (sdcard->state == DOSFS_SDCARD_STATE_WRITE_MULTIPLE)
+    {
+	DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_stop);
+
+	dosfs_sdcard_time(sdcard, sdcard->timing.stop + sdcard->timing.program);
+    }
+
+    sdcard->state = DOSFS_SDCARD_STATE_READY;
+}
+
+static int dosfs_sdcard_image_read(dosfs_sdcard_t *sdcard, uint32_t address, uint8_t *data, uint32_t length)
+{
+    int status = F_NO_ERROR;
+    size_t count;
+
+    if (fseeko(sdcard->image, ((off_t)address << DOSFS_BLK_SHIFT), SEEK_SET) != 0)
+    {
+	status = F_ERR_READ;
+    }
+    else
+    {
+	count = fread(data, 1, (length << DOSFS_BLK_SHIFT), sdcard->image);
+
+	/* A sparse image may be shorter than "block_count", so the tail reads as zero.
+	 */
+	if (count != (length << DOSFS_BLK_SHIFT))
+	{
+	    memset(data + count, 0, (length << DOSFS_BLK_SHIFT) - count);
+	}
+    }
+
+    return status;
+}
+
+static int dosfs_sdcard_image_write(dosfs_sdcard_t *sdcard, uint32_t address, const uint8_t *data, uint32_t length)
+{
+    int status = F_NO_ERROR;
+
+    if (fseeko(sdcard->image, ((off_t)address << DOSFS_BLK_SHIFT), SEEK_SET) != 0)
+    {
+	status = F_ERR_WRITE;
+    }
+    else
+    {
+	if (fwrite(data, 1, (length << DOSFS_BLK_SHIFT), sdcard->image) != (length << DOSFS_BLK_SHIFT))
+	{
+	    status = F_ERR_WRITE;
+	}
+    }
+
+    return status;
+}
+
+static int dosfs_sdcard_release(void *context)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_RELEASE\n");
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    dosfs_sdcard_stop(sdcard);
+
+    fflush(sdcard->image);
+
+    return status;
+}
+
+static int dosfs_sdcard_info(void *context, uint8_t *p_media, uint8_t *p_write_protected, uint32_t *p_block_count, uint32_t *p_au_size, uint32_t *p_serial)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_INFO\n");
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    if (sdcard->state == DOSFS_SDCARD_STATE_NONE)
+    {
+	status = F_ERR_CARDREMOVED;
+    }
+    else
+    {
+	*p_media = sdcard->media;
+	*p_write_protected = false;
+	*p_block_count = sdcard->block_count;
+	*p_au_size = sdcard->au_size;
+	*p_serial = 0x53494d55; /* "SIMU" */
+    }
+
+    return status;
+}
+
+static int dosfs_sdcard_format(void *context)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_FORMAT\n");
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    dosfs_sdcard_stop(sdcard);
+
+    return status;
+}
+
+static int dosfs_sdcard_erase(void *context, uint32_t address, uint32_t length)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_ERASE %08x, %d\n", address, length);
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    dosfs_sdcard_stop(sdcard);
+
+    DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_erase);
+    DOSFS_SDCARD_STATISTICS_COUNT_N(sdcard_erase, length);
+
+    dosfs_sdcard_time(sdcard, sdcard->timing.erase);
+
+    return status;
+}
+
+static int dosfs_sdcard_discard(void *context, uint32_t address, uint32_t length)
+{
+#if (DOSFS_CONFIG_STATISTICS == 1)
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+#endif /* (DOSFS_CONFIG_STATISTICS == 1) */
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_DISCARD %08x, %d\n", address, length);
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_discard);
+    DOSFS_SDCARD_STATISTICS_COUNT_N(sdcard_discard, length);
+
+    return status;
+}
+
+static int dosfs_sdcard_read(void *context, uint32_t address, uint8_t *data, uint32_t length, bool prefetch)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_READ %08x, %d%s\n", address, length, (prefetch ? " PREFETCH" : ""));
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    if ((address >= sdcard->block_count) || (length > (sdcard->block_count - address)))
+    {
+	status = F_ERR_READ;
+    }
+    else
+    {
+	if (!prefetch && (length == 1))
+	{
+	    dosfs_sdcard_stop(sdcard);
+
+	    DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_read);
+	    DOSFS_SDCARD_STATISTICS_COUNT(sdcard_read_single);
+
+	    dosfs_sdcard_time(sdcard, sdcard->timing.command + sdcard->timing.read);
+	}
+	else
+	{
+	    /* A CMD18 stream that continues at the current address does not
+	     * pay for a new command.
+	     */
+	    if ((sdcard->state != DOSFS_SDCARD_STATE_READ_MULTIPLE) || (sdcard->address != address))
+	    {
+		dosfs_sdcard_stop(sdcard);
+
+		DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_read);
+
+		dosfs_sdcard_time(sdcard, sdcard->timing.command);
+
+		sdcard->state = DOSFS_SDCARD_STATE_READ_MULTIPLE;
+	    }
+
+	    DOSFS_SDCARD_STATISTICS_COUNT_N(sdcard_read_multiple, length);
+
+	    dosfs_sdcard_time(sdcard, sdcard->timing.read * length);
+
+	    sdcard->address = address + length;
+
+	    if (!prefetch)
+	    {
+		dosfs_sdcard_stop(sdcard);
+	    }
+	}
+
+	DOSFS_SDCARD_STATISTICS_COUNT_N(sdcard_data_read, (length << DOSFS_BLK_SHIFT));
+
+	status = dosfs_sdcard_image_read(sdcard, address, data, length);
+    }
+
+    return status;
+}
+
+static int dosfs_sdcard_write(void *context, uint32_t address, const uint8_t *data, uint32_t length, volatile uint8_t *p_status)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_WRITE %08x, %d%s\n", address, length, (p_status ? " ASYNC" : ""));
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    if ((address >= sdcard->block_count) || (length > (sdcard->block_count - address)))
+    {
+	status = F_ERR_WRITE;
+    }
+    else
+    {
+	if ((p_status == NULL) && (length == 1))
+	{
+	    dosfs_sdcard_stop(sdcard);
+
+	    DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_write);
+	    DOSFS_SDCARD_STATISTICS_COUNT(sdcard_write_single);
+
+	    dosfs_sdcard_time(sdcard, sdcard->timing.command + sdcard->timing.write + sdcard->timing.program);
+	}
+	else
+	{
+	    if ((sdcard->state != DOSFS_SDCARD_STATE_WRITE_MULTIPLE) || (sdcard->address != address))
+	    {
+		dosfs_sdcard_stop(sdcard);
+
+		DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_write);
+
+		dosfs_sdcard_time(sdcard, sdcard->timing.command);
+
+		sdcard->state = DOSFS_SDCARD_STATE_WRITE_MULTIPLE;
+	    }
+
+	    DOSFS_SDCARD_STATISTICS_COUNT_N(sdcard_write_multiple, length);
+
+	    dosfs_sdcard_time(sdcard, sdcard->timing.write * length);
+
+	    sdcard->address = address + length;
+
+	    if (p_status == NULL)
+	    {
+		dosfs_sdcard_stop(sdcard);
+	    }
+	}
+
+	DOSFS_SDCARD_STATISTICS_COUNT_N(sdcard_data_write, (length << DOSFS_BLK_SHIFT));
+
+	status = dosfs_sdcard_image_write(sdcard, address, data, length);
+    }
+
+    return status;
+}
+
+static int dosfs_sdcard_sync(void *context, bool wait)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)context;
+    int status = F_NO_ERROR;
+
+#if (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1)
+    printf("SDCARD_SYNC%s\n", (wait ? " WAIT" : ""));
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE_TRACE == 1) */
+
+    DOSFS_SDCARD_STATISTICS_COUNT(sdcard_command_sync);
+
+    if (sdcard->state == DOSFS_SDCARD_STATE_NONE)
+    {
+	status = F_ERR_CARDREMOVED;
+    }
+    else
+    {
+	dosfs_sdcard_stop(sdcard);
+    }
+
+    return status;
+}
+
+static const dosfs_device_interface_t dosfs_sdcard_interface;
+
+static int dosfs_sdcard_read_vector(void *context, const dosfs_device_segment_t *segments, uint32_t count, bool prefetch)
+{
+    return dosfs_device_read_vector(&dosfs_sdcard_interface, context, segments, count, prefetch);
+}
+
+static int dosfs_sdcard_write_vector(void *context, const dosfs_device_segment_t *segments, uint32_t count, volatile uint8_t *p_status)
+{
+    return dosfs_device_write_vector(&dosfs_sdcard_interface, context, segments, count, p_status);
+}
+
+static int dosfs_sdcard_busy(void *context, bool *p_busy)
+{
+    /* The program time is only accounted for, the image is never busy.
+     */
+    *p_busy = false;
+
+    return F_NO_ERROR;
+}
+
+static const dosfs_device_interface_t dosfs_sdcard_interface = {
+    dosfs_sdcard_release,
+    dosfs_sdcard_info,
+    dosfs_sdcard_format,
+    dosfs_sdcard_erase,
+    dosfs_sdcard_discard,
+    dosfs_sdcard_read,
+    dosfs_sdcard_write,
+    dosfs_sdcard_sync,
+    dosfs_sdcard_read_vector,
+    dosfs_sdcard_write_vector,
+    dosfs_sdcard_busy,
+};
+
+int dosfs_sdcard_init(const char *filename, uint8_t media, const dosfs_sdcard_timing_t *timing)
+{
+    dosfs_sdcard_t *sdcard = (dosfs_sdcard_t*)&dosfs_sdcard;
+    int status = F_NO_ERROR;
+    off_t size;
+    bool format;
+    uint8_t data[DOSFS_BLK_SIZE];
+
+    dosfs_device.lock = DOSFS_DEVICE_LOCK_INIT;
+    dosfs_device.context = (void*)sdcard;
+    dosfs_device.interface = &dosfs_sdcard_interface;
+
+    if (sdcard->image)
+    {
+	fclose(sdcard->image);
+    }
+
+    memset(sdcard, 0, sizeof(dosfs_sdcard_t));
+
+    if (timing == NULL)
+    {
+	timing = ((media == DOSFS_MEDIA_SFLASH) ? &dosfs_sdcard_timing_sflash : ((media == DOSFS_MEDIA_SDHC) ? &dosfs_sdcard_timing_sdhc : &dosfs_sdcard_timing_sdsc));
+    }
+
+    sdcard->media = media;
+    sdcard->au_size = ((media == DOSFS_MEDIA_SFLASH) ? 1 : 0);
+    sdcard->timing = *timing;
+
+    format = false;
+
+    sdcard->image = fopen(filename, "r+b");
+
+    if (sdcard->image == NULL)
+    {
+	sdcard->image = fopen(filename, "w+b");
+
+	if (sdcard->image != NULL)
+	{
+	    /* Create a sparse image by writing the very last byte.
+	     */
+	    size = ((off_t)DOSFS_CONFIG_SDCARD_SIMULATE_BLKCNT << DOSFS_BLK_SHIFT);
+
+	    if ((fseeko(sdcard->image, size -1, SEEK_SET) != 0) || (fputc(0, sdcard->image) == EOF))
+	    {
+		fclose(sdcard->image);
+
+		sdcard->image = NULL;
+	    }
+
+	    format = true;
+	}
+    }
+
+    if (sdcard->image == NULL)
+    {
+	status = F_ERR_INVALIDMEDIA;
+    }
+    else
+    {
+	fseeko(sdcard->image, 0, SEEK_END);
+
+	size = ftello(sdcard->image);
+
+	sdcard->block_count = (uint32_t)(size >> DOSFS_BLK_SHIFT);
+	sdcard->state = DOSFS_SDCARD_STATE_READY;
+
+	if (format)
+	{
+	    status = dosfs_device_format(&dosfs_device, data);
+
+	    if (status != F_NO_ERROR)
+	    {
+		status = F_ERR_NOTFORMATTED;
+	    }
+	}
+
+#if (DOSFS_CONFIG_STATISTICS == 1)
+	memset(&sdcard->statistics, 0, sizeof(sdcard->statistics));
+#endif /* (DOSFS_CONFIG_STATISTICS == 1) */
+    }
+
+    dosfs_device.lock = 0;
+
+    return status;
+}
+
+#endif /* (DOSFS_CONFIG_SDCARD_SIMULATE == 1) */
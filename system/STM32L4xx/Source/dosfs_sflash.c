@@ -26,10 +26,10 @@
  * WITH THE SOFTWARE.
  */
 
-#if defined(STM32L476xx) || defined(STM32L496xx)
-
 #include "dosfs_sflash.h"
 
+#if defined(STM32L476xx) || defined(STM32L496xx) || (DOSFS_CONFIG_SFLASH_SIMULATE == 1)
+
 #include <stdio.h>
 
 #if (DOSFS_CONFIG_SFLASH_DEBUG == 1)
@@ -39,6 +39,9 @@
 dosfs_sflash_t dosfs_sflash;
 
 static uint32_t dosfs_sflash_cache[2 * (DOSFS_SFLASH_BLOCK_SIZE / sizeof(uint32_t))];
+#if (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0)
+static uint16_t dosfs_sflash_xlate_cache[DOSFS_SFLASH_XLATE_CACHE_ENTRIES][DOSFS_SFLASH_BLOCK_SIZE / sizeof(uint16_t)];
+#endif /* (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0) */
 
 #if (DOSFS_CONFIG_SFLASH_DEBUG == 1)
 static uint8_t sflash_data_shadow[DOSFS_SFLASH_DATA_SIZE]; /* 16 MB */
@@ -491,6 +494,16 @@ static uint32_t dosfs_sflash_nor_identify(dosfs_sflash_t *sflash)
     return data_size;
 }
 
+static void dosfs_sflash_nor_select(dosfs_sflash_t *sflash)
+{
+    stm32l4_qspi_select(&sflash->qspi);
+}
+
+static void dosfs_sflash_nor_unselect(dosfs_sflash_t *sflash)
+{
+    stm32l4_qspi_unselect(&sflash->qspi);
+}
+
 static bool dosfs_sflash_nor_erase(dosfs_sflash_t *sflash, uint32_t address)
 {
     uint8_t temp[1];
@@ -661,11 +674,23 @@ static void dosfs_sflash_nor_read(dosfs_sflash_t *sflash, uint32_t address, uint
 
 #else /* (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
 
+#include <stdlib.h>
+
+/* The simulated NOR is a RAM image that starts out erased. The FTL can be run
+ * on a host that way, with the NOR traffic and the erase count per physical
+ * sector being tracked in "statistics".
+ */
+
 static uint32_t dosfs_sflash_nor_identify(dosfs_sflash_t *sflash)
 {
     if (sflash->image == NULL)
     {
 	sflash->image = (uint8_t*)malloc(DOSFS_CONFIG_SFLASH_SIMULATE_DATA_SIZE);
+
+	if (sflash->image)
+	{
+	    memset(sflash->image, 0xff, DOSFS_CONFIG_SFLASH_SIMULATE_DATA_SIZE);
+	}
     }
 
     sflash->address  = 0;
@@ -673,6 +698,14 @@ static uint32_t dosfs_sflash_nor_identify(dosfs_sflash_t *sflash)
     return sflash->image ? DOSFS_CONFIG_SFLASH_SIMULATE_DATA_SIZE : 0;
 }
 
+static void dosfs_sflash_nor_select(dosfs_sflash_t *sflash)
+{
+}
+
+static void dosfs_sflash_nor_unselect(dosfs_sflash_t *sflash)
+{
+}
+
 static void dosfs_sflash_nor_erase(dosfs_sflash_t *sflash, uint32_t address)
 {
     if (sflash->address != (address >> 24))
@@ -684,6 +717,7 @@ static void dosfs_sflash_nor_erase(dosfs_sflash_t *sflash, uint32_t address)
 
     DOSFS_SFLASH_STATISTICS_COUNT(sflash_command_erase);
     DOSFS_SFLASH_STATISTICS_COUNT_N(sflash_nor_erase, DOSFS_SFLASH_ERASE_SIZE);
+    DOSFS_SFLASH_STATISTICS_COUNT(sflash_nor_erase_sector[(address & 0x01ff0000) / DOSFS_SFLASH_ERASE_SIZE]);
 
     memset(&sflash->image[address & 0x01ff0000], 0xff, 65536);
 }
@@ -799,6 +833,52 @@ static void dosfs_sflash_ftl_info_entry(dosfs_sflash_t *sflash, uint32_t logical
     dosfs_sflash_nor_write(sflash, (dosfs_sflash_ftl_translate(sflash, logical) & ~(DOSFS_SFLASH_ERASE_SIZE-1)) + ((logical & DOSFS_SFLASH_LOGICAL_BLOCK_MASK) * 4), 3, (const uint8_t*)&info);
 }
 
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY != DOSFS_SFLASH_VICTIM_POLICY_WEAR)
+
+static uint32_t dosfs_sflash_ftl_victim_score(dosfs_sflash_t *sflash, uint32_t index)
+{
+    uint32_t deleted, score;
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT)
+    uint32_t age;
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT) */
+
+    deleted = (sflash->victim_score[index] & DOSFS_SFLASH_VICTIM_DELETED_MASK) >> DOSFS_SFLASH_VICTIM_DELETED_SHIFT;
+
+    if (sflash->victim_delta[index] >= DOSFS_SFLASH_VICTIM_WEAR_THRESHOLD)
+    {
+	/* Static wear leveling takes precedence over reclaiming space.
+	 */
+	score = 0x80000000 + sflash->victim_delta[index];
+    }
+    else
+    {
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_GREEDY)
+	score = deleted;
+#else /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_GREEDY) */
+	/* The benefit (deleted blocks, weighted by the age of the sector) over the cost
+	 * (valid blocks to be copied). The age is counted in passes of the write frontier
+	 * over all sectors. The header block is counted as valid block, so the divisor
+	 * is never 0.
+	 */
+	age = ((uint16_t)(sflash->victim_clock - sflash->victim_stamp[index])) / (sflash->data_size / DOSFS_SFLASH_ERASE_SIZE);
+
+	score = ((age + 1) * deleted * 256) / (DOSFS_SFLASH_BLOCK_INFO_ENTRIES - deleted);
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_GREEDY) */
+    }
+
+    return score;
+}
+
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY != DOSFS_SFLASH_VICTIM_POLICY_WEAR) */
+
+static inline void dosfs_sflash_ftl_victim_stamp(dosfs_sflash_t *sflash, uint32_t sector)
+{
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT)
+    sflash->victim_clock++;
+    sflash->victim_stamp[sector] = sflash->victim_clock;
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT) */
+}
+
 static uint32_t dosfs_sflash_ftl_victim(dosfs_sflash_t *sflash)
 {
     uint32_t index, victim_index, victim_score, score;
@@ -846,7 +926,11 @@ static uint32_t dosfs_sflash_ftl_victim(dosfs_sflash_t *sflash)
 	
     do
     {
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_WEAR)
 	score = sflash->victim_delta[index] + sflash->victim_score[index];
+#else /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_WEAR) */
+	score = dosfs_sflash_ftl_victim_score(sflash, index);
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_WEAR) */
 	
 	if (victim_score < score)
 	{
@@ -873,17 +957,30 @@ static uint32_t dosfs_sflash_ftl_victim(dosfs_sflash_t *sflash)
     return dosfs_sflash_ftl_sector_lookup(sflash, victim_index) * DOSFS_SFLASH_ERASE_SIZE;
 }
     
+/* Called before cache[0]/cache[1] get used as scratch buffers. Without a
+ * dedicated xlate cache those buffers double as its 2 entries, which are
+ * dropped here. All xlate updates are written through to NOR, so nothing
+ * gets lost.
+ */
+static inline void dosfs_sflash_ftl_scratch(dosfs_sflash_t *sflash)
+{
+#if (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES == 0)
+    sflash->xlate_logical[0] = DOSFS_SFLASH_BLOCK_RESERVED;
+    sflash->xlate_logical[1] = DOSFS_SFLASH_BLOCK_RESERVED;
+#endif /* (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES == 0) */
+}
+
 static void dosfs_sflash_ftl_swap(dosfs_sflash_t *sflash, uint32_t victim_offset, uint32_t victim_sector, uint32_t victim_erase_count, uint32_t reclaim_offset)
 {
     uint32_t erase_info[4];
     uint32_t *cache;
 
+    dosfs_sflash_ftl_scratch(sflash);
+
     cache = sflash->cache[0];
 
     dosfs_sflash_nor_erase(sflash, victim_offset);
 
-    sflash->xlate_logical = DOSFS_SFLASH_BLOCK_RESERVED;
-
     memset(cache, 0xff, DOSFS_SFLASH_BLOCK_SIZE);
 
     cache[0] &= ~DOSFS_SFLASH_INFO_NOT_WRITTEN_TO;
@@ -923,11 +1020,11 @@ static void dosfs_sflash_ftl_reclaim(dosfs_sflash_t *sflash, uint32_t victim_off
      * and reclaim_erase_count will be 0xffffffff.
      */
 
+    dosfs_sflash_ftl_scratch(sflash);
+
     cache = sflash->cache[0];
     data = sflash->cache[1];
 
-    sflash->xlate_logical = DOSFS_SFLASH_BLOCK_RESERVED;
-    
     dosfs_sflash_nor_read(sflash, victim_offset, DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)cache);
 
     victim_sector = cache[0] & DOSFS_SFLASH_INFO_DATA_MASK;
@@ -935,6 +1032,12 @@ static void dosfs_sflash_ftl_reclaim(dosfs_sflash_t *sflash, uint32_t victim_off
 
     // printf("==== RECLAIM ==== %08x (%d=%d (%d)), %d\n", victim_offset, victim_sector, (sflash->victim_delta[victim_sector] + sflash->victim_score[victim_sector]), victim_erase_count, sflash->alloc_free);
 
+#if (DOSFS_CONFIG_SFLASH_SIMULATE_TRACE == 1)
+    printf("SFLASH_VICTIM %d, %08x, %d, %d, %d\n", victim_sector, victim_offset, victim_erase_count, sflash->victim_delta[victim_sector], ((sflash->victim_score[victim_sector] & DOSFS_SFLASH_VICTIM_DELETED_MASK) >> DOSFS_SFLASH_VICTIM_DELETED_SHIFT));
+#endif /* (DOSFS_CONFIG_SFLASH_SIMULATE_TRACE == 1) */
+
+    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_reclaim);
+
     
     /* Mark the victim sector as VICTIM and record the "reclaim_offset" (ERASE -> VICTIM).
      */
@@ -953,10 +1056,18 @@ static void dosfs_sflash_ftl_reclaim(dosfs_sflash_t *sflash, uint32_t victim_off
     dosfs_sflash_nor_write(sflash, victim_offset, DOSFS_SFLASH_INFO_EXTENDED_TOTAL, (const uint8_t*)cache);
 
     sflash->alloc_sector = victim_sector;
+
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD)
+    if (sflash->frontier_sector == victim_sector)
+    {
+	/* The free blocks of the victim are collected below for the
+	 * current frontier.
+	 */
+	sflash->frontier_count = 0;
+    }
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
     
     {
-	sflash->xlate_logical = DOSFS_SFLASH_BLOCK_RESERVED;
-
 	sflash->alloc_count   = 0;
 	sflash->alloc_index   = 0;
 	sflash->alloc_mask[0] = 0;
@@ -1000,7 +1111,7 @@ static void dosfs_sflash_ftl_reclaim(dosfs_sflash_t *sflash, uint32_t victim_off
 		}
 		else
 		{
-		    sflash->xlate2_logical = DOSFS_SFLASH_BLOCK_RESERVED;
+		    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_reclaim_copy);
 
 		    dosfs_sflash_nor_read(sflash, victim_offset + (index * DOSFS_SFLASH_BLOCK_SIZE), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)data);
 
@@ -1013,6 +1124,15 @@ static void dosfs_sflash_ftl_reclaim(dosfs_sflash_t *sflash, uint32_t victim_off
 #if (DOSFS_CONFIG_SFLASH_DEBUG == 1)
 	assert(n == ((sflash->victim_score[victim_sector] & DOSFS_SFLASH_VICTIM_DELETED_MASK) >> DOSFS_SFLASH_VICTIM_DELETED_SHIFT));
 #endif /* DOSFS_CONFIG_SFLASH_DEBUG == 1 */
+
+	/* A victim without any deleted blocks was picked for wear leveling only.
+	 */
+	DOSFS_SFLASH_STATISTICS_COUNT_N(sflash_ftl_reclaim_free, n);
+
+	if (n == 0)
+	{
+	    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_reclaim_static);
+	}
     }
 
     victim_erase_count++;
@@ -1067,6 +1187,11 @@ static void dosfs_sflash_ftl_reclaim(dosfs_sflash_t *sflash, uint32_t victim_off
     }
 
     sflash->victim_score[victim_sector] = (sflash->alloc_count ? 0 : DOSFS_SFLASH_VICTIM_ALLOCATED_MASK);
+
+    if (!sflash->alloc_count)
+    {
+	dosfs_sflash_ftl_victim_stamp(sflash, victim_sector);
+    }
 }
 
 
@@ -1075,15 +1200,21 @@ static void dosfs_sflash_ftl_format(dosfs_sflash_t *sflash)
     uint32_t offset, erase_count, erase_info[8];
     uint32_t *cache;
 
+#if (DOSFS_CONFIG_SFLASH_SIMULATE == 0)
     stm32l4_gpio_pin_configure(GPIO_PIN_PB2, (GPIO_PUPD_NONE | GPIO_OSPEED_HIGH | GPIO_OTYPE_PUSHPULL | GPIO_MODE_OUTPUT));
     stm32l4_gpio_pin_configure(GPIO_PIN_PA10, (GPIO_PUPD_NONE | GPIO_OSPEED_HIGH | GPIO_OTYPE_PUSHPULL | GPIO_MODE_OUTPUT));
+#endif /* (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
+
+    dosfs_sflash_ftl_scratch(sflash);
 
     cache = sflash->cache[0];
 
     for (offset = 0; offset < sflash->data_size; offset += DOSFS_SFLASH_ERASE_SIZE)
     {
+#if (DOSFS_CONFIG_SFLASH_SIMULATE == 0)
 	stm32l4_gpio_pin_write(GPIO_PIN_PB2, !(offset & DOSFS_SFLASH_ERASE_SIZE));
 	stm32l4_gpio_pin_write(GPIO_PIN_PA10, !!(offset & DOSFS_SFLASH_ERASE_SIZE));
+#endif /* (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
 
 	erase_count = 1;
 
@@ -1131,8 +1262,127 @@ static void dosfs_sflash_ftl_format(dosfs_sflash_t *sflash)
     memset(&sflash_xlate_shadow, 0xff, sizeof(sflash_xlate_shadow));
 #endif /* DOSFS_CONFIG_SFLASH_DEBUG == 1 */
 
+#if (DOSFS_CONFIG_SFLASH_SIMULATE == 0)
     stm32l4_gpio_pin_configure(GPIO_PIN_PB2, (GPIO_PUPD_NONE | GPIO_OSPEED_HIGH | GPIO_OTYPE_PUSHPULL | GPIO_MODE_INPUT));
     stm32l4_gpio_pin_configure(GPIO_PIN_PA10, (GPIO_PUPD_NONE | GPIO_OSPEED_HIGH | GPIO_OTYPE_PUSHPULL | GPIO_MODE_INPUT));
+#endif /* (DOSFS_CONFIG_SFLASH_SIMULATE == 0) */
+}
+
+/* The xlate cache holds the most recently used XLATE/XLATE_SECONDARY blocks, keyed
+ * by their logical block number. "xlate_order" lists the entries from the most
+ * recently used to the least recently used one. A logical block number does not
+ * change while the block is moved by a reclaim, so nothing needs to be flushed
+ * there. A newly allocated XLATE/XLATE_SECONDARY block is set up via
+ * dosfs_sflash_ftl_xlate_create(), which also replaces any stale entry left
+ * behind by a deleted block with the same logical block number.
+ */
+
+static void dosfs_sflash_ftl_xlate_reset(dosfs_sflash_t *sflash)
+{
+    uint32_t entry;
+
+    for (entry = 0; entry < DOSFS_SFLASH_XLATE_CACHE_ENTRIES; entry++)
+    {
+	sflash->xlate_logical[entry] = DOSFS_SFLASH_BLOCK_RESERVED;
+	sflash->xlate_order[entry] = entry;
+    }
+}
+
+static bool dosfs_sflash_ftl_xlate_entry(dosfs_sflash_t *sflash, uint32_t xlate_logical, uint16_t **p_xlate_cache)
+{
+    uint32_t index, entry;
+    bool hit;
+
+    for (index = 0; index < DOSFS_SFLASH_XLATE_CACHE_ENTRIES; index++)
+    {
+	if (sflash->xlate_logical[sflash->xlate_order[index]] == xlate_logical)
+	{
+	    break;
+	}
+    }
+
+    hit = (index != DOSFS_SFLASH_XLATE_CACHE_ENTRIES);
+
+    if (!hit)
+    {
+	index = DOSFS_SFLASH_XLATE_CACHE_ENTRIES -1;
+    }
+
+    entry = sflash->xlate_order[index];
+
+    for (; index != 0; index--)
+    {
+	sflash->xlate_order[index] = sflash->xlate_order[index -1];
+    }
+
+    sflash->xlate_order[0] = entry;
+    sflash->xlate_logical[entry] = xlate_logical;
+
+    *p_xlate_cache = sflash->xlate_cache[entry];
+
+    return hit;
+}
+
+static uint16_t *dosfs_sflash_ftl_xlate_cache(dosfs_sflash_t *sflash, uint32_t xlate_segment, uint32_t xlate_logical)
+{
+    uint16_t *xlate_cache;
+
+    if (!dosfs_sflash_ftl_xlate_entry(sflash, xlate_logical, &xlate_cache))
+    {
+	if (xlate_logical == sflash->xlate_table[xlate_segment])
+	{
+	    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_miss);
+	}
+	else
+	{
+	    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_miss);
+	}
+
+	DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_segment_miss[xlate_segment]);
+
+	dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
+    }
+    else
+    {
+	if (xlate_logical == sflash->xlate_table[xlate_segment])
+	{
+	    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_hit);
+	}
+	else
+	{
+	    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_hit);
+	}
+
+	DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_segment_hit[xlate_segment]);
+    }
+
+    return xlate_cache;
+}
+
+static void dosfs_sflash_ftl_xlate_create(dosfs_sflash_t *sflash, uint32_t xlate_logical)
+{
+    uint16_t *xlate_cache;
+
+    dosfs_sflash_ftl_xlate_entry(sflash, xlate_logical, &xlate_cache);
+
+    memset(xlate_cache, 0xff, DOSFS_SFLASH_BLOCK_SIZE);
+}
+
+static void dosfs_sflash_ftl_xlate_rename(dosfs_sflash_t *sflash, uint32_t xlate_logical, uint32_t xlate2_logical)
+{
+    uint32_t entry;
+
+    for (entry = 0; entry < DOSFS_SFLASH_XLATE_CACHE_ENTRIES; entry++)
+    {
+	if (sflash->xlate_logical[entry] == xlate2_logical)
+	{
+	    sflash->xlate_logical[entry] = DOSFS_SFLASH_BLOCK_RESERVED;
+	}
+	else if (sflash->xlate_logical[entry] == xlate_logical)
+	{
+	    sflash->xlate_logical[entry] = xlate2_logical;
+	}
+    }
 }
 
 /* Modify XLATE/XLATE_SECONDARY mappings. Assumption is that XLATE/XLATE_SECONDARY already
@@ -1145,24 +1395,10 @@ static void dosfs_sflash_ftl_modify(dosfs_sflash_t *sflash, uint32_t address, ui
     uint32_t xlate_segment, xlate_index, read_logical;
     uint16_t *xlate_cache, *xlate2_cache;
 
-    xlate_cache   = (uint16_t*)sflash->cache[0];
-    xlate2_cache  = (uint16_t*)sflash->cache[1];
-
     xlate_segment = (address - DOSFS_SFLASH_XLATE_OFFSET) >> DOSFS_SFLASH_XLATE_SEGMENT_SHIFT;
     xlate_index   = (address - DOSFS_SFLASH_XLATE_OFFSET) & DOSFS_SFLASH_XLATE_INDEX_MASK;
 
-    if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-    {
-        DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_miss);
-
-	sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-	
-	dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-    }
-    else
-    {
-        DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_hit);
-    }
+    xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
     read_logical = xlate_cache[xlate_index];
     
@@ -1175,24 +1411,13 @@ static void dosfs_sflash_ftl_modify(dosfs_sflash_t *sflash, uint32_t address, ui
 	
 	xlate_cache[xlate_index] = write_logical;
 	
-	dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical) + (xlate_index * 2), 2, (const uint8_t*)&xlate_cache[xlate_index]);
+	dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_table[xlate_segment]) + (xlate_index * 2), 2, (const uint8_t*)&xlate_cache[xlate_index]);
 	
 	dosfs_sflash_ftl_info_type(sflash, write_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_DATA_COMMITTED | address);
     }
     else
     {
-	if (sflash->xlate2_logical != sflash->xlate2_table[xlate_segment])
-	{
-	    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_miss);
-
-	    sflash->xlate2_logical = sflash->xlate2_table[xlate_segment];
-	    
-	    dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate2_cache);
-	}
-	else
-	{
-	    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_hit);
-	}
+	xlate2_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate2_table[xlate_segment]);
 
 #if (DOSFS_CONFIG_SFLASH_DEBUG == 1)
 	assert(read_logical == sflash_xlate_shadow[address]);
@@ -1201,7 +1426,7 @@ static void dosfs_sflash_ftl_modify(dosfs_sflash_t *sflash, uint32_t address, ui
 	
 	xlate2_cache[xlate_index] = write_logical;
 	
-	dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical) + (xlate_index * 2), 2, (const uint8_t*)&xlate2_cache[xlate_index]);
+	dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_table[xlate_segment]) + (xlate_index * 2), 2, (const uint8_t*)&xlate2_cache[xlate_index]);
 	
 	dosfs_sflash_ftl_info_type(sflash, write_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_DATA_COMMITTED | address);
 	
@@ -1209,7 +1434,7 @@ static void dosfs_sflash_ftl_modify(dosfs_sflash_t *sflash, uint32_t address, ui
 	{
 	    xlate_cache[xlate_index] = DOSFS_SFLASH_BLOCK_DELETED;
 	    
-	    dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical) + (xlate_index * 2), 2, (const uint8_t*)&xlate_cache[xlate_index]);
+	    dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_table[xlate_segment]) + (xlate_index * 2), 2, (const uint8_t*)&xlate_cache[xlate_index]);
 	    
 	    dosfs_sflash_ftl_info_type(sflash, read_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_DELETED);
 	    
@@ -1223,24 +1448,10 @@ static void dosfs_sflash_ftl_trim(dosfs_sflash_t *sflash, uint32_t address, uint
     uint32_t xlate_segment, xlate_index;
     uint16_t *xlate_cache, *xlate2_cache;
 
-    xlate_cache   = (uint16_t*)sflash->cache[0];
-    xlate2_cache  = (uint16_t*)sflash->cache[1];
-
     xlate_segment = (address - DOSFS_SFLASH_XLATE_OFFSET) >> DOSFS_SFLASH_XLATE_SEGMENT_SHIFT;
     xlate_index   = (address - DOSFS_SFLASH_XLATE_OFFSET) & DOSFS_SFLASH_XLATE_INDEX_MASK;
 
-    if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-    {
-	DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_miss);
-
-	sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-	
-	dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-    }
-    else
-    {
-	DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_hit);;
-    }
+    xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
     if (xlate_cache[xlate_index] != DOSFS_SFLASH_BLOCK_DELETED)
     {
@@ -1250,24 +1461,13 @@ static void dosfs_sflash_ftl_trim(dosfs_sflash_t *sflash, uint32_t address, uint
 
 	xlate_cache[xlate_index] = DOSFS_SFLASH_BLOCK_DELETED;
 				
-	dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical) + (xlate_index * 2), 2, (const uint8_t*)&xlate_cache[xlate_index]);
+	dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_table[xlate_segment]) + (xlate_index * 2), 2, (const uint8_t*)&xlate_cache[xlate_index]);
     }
     else
     {
 	if (sflash->xlate2_table[xlate_segment] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 	{
-	    if (sflash->xlate2_logical != sflash->xlate2_table[xlate_segment])
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_miss);
-
-		sflash->xlate2_logical = sflash->xlate2_table[xlate_segment];
-		
-		dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate2_cache);
-	    }
-	    else
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_hit);
-	    }
+	    xlate2_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate2_table[xlate_segment]);
 
 #if (DOSFS_CONFIG_SFLASH_DEBUG == 1)
 	    sflash_xlate_shadow[address] = DOSFS_SFLASH_BLOCK_DELETED;
@@ -1275,7 +1475,7 @@ static void dosfs_sflash_ftl_trim(dosfs_sflash_t *sflash, uint32_t address, uint
 
 	    xlate2_cache[xlate_index] = DOSFS_SFLASH_BLOCK_DELETED;
 	    
-	    dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical) + (xlate_index * 2), 2, (const uint8_t*)&xlate2_cache[xlate_index]);
+	    dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_table[xlate_segment]) + (xlate_index * 2), 2, (const uint8_t*)&xlate2_cache[xlate_index]);
 	}
     }
 
@@ -1375,9 +1575,6 @@ static void dosfs_sflash_ftl_check(dosfs_sflash_t *sflash)
 			    }
 			    else
 			    {
-				xlate_cache   = (uint16_t*)sflash->cache[0];
-				xlate2_cache  = (uint16_t*)sflash->cache[1];
-				
 				xlate_segment = (address - DOSFS_SFLASH_XLATE_OFFSET) >> DOSFS_SFLASH_XLATE_SEGMENT_SHIFT;
 				xlate_index   = (address - DOSFS_SFLASH_XLATE_OFFSET) & DOSFS_SFLASH_XLATE_INDEX_MASK;
 				
@@ -1387,12 +1584,7 @@ static void dosfs_sflash_ftl_check(dosfs_sflash_t *sflash)
 				}
 				else
 				{
-				    if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-				    {
-					sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-
-					dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-				    }
+				    xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
 				    read_logical = xlate_cache[xlate_index];
 				    
@@ -1400,12 +1592,7 @@ static void dosfs_sflash_ftl_check(dosfs_sflash_t *sflash)
 				    {
 					if (sflash->xlate2_table[xlate_segment] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 					{
-					    if (sflash->xlate2_logical != sflash->xlate2_table[xlate_segment])
-					    {
-						sflash->xlate2_logical = sflash->xlate2_table[xlate_segment];
-			
-						dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate2_cache);
-					    }
+					    xlate2_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate2_table[xlate_segment]);
 
 					    if (xlate2_cache[xlate_index] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 					    {
@@ -1461,9 +1648,6 @@ static void dosfs_sflash_ftl_check(dosfs_sflash_t *sflash)
 	}
     }
 
-    xlate_cache   = (uint16_t*)sflash->cache[0];
-    xlate2_cache  = (uint16_t*)sflash->cache[1];
-    
     cache_logical = DOSFS_SFLASH_BLOCK_NOT_ALLOCATED;
 
     for (xlate_segment = 0; xlate_segment < sflash->xlate_count; xlate_segment++)
@@ -1487,12 +1671,7 @@ static void dosfs_sflash_ftl_check(dosfs_sflash_t *sflash)
 		}
 		else
 		{
-		    if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-		    {
-			sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-
-			dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-		    }
+		    xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
 		    read_logical = xlate_cache[xlate_index];
 
@@ -1500,12 +1679,7 @@ static void dosfs_sflash_ftl_check(dosfs_sflash_t *sflash)
 		    {
 			if (sflash->xlate2_table[xlate_segment] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 			{
-			    if (sflash->xlate2_logical != sflash->xlate2_table[xlate_segment])
-			    {
-				sflash->xlate2_logical = sflash->xlate2_table[xlate_segment];
-			
-				dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate2_cache);
-			    }
+			    xlate2_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate2_table[xlate_segment]);
 			    
 			    if (xlate2_cache[xlate_index] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 			    {
@@ -1656,8 +1830,7 @@ static bool dosfs_sflash_ftl_mount(dosfs_sflash_t *sflash)
     memset(&sflash->victim_delta[0], 0x00, sizeof(sflash->victim_delta));
     memset(&sflash->victim_score[0], 0x00, sizeof(sflash->victim_score));
 
-    sflash->xlate_logical = DOSFS_SFLASH_BLOCK_RESERVED;
-    sflash->xlate2_logical = DOSFS_SFLASH_BLOCK_RESERVED;
+    dosfs_sflash_ftl_xlate_reset(sflash);
 
     sflash->reclaim_offset = DOSFS_SFLASH_PHYSICAL_ILLEGAL;
     sflash->reclaim_erase_count = 0xffffffff;
@@ -1667,6 +1840,19 @@ static bool dosfs_sflash_ftl_mount(dosfs_sflash_t *sflash)
     sflash->alloc_count = 0;
     sflash->alloc_free = 0;
 
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD)
+    sflash->alloc_frontier = DOSFS_SFLASH_FRONTIER_COLD;
+    sflash->frontier_sector = 0;
+    sflash->frontier_index = 0;
+    sflash->frontier_count = 0;
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
+
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT)
+    memset(&sflash->victim_stamp[0], 0x00, sizeof(sflash->victim_stamp));
+
+    sflash->victim_clock = 0;
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY >= DOSFS_SFLASH_VICTIM_POLICY_COST_BENEFIT) */
+
     data_written[0] = DOSFS_SFLASH_BLOCK_NOT_ALLOCATED;
     data_written[1] = 0;
 
@@ -1680,6 +1866,8 @@ static bool dosfs_sflash_ftl_mount(dosfs_sflash_t *sflash)
     reclaim_offset = DOSFS_SFLASH_PHYSICAL_ILLEGAL;
     victim_offset = DOSFS_SFLASH_PHYSICAL_ILLEGAL;
 
+    dosfs_sflash_ftl_scratch(sflash);
+
     cache = sflash->cache[0];
 
     for (offset = 0; offset < sflash->data_size; offset += DOSFS_SFLASH_ERASE_SIZE)
@@ -1945,6 +2133,10 @@ static bool dosfs_sflash_ftl_mount(dosfs_sflash_t *sflash)
     sflash->erase_count_max = erase_count_max;
 
     sflash->alloc_count = 0;
+
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD)
+    sflash->frontier_count = 0;
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
     
     dosfs_sflash_ftl_check(sflash);
 
@@ -1956,10 +2148,28 @@ static uint32_t dosfs_sflash_ftl_allocate(dosfs_sflash_t *sflash)
     uint32_t index, logical;
     uint32_t *cache;
 
+    dosfs_sflash_ftl_scratch(sflash);
+
     cache = sflash->cache[1];
 
     while (1)
     {
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD)
+	if ((sflash->alloc_count == 0) && (sflash->frontier_count != 0) && (sflash->alloc_sector == sflash->frontier_sector))
+	{
+	    /* The free blocks of this sector belong to the other frontier.
+	     */
+	    sflash->alloc_sector++;
+	    
+	    if (sflash->alloc_sector == ((sflash->data_size / DOSFS_SFLASH_ERASE_SIZE) -1))
+	    {
+		sflash->alloc_sector = 0;
+	    }
+
+	    continue;
+	}
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
+
 	if (sflash->alloc_count == 0)
 	{
 	    if (!(sflash->victim_score[sflash->alloc_sector] & DOSFS_SFLASH_VICTIM_ALLOCATED_MASK))
@@ -1970,8 +2180,6 @@ static uint32_t dosfs_sflash_ftl_allocate(dosfs_sflash_t *sflash)
 		sflash->alloc_mask[2] = 0;
 		sflash->alloc_mask[3] = 0;
 
-		sflash->xlate2_logical = DOSFS_SFLASH_BLOCK_RESERVED;
-
 		// printf("ALLOCATE %d\n", sflash->alloc_sector);
 
 		dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_sector_lookup(sflash, sflash->alloc_sector) * DOSFS_SFLASH_ERASE_SIZE, DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)cache);
@@ -1996,6 +2204,8 @@ static uint32_t dosfs_sflash_ftl_allocate(dosfs_sflash_t *sflash)
 	{
 	    sflash->victim_score[sflash->alloc_sector] |= DOSFS_SFLASH_VICTIM_ALLOCATED_MASK;
 
+	    dosfs_sflash_ftl_victim_stamp(sflash, sflash->alloc_sector);
+
 	    sflash->alloc_sector++;
 	    
 	    if (sflash->alloc_sector == ((sflash->data_size / DOSFS_SFLASH_ERASE_SIZE) -1))
@@ -2020,6 +2230,8 @@ static uint32_t dosfs_sflash_ftl_allocate(dosfs_sflash_t *sflash)
 		    {
 			sflash->victim_score[sflash->alloc_sector] |= DOSFS_SFLASH_VICTIM_ALLOCATED_MASK;
 
+			dosfs_sflash_ftl_victim_stamp(sflash, sflash->alloc_sector);
+
 			sflash->alloc_sector++;
 			
 			if (sflash->alloc_sector == ((sflash->data_size / DOSFS_SFLASH_ERASE_SIZE) -1))
@@ -2037,6 +2249,71 @@ static uint32_t dosfs_sflash_ftl_allocate(dosfs_sflash_t *sflash)
     }
 }
 
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD)
+
+/* There are two write frontiers, one for blocks that get rewritten (FAT, directories,
+ * records updated in place) and one for blocks written the first time (appended data).
+ * The one not in use is kept in "frontier_*", and swapped with "alloc_*" on demand.
+ */
+
+static void dosfs_sflash_ftl_frontier(dosfs_sflash_t *sflash, uint32_t frontier)
+{
+    uint32_t sector, index, count, mask[DOSFS_SFLASH_BLOCK_INFO_ENTRIES / 32];
+
+    if (sflash->alloc_frontier != frontier)
+    {
+	sector = sflash->frontier_sector;
+	index  = sflash->frontier_index;
+	count  = sflash->frontier_count;
+
+	memcpy(&mask[0], &sflash->frontier_mask[0], sizeof(mask));
+
+	sflash->frontier_sector = sflash->alloc_sector;
+	sflash->frontier_index  = sflash->alloc_index;
+	sflash->frontier_count  = sflash->alloc_count;
+
+	memcpy(&sflash->frontier_mask[0], &sflash->alloc_mask[0], sizeof(mask));
+
+	sflash->alloc_sector = sector;
+	sflash->alloc_index  = index;
+	sflash->alloc_count  = count;
+
+	memcpy(&sflash->alloc_mask[0], &mask[0], sizeof(mask));
+
+	sflash->alloc_frontier = frontier;
+    }
+}
+
+static bool dosfs_sflash_ftl_rewrite(dosfs_sflash_t *sflash, uint32_t address)
+{
+    uint32_t xlate_segment, xlate_index;
+    uint16_t *xlate_cache;
+
+    if (address < DOSFS_SFLASH_XLATE_OFFSET)
+    {
+	return (sflash->block_table[address] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED);
+    }
+    else
+    {
+	xlate_segment = (address - DOSFS_SFLASH_XLATE_OFFSET) >> DOSFS_SFLASH_XLATE_SEGMENT_SHIFT;
+	xlate_index   = (address - DOSFS_SFLASH_XLATE_OFFSET) & DOSFS_SFLASH_XLATE_INDEX_MASK;
+
+	if (sflash->xlate_table[xlate_segment] == DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
+	{
+	    return false;
+	}
+
+	xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
+
+	/* A DELETED entry means that the address was either rewritten (and the mapping
+	 * lives in xlate2), or discarded. Either way it had been written before.
+	 */
+	return (xlate_cache[xlate_index] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED);
+    }
+}
+
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
+
 static void dosfs_sflash_ftl_write(dosfs_sflash_t *sflash, uint32_t address, const uint8_t *data)
 {
     uint32_t victim_offset, read_logical, write_logical, write_offset, xlate_segment, xlate_index, index;
@@ -2048,10 +2325,32 @@ static void dosfs_sflash_ftl_write(dosfs_sflash_t *sflash, uint32_t address, con
     memcpy(&sflash_data_shadow[address * 512], data, 512);
 #endif /* DOSFS_CONFIG_SFLASH_DEBUG == 1 */
  
+#if (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD)
+    /* The data block and xlate/xlate2 blocks are allocated from the same frontier,
+     * picked by whether the address was written before.
+     */
+    if (dosfs_sflash_ftl_rewrite(sflash, address))
+    {
+	DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_write_hot);
+
+	dosfs_sflash_ftl_frontier(sflash, DOSFS_SFLASH_FRONTIER_HOT);
+    }
+    else
+    {
+	dosfs_sflash_ftl_frontier(sflash, DOSFS_SFLASH_FRONTIER_COLD);
+    }
+
+    /* Make sure there are enough free blocksto one new block and an xlate/xlate2 block.
+     * The free blocks held by the other frontier cannot be used for that.
+     */
+
+    while (sflash->alloc_free <= (16 + sflash->frontier_count))
+#else /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
     /* Make sure there are enough free blocksto one new block and an xlate/xlate2 block.
      */
 
     while (sflash->alloc_free <= 16)
+#endif /* (DOSFS_CONFIG_SFLASH_VICTIM_POLICY == DOSFS_SFLASH_VICTIM_POLICY_HOT_COLD) */
     {
 	victim_offset = dosfs_sflash_ftl_victim(sflash);
 
@@ -2061,9 +2360,6 @@ static void dosfs_sflash_ftl_write(dosfs_sflash_t *sflash, uint32_t address, con
     /* Prepare xlate/xlate2 so that the logical mapping can be updated.
      */
 
-    xlate_cache   = (uint16_t*)sflash->cache[0];
-    xlate2_cache  = (uint16_t*)sflash->cache[1];
-
     xlate_segment = (address - DOSFS_SFLASH_XLATE_OFFSET) >> DOSFS_SFLASH_XLATE_SEGMENT_SHIFT;
     xlate_index   = (address - DOSFS_SFLASH_XLATE_OFFSET) & DOSFS_SFLASH_XLATE_INDEX_MASK;
 
@@ -2071,53 +2367,29 @@ static void dosfs_sflash_ftl_write(dosfs_sflash_t *sflash, uint32_t address, con
     {
 	if (sflash->xlate_table[xlate_segment] == DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 	{
-	    sflash->xlate_logical = dosfs_sflash_ftl_allocate(sflash);
-	    sflash->xlate_table[xlate_segment] = sflash->xlate_logical;
+	    sflash->xlate_table[xlate_segment] = dosfs_sflash_ftl_allocate(sflash);
 
-	    dosfs_sflash_ftl_info_entry(sflash, sflash->xlate_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE | xlate_segment);
+	    dosfs_sflash_ftl_info_entry(sflash, sflash->xlate_table[xlate_segment], DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE | xlate_segment);
 
-	    memset(xlate_cache, 0xff, DOSFS_SFLASH_BLOCK_SIZE);
+	    dosfs_sflash_ftl_xlate_create(sflash, sflash->xlate_table[xlate_segment]);
 	}
 	else 
 	{
-	    if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_miss);
-
-		sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-
-		dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-	    }
-	    else
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_hit);;
-	    }
+	    xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
 	    if (xlate_cache[xlate_index] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 	    {
 		if (sflash->xlate2_table[xlate_segment] == DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 		{
-		    sflash->xlate2_logical = dosfs_sflash_ftl_allocate(sflash);
-		    sflash->xlate2_table[xlate_segment] = sflash->xlate2_logical;
+		    sflash->xlate2_table[xlate_segment] = dosfs_sflash_ftl_allocate(sflash);
 		    
-		    dosfs_sflash_ftl_info_entry(sflash, sflash->xlate2_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE_SECONDARY | xlate_segment);
+		    dosfs_sflash_ftl_info_entry(sflash, sflash->xlate2_table[xlate_segment], DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE_SECONDARY | xlate_segment);
 		    
-		    memset(xlate2_cache, 0xff, DOSFS_SFLASH_BLOCK_SIZE);
+		    dosfs_sflash_ftl_xlate_create(sflash, sflash->xlate2_table[xlate_segment]);
 		}
 		else
 		{
-		    if (sflash->xlate2_logical != sflash->xlate2_table[xlate_segment])
-		    {
-			DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_miss);
-
-			sflash->xlate2_logical = sflash->xlate2_table[xlate_segment];
-			
-			dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate2_cache);
-		    }
-		    else
-		    {
-			DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_hit);
-		    }
+		    xlate2_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate2_table[xlate_segment]);
 
 		    if (xlate2_cache[xlate_index] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 		    {
@@ -2125,21 +2397,10 @@ static void dosfs_sflash_ftl_write(dosfs_sflash_t *sflash, uint32_t address, con
 			 * xlate2 with the merged data back. Next allocate a new xlate2 and properly
 			 * add the next logical mapping.
 			 *
-			 * Make sure the upper allocate did not blow away the xlate_cache ...
+			 * The upper allocate did not touch the xlate cache, so this is a hit.
 			 */
 
-			if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-			{
-			    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_miss);
-
-			    sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-			    
-			    dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-			}
-			else
-			{
-			    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_hit);;
-			}
+			xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
 			for (index = 0; index < DOSFS_SFLASH_XLATE_ENTRIES; index++)
 			{
@@ -2149,30 +2410,31 @@ static void dosfs_sflash_ftl_write(dosfs_sflash_t *sflash, uint32_t address, con
 			    }
 			}
 
-			dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_PAGE_SIZE, (const uint8_t*)xlate_cache);
-			dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical) + DOSFS_SFLASH_PAGE_SIZE, DOSFS_SFLASH_PAGE_SIZE, (const uint8_t*)xlate_cache + DOSFS_SFLASH_PAGE_SIZE);
+			dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_table[xlate_segment]), DOSFS_SFLASH_PAGE_SIZE, (const uint8_t*)xlate_cache);
+			dosfs_sflash_nor_write(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_table[xlate_segment]) + DOSFS_SFLASH_PAGE_SIZE, DOSFS_SFLASH_PAGE_SIZE, (const uint8_t*)xlate_cache + DOSFS_SFLASH_PAGE_SIZE);
 
-			/* Change xlate2 to xlate, and delete the old xlate entry.
+			/* Change xlate2 to xlate, and delete the old xlate entry. The merged
+			 * xlate_cache now holds the contents of the new xlate.
 			 */
 			
-			dosfs_sflash_ftl_info_type(sflash, sflash->xlate_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_DELETED | xlate_segment);
+			dosfs_sflash_ftl_info_type(sflash, sflash->xlate_table[xlate_segment], DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_DELETED | xlate_segment);
 
-			sflash->victim_score[sflash->xlate_logical >> DOSFS_SFLASH_LOGICAL_SECTOR_SHIFT] += DOSFS_SFLASH_VICTIM_DELETED_INCREMENT;
+			sflash->victim_score[sflash->xlate_table[xlate_segment] >> DOSFS_SFLASH_LOGICAL_SECTOR_SHIFT] += DOSFS_SFLASH_VICTIM_DELETED_INCREMENT;
 
-			dosfs_sflash_ftl_info_type(sflash, sflash->xlate2_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE | xlate_segment);
+			dosfs_sflash_ftl_info_type(sflash, sflash->xlate2_table[xlate_segment], DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE | xlate_segment);
 
-			sflash->xlate_logical = sflash->xlate2_logical;
-			sflash->xlate_table[xlate_segment] = sflash->xlate_logical;
+			dosfs_sflash_ftl_xlate_rename(sflash, sflash->xlate_table[xlate_segment], sflash->xlate2_table[xlate_segment]);
+
+			sflash->xlate_table[xlate_segment] = sflash->xlate2_table[xlate_segment];
 
 			/* Allocate a new xlate2 and modify the target entry.
 			 */
 
-			sflash->xlate2_logical = dosfs_sflash_ftl_allocate(sflash);
-			sflash->xlate2_table[xlate_segment] = sflash->xlate2_logical;
+			sflash->xlate2_table[xlate_segment] = dosfs_sflash_ftl_allocate(sflash);
 
-			dosfs_sflash_ftl_info_entry(sflash, sflash->xlate2_logical, DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE_SECONDARY | xlate_segment);
+			dosfs_sflash_ftl_info_entry(sflash, sflash->xlate2_table[xlate_segment], DOSFS_SFLASH_INFO_EXTENDED_MASK | DOSFS_SFLASH_INFO_TYPE_XLATE_SECONDARY | xlate_segment);
 
-			memset(xlate2_cache, 0xff, DOSFS_SFLASH_BLOCK_SIZE);
+			dosfs_sflash_ftl_xlate_create(sflash, sflash->xlate2_table[xlate_segment]);
 		    }
 		}
 	    }
@@ -2239,9 +2501,6 @@ static void dosfs_sflash_ftl_read(dosfs_sflash_t *sflash, uint32_t address, uint
     }
     else
     {
-	xlate_cache   = (uint16_t*)sflash->cache[0];
-	xlate2_cache  = (uint16_t*)sflash->cache[1];
-
 	xlate_segment = (address - DOSFS_SFLASH_XLATE_OFFSET) >> DOSFS_SFLASH_XLATE_SEGMENT_SHIFT;
 	xlate_index   = (address - DOSFS_SFLASH_XLATE_OFFSET) & DOSFS_SFLASH_XLATE_INDEX_MASK;
 
@@ -2251,18 +2510,7 @@ static void dosfs_sflash_ftl_read(dosfs_sflash_t *sflash, uint32_t address, uint
 	}
 	else
 	{
-	    if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_miss);
-
-		sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-
-		dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-	    }
-	    else
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_hit);;
-	    }
+	    xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
 	    read_logical = xlate_cache[xlate_index];
 
@@ -2270,18 +2518,7 @@ static void dosfs_sflash_ftl_read(dosfs_sflash_t *sflash, uint32_t address, uint
 	    {
 		if (sflash->xlate2_table[xlate_segment] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 		{
-		    if (sflash->xlate2_logical != sflash->xlate2_table[xlate_segment])
-		    {
-			DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_miss);
-
-			sflash->xlate2_logical = sflash->xlate2_table[xlate_segment];
-			
-			dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate2_cache);
-		    }
-		    else
-		    {
-			DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_hit);
-		    }
+		    xlate2_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate2_table[xlate_segment]);
 
 		    if (xlate2_cache[xlate_index] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 		    {
@@ -2346,26 +2583,12 @@ static void dosfs_sflash_ftl_discard(dosfs_sflash_t *sflash, uint32_t address)
     }
     else
     {
-	xlate_cache   = (uint16_t*)sflash->cache[0];
-	xlate2_cache  = (uint16_t*)sflash->cache[1];
-
 	xlate_segment = (address - DOSFS_SFLASH_XLATE_OFFSET) >> DOSFS_SFLASH_XLATE_SEGMENT_SHIFT;
 	xlate_index   = (address - DOSFS_SFLASH_XLATE_OFFSET) & DOSFS_SFLASH_XLATE_INDEX_MASK;
 
 	if (sflash->xlate_table[xlate_segment] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 	{
-	    if (sflash->xlate_logical != sflash->xlate_table[xlate_segment])
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_miss);
-
-		sflash->xlate_logical = sflash->xlate_table[xlate_segment];
-
-		dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate_cache);
-	    }
-	    else
-	    {
-		DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate_hit);;
-	    }
+	    xlate_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate_table[xlate_segment]);
 
 	    delete_logical = xlate_cache[xlate_index];
 
@@ -2375,18 +2598,7 @@ static void dosfs_sflash_ftl_discard(dosfs_sflash_t *sflash, uint32_t address)
 		{
 		    if (sflash->xlate2_table[xlate_segment] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 		    {
-			if (sflash->xlate2_logical != sflash->xlate2_table[xlate_segment])
-			{
-			    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_miss);
-			    
-			    sflash->xlate2_logical = sflash->xlate2_table[xlate_segment];
-			
-			    dosfs_sflash_nor_read(sflash, dosfs_sflash_ftl_translate(sflash, sflash->xlate2_logical), DOSFS_SFLASH_BLOCK_SIZE, (uint8_t*)xlate2_cache);
-			}
-			else
-			{
-			    DOSFS_SFLASH_STATISTICS_COUNT(sflash_ftl_xlate2_hit);
-			}
+			xlate2_cache = dosfs_sflash_ftl_xlate_cache(sflash, xlate_segment, sflash->xlate2_table[xlate_segment]);
 
 			if (xlate2_cache[xlate_index] != DOSFS_SFLASH_BLOCK_NOT_ALLOCATED)
 			{
@@ -2455,7 +2667,7 @@ static int dosfs_sflash_format(void *context)
     printf("SFLASH_FORMAT\n");
 #endif /* (DOSFS_CONFIG_SFLASH_SIMULATE_TRACE == 1) */
 
-    stm32l4_qspi_select(&sflash->qspi);
+    dosfs_sflash_nor_select(sflash);
 
     dosfs_sflash_ftl_format(sflash);
 
@@ -2470,7 +2682,7 @@ static int dosfs_sflash_format(void *context)
 	sflash->state = DOSFS_SFLASH_STATE_READY;
     }
 
-    stm32l4_qspi_unselect(&sflash->qspi);
+    dosfs_sflash_nor_unselect(sflash);
 
     return status;
 }
@@ -2495,7 +2707,7 @@ static int dosfs_sflash_discard(void *context, uint32_t address, uint32_t length
     }
     else
     {
-	stm32l4_qspi_select(&sflash->qspi);
+	dosfs_sflash_nor_select(sflash);
 
 	while (length--)
 	{
@@ -2504,7 +2716,7 @@ static int dosfs_sflash_discard(void *context, uint32_t address, uint32_t length
 	    address++;
 	}
 
-	stm32l4_qspi_unselect(&sflash->qspi);
+	dosfs_sflash_nor_unselect(sflash);
     }
 
     return status;
@@ -2525,16 +2737,17 @@ static int dosfs_sflash_read(void *context, uint32_t address, uint8_t *data, uin
     }
     else
     {
-	stm32l4_qspi_select(&sflash->qspi);
+	dosfs_sflash_nor_select(sflash);
 
 	while (length--)
 	{
 	    dosfs_sflash_ftl_read(sflash, address, data);
 	    
 	    address++;
+	    data += DOSFS_BLK_SIZE;
 	}
 
-	stm32l4_qspi_unselect(&sflash->qspi);
+	dosfs_sflash_nor_unselect(sflash);
     }
 
     return status;
@@ -2555,16 +2768,17 @@ static int dosfs_sflash_write(void *context, uint32_t address, const uint8_t *da
     }
     else
     {
-	stm32l4_qspi_select(&sflash->qspi);
+	dosfs_sflash_nor_select(sflash);
 
 	while (length--)
 	{
 	    dosfs_sflash_ftl_write(sflash, address, data);
 	    
 	    address++;
+	    data += DOSFS_BLK_SIZE;
 	}
 
-	stm32l4_qspi_unselect(&sflash->qspi);
+	dosfs_sflash_nor_unselect(sflash);
     }
 
     return status;
@@ -2583,6 +2797,41 @@ static int dosfs_sflash_sync(void *context, bool wait)
     return status;
 }
 
+static int dosfs_sflash_read_vector(void *context, const dosfs_device_segment_t *segments, uint32_t count, bool prefetch)
+{
+    int status = F_NO_ERROR;
+    const dosfs_device_segment_t *segment, *segment_e;
+
+    for (segment = segments, segment_e = segments + count; (status == F_NO_ERROR) && (segment != segment_e); segment++)
+    {
+	status = dosfs_sflash_read(context, segment->address, segment->data, segment->length, prefetch);
+    }
+
+    return status;
+}
+
+static int dosfs_sflash_write_vector(void *context, const dosfs_device_segment_t *segments, uint32_t count, volatile uint8_t *p_status)
+{
+    int status = F_NO_ERROR;
+    const dosfs_device_segment_t *segment, *segment_e;
+
+    for (segment = segments, segment_e = segments + count; (status == F_NO_ERROR) && (segment != segment_e); segment++)
+    {
+	status = dosfs_sflash_write(context, segment->address, segment->data, segment->length, p_status);
+    }
+
+    return status;
+}
+
+static int dosfs_sflash_busy(void *context, bool *p_busy)
+{
+    /* Writes are programmed before dosfs_sflash_write() returns.
+     */
+    *p_busy = false;
+
+    return F_NO_ERROR;
+}
+
 static const dosfs_device_interface_t dosfs_sflash_interface = {
     dosfs_sflash_release,
     dosfs_sflash_info,
@@ -2592,6 +2841,9 @@ static const dosfs_device_interface_t dosfs_sflash_interface = {
     dosfs_sflash_read,
     dosfs_sflash_write,
     dosfs_sflash_sync,
+    dosfs_sflash_read_vector,
+    dosfs_sflash_write_vector,
+    dosfs_sflash_busy,
 };
 
 int dosfs_sflash_init(void)
@@ -2599,6 +2851,9 @@ int dosfs_sflash_init(void)
     dosfs_sflash_t *sflash = (dosfs_sflash_t*)&dosfs_sflash;
     int status = F_NO_ERROR;
     uint8_t data[DOSFS_BLK_SIZE];
+#if (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0)
+    unsigned int index;
+#endif /* (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0) */
 
     dosfs_device.lock = DOSFS_DEVICE_LOCK_INIT;
     dosfs_device.context = (void*)sflash;
@@ -2614,16 +2869,26 @@ int dosfs_sflash_init(void)
 	}
 	else
 	{
-	    stm32l4_qspi_select(&sflash->qspi);
+	    dosfs_sflash_nor_select(sflash);
 
 	    sflash->xlate_count = ((((sflash->data_size / DOSFS_SFLASH_ERASE_SIZE) * ((DOSFS_SFLASH_ERASE_SIZE / DOSFS_SFLASH_BLOCK_SIZE) -1)) -2) + (DOSFS_SFLASH_XLATE_ENTRIES -1)) / DOSFS_SFLASH_XLATE_ENTRIES;
 	    
 	    sflash->cache[0] = &dosfs_sflash_cache[0];
 	    sflash->cache[1] = &dosfs_sflash_cache[DOSFS_SFLASH_BLOCK_SIZE / sizeof(uint32_t)];
+
+#if (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0)
+	    for (index = 0; index < DOSFS_SFLASH_XLATE_CACHE_ENTRIES; index++)
+	    {
+		sflash->xlate_cache[index] = &dosfs_sflash_xlate_cache[index][0];
+	    }
+#else /* (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0) */
+	    sflash->xlate_cache[0] = (uint16_t*)sflash->cache[0];
+	    sflash->xlate_cache[1] = (uint16_t*)sflash->cache[1];
+#endif /* (DOSFS_CONFIG_SFLASH_XLATE_CACHE_ENTRIES != 0) */
 	    
 	    if (!dosfs_sflash_ftl_mount(sflash))
 	    {
-		stm32l4_qspi_unselect(&sflash->qspi);
+		dosfs_sflash_nor_unselect(sflash);
 
 		status = dosfs_device_format(&dosfs_device, data);
 
@@ -2640,7 +2905,7 @@ int dosfs_sflash_init(void)
 	    }
 	    else
 	    {
-		stm32l4_qspi_unselect(&sflash->qspi);
+		dosfs_sflash_nor_unselect(sflash);
 
 		sflash->state = DOSFS_SFLASH_STATE_READY;
 	    }
@@ -2652,4 +2917,4 @@ int dosfs_sflash_init(void)
     return status;
 }
 
-#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) || (DOSFS_CONFIG_SFLASH_SIMULATE == 1) */
@@ -33,6 +33,7 @@
 #include "armv7m.h"
 
 #include "stm32l4_adc.h"
+#include "stm32l4_dma.h"
 #include "stm32l4_gpio.h"
 #include "stm32l4_system.h"
 
@@ -45,6 +46,18 @@
 #define ADC_SAMPLE_TIME_247_5  6
 #define ADC_SAMPLE_TIME_640_5  7
 
+#define ADC_EXTSEL_NONE        0xff
+
+#define ADC_DMA_OPTION                    \
+    (DMA_OPTION_EVENT_TRANSFER_DONE |     \
+     DMA_OPTION_EVENT_TRANSFER_HALF |     \
+     DMA_OPTION_EVENT_TRANSFER_ERROR |    \
+     DMA_OPTION_CIRCULAR |                \
+     DMA_OPTION_PERIPHERAL_TO_MEMORY |    \
+     DMA_OPTION_PERIPHERAL_DATA_SIZE_16 | \
+     DMA_OPTION_MEMORY_DATA_SIZE_16 |     \
+     DMA_OPTION_MEMORY_DATA_INCREMENT |   \
+     DMA_OPTION_PRIORITY_HIGH)
 
 typedef struct _stm32l4_adc_driver_t {
     stm32l4_adc_t     *instances[ADC_INSTANCE_COUNT];
@@ -61,6 +74,97 @@ static ADC_TypeDef * const stm32l4_adc_xlate_ADC[ADC_INSTANCE_COUNT] = {
 #endif /* defined(STM32L476xx) || defined(STM32L496xx) */
 };
 
+/* EXTSEL for the TRGO of each timer instance (regular group).
+ */
+static const uint8_t stm32l4_adc_xlate_EXTSEL[TIMER_INSTANCE_COUNT] = {
+    9,                   /* TIM1_TRGO  */
+    11,                  /* TIM2_TRGO  */
+#if defined(STM32L476xx) || defined(STM32L496xx)
+    4,                   /* TIM3_TRGO  */
+    12,                  /* TIM4_TRGO  */
+    ADC_EXTSEL_NONE,     /* TIM5       */
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+    13,                  /* TIM6_TRGO  */
+    ADC_EXTSEL_NONE,     /* TIM7       */
+#if defined(STM32L476xx) || defined(STM32L496xx)
+    7,                   /* TIM8_TRGO  */
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+    14,                  /* TIM15_TRGO */
+    ADC_EXTSEL_NONE,     /* TIM16      */
+#if defined(STM32L476xx) || defined(STM32L496xx)
+    ADC_EXTSEL_NONE,     /* TIM17      */
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+};
+
+static uint32_t stm32l4_adc_sample_time(unsigned int period)
+{
+    uint32_t threshold, adcclk, adc_smp;
+
+    if ((stm32l4_system_hclk() <= 48000000) && (stm32l4_system_hclk() == stm32l4_system_sysclk()))
+    {
+	adcclk = stm32l4_system_hclk();
+    }
+    else
+    {
+	adcclk = stm32l4_system_hclk() / 2;
+    }
+
+    /* period is in uS. 1e6 / adcclk is one tick in terms of uS.
+     *
+     * (period * adcclk) / 1e6 is the threshold for the sampling time.
+     *
+     * The upper limit for period is 50uS, and adcclk limited to 48MHz,
+     * which means no overflow handling is needed.
+     */
+
+    if (period > 50)
+    {
+        period = 50;
+    }
+    
+    threshold = ((uint32_t)period * adcclk);
+
+    if      (threshold < (uint32_t)(  2.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_2_5;   } 
+    else if (threshold < (uint32_t)(  6.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_6_5;   } 
+    else if (threshold < (uint32_t)( 12.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_12_5;  } 
+    else if (threshold < (uint32_t)( 24.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_24_5;  } 
+    else if (threshold < (uint32_t)( 47.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_47_5;  } 
+    else if (threshold < (uint32_t)( 92.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_92_5;  } 
+    else if (threshold < (uint32_t)(247.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_247_5; } 
+    else                                          { adc_smp = ADC_SAMPLE_TIME_640_5; } 
+
+    return adc_smp;
+}
+
+static void stm32l4_adc_dma_callback(stm32l4_adc_t *adc, uint32_t events)
+{
+    uint32_t adc_events;
+
+    adc_events = 0;
+
+    if (events & DMA_EVENT_TRANSFER_HALF)
+    {
+	adc_events |= ADC_EVENT_TRANSFER_HALF;
+    }
+
+    if (events & DMA_EVENT_TRANSFER_DONE)
+    {
+	adc_events |= ADC_EVENT_TRANSFER_DONE;
+    }
+
+    if (events & DMA_EVENT_TRANSFER_ERROR)
+    {
+	adc_events |= ADC_EVENT_TRANSFER_ERROR;
+    }
+
+    adc_events &= adc->events;
+
+    if (adc_events)
+    {
+	(*adc->callback)(adc->context, adc_events);
+    }
+}
+
 bool stm32l4_adc_create(stm32l4_adc_t *adc, unsigned int instance, unsigned int priority, unsigned int mode)
 {
     if (instance >= ADC_INSTANCE_COUNT)
@@ -75,6 +179,7 @@ bool stm32l4_adc_create(stm32l4_adc_t *adc, unsigned int instance, unsigned int
     adc->callback = NULL;
     adc->context = NULL;
     adc->events = 0;
+    adc->channels = 0;
     
     stm32l4_adc_driver.instances[adc->instance] = adc;
 
@@ -128,6 +233,9 @@ bool stm32l4_adc_disable(stm32l4_adc_t *adc)
 {
     ADC_TypeDef *ADCx = adc->ADCx;
 
+    /* A stream has to be ended explicitly with stm32l4_adc_stop(), so that a
+     * single conversion user cannot tear it down behind its owner's back.
+     */
     if (adc->state != ADC_STATE_READY)
     {
 	return false;
@@ -285,7 +393,7 @@ bool stm32l4_adc_calibrate(stm32l4_adc_t *adc)
 uint32_t stm32l4_adc_convert(stm32l4_adc_t *adc, unsigned int channel, unsigned int period)
 {
     ADC_TypeDef *ADCx = adc->ADCx;
-    uint32_t convert, threshold, adcclk, adc_smp;
+    uint32_t convert, adc_smp;
 
     if (adc->state != ADC_STATE_READY)
     {
@@ -321,38 +429,7 @@ uint32_t stm32l4_adc_convert(stm32l4_adc_t *adc, unsigned int channel, unsigned
 	armv7m_core_udelay(120);
     }
 
-    if ((stm32l4_system_hclk() <= 48000000) && (stm32l4_system_hclk() == stm32l4_system_sysclk()))
-    {
-	adcclk = stm32l4_system_hclk();
-    }
-    else
-    {
-	adcclk = stm32l4_system_hclk() / 2;
-    }
-
-    /* period is in uS. 1e6 / adcclk is one tick in terms of uS.
-     *
-     * (period * adcclk) / 1e6 is the threshold for the sampling time.
-     *
-     * The upper limit for period is 50uS, and adcclk limited to 48MHz,
-     * which means no overflow handling is needed.
-     */
-
-    if (period > 50)
-    {
-        period = 50;
-    }
-    
-    threshold = ((uint32_t)period * adcclk);
-
-    if      (threshold < (uint32_t)(  2.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_2_5;   } 
-    else if (threshold < (uint32_t)(  6.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_6_5;   } 
-    else if (threshold < (uint32_t)( 12.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_12_5;  } 
-    else if (threshold < (uint32_t)( 24.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_24_5;  } 
-    else if (threshold < (uint32_t)( 47.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_47_5;  } 
-    else if (threshold < (uint32_t)( 92.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_92_5;  } 
-    else if (threshold < (uint32_t)(247.5 * 1e6)) { adc_smp = ADC_SAMPLE_TIME_247_5; } 
-    else                                          { adc_smp = ADC_SAMPLE_TIME_640_5; } 
+    adc_smp = stm32l4_adc_sample_time(period);
 
     ADCx->SQR1 = (channel << 6);
     ADCx->SMPR1 = (channel < 10) ? (adc_smp << (channel * 3)) : 0;
@@ -403,3 +480,204 @@ uint32_t stm32l4_adc_convert(stm32l4_adc_t *adc, unsigned int channel, unsigned
 
     return convert;
 }
+
+/* Streaming conversion of a regular sequence of up to 16 channels. Each
+ * TRGO of "timer" (TIMER_OPTION_TRGO_UPDATE) converts the whole sequence,
+ * and the DMA stores the results circular into data[size], signalling
+ * ADC_EVENT_TRANSFER_HALF/DONE per half of the buffer. "size" has to be
+ * a multiple of 2 * count so that each half holds complete sequences.
+ * With oversampling each sample is the accumulation of 2^RATIO conversions
+ * shifted right by SHIFT, which needs to fit into the trigger period.
+ */
+bool stm32l4_adc_start(stm32l4_adc_t *adc, const uint8_t *channels, unsigned int count, unsigned int period, stm32l4_timer_t *timer, uint16_t *data, uint32_t size, uint32_t option)
+{
+    ADC_TypeDef *ADCx = adc->ADCx;
+    uint32_t adc_smp, adc_extsel, adc_cfgr2, adc_sqr[4], adc_smpr[2], channel, index;
+    bool success;
+
+    if (adc->state != ADC_STATE_READY)
+    {
+	return false;
+    }
+
+    if ((count == 0) || (count > 16) || (size == 0) || (size > 65535) || (size % (2 * count)))
+    {
+	return false;
+    }
+
+    adc_extsel = stm32l4_adc_xlate_EXTSEL[timer->instance];
+
+    if (adc_extsel == ADC_EXTSEL_NONE)
+    {
+	return false;
+    }
+
+    switch (adc->instance) {
+    case ADC_INSTANCE_ADC1:
+	success = (stm32l4_dma_create(&adc->dma, DMA_CHANNEL_DMA1_CH1_ADC1, adc->priority) ||
+		   stm32l4_dma_create(&adc->dma, DMA_CHANNEL_DMA2_CH3_ADC1, adc->priority));
+	break;
+#if defined(STM32L476xx) || defined(STM32L496xx)
+    case ADC_INSTANCE_ADC2:
+	success = (stm32l4_dma_create(&adc->dma, DMA_CHANNEL_DMA1_CH2_ADC2, adc->priority) ||
+		   stm32l4_dma_create(&adc->dma, DMA_CHANNEL_DMA2_CH4_ADC2, adc->priority));
+	break;
+    case ADC_INSTANCE_ADC3:
+	success = (stm32l4_dma_create(&adc->dma, DMA_CHANNEL_DMA1_CH3_ADC3, adc->priority) ||
+		   stm32l4_dma_create(&adc->dma, DMA_CHANNEL_DMA2_CH5_ADC3, adc->priority));
+	break;
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+    default:
+	success = false;
+	break;
+    }
+
+    if (!success)
+    {
+	return false;
+    }
+
+    adc_smp = stm32l4_adc_sample_time(period);
+
+    adc_sqr[0] = (count -1);
+    adc_sqr[1] = 0;
+    adc_sqr[2] = 0;
+    adc_sqr[3] = 0;
+
+    adc_smpr[0] = 0;
+    adc_smpr[1] = 0;
+
+    adc->channels = 0;
+
+    for (index = 0; index < count; index++)
+    {
+	channel = channels[index] & 31;
+
+	/* SQR1 holds L in the first slot, followed by SQ1 .. SQ4, and
+	 * SQR2 .. SQR4 hold 5 sequence slots each, 6 bits apart.
+	 */
+	adc_sqr[(index +1) / 5] |= (channel << (((index +1) % 5) * 6));
+
+	if (channel < 10)
+	{
+	    adc_smpr[0] |= (adc_smp << (channel * 3));
+	}
+	else
+	{
+	    adc_smpr[1] |= (adc_smp << ((channel * 3) - 30));
+	}
+
+	adc->channels |= (1ul << channel);
+    }
+
+    if ((adc->instance == ADC_INSTANCE_ADC1) && (adc->channels & (1ul << ADC_CHANNEL_ADC1_TS)))
+    {
+	ADCx->CR |= ADC_CR_ADDIS;
+
+	while (ADCx->CR & ADC_CR_ADEN)
+	{
+	}
+	    
+#if defined(STM32L476xx) || defined(STM32L496xx)
+	armv7m_atomic_or(&ADC123_COMMON->CCR, ADC_CCR_TSEN);
+#else /* defined(STM32L476xx) || defined(STM32L496xx) */
+	armv7m_atomic_or(&ADC1_COMMON->CCR, ADC_CCR_TSEN);
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+
+	ADCx->ISR = ADC_ISR_ADRDY;
+
+	do
+	{
+	    ADCx->CR |= ADC_CR_ADEN;
+	}
+	while (!(ADCx->ISR & ADC_ISR_ADRDY));
+
+	armv7m_core_udelay(120);
+    }
+
+    adc_cfgr2 = 0;
+
+    if (option & ADC_OPTION_OVERSAMPLE_RATIO_MASK)
+    {
+	adc_cfgr2 |= (ADC_CFGR2_ROVSE |
+		      ((((option & ADC_OPTION_OVERSAMPLE_RATIO_MASK) >> ADC_OPTION_OVERSAMPLE_RATIO_SHIFT) -1) << 2) |
+		      (((option & ADC_OPTION_OVERSAMPLE_SHIFT_MASK) >> ADC_OPTION_OVERSAMPLE_SHIFT_SHIFT) << 5));
+    }
+
+    ADCx->SQR1 = adc_sqr[0];
+    ADCx->SQR2 = adc_sqr[1];
+    ADCx->SQR3 = adc_sqr[2];
+    ADCx->SQR4 = adc_sqr[3];
+    ADCx->SMPR1 = adc_smpr[0];
+    ADCx->SMPR2 = adc_smpr[1];
+    ADCx->CFGR2 = adc_cfgr2;
+
+    /* Rising edge of the timer's TRGO, circular DMA.
+     */
+    ADCx->CFGR = (ADC_CFGR_OVRMOD | ADC_CFGR_JQDIS | ADC_CFGR_DMAEN | ADC_CFGR_DMACFG | ADC_CFGR_EXTEN_0 | (adc_extsel << 6));
+
+    ADCx->ISR = (ADC_ISR_EOC | ADC_ISR_EOS | ADC_ISR_OVR);
+
+    stm32l4_dma_enable(&adc->dma, (stm32l4_dma_callback_t)stm32l4_adc_dma_callback, adc);
+    stm32l4_dma_start(&adc->dma, (uint32_t)data, (uint32_t)&ADCx->DR, size, ADC_DMA_OPTION);
+
+    adc->state = ADC_STATE_ACTIVE;
+
+    ADCx->CR |= ADC_CR_ADSTART;
+
+    return true;
+}
+
+bool stm32l4_adc_stop(stm32l4_adc_t *adc)
+{
+    ADC_TypeDef *ADCx = adc->ADCx;
+
+    if (adc->state != ADC_STATE_ACTIVE)
+    {
+	return false;
+    }
+
+    ADCx->CR |= ADC_CR_ADSTP;
+
+    while (ADCx->CR & ADC_CR_ADSTART)
+    {
+    }
+
+    stm32l4_dma_stop(&adc->dma);
+    stm32l4_dma_disable(&adc->dma);
+    stm32l4_dma_destroy(&adc->dma);
+
+    ADCx->CFGR = ADC_CFGR_OVRMOD | ADC_CFGR_JQDIS;
+    ADCx->CFGR2 = 0;
+
+    ADCx->ISR = (ADC_ISR_EOC | ADC_ISR_EOS | ADC_ISR_OVR);
+
+    if ((adc->instance == ADC_INSTANCE_ADC1) && (adc->channels & (1ul << ADC_CHANNEL_ADC1_TS)))
+    {
+	ADCx->CR |= ADC_CR_ADDIS;
+
+	while (ADCx->CR & ADC_CR_ADEN)
+	{
+	}
+	
+#if defined(STM32L476xx) || defined(STM32L496xx)
+	armv7m_atomic_and(&ADC123_COMMON->CCR, ~ADC_CCR_TSEN);
+#else /* defined(STM32L476xx) || defined(STM32L496xx) */
+	armv7m_atomic_and(&ADC1_COMMON->CCR, ~ADC_CCR_TSEN);
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+
+	ADCx->ISR = ADC_ISR_ADRDY;
+
+	do
+	{
+	    ADCx->CR |= ADC_CR_ADEN;
+	}
+	while (!(ADCx->ISR & ADC_ISR_ADRDY));
+    }
+
+    adc->channels = 0;
+
+    adc->state = ADC_STATE_READY;
+
+    return true;
+}
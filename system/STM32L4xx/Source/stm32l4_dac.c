@@ -33,6 +33,7 @@
 #include "armv7m.h"
 
 #include "stm32l4_dac.h"
+#include "stm32l4_dma.h"
 #include "stm32l4_gpio.h"
 #include "stm32l4_system.h"
 
@@ -42,6 +43,88 @@ typedef struct _stm32l4_dac_driver_t {
 
 static stm32l4_dac_driver_t stm32l4_dac_driver;
 
+#define DAC_TSEL_NONE          0xff
+
+#define DAC_DMA_OPTION                    \
+    (DMA_OPTION_EVENT_TRANSFER_DONE |     \
+     DMA_OPTION_EVENT_TRANSFER_HALF |     \
+     DMA_OPTION_CIRCULAR |                \
+     DMA_OPTION_MEMORY_TO_PERIPHERAL |    \
+     DMA_OPTION_PERIPHERAL_DATA_SIZE_32 | \
+     DMA_OPTION_MEMORY_DATA_SIZE_16 |     \
+     DMA_OPTION_MEMORY_DATA_INCREMENT |   \
+     DMA_OPTION_PRIORITY_HIGH)
+
+/* TSEL for the TRGO of each timer instance.
+ */
+static const uint8_t stm32l4_dac_xlate_TSEL[TIMER_INSTANCE_COUNT] = {
+    DAC_TSEL_NONE,       /* TIM1       */
+    4,                   /* TIM2_TRGO  */
+#if defined(STM32L476xx) || defined(STM32L496xx)
+    DAC_TSEL_NONE,       /* TIM3       */
+    5,                   /* TIM4_TRGO  */
+    3,                   /* TIM5_TRGO  */
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+    0,                   /* TIM6_TRGO  */
+    2,                   /* TIM7_TRGO  */
+#if defined(STM32L476xx) || defined(STM32L496xx)
+    1,                   /* TIM8_TRGO  */
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+    DAC_TSEL_NONE,       /* TIM15      */
+    DAC_TSEL_NONE,       /* TIM16      */
+#if defined(STM32L476xx) || defined(STM32L496xx)
+    DAC_TSEL_NONE,       /* TIM17      */
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+};
+
+static void stm32l4_dac_dma_callback_1(stm32l4_dac_t *dac, uint32_t events)
+{
+    uint32_t dac_events;
+
+    dac_events = 0;
+
+    if (events & DMA_EVENT_TRANSFER_HALF)
+    {
+	dac_events |= DAC_EVENT_CHANNEL_1_HALF;
+    }
+
+    if (events & DMA_EVENT_TRANSFER_DONE)
+    {
+	dac_events |= DAC_EVENT_CHANNEL_1_DONE;
+    }
+
+    dac_events &= dac->events;
+
+    if (dac_events)
+    {
+	(*dac->callback)(dac->context, dac_events);
+    }
+}
+
+static void stm32l4_dac_dma_callback_2(stm32l4_dac_t *dac, uint32_t events)
+{
+    uint32_t dac_events;
+
+    dac_events = 0;
+
+    if (events & DMA_EVENT_TRANSFER_HALF)
+    {
+	dac_events |= DAC_EVENT_CHANNEL_2_HALF;
+    }
+
+    if (events & DMA_EVENT_TRANSFER_DONE)
+    {
+	dac_events |= DAC_EVENT_CHANNEL_2_DONE;
+    }
+
+    dac_events &= dac->events;
+
+    if (dac_events)
+    {
+	(*dac->callback)(dac->context, dac_events);
+    }
+}
+
 bool stm32l4_dac_create(stm32l4_dac_t *dac, unsigned int instance, unsigned int priority, unsigned int mode)
 {
     if (instance != DAC_INSTANCE_DAC)
@@ -56,6 +139,7 @@ bool stm32l4_dac_create(stm32l4_dac_t *dac, unsigned int instance, unsigned int
     dac->callback = NULL;
     dac->context = NULL;
     dac->events = 0;
+    dac->channels = 0;
     
     stm32l4_dac_driver.instances[dac->instance] = dac;
 
@@ -108,6 +192,16 @@ bool stm32l4_dac_disable(stm32l4_dac_t *dac)
 	return false;
     }
 
+    if (dac->channels & (1ul << DAC_CHANNEL_1))
+    {
+	stm32l4_dac_stop(dac, DAC_CHANNEL_1);
+    }
+
+    if (dac->channels & (1ul << DAC_CHANNEL_2))
+    {
+	stm32l4_dac_stop(dac, DAC_CHANNEL_2);
+    }
+
     DACx->CR &= ~(DAC_CR_EN1 | DAC_CR_EN2);
 
     dac->events = 0;
@@ -163,6 +257,11 @@ bool stm32l4_dac_channel(stm32l4_dac_t *dac, unsigned int channel, uint32_t outp
 	return false;
     }
 
+    if (dac->channels & (1ul << channel))
+    {
+	stm32l4_dac_stop(dac, channel);
+    }
+
     if (channel == DAC_CHANNEL_1)
     {
 	DACx->CR &= ~(DAC_CR_EN1 | DAC_CR_TEN1 | DAC_CR_WAVE1 | DAC_CR_DMAEN1 | DAC_CR_DMAUDRIE1 | DAC_CR_CEN1);
@@ -313,3 +412,128 @@ bool stm32l4_dac_convert(stm32l4_dac_t *dac, unsigned int channel, uint32_t outp
     
     return true;
 }
+
+/* Waveform playback on a channel set up by stm32l4_dac_channel(). Each
+ * TRGO of "timer" (TIMER_OPTION_TRGO_UPDATE) latches the next sample of
+ * the circular data[count] buffer, which the DMA refills into DHR12Rx.
+ * DAC_EVENT_CHANNEL_x_HALF/DONE signal that the first/second half of the
+ * buffer has been consumed and can be refilled.
+ */
+bool stm32l4_dac_start(stm32l4_dac_t *dac, unsigned int channel, stm32l4_timer_t *timer, const uint16_t *data, uint32_t count)
+{
+    DAC_TypeDef *DACx = dac->DACx;
+    uint32_t dac_tsel;
+
+    if (dac->state != DAC_STATE_READY)
+    {
+	return false;
+    }
+
+    if ((count == 0) || (count > 65535) || (dac->channels & (1ul << channel)))
+    {
+	return false;
+    }
+
+    dac_tsel = stm32l4_dac_xlate_TSEL[timer->instance];
+
+    if (dac_tsel == DAC_TSEL_NONE)
+    {
+	return false;
+    }
+
+    if (channel == DAC_CHANNEL_1)
+    {
+	if (!(DACx->CR & DAC_CR_EN1))
+	{
+	    return false;
+	}
+
+	if (!stm32l4_dma_create(&dac->dma[DAC_CHANNEL_1], DMA_CHANNEL_DMA1_CH3_DAC1, dac->priority) &&
+	    !stm32l4_dma_create(&dac->dma[DAC_CHANNEL_1], DMA_CHANNEL_DMA2_CH4_DAC1, dac->priority))
+	{
+	    return false;
+	}
+
+	/* TSEL1 can only be changed while the channel is disabled.
+	 */
+	DACx->CR &= ~DAC_CR_EN1;
+	DACx->CR = (DACx->CR & ~DAC_CR_TSEL1) | (dac_tsel << 3) | (DAC_CR_TEN1 | DAC_CR_DMAEN1);
+
+	stm32l4_dma_enable(&dac->dma[DAC_CHANNEL_1], (stm32l4_dma_callback_t)stm32l4_dac_dma_callback_1, dac);
+	stm32l4_dma_start(&dac->dma[DAC_CHANNEL_1], (uint32_t)&DACx->DHR12R1, (uint32_t)data, count, DAC_DMA_OPTION);
+
+	DACx->CR |= DAC_CR_EN1;
+    }
+    else
+    {
+	if (!(DACx->CR & DAC_CR_EN2))
+	{
+	    return false;
+	}
+
+	if (!stm32l4_dma_create(&dac->dma[DAC_CHANNEL_2], DMA_CHANNEL_DMA1_CH4_DAC2, dac->priority) &&
+	    !stm32l4_dma_create(&dac->dma[DAC_CHANNEL_2], DMA_CHANNEL_DMA2_CH5_DAC2, dac->priority))
+	{
+	    return false;
+	}
+
+	/* TSEL2 can only be changed while the channel is disabled.
+	 */
+	DACx->CR &= ~DAC_CR_EN2;
+	DACx->CR = (DACx->CR & ~DAC_CR_TSEL2) | (dac_tsel << 19) | (DAC_CR_TEN2 | DAC_CR_DMAEN2);
+
+	stm32l4_dma_enable(&dac->dma[DAC_CHANNEL_2], (stm32l4_dma_callback_t)stm32l4_dac_dma_callback_2, dac);
+	stm32l4_dma_start(&dac->dma[DAC_CHANNEL_2], (uint32_t)&DACx->DHR12R2, (uint32_t)data, count, DAC_DMA_OPTION);
+
+	DACx->CR |= DAC_CR_EN2;
+    }
+
+    armv7m_atomic_or(&dac->channels, (1ul << channel));
+
+    return true;
+}
+
+bool stm32l4_dac_stop(stm32l4_dac_t *dac, unsigned int channel)
+{
+    DAC_TypeDef *DACx = dac->DACx;
+
+    if (dac->state != DAC_STATE_READY)
+    {
+	return false;
+    }
+
+    if (!(dac->channels & (1ul << channel)))
+    {
+	return false;
+    }
+
+    /* The output keeps the last sample, and the channel returns to
+     * software updates via stm32l4_dac_convert().
+     */
+    if (channel == DAC_CHANNEL_1)
+    {
+	DACx->CR &= ~(DAC_CR_EN1 | DAC_CR_DMAEN1);
+
+	stm32l4_dma_stop(&dac->dma[DAC_CHANNEL_1]);
+	stm32l4_dma_disable(&dac->dma[DAC_CHANNEL_1]);
+	stm32l4_dma_destroy(&dac->dma[DAC_CHANNEL_1]);
+
+	DACx->CR &= ~(DAC_CR_TEN1 | DAC_CR_TSEL1);
+	DACx->CR |= DAC_CR_EN1;
+    }
+    else
+    {
+	DACx->CR &= ~(DAC_CR_EN2 | DAC_CR_DMAEN2);
+
+	stm32l4_dma_stop(&dac->dma[DAC_CHANNEL_2]);
+	stm32l4_dma_disable(&dac->dma[DAC_CHANNEL_2]);
+	stm32l4_dma_destroy(&dac->dma[DAC_CHANNEL_2]);
+
+	DACx->CR &= ~(DAC_CR_TEN2 | DAC_CR_TSEL2);
+	DACx->CR |= DAC_CR_EN2;
+    }
+
+    armv7m_atomic_and(&dac->channels, ~(1ul << channel));
+
+    return true;
+}
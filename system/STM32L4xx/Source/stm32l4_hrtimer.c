@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2016-2017 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "armv7m.h"
+
+#include "stm32l4_hrtimer.h"
+
+/* Pending hrtimers are kept on a list sorted by deadline. The first
+ * HRTIMER_CHANNEL_COUNT entries each own one compare channel, so that
+ * closely spaced deadlines do not need a reprogramming step in between.
+ * Any compare event expires all timers that are due.
+ *
+ * The sorted insert walks the list one element per PRIMASK section, so
+ * interrupts are never held off for longer than a single step. Every
+ * change to the list bumps "sequence", and a walk that sees the sequence
+ * change under its feet starts over from the head. After HRTIMER_INSERT_RETRIES
+ * restarts (e.g. a short periodic hrtimer rearming from its callback) the
+ * walk is finished without opening PRIMASK again, so it cannot be starved.
+ */
+
+#define HRTIMER_CHANNEL_COUNT  4
+#define HRTIMER_CHANNEL_NONE   0xff
+#define HRTIMER_INSERT_RETRIES 4
+
+typedef struct _stm32l4_hrtimer_control_t {
+    stm32l4_hrtimer_t          *next;
+    stm32l4_hrtimer_t          *previous;
+    uint32_t                   sequence;
+    stm32l4_timer_t            timer;
+    stm32l4_hrtimer_t          *armed[HRTIMER_CHANNEL_COUNT];
+} stm32l4_hrtimer_control_t;
+
+static stm32l4_hrtimer_control_t stm32l4_hrtimer_control;
+
+static void stm32l4_hrtimer_unlink(stm32l4_hrtimer_t *hrtimer)
+{
+    hrtimer->next->previous = hrtimer->previous;
+    hrtimer->previous->next = hrtimer->next;
+    
+    hrtimer->next = NULL;
+    hrtimer->previous = NULL;
+
+    stm32l4_hrtimer_control.sequence++;
+
+    if (hrtimer->channel != HRTIMER_CHANNEL_NONE)
+    {
+	stm32l4_hrtimer_control.armed[hrtimer->channel] = NULL;
+
+	hrtimer->channel = HRTIMER_CHANNEL_NONE;
+    }
+}
+
+static void stm32l4_hrtimer_schedule(void)
+{
+    TIM_TypeDef *TIM = stm32l4_hrtimer_control.timer.TIM;
+    stm32l4_hrtimer_t *hrtimer, *first[HRTIMER_CHANNEL_COUNT];
+    unsigned int channel, index, count;
+
+    for (hrtimer = stm32l4_hrtimer_control.next, count = 0; count < HRTIMER_CHANNEL_COUNT; count++)
+    {
+	if (hrtimer == (stm32l4_hrtimer_t*)&stm32l4_hrtimer_control)
+	{
+	    break;
+	}
+
+	first[count] = hrtimer;
+
+	hrtimer = hrtimer->next;
+    }
+
+    /* Release the channels of timers that got pushed back by an earlier deadline.
+     */
+    for (channel = 0; channel < HRTIMER_CHANNEL_COUNT; channel++)
+    {
+	hrtimer = stm32l4_hrtimer_control.armed[channel];
+
+	if (hrtimer)
+	{
+	    for (index = 0; index < count; index++)
+	    {
+		if (first[index] == hrtimer)
+		{
+		    break;
+		}
+	    }
+
+	    if (index == count)
+	    {
+		stm32l4_hrtimer_control.armed[channel] = NULL;
+
+		hrtimer->channel = HRTIMER_CHANNEL_NONE;
+	    }
+	}
+    }
+
+    for (index = 0, channel = 0; index < count; index++)
+    {
+	hrtimer = first[index];
+
+	if (hrtimer->channel == HRTIMER_CHANNEL_NONE)
+	{
+	    while (stm32l4_hrtimer_control.armed[channel])
+	    {
+		channel++;
+	    }
+
+	    stm32l4_hrtimer_control.armed[channel] = hrtimer;
+
+	    hrtimer->channel = channel;
+
+	    stm32l4_timer_compare(&stm32l4_hrtimer_control.timer, channel, hrtimer->deadline);
+
+	    /* If the deadline passed before CCR got written, the compare will not match
+	     * until the counter wraps around. Hence force the compare event.
+	     */
+	    if ((int32_t)(hrtimer->deadline - TIM->CNT) <= 0)
+	    {
+		TIM->EGR = (TIM_EGR_CC1G << channel);
+	    }
+	}
+    }
+}
+
+static void stm32l4_hrtimer_event_callback(void *context, uint32_t events)
+{
+    TIM_TypeDef *TIM = stm32l4_hrtimer_control.timer.TIM;
+    stm32l4_hrtimer_t *hrtimer;
+    stm32l4_hrtimer_callback_t callback;
+    uint32_t primask;
+
+    while (1)
+    {
+	primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	hrtimer = stm32l4_hrtimer_control.next;
+
+	if ((hrtimer == (stm32l4_hrtimer_t*)&stm32l4_hrtimer_control) || ((int32_t)(hrtimer->deadline - TIM->CNT) > 0))
+	{
+	    stm32l4_hrtimer_schedule();
+
+	    __set_PRIMASK(primask);
+
+	    break;
+	}
+
+	stm32l4_hrtimer_unlink(hrtimer);
+
+	callback = hrtimer->callback;
+
+	__set_PRIMASK(primask);
+
+	(*callback)(hrtimer);
+    }
+}
+
+bool stm32l4_hrtimer_initialize(unsigned int instance, unsigned int priority)
+{
+    unsigned int channel;
+    uint32_t prescaler;
+
+    if ((instance != TIMER_INSTANCE_TIM2)
+#if defined(STM32L476xx) || defined(STM32L496xx)
+	&& (instance != TIMER_INSTANCE_TIM5)
+#endif /* defined(STM32L476xx) || defined(STM32L496xx) */
+	)
+    {
+	return false;
+    }
+
+    if (stm32l4_hrtimer_control.timer.state != TIMER_STATE_NONE)
+    {
+	return false;
+    }
+
+    if (!stm32l4_timer_create(&stm32l4_hrtimer_control.timer, instance, priority, 0))
+    {
+	return false;
+    }
+
+    stm32l4_hrtimer_control.next = (stm32l4_hrtimer_t*)&stm32l4_hrtimer_control;
+    stm32l4_hrtimer_control.previous = (stm32l4_hrtimer_t*)&stm32l4_hrtimer_control;
+
+    prescaler = stm32l4_timer_clock(&stm32l4_hrtimer_control.timer) / HRTIMER_CLOCK;
+
+    if (prescaler == 0)
+    {
+	prescaler = 1;
+    }
+
+    stm32l4_timer_enable(&stm32l4_hrtimer_control.timer, prescaler -1, 0xffffffff, 0, stm32l4_hrtimer_event_callback, NULL,
+			 (TIMER_EVENT_CHANNEL_1 | TIMER_EVENT_CHANNEL_2 | TIMER_EVENT_CHANNEL_3 | TIMER_EVENT_CHANNEL_4));
+
+    for (channel = 0; channel < HRTIMER_CHANNEL_COUNT; channel++)
+    {
+	stm32l4_hrtimer_control.armed[channel] = NULL;
+
+	stm32l4_timer_channel(&stm32l4_hrtimer_control.timer, channel, 0, TIMER_CONTROL_COMPARE_TIMING);
+    }
+
+    stm32l4_timer_start(&stm32l4_hrtimer_control.timer, false);
+
+    return true;
+}
+
+uint32_t stm32l4_hrtimer_count(void)
+{
+    return stm32l4_timer_count(&stm32l4_hrtimer_control.timer);
+}
+
+void stm32l4_hrtimer_create(stm32l4_hrtimer_t *hrtimer, stm32l4_hrtimer_callback_t callback)
+{
+    hrtimer->next = NULL;
+    hrtimer->previous = NULL;
+    hrtimer->callback = callback;
+    hrtimer->deadline = 0;
+    hrtimer->channel = HRTIMER_CHANNEL_NONE;
+}
+
+/* Start "hrtimer" to expire "timeout" microseconds from now, or if "offset"
+ * is set, from its previous deadline. The latter allows drift free periodic
+ * timers when restarted from the callback.
+ */
+bool stm32l4_hrtimer_start(stm32l4_hrtimer_t *hrtimer, uint32_t timeout, bool offset)
+{
+    stm32l4_hrtimer_t *element;
+    uint32_t primask, deadline, sequence, retries;
+
+    if (stm32l4_hrtimer_control.timer.state != TIMER_STATE_ACTIVE)
+    {
+	return false;
+    }
+
+    if (timeout > 0x7fffffff)
+    {
+	return false;
+    }
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if (hrtimer->next)
+    {
+	stm32l4_hrtimer_unlink(hrtimer);
+    }
+
+    if (offset)
+    {
+	deadline = hrtimer->deadline + timeout;
+    }
+    else
+    {
+	deadline = stm32l4_hrtimer_control.timer.TIM->CNT + timeout;
+    }
+
+    hrtimer->deadline = deadline;
+
+    sequence = stm32l4_hrtimer_control.sequence;
+    retries = 0;
+
+    element = stm32l4_hrtimer_control.next;
+
+    while ((element != (stm32l4_hrtimer_t*)&stm32l4_hrtimer_control) && ((int32_t)(deadline - element->deadline) >= 0))
+    {
+	element = element->next;
+
+	if (retries == HRTIMER_INSERT_RETRIES)
+	{
+	    continue;
+	}
+
+	/* Let pending interrupts in between two steps. If the list changed
+	 * meanwhile, "element" may be gone, so start over. That includes
+	 * a nested start() of this very hrtimer, which the outer call
+	 * overrides.
+	 */
+	__set_PRIMASK(primask);
+
+	__disable_irq();
+
+	if (sequence != stm32l4_hrtimer_control.sequence)
+	{
+	    if (hrtimer->next)
+	    {
+		stm32l4_hrtimer_unlink(hrtimer);
+	    }
+
+	    hrtimer->deadline = deadline;
+
+	    sequence = stm32l4_hrtimer_control.sequence;
+	    retries++;
+
+	    element = stm32l4_hrtimer_control.next;
+	}
+    }
+
+    hrtimer->previous = element->previous;
+    hrtimer->next = element;
+
+    hrtimer->previous->next = hrtimer;
+    hrtimer->next->previous = hrtimer;
+
+    stm32l4_hrtimer_control.sequence++;
+
+    stm32l4_hrtimer_schedule();
+
+    __set_PRIMASK(primask);
+
+    return true;
+}
+
+bool stm32l4_hrtimer_stop(stm32l4_hrtimer_t *hrtimer)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if (!hrtimer->next)
+    {
+	__set_PRIMASK(primask);
+
+	return false;
+    }
+
+    stm32l4_hrtimer_unlink(hrtimer);
+
+    stm32l4_hrtimer_schedule();
+
+    __set_PRIMASK(primask);
+
+    return true;
+}
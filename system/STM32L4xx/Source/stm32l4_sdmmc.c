@@ -35,6 +35,10 @@
 
 static stm32l4_sdmmc_t stm32l4_sdmmc;
 
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+static uint32_t stm32l4_sdmmc_read_ahead_data[STM32L4_SDMMC_READ_AHEAD_ENTRIES][DOSFS_BLK_SIZE / 4];
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
+
 #define SDMMC_DCTRL_DBLOCKSIZE_1B            (0u << SDMMC_DCTRL_DBLOCKSIZE_Pos)
 #define SDMMC_DCTRL_DBLOCKSIZE_2B            (1u << SDMMC_DCTRL_DBLOCKSIZE_Pos)
 #define SDMMC_DCTRL_DBLOCKSIZE_4B            (2u << SDMMC_DCTRL_DBLOCKSIZE_Pos)
@@ -140,6 +144,25 @@ static stm32l4_sdmmc_t stm32l4_sdmmc;
 #define STM32L4_SDMMC_CONTROL_PREFETCH 0x00000002
 #define STM32L4_SDMMC_CONTROL_CONTINUE 0x00000004
 
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+
+#define STM32L4_SDMMC_DMA_OPTION_RECEIVE   \
+    (DMA_OPTION_EVENT_TRANSFER_DONE |      \
+     DMA_OPTION_PERIPHERAL_TO_MEMORY |     \
+     DMA_OPTION_PERIPHERAL_DATA_SIZE_32 |  \
+     DMA_OPTION_MEMORY_DATA_SIZE_32 |      \
+     DMA_OPTION_MEMORY_DATA_INCREMENT |    \
+     DMA_OPTION_PRIORITY_HIGH)
+
+#define STM32L4_SDMMC_DMA_OPTION_TRANSMIT  \
+    (DMA_OPTION_MEMORY_TO_PERIPHERAL |     \
+     DMA_OPTION_PERIPHERAL_DATA_SIZE_32 |  \
+     DMA_OPTION_MEMORY_DATA_SIZE_32 |      \
+     DMA_OPTION_MEMORY_DATA_INCREMENT |    \
+     DMA_OPTION_PRIORITY_HIGH)
+
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+
 static inline __attribute__((optimize("O3"),always_inline)) uint32_t stm32l4_sdmmc_slice(const uint8_t *data, uint32_t size, uint32_t start, uint32_t width)
 {
     uint32_t mask, shift;
@@ -375,6 +398,428 @@ failure:
     return sdmmc_sta;
 }
 
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+
+/* The read-ahead ring is split into two halves. The RX DMA fills one half at
+ * a time, and the completion callback chains the next half right away if the
+ * consumer is done with it. Otherwise the stream stalls till
+ * stm32l4_sdmmc_read_ahead_fetch() frees up a half and restarts it. HWFC_EN
+ * stops SDMMC_CK while the FIFO is full, so the card simply waits in between.
+ *
+ * "ahead_tail" is only advanced by the DMA completion (or by the error path
+ * with interrupts disabled), "ahead_head" only by the consumer. Their
+ * difference is the number of blocks ready in the ring.
+ */
+
+static void stm32l4_sdmmc_read_ahead_fill(stm32l4_sdmmc_t *sdmmc)
+{
+    sdmmc->dma |= STM32L4_SDMMC_DMA_BUSY;
+
+    stm32l4_dma_start(&sdmmc->rx_dma, (uint32_t)&stm32l4_sdmmc_read_ahead_data[sdmmc->ahead_fill][0], (uint32_t)&SDMMC1->FIFO, (STM32L4_SDMMC_READ_AHEAD_HALF * (DOSFS_BLK_SIZE / 4)), STM32L4_SDMMC_DMA_OPTION_RECEIVE);
+
+    SDMMC1->MASK = SDMMC_MASK_DCRCFAILIE | SDMMC_MASK_DTIMEOUTIE;
+}
+
+static bool stm32l4_sdmmc_read_ahead_done(stm32l4_sdmmc_t *sdmmc)
+{
+    sdmmc->ahead_tail += STM32L4_SDMMC_READ_AHEAD_HALF;
+    sdmmc->ahead_fill = (sdmmc->ahead_fill == 0) ? STM32L4_SDMMC_READ_AHEAD_HALF : 0;
+
+    /* A pending data error ends the read-ahead. The error flags are left set,
+     * so that the next stm32l4_sdmmc_receive() terminates the stream and the
+     * normal retry logic kicks in.
+     */
+    if (SDMMC1->STA & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT))
+    {
+	sdmmc->dma &= ~STM32L4_SDMMC_DMA_AHEAD;
+    }
+    else
+    {
+	if ((uint8_t)(sdmmc->ahead_tail - sdmmc->ahead_head) <= (STM32L4_SDMMC_READ_AHEAD_ENTRIES - STM32L4_SDMMC_READ_AHEAD_HALF))
+	{
+	    stm32l4_sdmmc_read_ahead_fill(sdmmc);
+
+	    return true;
+	}
+    }
+
+    SDMMC1->MASK = 0;
+
+    return false;
+}
+
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
+
+static void stm32l4_sdmmc_dma_callback(stm32l4_sdmmc_t *sdmmc, uint32_t events)
+{
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+    if (sdmmc->dma & STM32L4_SDMMC_DMA_AHEAD)
+    {
+	if (stm32l4_sdmmc_read_ahead_done(sdmmc))
+	{
+	    return;
+	}
+    }
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
+
+    sdmmc->dma &= ~STM32L4_SDMMC_DMA_BUSY;
+}
+
+static void stm32l4_sdmmc_dma_acquire(stm32l4_sdmmc_t *sdmmc)
+{
+    /* DMA2 CH4/CH5 are shared with the DAC/SAI/SPI1 drivers, hence they are only
+     * claimed while the card is selected. A direction without a channel falls
+     * back to the FIFO code.
+     */
+    if (!(sdmmc->dma & STM32L4_SDMMC_DMA_RECEIVE))
+    {
+	if (stm32l4_dma_create(&sdmmc->rx_dma, DMA_CHANNEL_DMA2_CH4_SDMMC1, sdmmc->priority) ||
+	    stm32l4_dma_create(&sdmmc->rx_dma, DMA_CHANNEL_DMA2_CH5_SDMMC1, sdmmc->priority))
+	{
+	    stm32l4_dma_enable(&sdmmc->rx_dma, (stm32l4_dma_callback_t)stm32l4_sdmmc_dma_callback, sdmmc);
+
+	    sdmmc->dma |= STM32L4_SDMMC_DMA_RECEIVE;
+	}
+    }
+
+    if (stm32l4_dma_create(&sdmmc->tx_dma, DMA_CHANNEL_DMA2_CH5_SDMMC1, sdmmc->priority) ||
+	stm32l4_dma_create(&sdmmc->tx_dma, DMA_CHANNEL_DMA2_CH4_SDMMC1, sdmmc->priority))
+    {
+	stm32l4_dma_enable(&sdmmc->tx_dma, NULL, NULL);
+
+	sdmmc->dma |= STM32L4_SDMMC_DMA_TRANSMIT;
+    }
+
+    if (sdmmc->dma != (STM32L4_SDMMC_DMA_RECEIVE | STM32L4_SDMMC_DMA_TRANSMIT))
+    {
+	STM32L4_SDMMC_STATISTICS_COUNT(sdcard_dma_fallback);
+    }
+}
+
+static void stm32l4_sdmmc_dma_release(stm32l4_sdmmc_t *sdmmc)
+{
+    /* An active read-ahead keeps the RX channel till it gets discarded.
+     */
+    if ((sdmmc->dma & (STM32L4_SDMMC_DMA_RECEIVE | STM32L4_SDMMC_DMA_AHEAD)) == STM32L4_SDMMC_DMA_RECEIVE)
+    {
+	stm32l4_dma_disable(&sdmmc->rx_dma);
+	stm32l4_dma_destroy(&sdmmc->rx_dma);
+
+	sdmmc->dma &= ~STM32L4_SDMMC_DMA_RECEIVE;
+    }
+
+    if (sdmmc->dma & STM32L4_SDMMC_DMA_TRANSMIT)
+    {
+	stm32l4_dma_disable(&sdmmc->tx_dma);
+	stm32l4_dma_destroy(&sdmmc->tx_dma);
+
+	sdmmc->dma &= ~STM32L4_SDMMC_DMA_TRANSMIT;
+    }
+}
+
+static uint32_t stm32l4_sdmmc_dma_wait(stm32l4_sdmmc_t *sdmmc, stm32l4_dma_t *dma, uint32_t mask)
+{
+    /* Completion is signaled either by the RX DMA interrupt, or by the SDMMC1
+     * interrupt for the events in "mask" (DBCKEND on transmit, and the data
+     * errors). If the caller cannot be interrupted at this priority, poll.
+     */
+    SDMMC1->MASK = mask;
+
+    if (armv7m_core_priority() <= sdmmc->priority)
+    {
+	while (sdmmc->dma & STM32L4_SDMMC_DMA_BUSY)
+	{
+	    if (dma == &sdmmc->rx_dma)
+	    {
+		stm32l4_dma_poll(dma);
+	    }
+
+	    if (SDMMC1->STA & mask)
+	    {
+		SDMMC1->MASK = 0;
+
+		sdmmc->dma &= ~STM32L4_SDMMC_DMA_BUSY;
+	    }
+	}
+    }
+    else
+    {
+	while (sdmmc->dma & STM32L4_SDMMC_DMA_BUSY)
+	{
+	    armv7m_core_yield();
+	}
+    }
+
+    SDMMC1->MASK = 0;
+
+    return stm32l4_dma_stop(dma);
+}
+
+static __attribute__((optimize("O3"))) uint32_t stm32l4_sdmmc_read_dma(stm32l4_sdmmc_t *sdmmc, uint8_t *data, uint32_t count, uint32_t *p_count, bool wait)
+{
+    uint32_t sdmmc_sta;
+
+    STM32L4_SDMMC_STATISTICS_COUNT(sdcard_dma_receive);
+
+    sdmmc->dma |= STM32L4_SDMMC_DMA_BUSY;
+
+    stm32l4_dma_start(&sdmmc->rx_dma, (uint32_t)data, (uint32_t)&SDMMC1->FIFO, (count / 4), STM32L4_SDMMC_DMA_OPTION_RECEIVE);
+
+    *p_count = stm32l4_sdmmc_dma_wait(sdmmc, &sdmmc->rx_dma, (SDMMC_MASK_DCRCFAILIE | SDMMC_MASK_DTIMEOUTIE)) * 4;
+
+    sdmmc_sta = SDMMC1->STA;
+
+    /* The CRC of the last block is checked after the DMA has drained its data
+     * from the FIFO. For a bounded transfer wait for DATAEND to pick it up.
+     */
+    if (wait && !(sdmmc_sta & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT)))
+    {
+	do
+	{
+	    sdmmc_sta = SDMMC1->STA;
+	}
+	while (!(sdmmc_sta & (SDMMC_STA_DATAEND | SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT)));
+    }
+
+    return sdmmc_sta;
+}
+
+static __attribute__((optimize("O3"))) uint32_t stm32l4_sdmmc_write_dma(stm32l4_sdmmc_t *sdmmc, const uint8_t *data, uint32_t count)
+{
+    uint32_t sdmmc_sta;
+
+    STM32L4_SDMMC_STATISTICS_COUNT(sdcard_dma_transmit);
+
+    do
+    {
+	do
+	{
+	    sdmmc_sta = SDMMC1->STA;
+	    
+	    if (sdmmc_sta & SDMMC_STA_DTIMEOUT)
+	    {
+		goto failure;
+	    }
+	}
+	while (sdmmc_sta & SDMMC_STA_TXACT);
+	
+	sdmmc->dma |= STM32L4_SDMMC_DMA_BUSY;
+
+	stm32l4_dma_start(&sdmmc->tx_dma, (uint32_t)&SDMMC1->FIFO, (uint32_t)data, (512 / 4), STM32L4_SDMMC_DMA_OPTION_TRANSMIT);
+
+	SDMMC1->DTIMER = sdmmc->write_timeout;
+	SDMMC1->DLEN = 512;
+	SDMMC1->DCTRL = SDMMC_DCTRL_DBLOCKSIZE_512B | SDMMC_DCTRL_DMAEN | SDMMC_DCTRL_DTEN;
+
+	stm32l4_sdmmc_dma_wait(sdmmc, &sdmmc->tx_dma, (SDMMC_MASK_DBCKENDIE | SDMMC_MASK_DCRCFAILIE | SDMMC_MASK_DTIMEOUTIE));
+
+	sdmmc_sta = SDMMC1->STA;
+
+	if (sdmmc_sta & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT))
+	{
+	    goto failure;
+	}
+	
+	SDMMC1->ICR = SDMMC_ICR_DBCKENDC | SDMMC_ICR_DATAENDC | SDMMC_ICR_DTIMEOUTC | SDMMC_ICR_DCRCFAILC;
+
+	data += 512;
+	count -= 512;
+    }
+    while (count);
+    
+failure:
+    return sdmmc_sta;
+}
+
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+
+static void stm32l4_sdmmc_read_ahead_start(stm32l4_sdmmc_t *sdmmc)
+{
+    /* The CMD18 stream is still open, so keep the RX DMA draining the FIFO into
+     * the ring while the caller is busy with the data it just got.
+     */
+    STM32L4_SDMMC_STATISTICS_COUNT(sdcard_read_ahead);
+
+    sdmmc->ahead_index = 0;
+    sdmmc->ahead_fill = 0;
+    sdmmc->ahead_head = 0;
+    sdmmc->ahead_tail = 0;
+
+    sdmmc->dma |= STM32L4_SDMMC_DMA_AHEAD;
+
+    stm32l4_sdmmc_read_ahead_fill(sdmmc);
+}
+
+static void stm32l4_sdmmc_read_ahead_wait(stm32l4_sdmmc_t *sdmmc)
+{
+    uint32_t sdmmc_sta, offset, primask;
+    uint8_t tail;
+
+    tail = sdmmc->ahead_tail;
+
+    if (armv7m_core_priority() <= sdmmc->priority)
+    {
+	while ((sdmmc->dma & STM32L4_SDMMC_DMA_BUSY) && (tail == sdmmc->ahead_tail))
+	{
+	    stm32l4_dma_poll(&sdmmc->rx_dma);
+
+	    if (SDMMC1->STA & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT))
+	    {
+		SDMMC1->MASK = 0;
+
+		sdmmc->dma &= ~STM32L4_SDMMC_DMA_BUSY;
+	    }
+	}
+    }
+    else
+    {
+	while ((sdmmc->dma & STM32L4_SDMMC_DMA_BUSY) && (tail == sdmmc->ahead_tail))
+	{
+	    armv7m_core_yield();
+	}
+    }
+
+    /* BUSY got cleared by a data error while a half was still in flight. Only
+     * the blocks before the failing one are handed out. This has to be atomic
+     * against a DMA completion that might still be pending, which otherwise
+     * would account for the same half again.
+     */
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if ((sdmmc->dma & (STM32L4_SDMMC_DMA_AHEAD | STM32L4_SDMMC_DMA_BUSY)) == STM32L4_SDMMC_DMA_AHEAD)
+    {
+	sdmmc->dma &= ~STM32L4_SDMMC_DMA_AHEAD;
+
+	sdmmc_sta = SDMMC1->STA;
+
+	offset = stm32l4_dma_stop(&sdmmc->rx_dma) * 4;
+
+	if (sdmmc_sta & SDMMC_STA_DCRCFAIL)
+	{
+	    sdmmc->ahead_tail += ((offset > DOSFS_BLK_SIZE) ? (((offset & ~(DOSFS_BLK_SIZE - 1)) - DOSFS_BLK_SIZE) / DOSFS_BLK_SIZE) : 0);
+	}
+	else
+	{
+	    sdmmc->ahead_tail += (offset / DOSFS_BLK_SIZE);
+	}
+    }
+
+    __set_PRIMASK(primask);
+}
+
+static uint32_t stm32l4_sdmmc_read_ahead_fetch(stm32l4_sdmmc_t *sdmmc, uint8_t *data, uint32_t length)
+{
+    uint32_t count, total;
+
+    total = 0;
+
+    while (length)
+    {
+	count = (uint8_t)(sdmmc->ahead_tail - sdmmc->ahead_head);
+
+	if (!count)
+	{
+	    if (!(sdmmc->dma & STM32L4_SDMMC_DMA_AHEAD))
+	    {
+		break;
+	    }
+
+	    stm32l4_sdmmc_read_ahead_wait(sdmmc);
+
+	    continue;
+	}
+
+	if (count > length)
+	{
+	    count = length;
+	}
+
+	if (count > (uint32_t)(STM32L4_SDMMC_READ_AHEAD_ENTRIES - sdmmc->ahead_index))
+	{
+	    count = STM32L4_SDMMC_READ_AHEAD_ENTRIES - sdmmc->ahead_index;
+	}
+
+	memcpy(data, &stm32l4_sdmmc_read_ahead_data[sdmmc->ahead_index][0], (count * DOSFS_BLK_SIZE));
+
+	data += (DOSFS_BLK_SIZE * count);
+	length -= count;
+	total += count;
+
+	sdmmc->ahead_index += count;
+
+	if (sdmmc->ahead_index == STM32L4_SDMMC_READ_AHEAD_ENTRIES)
+	{
+	    sdmmc->ahead_index = 0;
+	}
+
+	sdmmc->ahead_head += count;
+
+	/* If the completion callback found no free half, the stream is stalled
+	 * and needs to be restarted here. The callback only runs while BUSY is
+	 * set, so it cannot race with this.
+	 */
+	if ((sdmmc->dma & (STM32L4_SDMMC_DMA_AHEAD | STM32L4_SDMMC_DMA_BUSY)) == STM32L4_SDMMC_DMA_AHEAD)
+	{
+	    if (SDMMC1->STA & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT))
+	    {
+		sdmmc->dma &= ~STM32L4_SDMMC_DMA_AHEAD;
+	    }
+	    else
+	    {
+		if ((uint8_t)(sdmmc->ahead_tail - sdmmc->ahead_head) <= (STM32L4_SDMMC_READ_AHEAD_ENTRIES - STM32L4_SDMMC_READ_AHEAD_HALF))
+		{
+		    stm32l4_sdmmc_read_ahead_fill(sdmmc);
+		}
+	    }
+	}
+    }
+
+    STM32L4_SDMMC_STATISTICS_COUNT_N(sdcard_read_ahead_hit, total);
+
+    return total;
+}
+
+static void stm32l4_sdmmc_read_ahead_discard(stm32l4_sdmmc_t *sdmmc)
+{
+    if (sdmmc->dma & STM32L4_SDMMC_DMA_AHEAD)
+    {
+	/* Clearing AHEAD first makes a completion that sneaks in just clear
+	 * BUSY, rather than chaining the next half.
+	 */
+	sdmmc->dma &= ~STM32L4_SDMMC_DMA_AHEAD;
+
+	SDMMC1->MASK = 0;
+
+	stm32l4_dma_stop(&sdmmc->rx_dma);
+
+	sdmmc->dma &= ~STM32L4_SDMMC_DMA_BUSY;
+    }
+
+    if (sdmmc->ahead_tail != sdmmc->ahead_head)
+    {
+	STM32L4_SDMMC_STATISTICS_COUNT(sdcard_read_ahead_discard);
+
+	sdmmc->ahead_head = sdmmc->ahead_tail;
+    }
+}
+
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
+
+void SDMMC1_IRQHandler(void)
+{
+    stm32l4_sdmmc_t *sdmmc = (stm32l4_sdmmc_t*)&stm32l4_sdmmc;
+
+    SDMMC1->MASK = 0;
+
+    sdmmc->dma &= ~STM32L4_SDMMC_DMA_BUSY;
+}
+
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+
 static bool stm32l4_sdmmc_detect(stm32l4_sdmmc_t *sdmmc)
 {
     bool detect;
@@ -399,10 +844,18 @@ static bool stm32l4_sdmmc_detect(stm32l4_sdmmc_t *sdmmc)
 static void stm32l4_sdmmc_select(stm32l4_sdmmc_t *sdmmc)
 {
     SDMMC1->CLKCR &= ~SDMMC_CLKCR_PWRSAV;
+
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+    stm32l4_sdmmc_dma_acquire(sdmmc);
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
 }
 
 static void stm32l4_sdmmc_deselect(stm32l4_sdmmc_t *sdmmc)
 {
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+    stm32l4_sdmmc_dma_release(sdmmc);
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+
     if (sdmmc->state != STM32L4_SDMMC_STATE_READ_MULTIPLE)
     {
 	SDMMC1->CLKCR |= SDMMC_CLKCR_PWRSAV;
@@ -679,6 +1132,17 @@ static int stm32l4_sdmmc_receive(stm32l4_sdmmc_t *sdmmc, uint8_t index, const ui
 	    }
 	}
 	
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+	/* DMAEN only routes the FIFO requests to the DMA. With the channel idle
+	 * the FIFO can still be drained by the CPU, which is used for unaligned
+	 * buffers (and a later CONTINUE without a channel).
+	 */
+	if ((sdmmc->dma & STM32L4_SDMMC_DMA_RECEIVE) && (blksz == 512))
+	{
+	    sdmmc_dctrl |= SDMMC_DCTRL_DMAEN;
+	}
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+
 	SDMMC1->DTIMER = sdmmc->read_timeout; 
 	SDMMC1->DLEN = ((control & STM32L4_SDMMC_CONTROL_PREFETCH) ? 0x00ffffff : count);
 	SDMMC1->DCTRL = sdmmc_dctrl | SDMMC_DCTRL_DTEN;
@@ -688,7 +1152,16 @@ static int stm32l4_sdmmc_receive(stm32l4_sdmmc_t *sdmmc, uint8_t index, const ui
 
     if (status == F_NO_ERROR)
     {
-	sdmmc_sta = stm32l4_sdmmc_read_fifo(sdmmc, data, count, &offset);
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+	if ((sdmmc->dma & STM32L4_SDMMC_DMA_RECEIVE) && (SDMMC1->DCTRL & SDMMC_DCTRL_DMAEN) && !((uint32_t)data & 3) && (count <= (65535 * 4)))
+	{
+	    sdmmc_sta = stm32l4_sdmmc_read_dma(sdmmc, data, count, &offset, !(control & (STM32L4_SDMMC_CONTROL_PREFETCH | STM32L4_SDMMC_CONTROL_CONTINUE)));
+	}
+	else
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+	{
+	    sdmmc_sta = stm32l4_sdmmc_read_fifo(sdmmc, data, count, &offset);
+	}
 
 	if (sdmmc_sta & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT))
 	{
@@ -782,7 +1255,16 @@ static int stm32l4_sdmmc_transmit(stm32l4_sdmmc_t *sdmmc, const uint8_t *data, u
 
     *p_check = false;
 
-    sdmmc_sta = stm32l4_sdmmc_write_fifo(sdmmc, data, count);
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+    if ((sdmmc->dma & STM32L4_SDMMC_DMA_TRANSMIT) && !((uint32_t)data & 3))
+    {
+	sdmmc_sta = stm32l4_sdmmc_write_dma(sdmmc, data, count);
+    }
+    else
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
+    {
+	sdmmc_sta = stm32l4_sdmmc_write_fifo(sdmmc, data, count);
+    }
 
     if (sdmmc_sta & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT))
     {
@@ -889,6 +1371,10 @@ static int stm32l4_sdmmc_read_stop(stm32l4_sdmmc_t *sdmmc)
 
     STM32L4_SDMMC_STATISTICS_COUNT(sdcard_read_stop);
 
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+    stm32l4_sdmmc_read_ahead_discard(sdmmc);
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
+
     SDMMC1->DCTRL = 0;
     SDMMC1->ICR = SDMMC_ICR_DBCKENDC | SDMMC_ICR_DATAENDC | SDMMC_ICR_DTIMEOUTC | SDMMC_ICR_DCRCFAILC;
     
@@ -1736,7 +2222,35 @@ static int stm32l4_sdmmc_read(void *context, uint32_t address, uint8_t *data, ui
 
 	if (status == F_NO_ERROR)
 	{
-	    do
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+	    /* The lock above had terminated the stream (and the read-ahead) if this
+	     * is not a sequential access. So whatever is in the ring is the data at
+	     * "address".
+	     */
+	    if (prefetch && (sdmmc->state == STM32L4_SDMMC_STATE_READ_MULTIPLE) && ((sdmmc->ahead_tail != sdmmc->ahead_head) || (sdmmc->dma & STM32L4_SDMMC_DMA_AHEAD)))
+	    {
+		count = stm32l4_sdmmc_read_ahead_fetch(sdmmc, data, length);
+
+		data += (DOSFS_BLK_SIZE * count);
+		
+		address += count;
+		length -= count;
+
+		sdmmc->address += count;
+		sdmmc->count += count;
+
+		if (sdmmc->count >= 16384)
+		{
+		    STM32L4_SDMMC_STATISTICS_COUNT(sdcard_read_stop);
+
+		    prefetch = false;
+
+		    status = stm32l4_sdmmc_read_stop(sdmmc);
+		}
+	    }
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
+
+	    while ((status == F_NO_ERROR) && length)
 	    {
 		if (prefetch)
 		{
@@ -1830,7 +2344,18 @@ static int stm32l4_sdmmc_read(void *context, uint32_t address, uint8_t *data, ui
 		    }
 		}
 	    }
-	    while ((status == F_NO_ERROR) && length);
+
+#if (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0)
+	    if ((status == F_NO_ERROR) &&
+		(sdmmc->state == STM32L4_SDMMC_STATE_READ_MULTIPLE) &&
+		(sdmmc->dma & STM32L4_SDMMC_DMA_RECEIVE) &&
+		(SDMMC1->DCTRL & SDMMC_DCTRL_DMAEN) &&
+		!(sdmmc->dma & STM32L4_SDMMC_DMA_AHEAD) &&
+		!(SDMMC1->STA & (SDMMC_STA_DCRCFAIL | SDMMC_STA_DTIMEOUT)))
+	    {
+		stm32l4_sdmmc_read_ahead_start(sdmmc);
+	    }
+#endif /* (STM32L4_SDMMC_READ_AHEAD_ENTRIES != 0) */
 
 	    status = stm32l4_sdmmc_unlock(sdmmc, status);
 	}
@@ -2045,6 +2570,52 @@ static int stm32l4_sdmmc_sync(void *context, bool wait)
     return status;
 }
 
+static const dosfs_device_interface_t stm32l4_sdmmc_interface;
+
+static int stm32l4_sdmmc_read_vector(void *context, const dosfs_device_segment_t *segments, uint32_t count, bool prefetch)
+{
+    return dosfs_device_read_vector(&stm32l4_sdmmc_interface, context, segments, count, prefetch);
+}
+
+static int stm32l4_sdmmc_write_vector(void *context, const dosfs_device_segment_t *segments, uint32_t count, volatile uint8_t *p_status)
+{
+    return dosfs_device_write_vector(&stm32l4_sdmmc_interface, context, segments, count, p_status);
+}
+
+static int stm32l4_sdmmc_busy(void *context, bool *p_busy)
+{
+    stm32l4_sdmmc_t *sdmmc = (stm32l4_sdmmc_t*)context;
+    int status = F_NO_ERROR;
+
+    *p_busy = false;
+
+    if (sdmmc->state == STM32L4_SDMMC_STATE_WRITE_MULTIPLE)
+    {
+	/* Within an open CMD25 stream TXACT stays set while the card signals
+	 * busy on D0 after a block (see stm32l4_sdmmc_write_fifo()).
+	 */
+	*p_busy = !!(SDMMC1->STA & SDMMC_STA_TXACT);
+    }
+    else if (sdmmc->state == STM32L4_SDMMC_STATE_WRITE_STOP)
+    {
+	status = stm32l4_sdmmc_lock(sdmmc, STM32L4_SDMMC_STATE_WRITE_STOP, 0);
+
+	if (status == F_NO_ERROR)
+	{
+	    status = stm32l4_sdmmc_command(sdmmc, SD_CMD_SEND_STATUS, sdmmc->RCA, SD_WAIT_RESPONSE_SHORT);
+
+	    if (status == F_NO_ERROR)
+	    {
+		*p_busy = ((SDMMC1->RESP1 & SD_R1_CURRENT_STATE_MASK) == SD_R1_CURRENT_STATE_PRG);
+	    }
+
+	    status = stm32l4_sdmmc_unlock(sdmmc, status);
+	}
+    }
+
+    return status;
+}
+
 static const dosfs_device_interface_t stm32l4_sdmmc_interface = {
     stm32l4_sdmmc_release,
     stm32l4_sdmmc_info,
@@ -2054,9 +2625,12 @@ static const dosfs_device_interface_t stm32l4_sdmmc_interface = {
     stm32l4_sdmmc_read,
     stm32l4_sdmmc_write,
     stm32l4_sdmmc_sync,
+    stm32l4_sdmmc_read_vector,
+    stm32l4_sdmmc_write_vector,
+    stm32l4_sdmmc_busy,
 };
 
-int stm32l4_sdmmc_initialize(uint32_t option)
+int stm32l4_sdmmc_initialize(unsigned int priority, uint32_t option)
 {
     stm32l4_sdmmc_t *sdmmc = (stm32l4_sdmmc_t*)&stm32l4_sdmmc;
     int status = F_NO_ERROR;
@@ -2066,6 +2640,12 @@ int stm32l4_sdmmc_initialize(uint32_t option)
     dosfs_device.interface = &stm32l4_sdmmc_interface;
 
     sdmmc->option = option;
+    sdmmc->priority = priority;
+
+#if (DOSFS_CONFIG_SDCARD_DMA == 1)
+    NVIC_SetPriority(SDMMC1_IRQn, sdmmc->priority);
+    NVIC_EnableIRQ(SDMMC1_IRQn);
+#endif /* (DOSFS_CONFIG_SDCARD_DMA == 1) */
 
     if (sdmmc->state == STM32L4_SDMMC_STATE_NONE)
     {
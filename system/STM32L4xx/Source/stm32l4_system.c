@@ -52,6 +52,8 @@ typedef struct _stm32l4_system_device_t {
     uint32_t                  pclk1;
     uint32_t                  pclk2;
     uint32_t                  saiclk; 
+    uint32_t                  lptimclk;
+    uint32_t                  lptimfrac;
     uint8_t                   clk48;
     uint8_t                   mco;
     uint8_t                   lsco;
@@ -2349,9 +2351,176 @@ static void stm32l4_system_resume(void)
     }
 }
 
+/* LPTIM1 is used as a free running timebase while in STOP mode, where
+ * SYSTICK is disabled. It is clocked by LSE (or LSI if there is no LSE)
+ * divided by 8, and woken up via the compare match event (EXTI line 32).
+ * A single sleep is limited to 0x8000 ticks, so that the 16 bit counter
+ * cannot wrap unnoticed.
+ */
+
+#define SYSTEM_LPTIM_SLEEP_MAX 0x8000
+
+static uint32_t stm32l4_system_lptim_count(void)
+{
+    uint32_t count;
+
+    /* LPTIM1 is clocked asynchronously, so CNT needs to be read until stable.
+     */
+    do
+    {
+	count = LPTIM1->CNT;
+    }
+    while (count != LPTIM1->CNT);
+
+    return count;
+}
+
+static void stm32l4_system_lptim_enable(void)
+{
+    if (!stm32l4_system_device.lptimclk)
+    {
+	if (stm32l4_system_device.lseclk)
+	{
+	    RCC->CCIPR |= RCC_CCIPR_LPTIM1SEL; /* LSE */
+
+	    stm32l4_system_device.lptimclk = stm32l4_system_device.lseclk / 8;
+	}
+	else
+	{
+	    stm32l4_system_lsi_enable();
+
+	    RCC->CCIPR = (RCC->CCIPR & ~RCC_CCIPR_LPTIM1SEL) | RCC_CCIPR_LPTIM1SEL_0; /* LSI */
+
+	    stm32l4_system_device.lptimclk = 32000 / 8;
+	}
+
+	stm32l4_system_periph_enable(SYSTEM_PERIPH_LPTIM1);
+
+	LPTIM1->CFGR = (LPTIM_CFGR_PRESC_0 | LPTIM_CFGR_PRESC_1);
+	LPTIM1->IER = LPTIM_IER_CMPMIE;
+	LPTIM1->CR = LPTIM_CR_ENABLE;
+	LPTIM1->ARR = 0xffff;
+
+	while (!(LPTIM1->ISR & LPTIM_ISR_ARROK))
+	{
+	}
+
+	LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+	LPTIM1->CR = (LPTIM_CR_ENABLE | LPTIM_CR_CNTSTRT);
+
+	stm32l4_system_device.lptimfrac = 0;
+    }
+}
+
+static bool stm32l4_system_lptim_pending(void)
+{
+    unsigned int index;
+
+    if (EXTI->PR1 || EXTI->PR2)
+    {
+	return true;
+    }
+
+    for (index = 0; index < 8; index++)
+    {
+	if (NVIC->ISPR[index] & NVIC->ISER[index])
+	{
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+/* Enter STOP and stay there for up to "timeout" milliseconds, or until
+ * any other wakeup source fires. Returns the time spent in microseconds.
+ */
+static uint64_t stm32l4_system_lptim_sleep(uint32_t timeout)
+{
+    uint32_t ticks, elapsed, step, start, count, delta;
+    uint64_t micros;
+
+    if (timeout == 0xffffffff)
+    {
+	ticks = 0xffffffff;
+    }
+    else
+    {
+	ticks = (uint32_t)(((uint64_t)timeout * stm32l4_system_device.lptimclk + 999) / 1000);
+    }
+
+    elapsed = 0;
+
+    armv7m_atomic_or(&EXTI->EMR2, EXTI_EMR2_EM32);
+
+    start = stm32l4_system_lptim_count();
+
+    while (elapsed < ticks)
+    {
+	step = ticks - elapsed;
+
+	if (step > SYSTEM_LPTIM_SLEEP_MAX)
+	{
+	    step = SYSTEM_LPTIM_SLEEP_MAX;
+	}
+
+	LPTIM1->ICR = (LPTIM_ICR_CMPMCF | LPTIM_ICR_CMPOKCF);
+	LPTIM1->CMP = (start + step) & 0xffff;
+
+	while (!(LPTIM1->ISR & LPTIM_ISR_CMPOK))
+	{
+	}
+
+	LPTIM1->ICR = LPTIM_ICR_CMPOKCF;
+
+	__DMB();
+
+	__SEV();
+	__WFE();
+
+	/* The compare value might have been passed while waiting for CMPOK.
+	 */
+	if (!(LPTIM1->ISR & LPTIM_ISR_CMPM) && (((stm32l4_system_lptim_count() - start) & 0xffff) < step))
+	{
+	    __WFE();
+	}
+
+	count = stm32l4_system_lptim_count();
+
+	delta = ((count - start) & 0xffff);
+
+	elapsed += delta;
+
+	start = count;
+
+	if (!(LPTIM1->ISR & LPTIM_ISR_CMPM) && (delta < step))
+	{
+	    break;
+	}
+
+	LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+
+	NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+
+	if (stm32l4_system_lptim_pending())
+	{
+	    break;
+	}
+    }
+
+    armv7m_atomic_and(&EXTI->EMR2, ~EXTI_EMR2_EM32);
+
+    micros = (uint64_t)elapsed * 1000000 + stm32l4_system_device.lptimfrac;
+
+    stm32l4_system_device.lptimfrac = micros % stm32l4_system_device.lptimclk;
+
+    return (micros / stm32l4_system_device.lptimclk);
+}
+
 bool stm32l4_system_stop(uint32_t timeout)
 {
-    uint32_t primask, apb1enr1, slot, mask;
+    uint32_t primask, apb1enr1, slot, mask, next;
+    uint64_t elapsed;
 
     primask = __get_PRIMASK();
 
@@ -2376,11 +2545,18 @@ bool stm32l4_system_stop(uint32_t timeout)
 
     armv7m_systick_disable();
 
-    if (timeout)
+    /* Wake up for whatever comes first, the caller's timeout or the
+     * earliest pending armv7m_timer_t.
+     */
+    next = armv7m_timer_next();
+
+    if (timeout && (timeout < next))
     {
-	stm32l4_rtc_wakeup(timeout);
+	next = timeout;
     }
 
+    stm32l4_system_lptim_enable();
+
     apb1enr1 = RCC->APB1ENR1;
 
     if (!(apb1enr1 & RCC_APB1ENR1_PWREN))
@@ -2399,11 +2575,7 @@ bool stm32l4_system_stop(uint32_t timeout)
 
     SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
 
-    __DMB();
-
-    __SEV();
-    __WFE();
-    __WFE();
+    elapsed = stm32l4_system_lptim_sleep(next);
 
     SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
 
@@ -2414,10 +2586,7 @@ bool stm32l4_system_stop(uint32_t timeout)
 	RCC->APB1ENR1 &= ~RCC_APB1ENR1_PWREN;
     }
 
-    if (timeout)
-    {
-	stm32l4_rtc_wakeup(0);
-    }
+    armv7m_systick_advance(elapsed);
 
     armv7m_systick_enable();
 
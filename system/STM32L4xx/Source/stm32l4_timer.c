@@ -147,6 +147,13 @@ bool stm32l4_timer_create(stm32l4_timer_t *timer, unsigned int instance, unsigne
 	return false;
     }
 
+    /* An instance belongs to whoever created it, till it gets destroyed again.
+     */
+    if (stm32l4_timer_driver.instances[instance] && (stm32l4_timer_driver.instances[instance] != timer))
+    {
+	return false;
+    }
+
     timer->TIM = stm32l4_timer_xlate_TIM[instance];
     timer->state = TIMER_STATE_INIT;
     timer->instance = instance;
@@ -329,7 +336,7 @@ bool stm32l4_timer_disable(stm32l4_timer_t *timer)
 bool stm32l4_timer_configure(stm32l4_timer_t *timer, uint32_t prescaler, uint32_t period, uint32_t option)
 {
     TIM_TypeDef *TIM = timer->TIM;
-    uint32_t tim_cr1, tim_smcr, tim_bdtr;
+    uint32_t tim_cr1, tim_cr2, tim_smcr, tim_bdtr;
 
     if ((timer->state != TIMER_STATE_BUSY) && (timer->state != TIMER_STATE_READY))
     {
@@ -382,9 +389,15 @@ bool stm32l4_timer_configure(stm32l4_timer_t *timer, uint32_t prescaler, uint32_
     }
 
     tim_cr1 = 0;
+    tim_cr2 = 0;
     tim_smcr = 0;
     tim_bdtr = TIM_BDTR_MOE;
 
+    if (option & TIMER_OPTION_TRGO_UPDATE)
+    {
+	tim_cr2 |= TIM_CR2_MMS_1; /* UPDATE -> TRGO */
+    }
+
     if (option & TIMER_OPTION_ENCODER_MODE_MASK)
     {
 	tim_smcr |= (((option & TIMER_OPTION_ENCODER_MODE_MASK) >> TIMER_OPTION_ENCODER_MODE_SHIFT) << 0);
@@ -425,6 +438,7 @@ bool stm32l4_timer_configure(stm32l4_timer_t *timer, uint32_t prescaler, uint32_
     }
 
     TIM->CR1  = tim_cr1;
+    TIM->CR2  = tim_cr2;
     TIM->SMCR = tim_smcr;
     TIM->BDTR = tim_bdtr;
     TIM->ARR  = period;
@@ -442,6 +456,8 @@ bool stm32l4_timer_configure(stm32l4_timer_t *timer, uint32_t prescaler, uint32_
     }
 #endif
 
+    armv7m_atomic_modify(&TIM->DIER, TIM_DIER_UDE, ((option & TIMER_OPTION_DMA_UPDATE) ? TIM_DIER_UDE : 0));
+
     // TIM->EGR = TIM_EGR_UG;
 
     return true;
@@ -655,7 +671,7 @@ bool stm32l4_timer_channel(stm32l4_timer_t *timer, unsigned int channel, uint32_
 	    tim_ccer |= TIM_CCER_CC1P;
 	}
 	    
-	if (channel > TIMER_CHANNEL_4)
+	if (channel <= TIMER_CHANNEL_4)
 	{
 	    armv7m_atomic_and(&timer->channels, ~(TIMER_EVENT_CHANNEL_1 << channel));
 	}
@@ -163,6 +163,78 @@ static void stm32l4_uart_dma_callback(stm32l4_uart_t *uart, uint32_t events)
     }
 }
 
+/* With UART_MODE_RX_DMA_DIRECT the RX DMA runs circular over the caller's
+ * rx_data[] buffer. rx_write tracks the last observed DMA position, so all
+ * that is left to do here is to account for the bytes the DMA has stored
+ * since. The DMA cannot be held off, hence an overrun overwrites unread data
+ * rather than dropping new data. The oldest valid byte then sits at rx_write,
+ * so rx_read has to move there. rx_read belongs to the reader, hence this
+ * only sets rx_sync, and stm32l4_uart_rx_sync() does the actual resync.
+ */
+static uint32_t stm32l4_uart_dma_receive(stm32l4_uart_t *uart)
+{
+    uint32_t rx_write, rx_count, events;
+
+    events = 0;
+
+    rx_write = stm32l4_dma_count(&uart->rx_dma);
+
+    if (rx_write == uart->rx_size)
+    {
+	rx_write = 0;
+    }
+
+    if (uart->rx_write != rx_write)
+    {
+	if (rx_write > uart->rx_write)
+	{
+	    rx_count = rx_write - uart->rx_write;
+	}
+	else
+	{
+	    rx_count = (uart->rx_size - uart->rx_write) + rx_write;
+	}
+
+	uart->rx_write = rx_write;
+
+	if (rx_count > (uart->rx_size - uart->rx_count))
+	{
+	    rx_count = (uart->rx_size - uart->rx_count);
+
+	    uart->rx_sync = 1;
+
+	    events |= UART_EVENT_OVERRUN;
+	}
+
+	armv7m_atomic_add(&uart->rx_count, rx_count);
+
+	uart->rx_event += rx_count;
+    }
+
+    return events;
+}
+
+static void stm32l4_uart_dma_direct_callback(stm32l4_uart_t *uart, uint32_t events)
+{
+    uint32_t rx_events;
+
+    rx_events = stm32l4_uart_dma_receive(uart);
+
+    if (uart->rx_event >= 16)
+    {
+	uart->rx_event = 0;
+
+	rx_events |= UART_EVENT_RECEIVE;
+    }
+
+    rx_events &= uart->events;
+
+    if (rx_events)
+    {
+	(*uart->callback)(uart->context, rx_events);
+    }
+}
+
 static void stm32l4_uart_interrupt(stm32l4_uart_t *uart)
 {
     USART_TypeDef *USART = uart->USART;
@@ -214,7 +286,11 @@ static void stm32l4_uart_interrupt(stm32l4_uart_t *uart)
     {
 	if (USART->CR1 & USART_CR1_RTOIE)
 	{
-	    if (uart->mode & UART_MODE_RX_DMA)
+	    if (uart->mode & UART_MODE_RX_DMA_DIRECT)
+	    {
+		events |= stm32l4_uart_dma_receive(uart);
+	    }
+	    else if (uart->mode & UART_MODE_RX_DMA)
 	    {
 		rx_index = uart->rx_index;
 		rx_count = stm32l4_dma_count(&uart->rx_dma);
@@ -278,6 +354,21 @@ static void stm32l4_uart_interrupt(stm32l4_uart_t *uart)
 	USART->ICR = USART_ICR_RTOCF;
     }
 
+    if (USART->ISR & USART_ISR_IDLE)
+    {
+	if (uart->mode & UART_MODE_RX_DMA_DIRECT)
+	{
+	    events |= stm32l4_uart_dma_receive(uart);
+
+	    if (uart->rx_event)
+	    {
+		uart->rx_event = 0;
+		
+		events |= UART_EVENT_RECEIVE;
+	    }
+	}
+    }
+
     if (USART->ISR & USART_ISR_TXE)
     {
 	if (USART->CR1 & USART_CR1_TXEIE)
@@ -471,6 +562,11 @@ bool stm32l4_uart_create(stm32l4_uart_t *uart, unsigned int instance, const stm3
 	return false;
     }
 
+    if (!(uart->mode & UART_MODE_RX_DMA))
+    {
+	uart->mode &= ~UART_MODE_RX_DMA_DIRECT;
+    }
+
     stm32l4_uart_driver.instances[instance] = uart;
 
     return true;
@@ -522,6 +618,7 @@ bool stm32l4_uart_enable(stm32l4_uart_t *uart, uint8_t *rx_data, uint16_t rx_siz
     uart->rx_write = 0;
     uart->rx_index = 0;
     uart->rx_event = 0;
+    uart->rx_sync  = 0;
     uart->rx_count = 0;
 
     if (uart->instance != UART_INSTANCE_LPUART1)
@@ -838,8 +935,16 @@ bool stm32l4_uart_configure(stm32l4_uart_t *uart, uint32_t bitrate, uint32_t opt
     {
 	if (uart->state == UART_STATE_BUSY)
 	{
-	    stm32l4_dma_enable(&uart->rx_dma, (stm32l4_dma_callback_t)stm32l4_uart_dma_callback, uart);
-	    stm32l4_dma_start(&uart->rx_dma, (uint32_t)uart->rx_fifo, (uint32_t)&USART->RDR, 16, UART_RX_DMA_OPTION);
+	    if (uart->mode & UART_MODE_RX_DMA_DIRECT)
+	    {
+		stm32l4_dma_enable(&uart->rx_dma, (stm32l4_dma_callback_t)stm32l4_uart_dma_direct_callback, uart);
+		stm32l4_dma_start(&uart->rx_dma, (uint32_t)uart->rx_data, (uint32_t)&USART->RDR, uart->rx_size, UART_RX_DMA_OPTION);
+	    }
+	    else
+	    {
+		stm32l4_dma_enable(&uart->rx_dma, (stm32l4_dma_callback_t)stm32l4_uart_dma_callback, uart);
+		stm32l4_dma_start(&uart->rx_dma, (uint32_t)uart->rx_fifo, (uint32_t)&USART->RDR, 16, UART_RX_DMA_OPTION);
+	    }
 	}
     }
 
@@ -873,7 +978,7 @@ bool stm32l4_uart_configure(stm32l4_uart_t *uart, uint32_t bitrate, uint32_t opt
 	    usart_cr1 |= USART_CR1_PEIE;
 	}
 
-	if (uart->events & UART_EVENT_IDLE)
+	if ((uart->events & UART_EVENT_IDLE) || (uart->mode & UART_MODE_RX_DMA_DIRECT))
 	{
 	    usart_cr1 |= USART_CR1_IDLEIE;
 	}
@@ -936,7 +1041,7 @@ bool stm32l4_uart_notify(stm32l4_uart_t *uart, stm32l4_uart_callback_t callback,
 	    armv7m_atomic_and(&USART->CR1, ~USART_CR1_PEIE);
 	}
 
-	if (uart->events & UART_EVENT_IDLE)
+	if ((uart->events & UART_EVENT_IDLE) || (uart->mode & UART_MODE_RX_DMA_DIRECT))
 	{
 	    armv7m_atomic_or(&USART->CR1, USART_CR1_IDLEIE);
 	}
@@ -970,6 +1075,28 @@ bool stm32l4_uart_notify(stm32l4_uart_t *uart, stm32l4_uart_callback_t callback,
     return true;
 }
 
+/* After a direct RX DMA overrun the ring holds the last rx_size bytes, with
+ * the oldest one at rx_write. Drop whatever got overwritten by moving rx_read
+ * there. This has to be atomic against stm32l4_uart_dma_receive().
+ */
+static void stm32l4_uart_rx_sync(stm32l4_uart_t *uart)
+{
+    uint32_t primask;
+
+    if (uart->rx_sync)
+    {
+	primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	uart->rx_read = uart->rx_write;
+	uart->rx_count = uart->rx_size;
+	uart->rx_sync = 0;
+
+	__set_PRIMASK(primask);
+    }
+}
+
 unsigned int stm32l4_uart_receive(stm32l4_uart_t *uart, uint8_t *rx_data, uint16_t rx_count)
 {
     uint32_t rx_total, rx_size, rx_read;
@@ -979,6 +1106,8 @@ unsigned int stm32l4_uart_receive(stm32l4_uart_t *uart, uint8_t *rx_data, uint16
 	return false;
     }
 
+    stm32l4_uart_rx_sync(uart);
+
     rx_size = uart->rx_count;
 
     if (rx_count > rx_size)
@@ -1031,6 +1160,8 @@ unsigned int stm32l4_uart_count(stm32l4_uart_t *uart)
 	return 0;
     }
 
+    stm32l4_uart_rx_sync(uart);
+
     return uart->rx_count;
 }
 
@@ -1041,6 +1172,8 @@ int stm32l4_uart_peek(stm32l4_uart_t *uart)
 	return -1;
     }
 
+    stm32l4_uart_rx_sync(uart);
+
     if (!uart->rx_count)
     {
 	return -1;